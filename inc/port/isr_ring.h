@@ -0,0 +1,96 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef PORT_isr_ring_H
+#define PORT_isr_ring_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+/* single producer / single consumer byte ring between an interrupt
+ * handler and the main loop
+ * head is only written by the producer, tail only by the consumer,
+ * both run freely and are masked on access
+ *
+ * no hardware dependencies, the same code runs in the uart isr on the
+ * mote and in a signal handler or thread on the host */
+struct isr_ring
+{
+  _Atomic uint32_t head;
+  _Atomic uint32_t tail;
+  uint32_t mask;
+  /* bytes the producer had to drop, only written by the producer */
+  uint32_t dropped;
+  uint8_t *buf;
+};
+
+/* size must be a power of two */
+static inline void
+isr_ring_init(struct isr_ring *ring, uint8_t *buf, uint32_t size)
+{
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  ring->mask = size - 1;
+  ring->dropped = 0;
+  ring->buf = buf;
+}
+
+/* producer side, 0 on success, -1 if the ring is full */
+static inline int
+isr_ring_push(struct isr_ring *ring, uint8_t c)
+{
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+  if(head - tail > ring->mask)
+  {
+    ring->dropped++;
+    return -1;
+  }
+
+  ring->buf[head & ring->mask] = c;
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+  return 0;
+}
+
+/* consumer side, copies up to len bytes and returns how many */
+static inline uint32_t
+isr_ring_pop(struct isr_ring *ring, uint8_t *data, uint32_t len)
+{
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  uint32_t n = head - tail;
+
+  if(n > len)
+  {
+    n = len;
+  }
+  if(!n)
+  {
+    return 0;
+  }
+
+  uint32_t start = tail & ring->mask;
+  uint32_t first = ring->mask + 1 - start;
+  if(first > n)
+  {
+    first = n;
+  }
+  memcpy(data, &ring->buf[start], first);
+  memcpy(data + first, ring->buf, n - first);
+
+  atomic_store_explicit(&ring->tail, tail + n, memory_order_release);
+  return n;
+}
+
+/* either side, a snapshot */
+static inline uint32_t
+isr_ring_count(struct isr_ring *ring)
+{
+  return atomic_load_explicit(&ring->head, memory_order_acquire) -
+         atomic_load_explicit(&ring->tail, memory_order_acquire);
+}
+
+#endif
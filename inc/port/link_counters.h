@@ -0,0 +1,94 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef PORT_link_counters_H
+#define PORT_link_counters_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* per link counters, kept by whoever sees the event: the framing driver
+ * (slipvif, hdlcif, iothread, tapif) hangs its set on the netif, the port
+ * keeps one per sio device for the bytes on the wire, overruns and the
+ * tx queue, the gateway's egress scheduler adds its drops and queue
+ * delay to the netif's set; fields a layer cannot see stay 0
+ *
+ * every counter has exactly one writer and is a plain add on its hot
+ * path; where that writer is an io thread and the reader the lwip core,
+ * the _SHARED forms make it one relaxed store (still no lock prefix) and
+ * readers go through link_counters_snapshot
+ *
+ * no lwip includes here, the port's sio has none; the netif helpers are
+ * macros for code that includes lwip/netif.h */
+
+/* first client data slot after the ones lwip reserves for its own
+ * protocols, lwipopts.h sets LWIP_NUM_NETIF_CLIENT_DATA for it */
+#define LINK_COUNTERS_CLIENT_DATA (LWIP_NETIF_CLIENT_DATA_INDEX_MAX)
+
+struct link_counters
+{
+  uint32_t rx_bytes;
+  uint32_t rx_frames;
+  uint32_t rx_escapes;
+  uint32_t rx_dropped;  // no buffer for the frame
+  uint32_t rx_oversize; // longer than the link mtu
+  uint32_t rx_errors;   // bad fcs, runts, aborts
+  uint32_t rx_overruns; // bytes lost before software saw them
+  uint32_t tx_bytes;
+  uint32_t tx_frames;
+  uint32_t tx_escapes;
+  uint32_t tx_dropped;
+  uint32_t tx_busy;  // refused for a full tx queue, the sender may retry
+  uint32_t tx_queue; // bytes, packets or frames waiting, at the last send
+  uint32_t tx_queue_max;
+  uint32_t tx_aqm_dropped;  // dropped by the egress scheduler
+  uint32_t tx_delay_us;     // time the last packet spent in it
+  uint32_t tx_delay_max_us;
+};
+
+#define LINK_COUNTERS_ADD(c, field, n) ((c)->field += (n))
+#define LINK_COUNTERS_INC(c, field) LINK_COUNTERS_ADD(c, field, 1)
+#define LINK_COUNTERS_SET(c, field, v) ((c)->field = (v))
+
+#define LINK_COUNTERS_ADD_SHARED(c, field, n) \
+  __atomic_store_n(&(c)->field, (c)->field + (n), __ATOMIC_RELAXED)
+#define LINK_COUNTERS_INC_SHARED(c, field) LINK_COUNTERS_ADD_SHARED(c, field, 1)
+#define LINK_COUNTERS_SET_SHARED(c, field, v) \
+  __atomic_store_n(&(c)->field, (v), __ATOMIC_RELAXED)
+
+/* tx_queue and its high water mark */
+#define LINK_COUNTERS_QUEUE(c, depth)       \
+  do                                        \
+  {                                         \
+    (c)->tx_queue = (depth);                \
+    if((c)->tx_queue > (c)->tx_queue_max)   \
+    {                                       \
+      (c)->tx_queue_max = (c)->tx_queue;    \
+    }                                       \
+  } while(0)
+
+#define link_counters_attach(netif, counters) \
+  netif_set_client_data(netif, LINK_COUNTERS_CLIENT_DATA, counters)
+
+/* NULL if the driver of netif keeps none */
+#define link_counters_of(netif) \
+  ((struct link_counters *)netif_get_client_data(netif, LINK_COUNTERS_CLIENT_DATA))
+
+static inline void
+link_counters_snapshot(struct link_counters *dst, const struct link_counters *src)
+{
+  const uint32_t *in = (const uint32_t *)src;
+  uint32_t *out = (uint32_t *)dst;
+
+  for(size_t i = 0; i < sizeof(*src) / sizeof(uint32_t); i++)
+  {
+    out[i] = __atomic_load_n(&in[i], __ATOMIC_RELAXED);
+  }
+}
+
+/* counters the port's sio keeps for devnum, NULL if the device was
+ * never opened */
+const struct link_counters *sio_link_counters(uint8_t devnum);
+
+#endif
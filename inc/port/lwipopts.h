@@ -20,14 +20,58 @@
 #define IP_FORWARD 1
 
 #define LWIP_ICMP 1
+
+/* per netif state of our layers, from LWIP_NETIF_CLIENT_DATA_INDEX_MAX
+ * on: the link counters (link_counters.h), header compression (hc.c),
+ * link security (lsec.c) */
+#define LWIP_NUM_NETIF_CLIENT_DATA 3
+
+/* the gateway's fast path forgets its cached routes when a netif is
+ * added, removed or renumbered, see fastpath.c */
+#define LWIP_NETIF_EXT_STATUS_CALLBACK 1
+
+/* tapif receives into preallocated custom pbufs */
+#define LWIP_SUPPORT_CUSTOM_PBUF 1
 //#define LWIP_NOASSERT 0
 
+/* tcp sized to the serial link instead of ethernet, at LINK_BAUD 8N1
+ * the link moves LINK_BAUD / 10 bytes/s:
+ * 1 Mbaud, a 576 byte segment is ~6 ms on the wire, with the ack and the
+ *   gateway ~12 ms rtt, so the bdp is ~1.2 kB; 4 segments cover it and
+ *   the two a delayed ack holds back
+ * 115200, the same segment takes ~50 ms; 256 byte segments keep a ping
+ *   from waiting that long behind bulk data, ~30 ms rtt, bdp ~350 bytes
+ * the send buffer matches the window so one sent callback refills it */
+#ifndef LINK_BAUD
+#define LINK_BAUD (1000000)
+#endif
+
+#if LINK_BAUD >= 460800
+#define TCP_MSS (536)
+#else
+#define TCP_MSS (256)
+#endif
+#define TCP_WND (4 * TCP_MSS)
+#define TCP_SND_BUF (4 * TCP_MSS)
+
 /* values are set as PUBLIC compile options for variant lwip_udp or lwip_tcp */
 //#define LWIP_UDP 1
 //#define LWIP_TCP 1
 
+/* mem_profile.c reads lwip's high water marks */
+#if defined(LWIP_PROFILE) && LWIP_PROFILE
+#define LWIP_STATS 1
+#define MEM_STATS 1
+#define MEMP_STATS 1
+#endif
+
 //#define LWIP_DEBUG 1
 //#define IP_DEBUG LWIP_DBG_ON
 //#define UDP_DEBUG LWIP_DBG_ON
 
+/* pool sizes written by a LWIP_PROFILE run, last so they win */
+#ifdef LWIP_OPTS_OVERLAY
+#include LWIP_OPTS_OVERLAY
+#endif
+
 #endif
@@ -0,0 +1,26 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef PORT_sio_framing_H
+#define PORT_sio_framing_H
+
+#include <stdint.h>
+
+/* which byte closes a frame on a sio device, for ports that collect
+ * whole frames (the mote's uDMA, the PC's tx buffer): SLIP escapes 0xC0
+ * but not 0x7E, HDLC the other way round, so only the framing's own
+ * delimiter ends one
+ *
+ * a device is SLIP (lwip's slipif) until its driver says otherwise; the
+ * framing is kept per devnum apart from it, every devnum stays usable */
+enum sio_framing
+{
+  SIO_FRAMING_SLIP,
+  SIO_FRAMING_HDLC,
+};
+
+/* before sio_open(devnum), implemented by each port */
+void sio_set_framing(uint8_t devnum, enum sio_framing framing);
+
+#endif
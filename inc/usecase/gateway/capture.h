@@ -0,0 +1,37 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef USECASE_GATEWAY_capture_H
+#define USECASE_GATEWAY_capture_H
+
+#include "lwip/netif.h"
+
+/* optional pcapng capture of what crosses the gateway: the core thread
+ * copies every packet as a finished enhanced packet block into a
+ * preallocated lock-free ring, a writer thread streams the ring to the
+ * file; a packet that does not fit is dropped, forwarding never waits
+ * for the disk
+ *
+ * packets are taken as plain ip, above encryption and header
+ * compression, each netif is one pcapng interface (LINKTYPE_RAW) with
+ * nanosecond timestamps and the direction in epb_flags */
+
+/* bytes, power of two */
+#define CAPTURE_RING_SIZE (4 * 1024 * 1024)
+
+/* writes the section header and starts the writer */
+int capture_open(const char *path);
+
+/* adds netif as the next interface and wraps netif->output, call after
+ * every other layer; received packets are taken by capture_input */
+err_t capture_attach(struct netif *netif);
+
+/* netif input function, records p and passes it on to ip_input or the
+ * stage set by capture_set_upper_input */
+err_t capture_input(struct pbuf *p, struct netif *inp);
+
+/* received packets go to input instead of ip_input (the gateway's pmtu) */
+void capture_set_upper_input(netif_input_fn input);
+
+#endif
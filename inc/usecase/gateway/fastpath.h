@@ -0,0 +1,40 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef USECASE_GATEWAY_fastpath_H
+#define USECASE_GATEWAY_fastpath_H
+
+#include "lwip/netif.h"
+
+/* cut-through forwarding for plain transit packets: the packet is taken
+ * as it came from the tun read or the serial decoder, the ttl is
+ * decremented, the header checksum updated incrementally (rfc 1141) and
+ * the packet handed straight to the egress netif's output, no ip_input,
+ * no ip4_forward
+ *
+ * anything else goes on to pmtu_input and lwip: packets to the gateway
+ * itself, broadcasts and multicasts, destinations ip4_canforward refuses
+ * (class e, loopback, 0/8), headers with a bad checksum, ip options,
+ * fragments, ttl <= 1, packets larger than the egress mtu and tcp syns
+ * (mss clamping)
+ *
+ * egress netifs are looked up with ip4_route and cached per destination;
+ * the cache is flushed on every change lwip reports through its netif
+ * ext callback: netifs added or removed, addresses, up/down, link */
+
+/* destinations cached, power of two */
+#define FASTPATH_ROUTE_CACHE (1024)
+
+/* registers the netif callback, before the first fastpath_input */
+void fastpath_init(void);
+
+/* forgets every cached route, for changes lwip does not report, e.g.
+ * netif_set_default */
+void fastpath_flush(void);
+
+/* netif input function, before pmtu_input on the tun netif and the
+ * links' upper input */
+err_t fastpath_input(struct pbuf *p, struct netif *inp);
+
+#endif
@@ -0,0 +1,50 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef USECASE_GATEWAY_iothread_H
+#define USECASE_GATEWAY_iothread_H
+
+#include "lwip/netif.h"
+
+/* threaded gateway mode: device fds are sharded across io worker threads,
+ * packets travel through spsc rings to and from the single lwip core
+ * thread, so SYS_LIGHTWEIGHT_PROT 0 stays valid
+ * each worker wakes the core through one eventfd for all of its devices */
+
+#define IOTHREAD_MAX_DEVS (64)
+
+enum iothread_kind
+{
+  IOTHREAD_TUN,
+  IOTHREAD_SERIAL, // slip framing is done in the io thread
+};
+
+struct iothread_config
+{
+  int cpu;           // -1: no pinning
+  int fifo_priority; // 0: default scheduler, else SCHED_FIFO priority
+};
+
+struct iothread_worker;
+struct iothread_dev;
+
+struct iothread_worker *iothread_worker_create(const struct iothread_config *config);
+
+/* takes over fd and the output path of an initialised netif,
+ * must be called before iothread_worker_start */
+struct iothread_dev *iothread_attach(struct iothread_worker *worker,
+                                     struct netif *netif,
+                                     int fd,
+                                     enum iothread_kind kind);
+
+int iothread_worker_start(struct iothread_worker *worker);
+
+/* readable whenever received packets of the worker wait for the core thread */
+int iothread_worker_core_fd(const struct iothread_worker *worker);
+
+/* core thread: feeds all packets the worker received into lwip,
+ * reactor_poll_fn compatible */
+void iothread_worker_poll(void *worker);
+
+#endif
@@ -0,0 +1,52 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef USECASE_GATEWAY_link_config_H
+#define USECASE_GATEWAY_link_config_H
+
+#include "lwip/ip_addr.h"
+
+#include <stdint.h>
+
+#define GATEWAY_MAX_LINKS (250)
+#define GATEWAY_LINK_PATH_MAX (64)
+#define GATEWAY_LINK_KEY_LEN (16)
+
+enum link_framing
+{
+  LINK_FRAMING_SLIP,
+  LINK_FRAMING_HDLC,   // FCS-16
+  LINK_FRAMING_HDLC32, // FCS-32
+};
+
+struct link_config
+{
+  char path[GATEWAY_LINK_PATH_MAX];
+  ip4_addr_t ipaddr;
+  ip4_addr_t netmask;
+  uint32_t baud;
+  enum link_framing framing;
+  // AES-CCM link key, the link is plaintext without one
+  uint8_t key[GATEWAY_LINK_KEY_LEN];
+  int has_key;
+  // largest frame the gateway takes from the link, the mote may agree
+  // on less
+  uint16_t mtu;
+};
+
+/* "path,a.b.c.d/prefix[,baud[,slip|hdlc|hdlc32[,key]]][,mtu=n]",
+ * key is 32 hex digits, mtu 68..1500 (default 1500), e.g.
+ * "/dev/ttyUSB0,10.1.0.1/16,1000000,hdlc,000102030405060708090a0b0c0d0e0f"
+ * "/dev/ttyUSB1,10.2.0.1/16,57600,mtu=256"
+ * 0 on success, -1 on a malformed spec */
+int link_config_parse(struct link_config *link, const char *spec);
+
+/* one spec per line, blank lines and # comments are skipped
+ * number of links appended after *num_links, -1 on the first bad line */
+int link_config_load(struct link_config *links,
+                     uint32_t *num_links,
+                     uint32_t max_links,
+                     const char *path);
+
+#endif
@@ -0,0 +1,27 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef USECASE_GATEWAY_pmtu_H
+#define USECASE_GATEWAY_pmtu_H
+
+#include "lwip/netif.h"
+
+/* the gateway neither fragments nor reassembles, so every packet it
+ * forwards has to fit the egress netif as it is; before ip_input sees a
+ * transit packet this stage looks up the egress netif and
+ * - lowers the mss option of a tcp syn to egress mtu - 40, both ends
+ *   then pick segments that fit from the first one on
+ * - answers a packet too large with df set by icmp fragmentation needed
+ *   carrying the egress mtu (rfc 1191), lwip's own answer leaves that
+ *   field 0 and hosts cannot tell which size to retry with
+ * packets to the gateway itself pass untouched */
+
+/* icmp errors sent per second at most, like the host's icmp_ratelimit */
+#define PMTU_ICMP_PER_SECOND (100)
+
+/* netif input function, the last stage before ip_input; chain it from
+ * the tun netif and the links' upper input */
+err_t pmtu_input(struct pbuf *p, struct netif *inp);
+
+#endif
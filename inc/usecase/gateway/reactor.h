@@ -0,0 +1,62 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef USECASE_GATEWAY_reactor_H
+#define USECASE_GATEWAY_reactor_H
+
+#include "arch/uring_pc.h"
+
+#include <stdint.h>
+
+#define REACTOR_MAX_SOURCES (256)
+
+typedef void (*reactor_poll_fn)(void *arg);
+
+struct reactor_source
+{
+  int fd;
+  reactor_poll_fn poll;
+  void *arg;
+  /* sio device whose tx queue decides on extra events, -1 for none */
+  int sio_fd;
+  uint32_t events;
+};
+
+/* epoll based main loop: wakes on readable device fds and on a timerfd
+ * armed from sys_timeouts_sleeptime()
+ *
+ * once uring_init succeeded the loop sleeps in uring_run instead, with
+ * the lwip timeout as its limit; devices on the ring run their own
+ * completions and the sources left on epoll are reached through one poll
+ * request for the epoll fd */
+struct reactor
+{
+  int epoll_fd;
+  int timer_fd;
+  struct uring_op epoll_op;
+  uint8_t epoll_armed;
+  uint32_t num_sources;
+  struct reactor_source sources[REACTOR_MAX_SOURCES];
+};
+
+int reactor_open(struct reactor *reactor);
+
+/* poll(arg) runs whenever fd is readable */
+int reactor_add(struct reactor *reactor,
+                int fd,
+                reactor_poll_fn poll,
+                void *arg);
+
+/* like reactor_add for a serial device opened through sio: while frames
+ * wait in its tx queue poll(arg) also runs once the device can take
+ * more, the driver's sio_tryread moves them on; a device on the io_uring
+ * calls poll(arg) from its read completions and stays out of epoll */
+int reactor_add_sio(struct reactor *reactor,
+                    int fd,
+                    reactor_poll_fn poll,
+                    void *arg);
+
+void reactor_run_once(struct reactor *reactor);
+
+#endif
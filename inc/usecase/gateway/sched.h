@@ -0,0 +1,58 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef USECASE_GATEWAY_sched_H
+#define USECASE_GATEWAY_sched_H
+
+#include "lwip/netif.h"
+
+/* egress scheduler for a serial link: the link is shaped to a little
+ * below its line rate so the queue builds up here, where it can be
+ * managed, instead of in the tty
+ * - icmp and small packets (acks, dns, control traffic) go first, strict
+ *   priority, up to SCHED_PRIO_LIMIT of them
+ * - everything else is hashed on the 5-tuple into SCHED_FLOWS queues
+ *   served by deficit round robin, one mtu per round
+ * - each flow queue runs codel (rfc 8289): once packets have waited
+ *   longer than the target for a whole interval, packets are dropped at
+ *   the head at a rising rate until the standing queue is gone
+ * - past SCHED_LIMIT packets the head of the longest queue is dropped
+ *
+ * packets are copied on enqueue and handed to the lower output (hc, lsec,
+ * the driver) when the shaper has credit; a lower output answering
+ * ERR_MEM keeps the packet at the head until the next tick
+ *
+ * the sojourn time of the last packet sent, its high water mark and the
+ * drops go into the netif's link counters */
+
+#define SCHED_FLOWS (64)
+#define SCHED_LIMIT (256)
+#define SCHED_PRIO_LIMIT (32)
+
+/* ip packets up to this size count as small */
+#define SCHED_SMALL_PACKET (128)
+
+/* codel's defaults; the target is raised to 1.5 mtu on the wire for
+ * links too slow to send one mtu in 5 ms */
+#define SCHED_CODEL_TARGET_US (5000)
+#define SCHED_CODEL_INTERVAL_US (100000)
+
+/* shaped rate in percent of baud / 10, room for slip escapes */
+#define SCHED_RATE_PERCENT (95)
+
+struct sched_config
+{
+  /* bytes per second */
+  u32_t rate;
+  /* one tail drop queue at the same rate, the baseline to compare to */
+  int fifo;
+};
+
+/* wraps netif->output, call after hc_attach and before capture_attach */
+err_t sched_attach(struct netif *netif, const struct sched_config *config);
+
+/* rate for a link at baud 8N1 */
+u32_t sched_rate_of_baud(u32_t baud);
+
+#endif
@@ -0,0 +1,38 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef USECASE_GATEWAY_spsc_ring_H
+#define USECASE_GATEWAY_spsc_ring_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define SPSC_RING_CACHE_LINE (64)
+
+/* lock-free single producer / single consumer ring of pointers
+ * head is only written by the producer, tail only by the consumer */
+struct spsc_ring
+{
+  _Alignas(SPSC_RING_CACHE_LINE) _Atomic uint32_t head;
+  _Alignas(SPSC_RING_CACHE_LINE) _Atomic uint32_t tail;
+  _Alignas(SPSC_RING_CACHE_LINE) uint32_t mask;
+  void **slots;
+};
+
+/* size must be a power of two */
+int spsc_ring_init(struct spsc_ring *ring, uint32_t size);
+
+void spsc_ring_destroy(struct spsc_ring *ring);
+
+/* 0 on success, -1 if the ring is full */
+int spsc_ring_push(struct spsc_ring *ring, void *item);
+
+/* NULL if the ring is empty */
+void *spsc_ring_pop(struct spsc_ring *ring);
+
+/* items in the ring, exact for the side that calls it, the other side
+ * may have moved on already */
+uint32_t spsc_ring_count(struct spsc_ring *ring);
+
+#endif
@@ -0,0 +1,24 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef USECASE_GATEWAY_stats_socket_H
+#define USECASE_GATEWAY_stats_socket_H
+
+/* local unix stream socket: every client that connects gets one
+ * link_stats snapshot and is closed again, e.g.
+ *   socat - UNIX-CONNECT:/tmp/gateway.stats
+ * runs on the core thread, so lwip's stats are read by their only writer */
+
+struct stats_socket;
+
+/* replaces a stale socket file at path */
+struct stats_socket *stats_socket_open(const char *path);
+
+/* readable whenever a client waits */
+int stats_socket_fd(const struct stats_socket *stats);
+
+/* answers all waiting clients, reactor_poll_fn compatible */
+void stats_socket_poll(void *stats);
+
+#endif
@@ -0,0 +1,58 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef USECASE_LINK_aes_ccm_H
+#define USECASE_LINK_aes_ccm_H
+
+#include "lwip/arch.h"
+
+/* AES-128-CCM (RFC 3610) with a 13 byte nonce, L = 2
+ *
+ * src/link/aes_ccm.c on hosts, AES-NI when the cpu has it and a byte
+ * oriented software AES otherwise; src/link/aes_ccm_cc2538.c hands the work
+ * to the cc2538 AES engine, whose dma wants the tag right behind the data */
+
+#define AES_CCM_KEY_LEN (16)
+#define AES_CCM_NONCE_LEN (13)
+#define AES_CCM_MAX_TAG_LEN (16)
+
+struct aes_ccm_key
+{
+  /* expanded key on hosts, unused on the cc2538 */
+  _Alignas(16) u8_t round_keys[176];
+  /* key store area on the cc2538 */
+  u8_t area;
+};
+
+enum aes_ccm_impl
+{
+  AES_CCM_SOFTWARE,
+  AES_CCM_AESNI,
+  AES_CCM_CC2538,
+};
+
+/* selects the best supported implementation not above wanted,
+ * the default is the best the platform has */
+enum aes_ccm_impl aes_ccm_select(enum aes_ccm_impl wanted);
+
+/* 0 on success, -1 if the key store is full */
+int aes_ccm_init(struct aes_ccm_key *key, const u8_t raw[AES_CCM_KEY_LEN]);
+
+/* encrypts data in place and writes tag_len (4..16, even) bytes of tag
+ * right behind it */
+int aes_ccm_seal(const struct aes_ccm_key *key,
+                 const u8_t nonce[AES_CCM_NONCE_LEN],
+                 const u8_t *aad, u16_t aad_len,
+                 u8_t *data, u16_t len,
+                 u8_t tag_len);
+
+/* decrypts data in place and checks the tag_len bytes behind it,
+ * 0 if the frame is authentic, -1 otherwise (data is garbage then) */
+int aes_ccm_open(const struct aes_ccm_key *key,
+                 const u8_t nonce[AES_CCM_NONCE_LEN],
+                 const u8_t *aad, u16_t aad_len,
+                 u8_t *data, u16_t len,
+                 u8_t tag_len);
+
+#endif
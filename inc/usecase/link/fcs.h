@@ -0,0 +1,26 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef USECASE_LINK_fcs_H
+#define USECASE_LINK_fcs_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* HDLC frame check sequences (RFC 1662), both are sent least significant
+ * byte first and complemented; running the fcs over data + fcs yields
+ * the good value */
+
+#define FCS16_INIT (0xFFFFU)
+#define FCS16_GOOD (0xF0B8U)
+
+#define FCS32_INIT (0xFFFFFFFFUL)
+#define FCS32_GOOD (0xDEBB20E3UL)
+
+uint16_t fcs16_update(uint16_t fcs, const uint8_t *data, size_t len);
+
+/* slice-by-8 on x86 hosts, byte-wise table elsewhere */
+uint32_t fcs32_update(uint32_t fcs, const uint8_t *data, size_t len);
+
+#endif
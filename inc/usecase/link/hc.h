@@ -0,0 +1,66 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef USECASE_LINK_hc_H
+#define USECASE_LINK_hc_H
+
+#include "lwip/netif.h"
+
+/* IPv4/UDP/TCP header compression for serial links, in the spirit of
+ * CSLIP: per flow contexts, a full header establishes a context id,
+ * later packets only carry what changes
+ *
+ * frame types (first byte, plain IPv4 starts with 0x4X):
+ *   0x70 cid ip-packet                          full header, sets context
+ *   0x80|flags cid [ip id] l4-dynamic payload   compressed
+ *   0xF0 op cids [mru]                          negotiation
+ *
+ * the negotiation also agrees on the link mtu: each side offers the
+ * largest ip packet it takes (mru, 16 bit big endian) and both use the
+ * smaller of the two; until then, or with a peer that does not send
+ * one, the mtu stays at HC_DEFAULT_MTU
+ */
+
+#ifndef HC_MAX_LINKS
+#define HC_MAX_LINKS (1)
+#endif
+
+#ifndef HC_MAX_CONTEXTS
+#define HC_MAX_CONTEXTS (8)
+#endif
+
+/* every ipv4 host takes 576 byte packets */
+#ifndef HC_DEFAULT_MTU
+#define HC_DEFAULT_MTU (576)
+#endif
+
+struct hc_stats
+{
+  u32_t tx_compressed;
+  u32_t tx_full;
+  u32_t tx_plain;
+  u32_t rx_compressed;
+  u32_t rx_full;
+  u32_t rx_plain;
+  u32_t rx_unknown_cid;
+  u32_t rx_errors;
+};
+
+/* netif input function, pass it to netif_add instead of ip_input */
+err_t hc_input(struct pbuf *p, struct netif *inp);
+
+/* wraps netif->output, call after the driver (and any io thread) set it
+ * the initiator offers compression on link up until the peer answers,
+ * the other side only compresses once it was asked
+ * netif->mtu at this point, less a full header frame's overhead, is the
+ * mru offered to the peer; lower it first to take smaller packets */
+err_t hc_attach(struct netif *netif, int initiate);
+
+/* plain packets of all links go to input instead of ip_input, for a
+ * layer that wants them after decompression (the gateway's capture) */
+void hc_set_upper_input(netif_input_fn input);
+
+const struct hc_stats *hc_stats_of(const struct netif *netif);
+
+#endif
@@ -0,0 +1,44 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef USECASE_LINK_hdlcif_H
+#define USECASE_LINK_hdlcif_H
+
+#include "lwip/netif.h"
+
+/* HDLC-like framing (RFC 1662 async octet stuffing) as alternative to
+ * slipif: flag, address, control (UI), payload, FCS-16 or FCS-32, flag
+ * frames with a bad FCS or a control field other than UI never reach
+ * ip_input */
+
+#define HDLCIF_ADDRESS_ALL (0xFF)
+#define HDLCIF_CONTROL_UI  (0x03)
+
+/* netif->state for hdlcif_init, owned by the caller */
+struct hdlcif_config
+{
+  u8_t devnum;  // sio_open(devnum)
+  u8_t address; // secondary station address, used in both directions
+  u8_t fcs32;   // 0: FCS-16, 1: FCS-32
+  u8_t primary; // primary accepts any address, a secondary only its own
+};
+
+/* what hides behind rx_errors of the link counters, and frames for
+ * other secondaries */
+struct hdlcif_stats
+{
+  u32_t rx_bad_fcs;
+  u32_t rx_runt;
+  u32_t rx_aborted;
+  u32_t rx_bad_control;
+  u32_t rx_other_address;
+};
+
+err_t hdlcif_init(struct netif *netif);
+
+void hdlcif_poll(struct netif *netif);
+
+const struct hdlcif_stats *hdlcif_stats(const struct netif *netif);
+
+#endif
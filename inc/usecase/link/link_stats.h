@@ -0,0 +1,30 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef USECASE_LINK_link_stats_H
+#define USECASE_LINK_link_stats_H
+
+#include "lwip/arch.h"
+
+#include <stddef.h>
+
+/* machine readable snapshot of the link counters and lwip's own stats,
+ * one json object per line:
+ *   {"name":"sv0","kind":"netif","rx_bytes":1432,...}   driver counters
+ *   {"name":"sio3","kind":"sio","rx_bytes":1502,...}    port counters
+ *   {"name":"ip","kind":"lwip","xmit":12,...}           lwip_stats
+ *   {"name":"PBUF_POOL","kind":"lwip","avail":16,...}   heap and pools
+ * the same fields in the same order every time, counters wrap at 2^32
+ * (lwip's at 2^16) */
+
+#define LINK_STATS_CURSOR_START (0)
+#define LINK_STATS_CURSOR_DONE (0xFFFFFFFFUL)
+
+/* writes whole lines from entry *cursor on while they fit into size,
+ * returns the bytes written (never more than size) and leaves *cursor at
+ * the first entry that did not fit, LINK_STATS_CURSOR_DONE after the
+ * last one; an entry longer than size on its own is skipped */
+size_t link_stats_format(char *buf, size_t size, u32_t *cursor);
+
+#endif
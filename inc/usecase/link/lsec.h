@@ -0,0 +1,69 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef USECASE_LINK_lsec_H
+#define USECASE_LINK_lsec_H
+
+#include "lwip/netif.h"
+
+#include "link/aes_ccm.h"
+
+/* authenticated encryption of every frame on a serial link, between
+ * the framing and header compression, AES-128-CCM with a per link key
+ *
+ * frames (all of them once attached, plaintext is dropped):
+ *   0x58 epoch(4) pn(4) ciphertext tag(8)   data, what hc/ip sent
+ *   0x59 epoch(4) pn(4) ciphertext tag(8)   ctrl, op(1) challenge(8)
+ *
+ * nonce = direction(1) epoch(4) pn(4) 0(4), the header is the aad
+ * every boot picks a random tx epoch and counts pn from 1, so a nonce
+ * never repeats under the key even though nothing is stored
+ *
+ * a receiver takes data of a new epoch only after the peer echoed a
+ * fresh challenge under it; frames replayed from an earlier boot fail
+ * that, within an epoch a 64 frame window catches replays of data and
+ * ctrl frames alike; a response only counts for the challenge still
+ * outstanding, which is forgotten once answered
+ * a challenge under an unknown epoch is answered and challenged back, so
+ * one lsec_handshake sets up both directions; without it the first data
+ * frames after either side booted are dropped while the challenge runs */
+
+#ifndef LSEC_MAX_LINKS
+#define LSEC_MAX_LINKS (1)
+#endif
+
+#define LSEC_HDR_LEN (9)
+#define LSEC_TAG_LEN (8)
+#define LSEC_OVERHEAD (LSEC_HDR_LEN + LSEC_TAG_LEN)
+
+struct lsec_config
+{
+  u8_t key[AES_CCM_KEY_LEN];
+  /* one side of a link must be the initiator, it owns the nonces with
+   * the direction byte set */
+  u8_t initiator;
+};
+
+struct lsec_stats
+{
+  u32_t tx_frames;
+  u32_t rx_frames;
+  u32_t rx_auth_failed;
+  u32_t rx_replayed;
+  u32_t rx_unknown_epoch;
+  u32_t rx_malformed;
+  u32_t challenges;
+};
+
+/* wraps netif->output and netif->input, call after the driver (and any
+ * io thread) set them and before hc_attach; lowers the mtu by
+ * LSEC_OVERHEAD */
+err_t lsec_attach(struct netif *netif, const struct lsec_config *config);
+
+/* challenges the peer ahead of any traffic */
+err_t lsec_handshake(struct netif *netif);
+
+const struct lsec_stats *lsec_stats_of(const struct netif *netif);
+
+#endif
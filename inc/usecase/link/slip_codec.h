@@ -0,0 +1,70 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef USECASE_LINK_slip_codec_H
+#define USECASE_LINK_slip_codec_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SLIP_END     (0xC0)
+#define SLIP_ESC     (0xDB)
+#define SLIP_ESC_END (0xDC)
+#define SLIP_ESC_ESC (0xDD)
+
+/* worst case: every byte escaped plus leading and trailing END */
+#define SLIP_ENCODED_MAX(len) (2 * (len) + 2)
+
+enum slip_codec_impl
+{
+  SLIP_CODEC_SCALAR,
+  SLIP_CODEC_SSE2,
+  SLIP_CODEC_AVX2,
+};
+
+/* selects the best supported implementation not above wanted,
+ * the default is the best the cpu supports */
+enum slip_codec_impl slip_codec_select(enum slip_codec_impl wanted);
+
+/* index of the first END or ESC byte, len if there is none */
+size_t slip_find_special(const uint8_t *data, size_t len);
+
+/* escapes len bytes of src into dst (no END delimiters),
+ * dst must hold 2 * len bytes, returns bytes written */
+size_t slip_escape(uint8_t *dst, const uint8_t *src, size_t len);
+
+typedef enum
+{
+  SLIP_DECODE_NEED_INPUT,
+  SLIP_DECODE_NEED_OUTPUT,
+  SLIP_DECODE_FRAME,
+} slip_decode_result;
+
+struct slip_decoder
+{
+  uint8_t *out;
+  size_t out_len;
+  size_t frame_len;
+  uint8_t esc;
+  uint8_t drop;
+  /* ESC sequences decoded, a running total the resets leave alone */
+  uint32_t escapes;
+};
+
+/* starts a new frame written to out */
+void slip_decoder_reset(struct slip_decoder *dec, uint8_t *out, size_t out_len);
+
+/* continues the current frame in the next output window (next pbuf) */
+void slip_decoder_window(struct slip_decoder *dec, uint8_t *out, size_t out_len);
+
+/* throws away the current frame up to the next END, then continues in out */
+void slip_decoder_discard(struct slip_decoder *dec, uint8_t *out, size_t out_len);
+
+/* consumes input until it is exhausted, the output window is full or a
+ * non empty frame is complete, clean runs are copied in bulk */
+slip_decode_result slip_decode(struct slip_decoder *dec,
+                               const uint8_t **in,
+                               size_t *in_len);
+
+#endif
@@ -0,0 +1,17 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef USECASE_LINK_slipvif_H
+#define USECASE_LINK_slipvif_H
+
+#include "lwip/netif.h"
+
+/* drop-in alternative to slipif_init/slipif_poll for the host:
+ * same wire format, but bulk reads/writes through a vectorized codec
+ * netif->state is the sio devnum like for slipif */
+err_t slipvif_init(struct netif *netif);
+
+void slipvif_poll(struct netif *netif);
+
+#endif
@@ -0,0 +1,52 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef USECASE_SERVER_blast_H
+#define USECASE_SERVER_blast_H
+
+#include <stdint.h>
+
+/* udp link qualification, one direction at a time, driven by the host's
+ * udp_blast:
+ *   sink    host -> mote, the mote counts, BLAST_REPORT fetches the counts
+ *   source  mote -> host, count datagrams of size at rate per second
+ *   echo    every datagram goes back unchanged
+ * all fields are big endian, the rest of a datagram is padding up to the
+ * size under test */
+#define USECASE_BLAST_PORT (1238)
+
+enum blast_mode
+{
+  BLAST_SINK = 1,
+  BLAST_SOURCE = 2,
+  BLAST_ECHO = 3,
+  BLAST_REPORT = 4,
+};
+
+struct blast_hdr
+{
+  uint8_t mode;
+  uint8_t reserved;
+  uint16_t size;    // source request: bytes per datagram
+  uint32_t session; // picked by the host, a new one resets the counts
+  uint32_t seq;
+  uint32_t ts_us;   // sender's clock, the mote's has ms resolution
+  uint32_t rate;    // source request: datagrams per second
+  uint32_t count;   // source request: datagrams to send
+};
+
+/* follows the header of a BLAST_REPORT answer, sink counts of session */
+struct blast_report
+{
+  uint32_t packets;
+  uint32_t bytes;
+  uint32_t lost;        // sequence gaps, a lost tail is only seen by the host
+  uint32_t reordered;   // arrived after a later one
+  uint32_t jitter_us;   // rfc 3550 interarrival jitter
+  uint32_t duration_us; // first to last datagram
+};
+
+void blast_server_setup(void);
+
+#endif
@@ -0,0 +1,14 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef USECASE_SERVER_stats_H
+#define USECASE_SERVER_stats_H
+
+/* any datagram to this port is answered with the link stats, whole
+ * lines split over as many datagrams as it takes */
+#define USECASE_STATS_PORT (1235)
+
+void stats_server_setup(void);
+
+#endif
@@ -5,7 +5,12 @@
 #ifndef USECASE_SERVER_tcp_H
 #define USECASE_SERVER_tcp_H
 
+/* echo: what arrives goes back, the window only opens as the echo is acked
+ * sink: everything is read and dropped, measures the uplink
+ * source: a pattern is sent until the client closes, measures the downlink */
 #define USECASE_SERVER_PORT (1234)
+#define USECASE_TCP_SINK_PORT (1236)
+#define USECASE_TCP_SOURCE_PORT (1237)
 
 void tcp_server_setup(void);
 
@@ -0,0 +1,472 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+/* many virtual motes for sizing a gateway
+ *
+ * every mote is the main.c stack (slipif, header compression,
+ * udp_server.c) on its own pty, the slave shows up as <dir>/mote<i>
+ * and <dir>/links lists them in the gateway's -f format
+ *
+ * lwip keeps its state in globals, so a mote is a forked process
+ * rather than a thread; -c/-k pin the farm to a set of cpus so one
+ * core's worth of motes can be measured, the kernel schedules them
+ *
+ * the farm reports what each mote costs in memory (private dirty
+ * pages after start, i.e. what fork could not share) and cpu, and
+ * from the cpu per packet how many motes a core sustains at -r */
+
+#define _GNU_SOURCE
+
+#include "gateway/reactor.h"
+#include "link/hc.h"
+#include "server/udp.h"
+#include "server/tcp.h"
+
+#include "arch/sio_pc.h"
+
+#include "lwip/init.h"
+#include "lwip/ip.h"
+#include "lwip/timeouts.h"
+#include "netif/slipif.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define FARM_MAX_MOTES (250)
+#define FARM_DEVNUM (0)
+
+struct farm_mote
+{
+  pid_t pid;
+  _Atomic uint32_t rx_packets;
+  _Atomic uint32_t tx_packets;
+};
+
+struct farm
+{
+  uint32_t num_motes;
+  const char *dir;
+  int first_cpu;
+  uint32_t num_cpus;
+  uint32_t seconds;
+  uint32_t rate;
+  struct farm_mote *motes;
+};
+
+static struct farm farm;
+
+static volatile sig_atomic_t stop;
+
+/* per mote, in the child */
+static struct farm_mote *self;
+static netif_output_fn link_output;
+
+static void
+on_signal(int sig)
+{
+  LWIP_UNUSED_ARG(sig);
+  stop = 1;
+}
+
+static err_t
+count_input(struct pbuf *p, struct netif *inp)
+{
+  atomic_fetch_add_explicit(&self->rx_packets, 1, memory_order_relaxed);
+  return hc_input(p, inp);
+}
+
+static err_t
+count_output(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+  atomic_fetch_add_explicit(&self->tx_packets, 1, memory_order_relaxed);
+  return link_output(netif, p, ipaddr);
+}
+
+static void
+poll_slipif(void *arg)
+{
+  slipif_poll(arg);
+}
+
+static void
+pin_to_cpu(int cpu)
+{
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  if(sched_setaffinity(0, sizeof(cpus), &cpus) < 0)
+  {
+    perror("sched_setaffinity");
+  }
+}
+
+/* main.c with the mote's number in its address: 10.1.<i>.2/24 */
+static void
+run_mote(uint32_t i)
+{
+  static struct netif slipif1;
+  ptrdiff_t num_slip1 = FARM_DEVNUM;
+  ip4_addr_t ipaddr_slip1;
+  ip4_addr_t netmask_slip1;
+  ip4_addr_t gw_slip1;
+  char path[128];
+
+  self = &farm.motes[i];
+
+  if(farm.first_cpu >= 0)
+  {
+    pin_to_cpu(farm.first_cpu + i % farm.num_cpus);
+  }
+
+  snprintf(path, sizeof(path), "pty:%s/mote%u", farm.dir, i);
+  if(sio_set_path(FARM_DEVNUM, path, 1000000) < 0)
+  {
+    exit(1);
+  }
+
+  lwip_init();
+
+  IP4_ADDR(&ipaddr_slip1,
+           10,
+           1,
+           i,
+           2);
+  IP4_ADDR(&netmask_slip1,
+           255,
+           255,
+           255,
+           0);
+  IP4_ADDR(&gw_slip1,
+           10,
+           1,
+           i,
+           1);
+
+  struct netif *ret = netif_add(&slipif1,
+                                &ipaddr_slip1,
+                                &netmask_slip1,
+                                &gw_slip1,
+                                (void *)num_slip1,
+                                slipif_init,
+                                count_input);
+  if(ret != &slipif1)
+  {
+    exit(1);
+  }
+
+  netif_set_default(&slipif1);
+
+  netif_set_up(&slipif1);
+  netif_set_link_up(&slipif1);
+
+  hc_attach(&slipif1, 0);
+  link_output = slipif1.output;
+  slipif1.output = count_output;
+
+  udp_server_setup();
+  tcp_server_setup();
+
+  struct reactor reactor;
+  if(reactor_open(&reactor) < 0)
+  {
+    exit(1);
+  }
+  reactor_add_sio(&reactor, sio_fd_of(FARM_DEVNUM), poll_slipif, &slipif1);
+
+  while(1)
+  {
+    reactor_run_once(&reactor);
+  }
+}
+
+static int
+write_links(void)
+{
+  char path[128];
+  snprintf(path, sizeof(path), "%s/links", farm.dir);
+
+  FILE *file = fopen(path, "w");
+  if(!file)
+  {
+    perror(path);
+    return -1;
+  }
+
+  fprintf(file, "# icmp_server_dual_interface -f %s\n", path);
+  for(uint32_t i = 0; i < farm.num_motes; i++)
+  {
+    fprintf(file, "%s/mote%u,10.1.%u.1/24\n", farm.dir, i, i);
+  }
+
+  fclose(file);
+  return 0;
+}
+
+/* utime + stime in clock ticks, see proc(5) */
+static uint64_t
+proc_cpu_ticks(pid_t pid)
+{
+  char path[64];
+  char buf[512];
+  snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+
+  FILE *file = fopen(path, "r");
+  if(!file)
+  {
+    return 0;
+  }
+  size_t n = fread(buf, 1, sizeof(buf) - 1, file);
+  fclose(file);
+  buf[n] = '\0';
+
+  /* comm may contain spaces, fields continue after the last ')' */
+  char *p = strrchr(buf, ')');
+  unsigned long utime = 0;
+  unsigned long stime = 0;
+  if(!p ||
+     sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+            &utime, &stime) != 2)
+  {
+    return 0;
+  }
+  return utime + stime;
+}
+
+/* kB of one field of /proc/<pid>/smaps_rollup */
+static uint64_t
+proc_smaps_kb(pid_t pid, const char *field)
+{
+  char path[64];
+  char line[128];
+  size_t field_len = strlen(field);
+  uint64_t kb = 0;
+  snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", pid);
+
+  FILE *file = fopen(path, "r");
+  if(!file)
+  {
+    return 0;
+  }
+  while(fgets(line, sizeof(line), file))
+  {
+    if(strncmp(line, field, field_len) == 0 && line[field_len] == ':')
+    {
+      kb = strtoull(line + field_len + 1, NULL, 10);
+      break;
+    }
+  }
+  fclose(file);
+  return kb;
+}
+
+static uint64_t
+total_packets(void)
+{
+  uint64_t packets = 0;
+  for(uint32_t i = 0; i < farm.num_motes; i++)
+  {
+    packets += atomic_load_explicit(&farm.motes[i].rx_packets, memory_order_relaxed) +
+               atomic_load_explicit(&farm.motes[i].tx_packets, memory_order_relaxed);
+  }
+  return packets;
+}
+
+static uint64_t
+total_cpu_ticks(void)
+{
+  uint64_t ticks = 0;
+  for(uint32_t i = 0; i < farm.num_motes; i++)
+  {
+    ticks += proc_cpu_ticks(farm.motes[i].pid);
+  }
+  return ticks;
+}
+
+static double
+elapsed_s(const struct timespec *since)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - since->tv_sec) + (now.tv_nsec - since->tv_nsec) / 1e9;
+}
+
+static void
+report(double seconds, uint64_t packets, uint64_t cpu_ticks)
+{
+  double tick_s = 1.0 / sysconf(_SC_CLK_TCK);
+  double cpu_s = cpu_ticks * tick_s;
+  uint64_t private_kb = 0;
+  uint64_t pss_kb = 0;
+
+  for(uint32_t i = 0; i < farm.num_motes; i++)
+  {
+    private_kb += proc_smaps_kb(farm.motes[i].pid, "Private_Dirty");
+    pss_kb += proc_smaps_kb(farm.motes[i].pid, "Pss");
+  }
+
+  printf("motes=%u time=%.1fs\n", farm.num_motes, seconds);
+  printf("  memory per mote: %.1f kB private dirty, %.1f kB pss\n",
+         (double)private_kb / farm.num_motes,
+         (double)pss_kb / farm.num_motes);
+  printf("  packets: %.0f pkt/s in and out, %.1f pkt/s per mote\n",
+         packets / seconds,
+         packets / seconds / farm.num_motes);
+  printf("  cpu: %.1f%% of one core, %.1f%% per mote\n",
+         100.0 * cpu_s / seconds,
+         100.0 * cpu_s / seconds / farm.num_motes);
+
+  if(packets)
+  {
+    double cpu_per_packet = cpu_s / packets;
+    printf("  cpu per packet: %.2fus\n", cpu_per_packet * 1e6);
+    printf("  motes per core at %u pkt/s each: %.0f\n",
+           farm.rate,
+           1.0 / (cpu_per_packet * farm.rate));
+  } else {
+    printf("  no traffic, send some to 10.1.<i>.2 through the gateway\n");
+  }
+}
+
+static void
+usage(const char *name)
+{
+  fprintf(stderr,
+          "usage: %s [-n motes] [-d dir] [-c cpu] [-k cpus] [-t seconds] [-r rate]\n"
+          "  -n motes    number of virtual motes (default 16, max %u)\n"
+          "  -d dir      where the mote ptys and the links file go (default /tmp/farm)\n"
+          "  -c cpu      pin motes to cpu, cpu + 1, ... (default unpinned)\n"
+          "  -k cpus     number of cpus to spread the motes over with -c (default 1)\n"
+          "  -t seconds  run for seconds, 0 until SIGINT (default 0)\n"
+          "  -r rate     target pkt/s per mote for the sizing estimate (default 10)\n",
+          name,
+          FARM_MAX_MOTES);
+}
+
+int
+main(int argc, char **argv)
+{
+  farm.num_motes = 16;
+  farm.dir = "/tmp/farm";
+  farm.first_cpu = -1;
+  farm.num_cpus = 1;
+  farm.seconds = 0;
+  farm.rate = 10;
+
+  int opt;
+  while((opt = getopt(argc, argv, "n:d:c:k:t:r:")) != -1)
+  {
+    switch(opt)
+    {
+      case 'n':
+        farm.num_motes = strtoul(optarg, NULL, 10);
+        break;
+      case 'd':
+        farm.dir = optarg;
+        break;
+      case 'c':
+        farm.first_cpu = atoi(optarg);
+        break;
+      case 'k':
+        farm.num_cpus = strtoul(optarg, NULL, 10);
+        break;
+      case 't':
+        farm.seconds = strtoul(optarg, NULL, 10);
+        break;
+      case 'r':
+        farm.rate = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if(farm.num_motes < 1 || farm.num_motes > FARM_MAX_MOTES ||
+     farm.num_cpus < 1 || farm.rate < 1)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if(mkdir(farm.dir, 0755) < 0 && errno != EEXIST)
+  {
+    perror(farm.dir);
+    return 1;
+  }
+
+  /* counters are written by the motes and read here */
+  farm.motes = mmap(NULL,
+                    farm.num_motes * sizeof(struct farm_mote),
+                    PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS,
+                    -1,
+                    0);
+  if(farm.motes == MAP_FAILED)
+  {
+    perror("mmap");
+    return 1;
+  }
+
+  for(uint32_t i = 0; i < farm.num_motes; i++)
+  {
+    pid_t pid = fork();
+    if(pid < 0)
+    {
+      perror("fork");
+      farm.num_motes = i;
+      break;
+    }
+    if(pid == 0)
+    {
+      signal(SIGINT, SIG_DFL);
+      run_mote(i);
+    }
+    farm.motes[i].pid = pid;
+  }
+
+  if(write_links() < 0)
+  {
+    stop = 1;
+  }
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  printf("%u motes up, start the gateway with -f %s/links\n", farm.num_motes, farm.dir);
+  fflush(stdout);
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  uint64_t start_packets = total_packets();
+  uint64_t start_ticks = total_cpu_ticks();
+
+  while(!stop && (!farm.seconds || elapsed_s(&start) < farm.seconds))
+  {
+    sleep(1);
+  }
+
+  report(elapsed_s(&start),
+         total_packets() - start_packets,
+         total_cpu_ticks() - start_ticks);
+
+  for(uint32_t i = 0; i < farm.num_motes; i++)
+  {
+    kill(farm.motes[i].pid, SIGTERM);
+  }
+  while(wait(NULL) > 0)
+  {
+  }
+
+  return 0;
+}
@@ -0,0 +1,848 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+/* gateway <-> mote over a pty, socketpair or shared memory ring (-b),
+ * no hardware and no tun needed
+ *
+ * lwip keeps its state in globals, so each side gets its own process:
+ * the child is the mote (slipif, udp_server.c, tcp_server.c), the parent
+ * runs the gateway's serial path (slipvif, header compression) with a
+ * load generator on top instead of the tun interface
+ *
+ * udp and icmp keep -w probes in flight and measure every round trip,
+ * tcp streams into the mote for -d seconds and counts acked bytes, load
+ * does the same and pings the mote every BENCH_LOAD_PROBE_MS meanwhile;
+ * -q/-Q shape the gateway's side of the link, to see what the egress
+ * scheduler does for the pings behind the stream; -u puts the gateway's
+ * device on the io_uring, the syscalls its loop makes are counted either
+ * way (syscall_count.c)
+ *
+ * idle sends nothing for -d seconds and reports what the gateway's loop
+ * costs meanwhile; -P swaps the reactor for the loop it replaced, every
+ * device polled each BENCH_POLL_US, to compare idle cpu and round trips */
+
+#include "gateway/reactor.h"
+#include "gateway/sched.h"
+#include "link/hc.h"
+#include "link/lsec.h"
+#include "link/slipvif.h"
+#include "server/udp.h"
+#include "server/tcp.h"
+
+#include "arch/sio_pc.h"
+#include "arch/uring_pc.h"
+
+#include "lwip/init.h"
+#include "lwip/ip.h"
+#include "lwip/udp.h"
+#include "lwip/tcp.h"
+#include "lwip/raw.h"
+#include "lwip/icmp.h"
+#include "lwip/prot/ip4.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/timeouts.h"
+#include "netif/slipif.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define BENCH_GATEWAY_DEVNUM (0)
+#define BENCH_MOTE_DEVNUM (1)
+#define BENCH_ICMP_ID (0xBE4C)
+
+/* time for the header compression handshake before traffic starts */
+#define BENCH_WARMUP_MS (1500)
+
+/* probes without an answer for this long count as lost */
+#define BENCH_LOSS_TIMEOUT_MS (200)
+
+#define BENCH_MAX_SIZE (1400)
+
+#define BENCH_LOAD_PROBE_MS (50)
+
+/* the sleep of the gateway's loop before the reactor */
+#define BENCH_POLL_US (100)
+
+/* syscall_count.c */
+extern uint64_t syscall_count;
+
+enum bench_mode
+{
+  BENCH_UDP,
+  BENCH_ICMP,
+  BENCH_TCP,
+  BENCH_LOAD,
+  BENCH_IDLE,
+};
+
+struct bench_probe
+{
+  u32_t seq;
+  uint64_t t_ns;
+};
+
+struct bench
+{
+  enum bench_mode mode;
+  u32_t count;
+  u32_t size;
+  u32_t window;
+  u32_t seconds;
+  int compress;
+  int secure;
+  enum sio_pair_kind link;
+  struct sched_config sched;
+  int uring;
+  int poll_loop;
+
+  u32_t sent;
+  u32_t received;
+  u32_t in_flight;
+  u32_t progress;
+  uint64_t bytes;
+  uint64_t *rtt_ns;
+
+  uint64_t start_ns;
+  uint64_t end_ns;
+  u32_t link_packets;
+  int running;
+  int done;
+
+  ip_addr_t mote_addr;
+  struct udp_pcb *udp;
+  struct raw_pcb *raw;
+  struct tcp_pcb *tcp;
+};
+
+static struct bench bench;
+
+static u8_t tx_data[BENCH_MAX_SIZE];
+
+static netif_output_fn link_output;
+
+static const struct lsec_config bench_sec = {
+  .key = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+           0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f },
+  .initiator = 0,
+};
+
+static uint64_t
+now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t
+cpu_ns(const struct rusage *ru)
+{
+  return (uint64_t)(ru->ru_utime.tv_sec + ru->ru_stime.tv_sec) * 1000000000ULL +
+         (uint64_t)(ru->ru_utime.tv_usec + ru->ru_stime.tv_usec) * 1000ULL;
+}
+
+static void
+poll_slipif(void *arg)
+{
+  slipif_poll(arg);
+}
+
+static void
+poll_slipvif(void *arg)
+{
+  slipvif_poll(arg);
+}
+
+static struct netif *
+add_link(struct netif *netif, ptrdiff_t devnum, u8_t host, netif_init_fn init)
+{
+  ip4_addr_t ipaddr;
+  ip4_addr_t netmask;
+  ip4_addr_t gw;
+  IP4_ADDR(&ipaddr,
+           10,
+           1,
+           0,
+           host);
+  IP4_ADDR(&netmask,
+           255,
+           255,
+           0,
+           0);
+  IP4_ADDR(&gw,
+           10,
+           1,
+           0,
+           1);
+
+  if(netif_add(netif,
+               &ipaddr,
+               &netmask,
+               &gw,
+               (void *)devnum,
+               init,
+               hc_input) != netif)
+  {
+    return NULL;
+  }
+
+  netif_set_default(netif);
+  netif_set_up(netif);
+  netif_set_link_up(netif);
+  return netif;
+}
+
+static void
+run_mote(void)
+{
+  static struct netif mote;
+  struct reactor reactor;
+
+  lwip_init();
+
+  if(!add_link(&mote, BENCH_MOTE_DEVNUM, 2, slipif_init) || reactor_open(&reactor) < 0)
+  {
+    exit(1);
+  }
+
+  if(bench.secure)
+  {
+    lsec_attach(&mote, &bench_sec);
+  }
+  if(bench.compress)
+  {
+    hc_attach(&mote, 0);
+  }
+
+  udp_server_setup();
+  tcp_server_setup();
+
+  reactor_add_sio(&reactor, sio_fd_of(BENCH_MOTE_DEVNUM), poll_slipif, &mote);
+  while(1)
+  {
+    reactor_run_once(&reactor);
+  }
+}
+
+/* counts what actually goes onto the link, for tcp that is the only
+ * packet rate there is */
+static err_t
+count_output(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+  if(bench.running)
+  {
+    bench.link_packets++;
+  }
+  return link_output(netif, p, ipaddr);
+}
+
+static void
+bench_finish(void)
+{
+  if(!bench.done)
+  {
+    bench.end_ns = now_ns();
+    bench.running = 0;
+    bench.done = 1;
+  }
+}
+
+static void
+bench_stop_timeout(void *arg)
+{
+  LWIP_UNUSED_ARG(arg);
+  bench_finish();
+}
+
+static void
+bench_send_probe(void)
+{
+  struct bench_probe probe = { .seq = bench.sent, .t_ns = now_ns() };
+  struct pbuf *p;
+
+  if(bench.mode == BENCH_UDP)
+  {
+    p = pbuf_alloc(PBUF_TRANSPORT, bench.size, PBUF_RAM);
+    if(!p)
+    {
+      return;
+    }
+    pbuf_take(p, tx_data, bench.size);
+    pbuf_take(p, &probe, sizeof(probe));
+    udp_send(bench.udp, p);
+  } else {
+    struct icmp_echo_hdr echo;
+    p = pbuf_alloc(PBUF_IP, sizeof(echo) + bench.size, PBUF_RAM);
+    if(!p)
+    {
+      return;
+    }
+    echo.type = ICMP_ECHO;
+    echo.code = 0;
+    echo.chksum = 0;
+    echo.id = BENCH_ICMP_ID;
+    echo.seqno = lwip_htons((u16_t)bench.sent);
+    pbuf_take(p, &echo, sizeof(echo));
+    pbuf_take_at(p, tx_data, bench.size, sizeof(echo));
+    pbuf_take_at(p, &probe, sizeof(probe), sizeof(echo));
+    echo.chksum = inet_chksum_pbuf(p);
+    pbuf_take(p, &echo, sizeof(echo));
+    raw_sendto(bench.raw, p, &bench.mote_addr);
+  }
+
+  pbuf_free(p);
+  bench.sent++;
+  bench.in_flight++;
+}
+
+static void
+bench_fill_window(void)
+{
+  while(bench.running &&
+        bench.in_flight < bench.window &&
+        bench.sent < bench.count)
+  {
+    bench_send_probe();
+  }
+
+  if(bench.sent == bench.count && bench.in_flight == 0)
+  {
+    bench_finish();
+  }
+}
+
+static void
+bench_loss_timeout(void *arg)
+{
+  LWIP_UNUSED_ARG(arg);
+
+  if(!bench.running)
+  {
+    return;
+  }
+
+  // nothing came back since the last check, the window is lost
+  if(bench.progress == bench.received)
+  {
+    bench.in_flight = 0;
+    bench_fill_window();
+  }
+  bench.progress = bench.received;
+
+  sys_timeout(BENCH_LOSS_TIMEOUT_MS, bench_loss_timeout, NULL);
+}
+
+static void
+bench_reply(const struct pbuf *p, u16_t offset, u16_t len)
+{
+  struct bench_probe probe;
+
+  if(!bench.running ||
+     pbuf_copy_partial(p, &probe, sizeof(probe), offset) != sizeof(probe) ||
+     probe.seq >= bench.sent)
+  {
+    return;
+  }
+
+  bench.rtt_ns[bench.received++] = now_ns() - probe.t_ns;
+  if(bench.in_flight)
+  {
+    bench.in_flight--;
+  }
+  if(bench.mode == BENCH_LOAD)
+  {
+    // paced probes, the goodput is the stream's
+    return;
+  }
+  bench.bytes += len;
+  bench_fill_window();
+}
+
+static void
+bench_load_probe(void *arg)
+{
+  LWIP_UNUSED_ARG(arg);
+
+  if(bench.running && bench.sent < bench.count)
+  {
+    bench_send_probe();
+    sys_timeout(BENCH_LOAD_PROBE_MS, bench_load_probe, NULL);
+  }
+}
+
+static void
+udp_reply_callback(void *arg, struct udp_pcb *pcb, struct pbuf *p,
+                   const ip_addr_t *addr, u16_t port)
+{
+  LWIP_UNUSED_ARG(arg);
+  LWIP_UNUSED_ARG(pcb);
+  LWIP_UNUSED_ARG(addr);
+  LWIP_UNUSED_ARG(port);
+
+  bench_reply(p, 0, p->tot_len);
+  pbuf_free(p);
+}
+
+static u8_t
+icmp_reply_callback(void *arg, struct raw_pcb *pcb, struct pbuf *p,
+                    const ip_addr_t *addr)
+{
+  struct icmp_echo_hdr echo;
+  LWIP_UNUSED_ARG(arg);
+  LWIP_UNUSED_ARG(pcb);
+  LWIP_UNUSED_ARG(addr);
+
+  u16_t hlen = IPH_HL_BYTES((const struct ip_hdr *)p->payload);
+  if(pbuf_copy_partial(p, &echo, sizeof(echo), hlen) != sizeof(echo) ||
+     echo.type != ICMP_ER ||
+     echo.id != BENCH_ICMP_ID)
+  {
+    return 0;
+  }
+
+  bench_reply(p, hlen + sizeof(echo), p->tot_len - hlen - sizeof(echo));
+  pbuf_free(p);
+  return 1;
+}
+
+static void
+bench_tcp_fill(struct tcp_pcb *pcb)
+{
+  while(bench.running && tcp_sndbuf(pcb) > 0)
+  {
+    u16_t len = LWIP_MIN(tcp_sndbuf(pcb), bench.size);
+    if(tcp_write(pcb, tx_data, len, 0) != ERR_OK)
+    {
+      break;
+    }
+    bench.sent++;
+  }
+  tcp_output(pcb);
+}
+
+static err_t
+tcp_sent_callback(void *arg, struct tcp_pcb *pcb, u16_t len)
+{
+  LWIP_UNUSED_ARG(arg);
+
+  if(bench.running)
+  {
+    bench.bytes += len;
+  }
+  bench_tcp_fill(pcb);
+  return ERR_OK;
+}
+
+static err_t
+tcp_recv_callback(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  LWIP_UNUSED_ARG(arg);
+  LWIP_UNUSED_ARG(err);
+
+  if(!p)
+  {
+    bench_finish();
+    return ERR_OK;
+  }
+
+  // the sink sends nothing back, whatever arrives is dropped
+  tcp_recved(pcb, p->tot_len);
+  pbuf_free(p);
+  return ERR_OK;
+}
+
+static void
+tcp_err_callback(void *arg, err_t err)
+{
+  LWIP_UNUSED_ARG(arg);
+
+  fprintf(stderr, "tcp connection failed: %d\n", err);
+  bench.tcp = NULL;
+  bench_finish();
+}
+
+static err_t
+tcp_connected_callback(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+  LWIP_UNUSED_ARG(arg);
+
+  if(err != ERR_OK)
+  {
+    bench_finish();
+    return err;
+  }
+
+  bench.start_ns = now_ns();
+  bench.running = 1;
+  sys_timeout(bench.seconds * 1000, bench_stop_timeout, NULL);
+  if(bench.mode == BENCH_LOAD)
+  {
+    bench_load_probe(NULL);
+  }
+  bench_tcp_fill(pcb);
+  return ERR_OK;
+}
+
+static void
+bench_start(void *arg)
+{
+  LWIP_UNUSED_ARG(arg);
+
+  switch(bench.mode)
+  {
+    case BENCH_UDP:
+      bench.udp = udp_new();
+      udp_bind(bench.udp, IP_ADDR_ANY, 0);
+      udp_connect(bench.udp, &bench.mote_addr, USECASE_SERVER_PORT);
+      udp_recv(bench.udp, udp_reply_callback, NULL);
+      break;
+    case BENCH_ICMP:
+      bench.raw = raw_new(IP_PROTO_ICMP);
+      raw_bind(bench.raw, IP_ADDR_ANY);
+      raw_recv(bench.raw, icmp_reply_callback, NULL);
+      break;
+    case BENCH_LOAD:
+      bench.raw = raw_new(IP_PROTO_ICMP);
+      raw_bind(bench.raw, IP_ADDR_ANY);
+      raw_recv(bench.raw, icmp_reply_callback, NULL);
+      /* fall through */
+    case BENCH_TCP:
+      bench.tcp = tcp_new();
+      tcp_err(bench.tcp, tcp_err_callback);
+      tcp_recv(bench.tcp, tcp_recv_callback);
+      tcp_sent(bench.tcp, tcp_sent_callback);
+      tcp_connect(bench.tcp, &bench.mote_addr, USECASE_TCP_SINK_PORT, tcp_connected_callback);
+      // running starts once connected, give up if that never happens
+      sys_timeout((bench.seconds + 5) * 1000, bench_stop_timeout, NULL);
+      return;
+    case BENCH_IDLE:
+      bench.start_ns = now_ns();
+      bench.running = 1;
+      sys_timeout(bench.seconds * 1000, bench_stop_timeout, NULL);
+      return;
+  }
+
+  bench.start_ns = now_ns();
+  bench.running = 1;
+  sys_timeout(bench.seconds * 1000, bench_stop_timeout, NULL);
+  sys_timeout(BENCH_LOSS_TIMEOUT_MS, bench_loss_timeout, NULL);
+  bench_fill_window();
+}
+
+static int
+compare_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static double
+percentile_us(double p)
+{
+  if(!bench.received)
+  {
+    return 0.0;
+  }
+  u32_t i = (u32_t)(p * (bench.received - 1) + 0.5);
+  return bench.rtt_ns[i] / 1000.0;
+}
+
+static void
+bench_report(uint64_t gateway_cpu_ns,
+             uint64_t mote_cpu_ns,
+             uint64_t syscalls,
+             uint64_t wakeups)
+{
+  static const char *modes[] = { "udp", "icmp", "tcp", "load", "idle" };
+  static const char *links[] = { "pty", "socket", "ring" };
+  double seconds = (bench.end_ns - bench.start_ns) / 1e9;
+  int stream = bench.mode == BENCH_TCP || bench.mode == BENCH_LOAD;
+  u32_t packets = stream ? bench.link_packets : bench.received;
+
+  qsort(bench.rtt_ns, bench.received, sizeof(uint64_t), compare_u64);
+
+  printf("%s link=%s size=%u window=%u hc=%s sec=%s shaper=%s io=%s time=%.2fs\n",
+         modes[bench.mode],
+         links[bench.link],
+         bench.size,
+         bench.window,
+         bench.compress ? "on" : "off",
+         bench.secure ? "on" : "off",
+         !bench.sched.rate ? "off" : (bench.sched.fifo ? "fifo" : "fq_codel"),
+         bench.poll_loop ? "poll" : (uring_enabled() ? "uring" : "epoll"),
+         seconds);
+  if(bench.mode == BENCH_IDLE)
+  {
+    printf("  idle: gateway cpu %.3f%%, %.0f wakeups/s, %.0f syscalls/s\n",
+           seconds > 0 ? gateway_cpu_ns / 1e9 / seconds * 100.0 : 0.0,
+           seconds > 0 ? wakeups / seconds : 0.0,
+           seconds > 0 ? syscalls / seconds : 0.0);
+    return;
+  }
+  if(stream)
+  {
+    printf("  segments: %u (link packets from the gateway)\n", packets);
+  }
+  if(bench.mode == BENCH_LOAD)
+  {
+    printf("  pings: sent=%u received=%u\n", bench.sent, bench.received);
+    printf("  ping rtt under load: p50=%.1fus p99=%.1fus max=%.1fus\n",
+           percentile_us(0.50),
+           percentile_us(0.99),
+           percentile_us(1.0));
+  } else if(!stream) {
+    printf("  probes: sent=%u received=%u lost=%u\n",
+           bench.sent,
+           bench.received,
+           bench.sent - bench.received);
+    printf("  rtt: p50=%.1fus p99=%.1fus p999=%.1fus\n",
+           percentile_us(0.50),
+           percentile_us(0.99),
+           percentile_us(0.999));
+  }
+  printf("  rate: %.0f pkt/s, goodput %.3f Mbit/s\n",
+         seconds > 0 ? packets / seconds : 0.0,
+         seconds > 0 ? bench.bytes * 8 / seconds / 1e6 : 0.0);
+  printf("  cpu: gateway %.2fus/pkt, mote %.2fus/pkt\n",
+         packets ? gateway_cpu_ns / 1000.0 / packets : 0.0,
+         packets ? mote_cpu_ns / 1000.0 / packets : 0.0);
+  printf("  syscalls: gateway %llu, %.2f/pkt\n",
+         (unsigned long long)syscalls,
+         packets ? (double)syscalls / packets : 0.0);
+}
+
+static void
+usage(const char *name)
+{
+  fprintf(stderr,
+          "usage: %s [-m udp|icmp|tcp|load|idle] [-b pty|socket|ring] [-n count] [-s size]\n"
+          "          [-w window] [-d seconds] [-C] [-e] [-q|-Q rate] [-u] [-P]\n"
+          "  -m mode     traffic, default udp; load is tcp with pings alongside,\n"
+          "              idle sends nothing and reports the gateway's idle cost\n"
+          "  -b link     what joins gateway and mote, default pty\n"
+          "  -n count    udp/icmp probes to send (default 10000)\n"
+          "  -s size     payload bytes per probe or tcp write (default 64)\n"
+          "  -w window   udp/icmp probes in flight (default 1)\n"
+          "  -d seconds  tcp duration, udp/icmp upper bound (default 10)\n"
+          "  -C          no header compression on the link\n"
+          "  -e          AES-CCM link encryption, as with a gateway link key\n"
+          "  -q rate     shape the gateway's side to rate bytes/s, with\n"
+          "              priority for small packets, fair queueing and codel\n"
+          "  -Q rate     the same rate through a plain fifo\n"
+          "  -u          the gateway's reads and writes go through an io_uring\n"
+          "              (pty only, the others stay on epoll)\n"
+          "  -P          the gateway polls its device every 100us instead of\n"
+          "              sleeping in the reactor, the loop the reactor replaced\n",
+          name);
+}
+
+int
+main(int argc, char **argv)
+{
+  bench.mode = BENCH_UDP;
+  bench.count = 10000;
+  bench.size = 64;
+  bench.window = 1;
+  bench.seconds = 10;
+  bench.compress = 1;
+  bench.link = SIO_PAIR_PTY;
+
+  int opt;
+  while((opt = getopt(argc, argv, "m:b:n:s:w:d:Ceq:Q:uP")) != -1)
+  {
+    switch(opt)
+    {
+      case 'm':
+        if(strcmp(optarg, "udp") == 0)
+        {
+          bench.mode = BENCH_UDP;
+        } else if(strcmp(optarg, "icmp") == 0) {
+          bench.mode = BENCH_ICMP;
+        } else if(strcmp(optarg, "tcp") == 0) {
+          bench.mode = BENCH_TCP;
+        } else if(strcmp(optarg, "load") == 0) {
+          bench.mode = BENCH_LOAD;
+        } else if(strcmp(optarg, "idle") == 0) {
+          bench.mode = BENCH_IDLE;
+        } else {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'b':
+        if(strcmp(optarg, "pty") == 0)
+        {
+          bench.link = SIO_PAIR_PTY;
+        } else if(strcmp(optarg, "socket") == 0) {
+          bench.link = SIO_PAIR_SOCKET;
+        } else if(strcmp(optarg, "ring") == 0) {
+          bench.link = SIO_PAIR_RING;
+        } else {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'n':
+        bench.count = strtoul(optarg, NULL, 10);
+        break;
+      case 's':
+        bench.size = strtoul(optarg, NULL, 10);
+        break;
+      case 'w':
+        bench.window = strtoul(optarg, NULL, 10);
+        break;
+      case 'd':
+        bench.seconds = strtoul(optarg, NULL, 10);
+        break;
+      case 'C':
+        bench.compress = 0;
+        break;
+      case 'e':
+        bench.secure = 1;
+        break;
+      case 'q':
+      case 'Q':
+        bench.sched.rate = strtoul(optarg, NULL, 10);
+        bench.sched.fifo = opt == 'Q';
+        break;
+      case 'u':
+        bench.uring = 1;
+        break;
+      case 'P':
+        bench.poll_loop = 1;
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if(bench.size < sizeof(struct bench_probe) || bench.size > BENCH_MAX_SIZE ||
+     bench.window < 1 || bench.count < 1 || bench.seconds < 1)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  for(u32_t i = 0; i < sizeof(tx_data); i++)
+  {
+    tx_data[i] = (u8_t)i;
+  }
+
+  if(sio_pair(BENCH_GATEWAY_DEVNUM, BENCH_MOTE_DEVNUM, bench.link) < 0)
+  {
+    return 1;
+  }
+
+  pid_t mote = fork();
+  if(mote < 0)
+  {
+    perror("fork");
+    return 1;
+  }
+  if(mote == 0)
+  {
+    run_mote();
+  }
+
+  bench.rtt_ns = calloc(bench.count, sizeof(uint64_t));
+  if(!bench.rtt_ns)
+  {
+    return 1;
+  }
+
+  static struct netif gateway;
+  struct reactor reactor;
+
+  lwip_init();
+
+  // before the device is opened, which then goes onto the ring
+  if(bench.uring && !bench.poll_loop && uring_init() < 0)
+  {
+    fprintf(stderr, "no io_uring, staying on epoll\n");
+  }
+
+  if(!add_link(&gateway, BENCH_GATEWAY_DEVNUM, 1, slipvif_init) || reactor_open(&reactor) < 0)
+  {
+    kill(mote, SIGKILL);
+    return 1;
+  }
+
+  if(bench.secure)
+  {
+    struct lsec_config sec = bench_sec;
+    sec.initiator = 1;
+    lsec_attach(&gateway, &sec);
+  }
+  if(bench.compress)
+  {
+    hc_attach(&gateway, 1);
+  }
+  link_output = gateway.output;
+  gateway.output = count_output;
+  if(bench.sched.rate)
+  {
+    // above the counter, which then sees what the shaper lets through
+    sched_attach(&gateway, &bench.sched);
+  }
+
+  IP4_ADDR(ip_2_ip4(&bench.mote_addr), 10, 1, 0, 2);
+  reactor_add_sio(&reactor, sio_fd_of(BENCH_GATEWAY_DEVNUM), poll_slipvif, &gateway);
+  if(bench.secure)
+  {
+    // done long before the warmup ends, no probe is lost to it
+    lsec_handshake(&gateway);
+  }
+  sys_timeout(BENCH_WARMUP_MS, bench_start, NULL);
+
+  struct rusage before;
+  struct rusage after;
+  uint64_t syscalls_before = 0;
+  int measuring = 0;
+  while(!bench.done)
+  {
+    if(!measuring && bench.running)
+    {
+      getrusage(RUSAGE_SELF, &before);
+      syscalls_before = syscall_count;
+      measuring = 1;
+    }
+    if(bench.poll_loop)
+    {
+      struct timespec nap = { .tv_sec = 0, .tv_nsec = BENCH_POLL_US * 1000L };
+      sys_check_timeouts();
+      slipvif_poll(&gateway);
+      nanosleep(&nap, NULL);
+    } else {
+      reactor_run_once(&reactor);
+    }
+  }
+  getrusage(RUSAGE_SELF, &after);
+  uint64_t syscalls = syscall_count;
+
+  struct rusage mote_usage;
+  int status;
+  kill(mote, SIGTERM);
+  wait4(mote, &status, 0, &mote_usage);
+
+  if(!measuring)
+  {
+    before = after;
+    syscalls_before = syscalls;
+  }
+
+  bench_report(cpu_ns(&after) - cpu_ns(&before),
+               cpu_ns(&mote_usage),
+               syscalls - syscalls_before,
+               after.ru_nvcsw - before.ru_nvcsw);
+
+  return (bench.received || bench.bytes || bench.mode == BENCH_IDLE) ? 0 : 1;
+}
@@ -0,0 +1,104 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+// bytes per cycle of slip_escape/slip_decode for every implementation the
+// cpu supports, on random payloads and on all-escape payloads
+
+#include "link/slip_codec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <x86intrin.h>
+
+#define PAYLOAD_LEN (1500)
+#define ROUNDS (20000)
+
+static uint8_t payload[PAYLOAD_LEN];
+static uint8_t encoded[SLIP_ENCODED_MAX(PAYLOAD_LEN)];
+static uint8_t decoded[PAYLOAD_LEN];
+
+static double
+bench_escape(size_t *encoded_len)
+{
+  uint64_t start = __rdtsc();
+  for(int i = 0; i < ROUNDS; i++)
+  {
+    encoded[0] = SLIP_END;
+    *encoded_len = 1 + slip_escape(encoded + 1, payload, PAYLOAD_LEN);
+    encoded[(*encoded_len)++] = SLIP_END;
+    __asm__ volatile("" ::: "memory");
+  }
+  uint64_t cycles = __rdtsc() - start;
+  return (double)PAYLOAD_LEN * ROUNDS / cycles;
+}
+
+static double
+bench_decode(size_t encoded_len)
+{
+  struct slip_decoder dec;
+
+  uint64_t start = __rdtsc();
+  for(int i = 0; i < ROUNDS; i++)
+  {
+    const uint8_t *in = encoded;
+    size_t in_len = encoded_len;
+    slip_decoder_reset(&dec, decoded, sizeof(decoded));
+    if(slip_decode(&dec, &in, &in_len) != SLIP_DECODE_FRAME ||
+       dec.frame_len != PAYLOAD_LEN)
+    {
+      fprintf(stderr, "decode mismatch\n");
+      exit(1);
+    }
+    __asm__ volatile("" ::: "memory");
+  }
+  uint64_t cycles = __rdtsc() - start;
+
+  if(memcmp(decoded, payload, PAYLOAD_LEN))
+  {
+    fprintf(stderr, "round trip mismatch\n");
+    exit(1);
+  }
+
+  return (double)PAYLOAD_LEN * ROUNDS / cycles;
+}
+
+static void
+bench_payload(const char *name)
+{
+  static const char *impl_names[] = { "scalar", "sse2", "avx2" };
+
+  for(int impl = SLIP_CODEC_SCALAR; impl <= SLIP_CODEC_AVX2; impl++)
+  {
+    if((int)slip_codec_select(impl) != impl)
+    {
+      continue;
+    }
+
+    size_t encoded_len;
+    double enc = bench_escape(&encoded_len);
+    double dec = bench_decode(encoded_len);
+    printf("%-10s %-6s encode %6.3f B/cycle  decode %6.3f B/cycle\n",
+           name, impl_names[impl], enc, dec);
+  }
+}
+
+int
+main(void)
+{
+  srand(1);
+  for(int i = 0; i < PAYLOAD_LEN; i++)
+  {
+    payload[i] = rand();
+  }
+  bench_payload("random");
+
+  for(int i = 0; i < PAYLOAD_LEN; i++)
+  {
+    payload[i] = (i & 1) ? SLIP_END : SLIP_ESC;
+  }
+  bench_payload("all-escape");
+
+  return 0;
+}
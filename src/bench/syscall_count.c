@@ -0,0 +1,145 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+/* pty_bench is linked with --wrap for the calls the gateway's loop makes
+ * into the kernel, each one lands here and is counted; calls libc makes
+ * internally are not seen, the loop's own are all there is on this path
+ *
+ * syscall() carries io_uring_enter and io_uring_register */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <time.h>
+
+uint64_t syscall_count;
+
+ssize_t __real_read(int fd, void *buf, size_t count);
+ssize_t __real_write(int fd, const void *buf, size_t count);
+ssize_t __real_writev(int fd, const struct iovec *iov, int iovcnt);
+ssize_t __real_send(int fd, const void *buf, size_t len, int flags);
+ssize_t __real_recv(int fd, void *buf, size_t len, int flags);
+int __real_poll(struct pollfd *fds, nfds_t nfds, int timeout);
+int __real_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout);
+int __real_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+int __real_timerfd_settime(int fd,
+                           int flags,
+                           const struct itimerspec *new_value,
+                           struct itimerspec *old_value);
+int __real_eventfd_read(int fd, eventfd_t *value);
+int __real_eventfd_write(int fd, eventfd_t value);
+int __real_nanosleep(const struct timespec *req, struct timespec *rem);
+long __real_syscall(long number, ...);
+
+ssize_t
+__wrap_read(int fd, void *buf, size_t count)
+{
+  syscall_count++;
+  return __real_read(fd, buf, count);
+}
+
+ssize_t
+__wrap_write(int fd, const void *buf, size_t count)
+{
+  syscall_count++;
+  return __real_write(fd, buf, count);
+}
+
+ssize_t
+__wrap_writev(int fd, const struct iovec *iov, int iovcnt)
+{
+  syscall_count++;
+  return __real_writev(fd, iov, iovcnt);
+}
+
+ssize_t
+__wrap_send(int fd, const void *buf, size_t len, int flags)
+{
+  syscall_count++;
+  return __real_send(fd, buf, len, flags);
+}
+
+ssize_t
+__wrap_recv(int fd, void *buf, size_t len, int flags)
+{
+  syscall_count++;
+  return __real_recv(fd, buf, len, flags);
+}
+
+int
+__wrap_poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+  syscall_count++;
+  return __real_poll(fds, nfds, timeout);
+}
+
+int
+__wrap_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout)
+{
+  syscall_count++;
+  return __real_epoll_wait(epfd, events, maxevents, timeout);
+}
+
+int
+__wrap_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
+{
+  syscall_count++;
+  return __real_epoll_ctl(epfd, op, fd, event);
+}
+
+int
+__wrap_timerfd_settime(int fd,
+                       int flags,
+                       const struct itimerspec *new_value,
+                       struct itimerspec *old_value)
+{
+  syscall_count++;
+  return __real_timerfd_settime(fd, flags, new_value, old_value);
+}
+
+int
+__wrap_eventfd_read(int fd, eventfd_t *value)
+{
+  syscall_count++;
+  return __real_eventfd_read(fd, value);
+}
+
+int
+__wrap_eventfd_write(int fd, eventfd_t value)
+{
+  syscall_count++;
+  return __real_eventfd_write(fd, value);
+}
+
+int
+__wrap_nanosleep(const struct timespec *req, struct timespec *rem)
+{
+  syscall_count++;
+  return __real_nanosleep(req, rem);
+}
+
+/* no syscall takes more than six arguments, the kernel ignores the ones
+ * a call does not use */
+long
+__wrap_syscall(long number, ...)
+{
+  va_list ap;
+  long arg[6];
+
+  va_start(ap, number);
+  for(int i = 0; i < 6; i++)
+  {
+    arg[i] = va_arg(ap, long);
+  }
+  va_end(ap);
+
+  syscall_count++;
+  return __real_syscall(number, arg[0], arg[1], arg[2], arg[3], arg[4], arg[5]);
+}
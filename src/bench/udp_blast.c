@@ -0,0 +1,426 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+/* host side of src/blast_server.c over the kernel's udp, through the
+ * gateway's tun like any other client
+ *
+ * sink measures the uplink (the mote counts and reports), source the
+ * downlink, echo the round trip; each run prints goodput, loss,
+ * reordering and jitter for the size and rate under test */
+
+#include "server/blast.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#define BLAST_MAX_SIZE (1472)
+
+/* how long the mote gets to deliver stragglers and answer requests */
+#define BLAST_DRAIN_MS (1000)
+#define BLAST_REQUEST_TRIES (5)
+
+struct blast_stats
+{
+  uint32_t packets;
+  uint64_t bytes;
+  uint32_t next_seq;
+  uint32_t reordered;
+  uint32_t duplicates;
+  uint64_t first_ns;
+  uint64_t last_ns;
+  int64_t transit_us;
+  double jitter_us;
+  uint8_t *seen;
+  uint64_t *rtt_ns;
+};
+
+struct blast
+{
+  enum blast_mode mode;
+  uint32_t size;
+  uint32_t rate;
+  uint32_t seconds;
+  uint32_t count;
+  uint32_t session;
+  int fd;
+  struct blast_stats stats;
+};
+
+static struct blast blast;
+
+static uint8_t tx_buf[BLAST_MAX_SIZE];
+static uint8_t rx_buf[BLAST_MAX_SIZE];
+
+static uint64_t
+now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+sleep_until_ns(uint64_t t_ns)
+{
+  struct timespec ts = { t_ns / 1000000000ULL, t_ns % 1000000000ULL };
+  while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+  {
+  }
+}
+
+static void
+blast_send(enum blast_mode mode, uint32_t seq, uint32_t size)
+{
+  struct blast_hdr *hdr = (struct blast_hdr *)tx_buf;
+
+  memset(hdr, 0, sizeof(*hdr));
+  hdr->mode = mode;
+  hdr->session = htonl(blast.session);
+  hdr->seq = htonl(seq);
+  hdr->ts_us = htonl((uint32_t)(now_ns() / 1000));
+  if(mode == BLAST_SOURCE)
+  {
+    hdr->size = htons(blast.size);
+    hdr->rate = htonl(blast.rate);
+    hdr->count = htonl(blast.count);
+  }
+
+  if(send(blast.fd, tx_buf, size, 0) < 0 && errno != ENOBUFS)
+  {
+    perror("udp_blast: send");
+  }
+}
+
+/* next datagram of our session within timeout_ms, its length or -1 */
+static ssize_t
+blast_recv(int timeout_ms, uint64_t *t_ns)
+{
+  struct pollfd pfd = { .fd = blast.fd, .events = POLLIN };
+
+  while(poll(&pfd, 1, timeout_ms) > 0)
+  {
+    ssize_t n = recv(blast.fd, rx_buf, sizeof(rx_buf), 0);
+    *t_ns = now_ns();
+
+    const struct blast_hdr *hdr = (const struct blast_hdr *)rx_buf;
+    if(n >= (ssize_t)sizeof(*hdr) && ntohl(hdr->session) == blast.session)
+    {
+      return n;
+    }
+  }
+  return -1;
+}
+
+/* loss, order and rfc 3550 jitter of what arrived here, against the
+ * sender's timestamps */
+static void
+blast_count(const struct blast_hdr *hdr, ssize_t len, uint64_t t_ns)
+{
+  struct blast_stats *s = &blast.stats;
+  uint32_t seq = ntohl(hdr->seq);
+
+  if(seq < blast.count)
+  {
+    if(s->seen[seq])
+    {
+      s->duplicates++;
+      return;
+    }
+    s->seen[seq] = 1;
+  }
+
+  int64_t transit_us = (int64_t)(uint32_t)(t_ns / 1000) - ntohl(hdr->ts_us);
+  if(s->packets)
+  {
+    double d = (double)(transit_us - s->transit_us);
+    s->jitter_us += ((d < 0 ? -d : d) - s->jitter_us) / 16;
+  } else {
+    s->first_ns = t_ns;
+  }
+  s->transit_us = transit_us;
+
+  s->packets++;
+  s->bytes += len;
+  s->last_ns = t_ns;
+  if(seq < s->next_seq)
+  {
+    s->reordered++;
+  } else {
+    s->next_seq = seq + 1;
+  }
+}
+
+static void
+blast_print(const char *direction, uint32_t sent, uint32_t packets, uint64_t bytes,
+            uint32_t reordered, double jitter_us, double seconds)
+{
+  uint32_t lost = (sent > packets) ? sent - packets : 0;
+
+  printf("%s size=%u rate=%u/s\n", direction, blast.size, blast.rate);
+  printf("  datagrams: sent=%u received=%u lost=%u (%.2f%%) reordered=%u\n",
+         sent,
+         packets,
+         lost,
+         sent ? 100.0 * lost / sent : 0.0,
+         reordered);
+  printf("  goodput: %.1f kbit/s over %.2fs\n",
+         seconds > 0 ? bytes * 8 / seconds / 1e3 : 0.0,
+         seconds);
+  printf("  jitter: %.0fus\n", jitter_us);
+}
+
+static int
+blast_sink(void)
+{
+  uint64_t start = now_ns();
+  for(uint32_t seq = 0; seq < blast.count; seq++)
+  {
+    sleep_until_ns(start + (uint64_t)seq * 1000000000ULL / blast.rate);
+    blast_send(BLAST_SINK, seq, blast.size);
+  }
+
+  // stragglers first, then the mote's counts
+  usleep(BLAST_DRAIN_MS * 1000);
+  for(int i = 0; i < BLAST_REQUEST_TRIES; i++)
+  {
+    blast_send(BLAST_REPORT, 0, sizeof(struct blast_hdr));
+
+    uint64_t t_ns;
+    ssize_t n = blast_recv(BLAST_DRAIN_MS, &t_ns);
+    const struct blast_hdr *hdr = (const struct blast_hdr *)rx_buf;
+    if(n < (ssize_t)(sizeof(*hdr) + sizeof(struct blast_report)) || hdr->mode != BLAST_REPORT)
+    {
+      continue;
+    }
+
+    struct blast_report report;
+    memcpy(&report, rx_buf + sizeof(*hdr), sizeof(report));
+    blast_print("uplink (host -> mote)",
+                blast.count,
+                ntohl(report.packets),
+                ntohl(report.bytes),
+                ntohl(report.reordered),
+                ntohl(report.jitter_us),
+                ntohl(report.duration_us) / 1e6);
+    return 0;
+  }
+
+  fprintf(stderr, "udp_blast: no report from the mote\n");
+  return 1;
+}
+
+static int
+blast_source(void)
+{
+  struct blast_stats *s = &blast.stats;
+  uint64_t t_ns;
+  ssize_t n = -1;
+
+  // the mote starts on the first request that gets through
+  for(int i = 0; i < BLAST_REQUEST_TRIES && n < 0; i++)
+  {
+    blast_send(BLAST_SOURCE, 0, sizeof(struct blast_hdr));
+    n = blast_recv(BLAST_DRAIN_MS, &t_ns);
+  }
+  if(n < 0)
+  {
+    fprintf(stderr, "udp_blast: the mote does not send\n");
+    return 1;
+  }
+
+  while(n >= 0)
+  {
+    blast_count((const struct blast_hdr *)rx_buf, n, t_ns);
+    if(s->packets + s->duplicates >= blast.count)
+    {
+      break;
+    }
+    n = blast_recv(BLAST_DRAIN_MS, &t_ns);
+  }
+
+  blast_print("downlink (mote -> host)",
+              blast.count,
+              s->packets,
+              s->bytes,
+              s->reordered,
+              s->jitter_us,
+              (s->last_ns - s->first_ns) / 1e9);
+  return 0;
+}
+
+static int
+compare_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static int
+blast_echo(void)
+{
+  struct blast_stats *s = &blast.stats;
+  uint64_t start = now_ns();
+  uint64_t end = start + (uint64_t)blast.count * 1000000000ULL / blast.rate +
+                 BLAST_DRAIN_MS * 1000000ULL;
+  uint32_t seq = 0;
+
+  while(1)
+  {
+    uint64_t now = now_ns();
+    uint64_t next = start + (uint64_t)seq * 1000000000ULL / blast.rate;
+
+    if(seq < blast.count && now >= next)
+    {
+      blast_send(BLAST_ECHO, seq++, blast.size);
+      continue;
+    }
+    if(seq == blast.count && (now >= end || s->packets + s->duplicates == blast.count))
+    {
+      break;
+    }
+
+    // answers until the next datagram is due
+    uint64_t wait = ((seq < blast.count) ? next : end) - now;
+    uint64_t t_ns;
+    ssize_t n = blast_recv((int)(wait / 1000000ULL), &t_ns);
+    if(n < 0)
+    {
+      continue;
+    }
+
+    const struct blast_hdr *hdr = (const struct blast_hdr *)rx_buf;
+    uint32_t packets = s->packets;
+    blast_count(hdr, n, t_ns);
+    if(s->packets != packets)
+    {
+      // our own timestamp came back, wraps like it
+      s->rtt_ns[packets] = (uint64_t)((uint32_t)(t_ns / 1000) - ntohl(hdr->ts_us)) * 1000;
+    }
+  }
+
+  blast_print("round trip (host -> mote -> host)",
+              blast.count,
+              s->packets,
+              s->bytes,
+              s->reordered,
+              s->jitter_us,
+              (s->last_ns - s->first_ns) / 1e9);
+
+  if(s->packets)
+  {
+    qsort(s->rtt_ns, s->packets, sizeof(uint64_t), compare_u64);
+    printf("  rtt: p50=%.1fus p99=%.1fus max=%.1fus\n",
+           s->rtt_ns[s->packets / 2] / 1000.0,
+           s->rtt_ns[(uint64_t)s->packets * 99 / 100] / 1000.0,
+           s->rtt_ns[s->packets - 1] / 1000.0);
+  }
+  return 0;
+}
+
+static void
+usage(const char *name)
+{
+  fprintf(stderr,
+          "usage: %s [-m sink|source|echo] [-s size] [-r rate] [-d seconds] [host]\n"
+          "  -m mode     sink: uplink, source: downlink, echo: round trip\n"
+          "              (default sink)\n"
+          "  -s size     udp payload bytes per datagram, %u..%u (default 512)\n"
+          "  -r rate     datagrams per second (default 100)\n"
+          "  -d seconds  duration (default 10)\n"
+          "  host        the mote, default 10.1.0.2\n",
+          name,
+          (unsigned)sizeof(struct blast_hdr),
+          BLAST_MAX_SIZE);
+}
+
+int
+main(int argc, char **argv)
+{
+  blast.mode = BLAST_SINK;
+  blast.size = 512;
+  blast.rate = 100;
+  blast.seconds = 10;
+
+  int opt;
+  while((opt = getopt(argc, argv, "m:s:r:d:")) != -1)
+  {
+    switch(opt)
+    {
+      case 'm':
+        if(strcmp(optarg, "sink") == 0)
+        {
+          blast.mode = BLAST_SINK;
+        } else if(strcmp(optarg, "source") == 0) {
+          blast.mode = BLAST_SOURCE;
+        } else if(strcmp(optarg, "echo") == 0) {
+          blast.mode = BLAST_ECHO;
+        } else {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 's':
+        blast.size = strtoul(optarg, NULL, 10);
+        break;
+      case 'r':
+        blast.rate = strtoul(optarg, NULL, 10);
+        break;
+      case 'd':
+        blast.seconds = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if(blast.size < sizeof(struct blast_hdr) || blast.size > BLAST_MAX_SIZE ||
+     blast.rate < 1 || blast.seconds < 1)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  struct sockaddr_in mote = { .sin_family = AF_INET, .sin_port = htons(USECASE_BLAST_PORT) };
+  const char *host = (optind < argc) ? argv[optind] : "10.1.0.2";
+  if(inet_pton(AF_INET, host, &mote.sin_addr) != 1)
+  {
+    fprintf(stderr, "udp_blast: bad address %s\n", host);
+    return 1;
+  }
+
+  blast.fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if(blast.fd < 0 || connect(blast.fd, (struct sockaddr *)&mote, sizeof(mote)) < 0)
+  {
+    perror("udp_blast: socket");
+    return 1;
+  }
+
+  blast.count = blast.rate * blast.seconds;
+  blast.session = (uint32_t)getpid() ^ (uint32_t)now_ns();
+  blast.stats.seen = calloc(blast.count, 1);
+  blast.stats.rtt_ns = calloc(blast.count, sizeof(uint64_t));
+  if(!blast.stats.seen || !blast.stats.rtt_ns)
+  {
+    return 1;
+  }
+
+  switch(blast.mode)
+  {
+    case BLAST_SOURCE:
+      return blast_source();
+    case BLAST_ECHO:
+      return blast_echo();
+    default:
+      return blast_sink();
+  }
+}
@@ -0,0 +1,263 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "server/blast.h"
+
+#if defined(LWIP_UDP) && LWIP_UDP
+#include "lwip/def.h"
+#include "lwip/prot/ip4.h"
+#include "lwip/prot/udp.h"
+#include "lwip/sys.h"
+#include "lwip/timeouts.h"
+#include "lwip/udp.h"
+
+#include <string.h>
+
+/* source pacing, with sys_now's 1 ms resolution */
+#define BLAST_TICK_MS (1)
+
+/* datagrams per tick at most, a rate the link cannot carry queues up in
+ * the driver instead of starving the main loop */
+#define BLAST_MAX_BURST (8)
+
+#define BLAST_MAX_SIZE (1500 - IP_HLEN - UDP_HLEN)
+
+struct blast_sink
+{
+  u32_t session;
+  u32_t packets;
+  u32_t bytes;
+  u32_t next_seq;
+  u32_t reordered;
+  u32_t first_ms;
+  u32_t last_ms;
+  s32_t transit;
+  u32_t jitter16; // jitter in us, scaled by 16 as in rfc 3550
+};
+
+struct blast_source
+{
+  u32_t session;
+  ip_addr_t addr;
+  u16_t port;
+  u16_t size;
+  u32_t rate;
+  u32_t count;
+  u32_t sent;
+  u32_t start_ms;
+  u8_t running;
+};
+
+static struct udp_pcb *blast_pcb;
+static struct blast_sink sink;
+static struct blast_source source;
+
+/* source padding, zeros sent by reference from flash */
+static const u8_t blast_padding[BLAST_MAX_SIZE - sizeof(struct blast_hdr)];
+
+static void
+blast_sink_count(const struct blast_hdr *hdr, u16_t len)
+{
+  u32_t session = lwip_ntohl(hdr->session);
+  u32_t seq = lwip_ntohl(hdr->seq);
+  u32_t now_ms = sys_now();
+
+  if(session != sink.session)
+  {
+    memset(&sink, 0, sizeof(sink));
+    sink.session = session;
+    sink.first_ms = now_ms;
+  }
+
+  // rfc 3550: J += (|D| - J) / 16, D the change in transit time
+  s32_t transit = (s32_t)(now_ms * 1000 - lwip_ntohl(hdr->ts_us));
+  if(sink.packets)
+  {
+    s32_t d = transit - sink.transit;
+    sink.jitter16 += ((d < 0) ? -d : d) - ((sink.jitter16 + 8) >> 4);
+  }
+  sink.transit = transit;
+
+  sink.packets++;
+  sink.bytes += len;
+  sink.last_ms = now_ms;
+  if(seq < sink.next_seq)
+  {
+    sink.reordered++;
+  } else {
+    sink.next_seq = seq + 1;
+  }
+}
+
+static void
+blast_send(const ip_addr_t *addr, u16_t port, const struct blast_hdr *hdr,
+           const void *body, u16_t body_len)
+{
+  struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, sizeof(*hdr), PBUF_RAM);
+  if(!p)
+  {
+    return;
+  }
+  memcpy(p->payload, hdr, sizeof(*hdr));
+
+  if(body_len)
+  {
+    struct pbuf *b = pbuf_alloc(PBUF_RAW, body_len, PBUF_ROM);
+    if(!b)
+    {
+      pbuf_free(p);
+      return;
+    }
+    b->payload = (void *)body;
+    pbuf_cat(p, b);
+  }
+
+  udp_sendto(blast_pcb, p, addr, port);
+  pbuf_free(p);
+}
+
+static void
+blast_report(const ip_addr_t *addr, u16_t port, u32_t session)
+{
+  struct blast_hdr hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.mode = BLAST_REPORT;
+  hdr.session = lwip_htonl(session);
+
+  static struct blast_report report;
+  memset(&report, 0, sizeof(report));
+  if(session == sink.session)
+  {
+    u32_t expected = sink.next_seq;
+    report.packets = lwip_htonl(sink.packets);
+    report.bytes = lwip_htonl(sink.bytes);
+    report.lost = lwip_htonl((expected > sink.packets) ? expected - sink.packets : 0);
+    report.reordered = lwip_htonl(sink.reordered);
+    report.jitter_us = lwip_htonl(sink.jitter16 >> 4);
+    report.duration_us = lwip_htonl((sink.last_ms - sink.first_ms) * 1000);
+  }
+
+  // the report is copied into the link's frame before udp_sendto returns
+  blast_send(addr, port, &hdr, &report, sizeof(report));
+}
+
+static void
+blast_source_tick(void *arg)
+{
+  LWIP_UNUSED_ARG(arg);
+
+  u32_t elapsed = sys_now() - source.start_ms;
+  uint64_t due = (uint64_t)elapsed * source.rate / 1000 + 1;
+  if(due > source.count)
+  {
+    due = source.count;
+  }
+
+  struct blast_hdr hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.mode = BLAST_SOURCE;
+  hdr.session = lwip_htonl(source.session);
+
+  for(u32_t burst = 0; source.sent < due && burst < BLAST_MAX_BURST; burst++)
+  {
+    hdr.seq = lwip_htonl(source.sent);
+    hdr.ts_us = lwip_htonl(sys_now() * 1000);
+    blast_send(&source.addr, source.port, &hdr,
+               blast_padding, source.size - sizeof(hdr));
+    source.sent++;
+  }
+
+  if(source.sent < source.count)
+  {
+    sys_timeout(BLAST_TICK_MS, blast_source_tick, NULL);
+  } else {
+    source.running = 0;
+  }
+}
+
+static void
+blast_source_start(const struct blast_hdr *hdr, const ip_addr_t *addr, u16_t port)
+{
+  u32_t session = lwip_ntohl(hdr->session);
+
+  // the host repeats its request until data arrives
+  if(source.running && session == source.session)
+  {
+    return;
+  }
+
+  if(source.running)
+  {
+    sys_untimeout(blast_source_tick, NULL);
+  }
+
+  u16_t max_size = LWIP_MIN(BLAST_MAX_SIZE, netif_default->mtu - IP_HLEN - UDP_HLEN);
+  u16_t size = lwip_ntohs(hdr->size);
+
+  source.session = session;
+  ip_addr_copy(source.addr, *addr);
+  source.port = port;
+  source.size = LWIP_MAX(sizeof(struct blast_hdr), LWIP_MIN(size, max_size));
+  source.rate = LWIP_MAX(1, lwip_ntohl(hdr->rate));
+  source.count = lwip_ntohl(hdr->count);
+  source.sent = 0;
+  source.start_ms = sys_now();
+  source.running = 1;
+
+  blast_source_tick(NULL);
+}
+
+static void
+blast_recv_callback(void *arg, struct udp_pcb *pcb, struct pbuf *p,
+                    const ip_addr_t *addr, u16_t port)
+{
+  LWIP_UNUSED_ARG(arg);
+
+  struct blast_hdr hdr;
+  if(!p || pbuf_copy_partial(p, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+  {
+    if(p)
+    {
+      pbuf_free(p);
+    }
+    return;
+  }
+
+  switch(hdr.mode)
+  {
+    case BLAST_SINK:
+      blast_sink_count(&hdr, p->tot_len);
+      break;
+    case BLAST_SOURCE:
+      blast_source_start(&hdr, addr, port);
+      break;
+    case BLAST_ECHO:
+      udp_sendto(pcb, p, addr, port);
+      break;
+    case BLAST_REPORT:
+      blast_report(addr, port, lwip_ntohl(hdr.session));
+      break;
+    default:
+      break;
+  }
+
+  pbuf_free(p);
+}
+
+void blast_server_setup(void)
+{
+  blast_pcb = udp_new();
+  udp_bind(blast_pcb, &netif_default->ip_addr, USECASE_BLAST_PORT);
+  udp_recv(blast_pcb, blast_recv_callback, NULL);
+}
+
+#else
+
+// null impl, the tcp build has no udp
+
+void blast_server_setup(void)
+{
+
+}
+#endif
@@ -0,0 +1,452 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "gateway/capture.h"
+#include "gateway/spsc_ring.h"
+
+#include "lwip/ip.h"
+#include "lwip/pbuf.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#define CAPTURE_MAX_NETIF (256)
+
+/* the core wakes the writer on the first packet into an empty ring and
+ * once this much is waiting; less than that goes to the file after
+ * CAPTURE_FLUSH_MS */
+#define CAPTURE_WRITE_BATCH (64 * 1024)
+#define CAPTURE_FLUSH_MS (100)
+
+/* wake_at while the writer is not waiting */
+#define CAPTURE_WAKE_NEVER (0xFFFFFFFFUL)
+
+#define CAPTURE_DROP_REPORT_S (1)
+
+#define PCAPNG_SHB (0x0A0D0D0AUL)
+#define PCAPNG_IDB (0x00000001UL)
+#define PCAPNG_EPB (0x00000006UL)
+#define PCAPNG_BYTE_ORDER_MAGIC (0x1A2B3C4DUL)
+
+#define PCAPNG_LINKTYPE_RAW (101)
+
+#define PCAPNG_OPT_END (0)
+#define PCAPNG_OPT_IF_NAME (2)
+#define PCAPNG_OPT_IF_TSRESOL (9)
+#define PCAPNG_OPT_EPB_FLAGS (2)
+
+#define PCAPNG_EPB_INBOUND (1)
+#define PCAPNG_EPB_OUTBOUND (2)
+
+#define PCAPNG_PAD(len) (((len) + 3) & ~3UL)
+
+struct pcapng_shb
+{
+  u32_t type;
+  u32_t total_len;
+  u32_t magic;
+  u16_t major;
+  u16_t minor;
+  u32_t section_len_low;
+  u32_t section_len_high;
+  u32_t total_len_trailer;
+};
+
+struct pcapng_epb
+{
+  u32_t type;
+  u32_t total_len;
+  u32_t if_id;
+  u32_t ts_high;
+  u32_t ts_low;
+  u32_t cap_len;
+  u32_t orig_len;
+};
+
+struct pcapng_idb
+{
+  u32_t type;
+  u32_t total_len;
+  u16_t linktype;
+  u16_t reserved;
+  u32_t snaplen;
+};
+
+struct pcapng_opt
+{
+  u16_t code;
+  u16_t len;
+};
+
+/* after the padded packet data */
+struct pcapng_epb_trailer
+{
+  u16_t flags_code;
+  u16_t flags_len;
+  u32_t flags;
+  u32_t end;
+  u32_t total_len;
+};
+
+struct capture_if
+{
+  netif_output_fn lower_output;
+  u32_t id;
+  u8_t attached;
+};
+
+/* head is only written by the core thread, tail only by the writer;
+ * both run freely and are masked on use; wake_at is the fill at which
+ * the sleeping writer wants wake_fd, whoever resets it to
+ * CAPTURE_WAKE_NEVER first owns the wakeup */
+struct capture
+{
+  _Alignas(SPSC_RING_CACHE_LINE) _Atomic uint32_t head;
+  _Alignas(SPSC_RING_CACHE_LINE) _Atomic uint32_t tail;
+  _Alignas(SPSC_RING_CACHE_LINE) _Atomic uint32_t dropped;
+  _Atomic uint32_t wake_at;
+  u8_t *ring;
+  int fd;
+  int wake_fd;
+  u32_t num_ifs;
+  pthread_t writer;
+};
+
+static const u8_t pcapng_zeros[3];
+
+static struct capture capture = { .fd = -1, .wake_fd = -1, .wake_at = CAPTURE_WAKE_NEVER };
+static struct capture_if capture_ifs[CAPTURE_MAX_NETIF];
+
+static netif_input_fn capture_upper_input = ip_input;
+
+/*-------------------------------------------------------------------------*/
+/* core thread */
+
+static void
+capture_put(u32_t *pos, const void *data, u32_t len)
+{
+  u32_t off = *pos & (CAPTURE_RING_SIZE - 1);
+  u32_t first = LWIP_MIN(len, CAPTURE_RING_SIZE - off);
+
+  memcpy(capture.ring + off, data, first);
+  memcpy(capture.ring, (const u8_t *)data + first, len - first);
+  *pos += len;
+}
+
+/* -1 if len bytes do not fit, the block is dropped then */
+static int
+capture_reserve(u32_t len, u32_t *head)
+{
+  *head = atomic_load_explicit(&capture.head, memory_order_relaxed);
+  u32_t tail = atomic_load_explicit(&capture.tail, memory_order_acquire);
+
+  if(CAPTURE_RING_SIZE - (*head - tail) < len)
+  {
+    atomic_store_explicit(&capture.dropped,
+                          atomic_load_explicit(&capture.dropped, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    return -1;
+  }
+  return 0;
+}
+
+/* one eventfd write per wakeup the writer asked for, not per packet */
+static void
+capture_commit(u32_t head)
+{
+  /* seq_cst against the writer's store of wake_at and load of head:
+   * either it sees this head or this sees its wake_at */
+  atomic_store_explicit(&capture.head, head, memory_order_seq_cst);
+
+  u32_t wake_at = atomic_load_explicit(&capture.wake_at, memory_order_seq_cst);
+  if(wake_at == CAPTURE_WAKE_NEVER)
+  {
+    return;
+  }
+
+  u32_t tail = atomic_load_explicit(&capture.tail, memory_order_relaxed);
+  if(head - tail >= wake_at &&
+     atomic_compare_exchange_strong(&capture.wake_at, &wake_at, CAPTURE_WAKE_NEVER))
+  {
+    if(eventfd_write(capture.wake_fd, 1) < 0)
+    {
+      perror("capture: eventfd write");
+    }
+  }
+}
+
+static void
+capture_packet(const struct capture_if *cif, struct pbuf *p, u32_t direction)
+{
+  u32_t padded = PCAPNG_PAD(p->tot_len);
+  u32_t total = sizeof(struct pcapng_epb) + padded + sizeof(struct pcapng_epb_trailer);
+  u32_t pos;
+
+  if(capture_reserve(total, &pos) < 0)
+  {
+    return;
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  uint64_t ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+
+  struct pcapng_epb epb =
+  {
+    .type = PCAPNG_EPB,
+    .total_len = total,
+    .if_id = cif->id,
+    .ts_high = ns >> 32,
+    .ts_low = (u32_t)ns,
+    .cap_len = p->tot_len,
+    .orig_len = p->tot_len,
+  };
+  capture_put(&pos, &epb, sizeof(epb));
+
+  for(struct pbuf *q = p; q; q = q->next)
+  {
+    capture_put(&pos, q->payload, q->len);
+  }
+
+  capture_put(&pos, pcapng_zeros, padded - p->tot_len);
+
+  struct pcapng_epb_trailer trailer =
+  {
+    .flags_code = PCAPNG_OPT_EPB_FLAGS,
+    .flags_len = sizeof(u32_t),
+    .flags = direction,
+    .end = PCAPNG_OPT_END,
+    .total_len = total,
+  };
+  capture_put(&pos, &trailer, sizeof(trailer));
+
+  capture_commit(pos);
+}
+
+static err_t
+capture_output(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+  const struct capture_if *cif = &capture_ifs[netif->num];
+  capture_packet(cif, p, PCAPNG_EPB_OUTBOUND);
+  return cif->lower_output(netif, p, ipaddr);
+}
+
+err_t
+capture_input(struct pbuf *p, struct netif *inp)
+{
+  const struct capture_if *cif = &capture_ifs[inp->num];
+  if(cif->attached)
+  {
+    capture_packet(cif, p, PCAPNG_EPB_INBOUND);
+  }
+  return capture_upper_input(p, inp);
+}
+
+void
+capture_set_upper_input(netif_input_fn input)
+{
+  capture_upper_input = input;
+}
+
+err_t
+capture_attach(struct netif *netif)
+{
+  if(capture.fd < 0)
+  {
+    return ERR_ARG;
+  }
+
+  /* name and ns resolution, the block goes through the ring so it is in
+   * the file before the first packet of the interface */
+  char name[8];
+  u16_t name_len = snprintf(name, sizeof(name), "%c%c%u",
+                            netif->name[0], netif->name[1], netif->num);
+  const u8_t tsresol[4] = { 9 };
+  const struct pcapng_opt name_opt = { PCAPNG_OPT_IF_NAME, name_len };
+  const struct pcapng_opt tsresol_opt = { PCAPNG_OPT_IF_TSRESOL, 1 };
+  const struct pcapng_opt end = { PCAPNG_OPT_END, 0 };
+
+  u32_t total = sizeof(struct pcapng_idb) +
+                sizeof(name_opt) + PCAPNG_PAD(name_len) +
+                sizeof(tsresol_opt) + sizeof(tsresol) +
+                sizeof(end) + sizeof(u32_t);
+  u32_t pos;
+
+  if(capture_reserve(total, &pos) < 0)
+  {
+    return ERR_MEM;
+  }
+
+  const struct pcapng_idb idb =
+  {
+    .type = PCAPNG_IDB,
+    .total_len = total,
+    .linktype = PCAPNG_LINKTYPE_RAW,
+    .snaplen = 0, // no limit
+  };
+  capture_put(&pos, &idb, sizeof(idb));
+  capture_put(&pos, &name_opt, sizeof(name_opt));
+  capture_put(&pos, name, name_len);
+  capture_put(&pos, pcapng_zeros, PCAPNG_PAD(name_len) - name_len);
+  capture_put(&pos, &tsresol_opt, sizeof(tsresol_opt));
+  capture_put(&pos, tsresol, sizeof(tsresol));
+  capture_put(&pos, &end, sizeof(end));
+  capture_put(&pos, &total, sizeof(total));
+  capture_commit(pos);
+
+  struct capture_if *cif = &capture_ifs[netif->num];
+  cif->lower_output = netif->output;
+  cif->id = capture.num_ifs++;
+  cif->attached = 1;
+  netif->output = capture_output;
+
+  return ERR_OK;
+}
+
+/*-------------------------------------------------------------------------*/
+/* writer thread */
+
+/* sleeps until the core committed CAPTURE_WRITE_BATCH bytes, or any at
+ * all into an empty ring, or for CAPTURE_FLUSH_MS with less waiting;
+ * returns the head after */
+static u32_t
+capture_wait(u32_t tail, u32_t head)
+{
+  u32_t wake_at = (head == tail) ? 1 : CAPTURE_WRITE_BATCH;
+
+  atomic_store_explicit(&capture.wake_at, wake_at, memory_order_seq_cst);
+  head = atomic_load_explicit(&capture.head, memory_order_seq_cst);
+
+  if(head - tail < wake_at)
+  {
+    struct pollfd pfd = { .fd = capture.wake_fd, .events = POLLIN };
+    if(poll(&pfd, 1, (head == tail) ? -1 : CAPTURE_FLUSH_MS) < 0 && errno != EINTR)
+    {
+      perror("capture: poll");
+    }
+  }
+
+  /* the core took the wakeup, its write may still be on the way: the
+   * blocking read waits for it so no stale count is left behind */
+  u32_t expected = wake_at;
+  if(!atomic_compare_exchange_strong(&capture.wake_at, &expected, CAPTURE_WAKE_NEVER))
+  {
+    eventfd_t value;
+    if(eventfd_read(capture.wake_fd, &value) < 0 && errno != EAGAIN)
+    {
+      perror("capture: eventfd read");
+    }
+  }
+
+  return atomic_load_explicit(&capture.head, memory_order_acquire);
+}
+
+static void *
+capture_writer(void *arg)
+{
+  (void)arg;
+  u32_t reported = 0;
+  time_t last_report = 0;
+
+  while(1)
+  {
+    u32_t tail = atomic_load_explicit(&capture.tail, memory_order_relaxed);
+    u32_t head = atomic_load_explicit(&capture.head, memory_order_acquire);
+
+    if(head == tail)
+    {
+      u32_t dropped = atomic_load_explicit(&capture.dropped, memory_order_relaxed);
+      time_t now = time(NULL);
+      if(dropped != reported && now - last_report >= CAPTURE_DROP_REPORT_S)
+      {
+        fprintf(stderr, "capture: %u packets dropped, writer behind\n", dropped - reported);
+        reported = dropped;
+        last_report = now;
+      }
+    }
+
+    if(head - tail < CAPTURE_WRITE_BATCH)
+    {
+      u32_t idle = (head == tail);
+      head = capture_wait(tail, head);
+      if(idle)
+      {
+        /* the first packet after a pause waits for a batch or the
+         * flush interval like any other */
+        continue;
+      }
+    }
+
+    /* up to the end of the ring, the rest on the next round */
+    u32_t off = tail & (CAPTURE_RING_SIZE - 1);
+    u32_t len = LWIP_MIN(head - tail, CAPTURE_RING_SIZE - off);
+
+    ssize_t n = write(capture.fd, capture.ring + off, len);
+    if(n < 0)
+    {
+      if(errno == EINTR)
+      {
+        continue;
+      }
+      /* the ring fills up and everything after is dropped */
+      perror("capture: write");
+      return NULL;
+    }
+
+    atomic_store_explicit(&capture.tail, tail + (u32_t)n, memory_order_release);
+  }
+}
+
+int
+capture_open(const char *path)
+{
+  capture.ring = malloc(CAPTURE_RING_SIZE);
+  capture.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  /* blocking, the writer only reads it after poll said so */
+  capture.wake_fd = eventfd(0, EFD_CLOEXEC);
+  if(!capture.ring || capture.fd < 0 || capture.wake_fd < 0)
+  {
+    perror("capture_open");
+    return -1;
+  }
+
+  /* the ring is written once before packets arrive, no page faults on
+   * the forwarding path */
+  memset(capture.ring, 0, CAPTURE_RING_SIZE);
+
+  const struct pcapng_shb shb =
+  {
+    .type = PCAPNG_SHB,
+    .total_len = sizeof(shb),
+    .magic = PCAPNG_BYTE_ORDER_MAGIC,
+    .major = 1,
+    .minor = 0,
+    .section_len_low = 0xFFFFFFFFUL, // unknown
+    .section_len_high = 0xFFFFFFFFUL,
+    .total_len_trailer = sizeof(shb),
+  };
+  if(write(capture.fd, &shb, sizeof(shb)) != sizeof(shb))
+  {
+    perror("capture_open: write");
+    return -1;
+  }
+
+  int err = pthread_create(&capture.writer, NULL, capture_writer, NULL);
+  if(err)
+  {
+    fprintf(stderr, "capture_open: pthread_create: %s\n", strerror(err));
+    return -1;
+  }
+
+  return 0;
+}
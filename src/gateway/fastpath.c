@@ -0,0 +1,184 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "gateway/fastpath.h"
+#include "gateway/pmtu.h"
+
+#include "lwip/opt.h"
+#include "lwip/def.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/ip4.h"
+#include "lwip/pbuf.h"
+#include "lwip/prot/ip4.h"
+#include "lwip/prot/tcp.h"
+
+#include <string.h>
+
+struct fastpath_route
+{
+  u32_t dest;
+  /* NULL if the slow path has to take packets to dest */
+  struct netif *netif;
+  u8_t valid;
+};
+
+static struct fastpath_route fastpath_routes[FASTPATH_ROUTE_CACHE];
+
+#if LWIP_NETIF_EXT_STATUS_CALLBACK
+NETIF_DECLARE_EXT_CALLBACK(fastpath_netif_callback)
+#endif
+
+/* what ip4_canforward refuses as well, lwip drops these on the slow
+ * path: class e, loopback and 0/8 destinations */
+static int
+fastpath_can_forward(const ip4_addr_t *dest)
+{
+  u32_t addr = lwip_htonl(ip4_addr_get_u32(dest));
+
+  if(IP_EXPERIMENTAL(addr))
+  {
+    return 0;
+  }
+
+  if(IP_CLASSA(addr))
+  {
+    u32_t net = addr & IP_CLASSA_NET;
+    if(net == 0 || net == ((u32_t)IP_LOOPBACKNET << IP_CLASSA_NSHIFT))
+    {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static struct netif *
+fastpath_lookup(const ip4_addr_t *dest)
+{
+  u32_t addr = ip4_addr_get_u32(dest);
+  u32_t h = addr * 0x9E3779B1UL;
+  struct fastpath_route *route = &fastpath_routes[(h >> 16) & (FASTPATH_ROUTE_CACHE - 1)];
+
+  if(route->valid && route->dest == addr)
+  {
+    return route->netif;
+  }
+
+  route->dest = addr;
+  route->valid = 1;
+  route->netif = NULL;
+
+  if(ip4_addr_ismulticast(dest) || !fastpath_can_forward(dest))
+  {
+    return NULL;
+  }
+
+  struct netif *netif;
+  NETIF_FOREACH(netif)
+  {
+    if(ip4_addr_cmp(dest, netif_ip4_addr(netif)) ||
+       ip4_addr_isbroadcast(dest, netif))
+    {
+      return NULL;
+    }
+  }
+
+  route->netif = ip4_route(dest);
+  return route->netif;
+}
+
+static int
+fastpath_is_syn(const struct pbuf *p)
+{
+  if(p->len < IP_HLEN + TCP_HLEN)
+  {
+    // cannot tell, let the slow path look
+    return 1;
+  }
+  const struct tcp_hdr *tcph = (const struct tcp_hdr *)((const u8_t *)p->payload + IP_HLEN);
+  return (TCPH_FLAGS(tcph) & TCP_SYN) != 0;
+}
+
+err_t
+fastpath_input(struct pbuf *p, struct netif *inp)
+{
+  if(p->len < IP_HLEN)
+  {
+    return pmtu_input(p, inp);
+  }
+
+  struct ip_hdr *iph = (struct ip_hdr *)p->payload;
+  u16_t tot_len = lwip_ntohs(IPH_LEN(iph));
+  if(IPH_V(iph) != 4 || IPH_HL(iph) != 5 ||
+     IPH_TTL(iph) <= 1 ||
+     (lwip_ntohs(IPH_OFFSET(iph)) & (IP_MF | IP_OFFMASK)) ||
+     tot_len < IP_HLEN || tot_len > p->tot_len ||
+     (IPH_PROTO(iph) == IP_PROTO_TCP && fastpath_is_syn(p)))
+  {
+    return pmtu_input(p, inp);
+  }
+
+  /* the incremental update below keeps a bad checksum bad, ip_input
+   * counts and drops the packet */
+  if(inet_chksum(iph, IP_HLEN) != 0)
+  {
+    return pmtu_input(p, inp);
+  }
+
+  ip4_addr_t dest;
+  ip4_addr_copy(dest, iph->dest);
+  struct netif *out = fastpath_lookup(&dest);
+  if(!out || out == inp || tot_len > out->mtu ||
+     !netif_is_up(out) || !netif_is_link_up(out))
+  {
+    return pmtu_input(p, inp);
+  }
+
+  /* trailing link padding, ip_input would cut it as well */
+  if(tot_len < p->tot_len)
+  {
+    pbuf_realloc(p, tot_len);
+  }
+
+  /* ttl is the high byte of its checksum word: -1 there is +0x0100 on
+   * the checksum, with the end around carry */
+  IPH_TTL_SET(iph, IPH_TTL(iph) - 1);
+  u32_t chksum = lwip_ntohs(IPH_CHKSUM(iph)) + 0x0100;
+  IPH_CHKSUM_SET(iph, lwip_htons((u16_t)(chksum + (chksum >> 16))));
+
+  /* output does not take p, like after ip4_forward */
+  out->output(out, p, &dest);
+  pbuf_free(p);
+  return ERR_OK;
+}
+
+void
+fastpath_flush(void)
+{
+  memset(fastpath_routes, 0, sizeof(fastpath_routes));
+}
+
+#if LWIP_NETIF_EXT_STATUS_CALLBACK
+/* every reason (added, removed, addresses, up/down, link) can move a
+ * route, and cached entries may name a removed netif */
+static void
+fastpath_netif_changed(struct netif *netif, netif_nsc_reason_t reason,
+                       const netif_ext_callback_args_t *args)
+{
+  LWIP_UNUSED_ARG(netif);
+  LWIP_UNUSED_ARG(reason);
+  LWIP_UNUSED_ARG(args);
+
+  fastpath_flush();
+}
+#endif
+
+void
+fastpath_init(void)
+{
+  fastpath_flush();
+#if LWIP_NETIF_EXT_STATUS_CALLBACK
+  netif_add_ext_callback(&fastpath_netif_callback, fastpath_netif_changed);
+#endif
+}
@@ -0,0 +1,552 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#define _GNU_SOURCE
+
+#include "gateway/iothread.h"
+#include "gateway/spsc_ring.h"
+#include "link/slip_codec.h"
+#include "link_counters.h"
+
+#include "lwip/pbuf.h"
+#include "lwip/sio.h"
+#include "arch/sio_pc.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#define IOTHREAD_MTU (1500)
+
+/* packets per direction, power of two */
+#define IOTHREAD_RING_SIZE (64)
+
+/* packets read before the core thread is signalled */
+#define IOTHREAD_RX_BUDGET (16)
+
+#define IOTHREAD_MAX_NETIF (256)
+
+struct iothread_pkt
+{
+  struct pbuf_custom pc; // only touched by the core thread
+  struct iothread_dev *dev;
+  uint16_t len;
+  uint8_t data[IOTHREAD_MTU];
+};
+
+struct iothread_dev
+{
+  int fd;
+  enum iothread_kind kind;
+  struct netif *netif;
+  struct iothread_worker *worker;
+
+  struct spsc_ring rx;      // io thread -> core
+  struct spsc_ring rx_free; // core -> io thread
+  struct spsc_ring tx;      // core -> io thread
+  struct spsc_ring tx_free; // io thread -> core
+
+  struct iothread_pkt *pkts;
+
+  /* rx and tx bytes/frames are written by the io thread, tx_dropped and
+   * tx_queue by the core */
+  struct link_counters counters;
+
+  /* io thread only */
+  struct iothread_pkt *rx_pkt;
+  struct slip_decoder dec;
+  struct iothread_pkt *tx_pkt; // pending tun write
+  const uint8_t *tx_ptr;
+  size_t tx_len;
+  uint8_t tx_buf[SLIP_ENCODED_MAX(IOTHREAD_MTU)];
+  uint8_t rx_buf[2048];
+};
+
+struct iothread_worker
+{
+  struct iothread_config config;
+
+  int wake_fd; // core -> io thread: tx packets queued
+  int core_fd; // io thread -> core: rx packets queued
+
+  uint32_t num_devs;
+  struct iothread_dev *devs[IOTHREAD_MAX_DEVS];
+  pthread_t thread;
+};
+
+static struct iothread_dev *dev_of_netif[IOTHREAD_MAX_NETIF];
+
+static void
+iothread_signal(int fd)
+{
+  uint64_t one = 1;
+  if(write(fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+  {
+    perror("iothread: eventfd write");
+  }
+}
+
+static void
+iothread_clear(int fd)
+{
+  uint64_t value;
+  if(read(fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+  {
+    perror("iothread: eventfd read");
+  }
+}
+
+/*-------------------------------------------------------------------------*/
+/* io thread */
+
+static void
+iothread_rx_next(struct iothread_dev *dev)
+{
+  dev->rx_pkt = spsc_ring_pop(&dev->rx_free);
+  if(dev->rx_pkt)
+  {
+    slip_decoder_reset(&dev->dec, dev->rx_pkt->data, sizeof(dev->rx_pkt->data));
+  } else {
+    /* core holds every packet, drop until it returns some */
+    LINK_COUNTERS_INC_SHARED(&dev->counters, rx_dropped);
+    slip_decoder_discard(&dev->dec, NULL, 0);
+  }
+}
+
+static int
+iothread_rx_serial(struct iothread_dev *dev)
+{
+  int frames = 0;
+  ssize_t n;
+
+  while(frames < IOTHREAD_RX_BUDGET &&
+        (n = sio_tryread(dev->fd, dev->rx_buf, sizeof(dev->rx_buf))) > 0)
+  {
+    const uint8_t *in = dev->rx_buf;
+    size_t len = n;
+
+    LINK_COUNTERS_ADD_SHARED(&dev->counters, rx_bytes, n);
+
+    while(len)
+    {
+      switch(slip_decode(&dev->dec, &in, &len))
+      {
+        case SLIP_DECODE_NEED_INPUT:
+          break;
+        case SLIP_DECODE_NEED_OUTPUT:
+          if(dev->rx_pkt)
+          {
+            /* frame longer than the mtu */
+            LINK_COUNTERS_INC_SHARED(&dev->counters, rx_oversize);
+            slip_decoder_discard(&dev->dec, dev->rx_pkt->data, sizeof(dev->rx_pkt->data));
+          } else {
+            iothread_rx_next(dev);
+          }
+          break;
+        case SLIP_DECODE_FRAME:
+          dev->rx_pkt->len = dev->dec.frame_len;
+          spsc_ring_push(&dev->rx, dev->rx_pkt);
+          frames++;
+          iothread_rx_next(dev);
+          break;
+      }
+    }
+  }
+
+  LINK_COUNTERS_ADD_SHARED(&dev->counters, rx_frames, frames);
+  LINK_COUNTERS_SET_SHARED(&dev->counters, rx_escapes, dev->dec.escapes);
+  return frames;
+}
+
+static int
+iothread_rx_tun(struct iothread_dev *dev)
+{
+  int packets = 0;
+
+  while(packets < IOTHREAD_RX_BUDGET)
+  {
+    if(!dev->rx_pkt)
+    {
+      dev->rx_pkt = spsc_ring_pop(&dev->rx_free);
+      if(!dev->rx_pkt)
+      {
+        break;
+      }
+    }
+
+    ssize_t n = read(dev->fd, dev->rx_pkt->data, sizeof(dev->rx_pkt->data));
+    if(n <= 0)
+    {
+      /* keep rx_pkt for the next wakeup */
+      break;
+    }
+
+    dev->rx_pkt->len = n;
+    spsc_ring_push(&dev->rx, dev->rx_pkt);
+    dev->rx_pkt = NULL;
+    packets++;
+    LINK_COUNTERS_ADD_SHARED(&dev->counters, rx_bytes, n);
+  }
+
+  LINK_COUNTERS_ADD_SHARED(&dev->counters, rx_frames, packets);
+  return packets;
+}
+
+/* serial devices go through sio so every backend works, tun is a plain fd */
+static ssize_t
+iothread_write(struct iothread_dev *dev)
+{
+  if(dev->kind == IOTHREAD_SERIAL)
+  {
+    int32_t n = sio_write_nonblock(dev->fd, dev->tx_ptr, dev->tx_len);
+    if(n == 0)
+    {
+      errno = EAGAIN;
+      return -1;
+    }
+    return n;
+  }
+
+  return write(dev->fd, dev->tx_ptr, dev->tx_len);
+}
+
+/* 0 when everything queued was written, -1 when the fd is full */
+static int
+iothread_tx(struct iothread_dev *dev)
+{
+  while(1)
+  {
+    if(!dev->tx_len)
+    {
+      struct iothread_pkt *pkt = spsc_ring_pop(&dev->tx);
+      if(!pkt)
+      {
+        return 0;
+      }
+
+      if(dev->kind == IOTHREAD_SERIAL)
+      {
+        uint8_t *out = dev->tx_buf;
+        *out++ = SLIP_END;
+        out += slip_escape(out, pkt->data, pkt->len);
+        *out++ = SLIP_END;
+        dev->tx_ptr = dev->tx_buf;
+        dev->tx_len = out - dev->tx_buf;
+        LINK_COUNTERS_ADD_SHARED(&dev->counters, tx_escapes, dev->tx_len - 2 - pkt->len);
+        spsc_ring_push(&dev->tx_free, pkt);
+      } else {
+        dev->tx_pkt = pkt;
+        dev->tx_ptr = pkt->data;
+        dev->tx_len = pkt->len;
+      }
+      LINK_COUNTERS_INC_SHARED(&dev->counters, tx_frames);
+    }
+
+    ssize_t n = iothread_write(dev);
+    if(n < 0)
+    {
+      if(errno == EAGAIN)
+      {
+        return -1;
+      }
+      if(errno != EINTR)
+      {
+        perror("iothread: write");
+        dev->tx_len = 0;
+      }
+    } else {
+      dev->tx_ptr += n;
+      dev->tx_len -= n;
+      LINK_COUNTERS_ADD_SHARED(&dev->counters, tx_bytes, n);
+    }
+
+    if(!dev->tx_len && dev->tx_pkt)
+    {
+      spsc_ring_push(&dev->tx_free, dev->tx_pkt);
+      dev->tx_pkt = NULL;
+    }
+  }
+}
+
+static void
+iothread_setup_scheduling(const struct iothread_config *config)
+{
+  if(config->cpu >= 0)
+  {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(config->cpu, &cpus);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if(err)
+    {
+      fprintf(stderr, "iothread: pinning to cpu %d: %s\n", config->cpu, strerror(err));
+    }
+  }
+
+  if(config->fifo_priority > 0)
+  {
+    struct sched_param param =
+    {
+      .sched_priority = config->fifo_priority,
+    };
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if(err)
+    {
+      fprintf(stderr, "iothread: SCHED_FIFO %d: %s\n", config->fifo_priority, strerror(err));
+    }
+  }
+}
+
+/* one pass over a device, returns the number of packets received,
+ * sets *tx_blocked and *starved for the following poll */
+static int
+iothread_service(struct iothread_dev *dev, int *tx_blocked, int *starved)
+{
+  *tx_blocked = iothread_tx(dev) < 0;
+
+  int received = (dev->kind == IOTHREAD_SERIAL) ? iothread_rx_serial(dev) :
+                                                  iothread_rx_tun(dev);
+
+  /* without a free rx packet the tun fd would stay readable forever,
+   * poll the rx_free ring instead; serial keeps reading and drops */
+  *starved = (dev->kind == IOTHREAD_TUN) && !dev->rx_pkt &&
+             !(dev->rx_pkt = spsc_ring_pop(&dev->rx_free));
+
+  return received;
+}
+
+static void *
+iothread_main(void *arg)
+{
+  struct iothread_worker *worker = arg;
+  struct pollfd pfd[IOTHREAD_MAX_DEVS + 1];
+
+  iothread_setup_scheduling(&worker->config);
+
+  for(uint32_t i = 0; i < worker->num_devs; i++)
+  {
+    if(worker->devs[i]->kind == IOTHREAD_SERIAL)
+    {
+      iothread_rx_next(worker->devs[i]);
+    }
+  }
+
+  while(1)
+  {
+    int received = 0;
+    int busy = 0;
+    int any_starved = 0;
+
+    for(uint32_t i = 0; i < worker->num_devs; i++)
+    {
+      struct iothread_dev *dev = worker->devs[i];
+      int tx_blocked;
+      int starved;
+      int n = iothread_service(dev, &tx_blocked, &starved);
+
+      received += n;
+      busy |= (n == IOTHREAD_RX_BUDGET);
+      any_starved |= starved;
+
+      pfd[i].fd = dev->fd;
+      pfd[i].events = (starved ? 0 : POLLIN) | (tx_blocked ? POLLOUT : 0);
+    }
+
+    /* one wakeup of the core for everything this pass received */
+    if(received)
+    {
+      iothread_signal(worker->core_fd);
+    }
+
+    if(busy)
+    {
+      continue;
+    }
+
+    pfd[worker->num_devs].fd = worker->wake_fd;
+    pfd[worker->num_devs].events = POLLIN;
+
+    if(poll(pfd, worker->num_devs + 1, any_starved ? 1 : -1) < 0 && errno != EINTR)
+    {
+      perror("iothread: poll");
+    }
+
+    if(pfd[worker->num_devs].revents & POLLIN)
+    {
+      iothread_clear(worker->wake_fd);
+    }
+  }
+
+  return NULL;
+}
+
+/*-------------------------------------------------------------------------*/
+/* core thread */
+
+static void
+iothread_pkt_free(struct pbuf *p)
+{
+  struct iothread_pkt *pkt = (struct iothread_pkt *)p;
+  spsc_ring_push(&pkt->dev->rx_free, pkt);
+}
+
+static err_t
+iothread_output(struct netif *netif, struct pbuf *p)
+{
+  struct iothread_dev *dev = dev_of_netif[netif_get_index(netif)];
+
+  if(p->tot_len > IOTHREAD_MTU)
+  {
+    LINK_COUNTERS_INC_SHARED(&dev->counters, tx_dropped);
+    return ERR_BUF;
+  }
+
+  struct iothread_pkt *pkt = spsc_ring_pop(&dev->tx_free);
+  if(!pkt)
+  {
+    LINK_COUNTERS_INC_SHARED(&dev->counters, tx_dropped);
+    return ERR_MEM;
+  }
+
+  pkt->len = pbuf_copy_partial(p, pkt->data, p->tot_len, 0);
+  spsc_ring_push(&dev->tx, pkt);
+
+  uint32_t queued = spsc_ring_count(&dev->tx);
+  LINK_COUNTERS_SET_SHARED(&dev->counters, tx_queue, queued);
+  if(queued > dev->counters.tx_queue_max)
+  {
+    LINK_COUNTERS_SET_SHARED(&dev->counters, tx_queue_max, queued);
+  }
+  iothread_signal(dev->worker->wake_fd);
+
+  return ERR_OK;
+}
+
+static err_t
+iothread_output_v4(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+  LWIP_UNUSED_ARG(ipaddr);
+  return iothread_output(netif, p);
+}
+
+void
+iothread_worker_poll(void *arg)
+{
+  struct iothread_worker *worker = arg;
+
+  iothread_clear(worker->core_fd);
+
+  for(uint32_t i = 0; i < worker->num_devs; i++)
+  {
+    struct iothread_dev *dev = worker->devs[i];
+    struct iothread_pkt *pkt;
+
+    while((pkt = spsc_ring_pop(&dev->rx)))
+    {
+      struct pbuf *p = pbuf_alloced_custom(PBUF_RAW, pkt->len, PBUF_REF, &pkt->pc,
+                                           pkt->data, sizeof(pkt->data));
+      if(dev->netif->input(p, dev->netif) != ERR_OK)
+      {
+        pbuf_free(p);
+      }
+    }
+  }
+}
+
+int
+iothread_worker_core_fd(const struct iothread_worker *worker)
+{
+  return worker->core_fd;
+}
+
+struct iothread_worker *
+iothread_worker_create(const struct iothread_config *config)
+{
+  struct iothread_worker *worker = calloc(1, sizeof(struct iothread_worker));
+  if(!worker)
+  {
+    return NULL;
+  }
+
+  worker->config = *config;
+  worker->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  worker->core_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  if(worker->wake_fd < 0 || worker->core_fd < 0)
+  {
+    perror("iothread_worker_create");
+    exit(1);
+  }
+
+  return worker;
+}
+
+int
+iothread_worker_start(struct iothread_worker *worker)
+{
+  int err = pthread_create(&worker->thread, NULL, iothread_main, worker);
+  if(err)
+  {
+    fprintf(stderr, "iothread_worker_start: pthread_create: %s\n", strerror(err));
+    return -1;
+  }
+  return 0;
+}
+
+struct iothread_dev *
+iothread_attach(struct iothread_worker *worker,
+                struct netif *netif,
+                int fd,
+                enum iothread_kind kind)
+{
+  if(worker->num_devs >= IOTHREAD_MAX_DEVS)
+  {
+    fprintf(stderr, "iothread_attach: too many devices per worker\n");
+    return NULL;
+  }
+
+  struct iothread_dev *dev = calloc(1, sizeof(struct iothread_dev));
+  if(!dev)
+  {
+    return NULL;
+  }
+
+  dev->fd = fd;
+  dev->kind = kind;
+  dev->netif = netif;
+  dev->worker = worker;
+  dev->pkts = calloc(2 * IOTHREAD_RING_SIZE, sizeof(struct iothread_pkt));
+
+  if(!dev->pkts ||
+     spsc_ring_init(&dev->rx, IOTHREAD_RING_SIZE) ||
+     spsc_ring_init(&dev->rx_free, IOTHREAD_RING_SIZE) ||
+     spsc_ring_init(&dev->tx, IOTHREAD_RING_SIZE) ||
+     spsc_ring_init(&dev->tx_free, IOTHREAD_RING_SIZE))
+  {
+    perror("iothread_attach");
+    exit(1);
+  }
+
+  for(int i = 0; i < 2 * IOTHREAD_RING_SIZE; i++)
+  {
+    struct iothread_pkt *pkt = &dev->pkts[i];
+    pkt->dev = dev;
+    pkt->pc.custom_free_function = iothread_pkt_free;
+    spsc_ring_push(i < IOTHREAD_RING_SIZE ? &dev->rx_free : &dev->tx_free, pkt);
+  }
+
+  dev_of_netif[netif_get_index(netif)] = dev;
+  link_counters_attach(netif, &dev->counters);
+  netif->output = iothread_output_v4;
+  netif->linkoutput = iothread_output;
+
+  worker->devs[worker->num_devs++] = dev;
+  return dev;
+}
@@ -0,0 +1,157 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "gateway/link_config.h"
+
+#include "lwip/def.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LINK_CONFIG_DEFAULT_BAUD (1000000)
+
+/* what the host drivers frame, and the least ipv4 allows */
+#define LINK_CONFIG_DEFAULT_MTU (1500)
+#define LINK_CONFIG_MIN_MTU (68)
+
+static int
+link_config_hex(uint8_t *out, size_t len, const char *hex)
+{
+  if(strlen(hex) != 2 * len)
+  {
+    return -1;
+  }
+
+  for(size_t i = 0; i < len; i++)
+  {
+    char byte[3] = { hex[2 * i], hex[2 * i + 1], '\0' };
+    if(!isxdigit((unsigned char)byte[0]) || !isxdigit((unsigned char)byte[1]))
+    {
+      return -1;
+    }
+    out[i] = (uint8_t)strtoul(byte, NULL, 16);
+  }
+  return 0;
+}
+
+int
+link_config_parse(struct link_config *link, const char *spec)
+{
+  char buf[160];
+  if(strlen(spec) >= sizeof(buf))
+  {
+    return -1;
+  }
+  strcpy(buf, spec);
+
+  char *path = strtok(buf, ",");
+  char *addr = strtok(NULL, ",");
+
+  /* baud, framing and key by position, name=value options anywhere after */
+  char *baud = NULL;
+  char *framing = NULL;
+  char *key = NULL;
+  char **positional[] = { &baud, &framing, &key };
+  size_t num_positional = 0;
+  link->mtu = LINK_CONFIG_DEFAULT_MTU;
+
+  for(char *field = strtok(NULL, ","); field; field = strtok(NULL, ","))
+  {
+    if(strncmp(field, "mtu=", 4) == 0)
+    {
+      char *end;
+      unsigned long mtu = strtoul(field + 4, &end, 10);
+      if(*end || mtu < LINK_CONFIG_MIN_MTU || mtu > LINK_CONFIG_DEFAULT_MTU)
+      {
+        return -1;
+      }
+      link->mtu = (uint16_t)mtu;
+    } else if(num_positional < sizeof(positional) / sizeof(positional[0])) {
+      *positional[num_positional++] = field;
+    } else {
+      return -1;
+    }
+  }
+
+  if(!path || !addr || strlen(path) >= sizeof(link->path))
+  {
+    return -1;
+  }
+
+  char *prefix = strchr(addr, '/');
+  if(!prefix)
+  {
+    return -1;
+  }
+  *prefix++ = '\0';
+
+  int bits = atoi(prefix);
+  if(bits < 1 || bits > 30 || !ip4addr_aton(addr, &link->ipaddr))
+  {
+    return -1;
+  }
+
+  if(!framing || strcmp(framing, "slip") == 0)
+  {
+    link->framing = LINK_FRAMING_SLIP;
+  } else if(strcmp(framing, "hdlc") == 0) {
+    link->framing = LINK_FRAMING_HDLC;
+  } else if(strcmp(framing, "hdlc32") == 0) {
+    link->framing = LINK_FRAMING_HDLC32;
+  } else {
+    return -1;
+  }
+
+  link->has_key = key != NULL;
+  if(key && link_config_hex(link->key, sizeof(link->key), key) < 0)
+  {
+    return -1;
+  }
+
+  strcpy(link->path, path);
+  ip4_addr_set_u32(&link->netmask, lwip_htonl(0xFFFFFFFFUL << (32 - bits)));
+  link->baud = baud ? (uint32_t)strtoul(baud, NULL, 10) : LINK_CONFIG_DEFAULT_BAUD;
+
+  return 0;
+}
+
+int
+link_config_load(struct link_config *links,
+                 uint32_t *num_links,
+                 uint32_t max_links,
+                 const char *path)
+{
+  FILE *file = fopen(path, "r");
+  if(!file)
+  {
+    perror(path);
+    return -1;
+  }
+
+  char line[192];
+  int added = 0;
+  while(fgets(line, sizeof(line), file))
+  {
+    line[strcspn(line, "\r\n")] = '\0';
+    if(line[0] == '\0' || line[0] == '#')
+    {
+      continue;
+    }
+
+    if(*num_links == max_links ||
+       link_config_parse(&links[*num_links], line) < 0)
+    {
+      fprintf(stderr, "%s: bad link %s\n", path, line);
+      fclose(file);
+      return -1;
+    }
+    (*num_links)++;
+    added++;
+  }
+
+  fclose(file);
+  return added;
+}
@@ -0,0 +1,238 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "gateway/pmtu.h"
+
+#include "lwip/opt.h"
+#include "lwip/def.h"
+#include "lwip/icmp.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/ip.h"
+#include "lwip/ip4.h"
+#include "lwip/pbuf.h"
+#include "lwip/sys.h"
+#include "lwip/prot/icmp.h"
+#include "lwip/prot/ip4.h"
+#include "lwip/prot/tcp.h"
+
+#include <string.h>
+
+#define PMTU_TCP_OPT_EOL (0)
+#define PMTU_TCP_OPT_NOP (1)
+#define PMTU_TCP_OPT_MSS (2)
+
+/* ip + tcp header without options */
+#define PMTU_TCPIP_HLEN (IP_HLEN + TCP_HLEN)
+
+/* quoted from the offending packet: its ip header and 64 bits of payload */
+#define PMTU_ICMP_QUOTE (8)
+
+static u32_t pmtu_icmp_second;
+static u32_t pmtu_icmp_count;
+
+/* rfc 1624 eqn. 3 for one 16 bit word; a word at an odd offset from the
+ * start of the checksummed data is summed byte swapped */
+static u16_t
+pmtu_chksum_adjust(u16_t chksum, u16_t old_value, u16_t new_value, int odd)
+{
+  if(odd)
+  {
+    old_value = SWAP_BYTES_IN_WORD(old_value);
+    new_value = SWAP_BYTES_IN_WORD(new_value);
+  }
+
+  u32_t sum = (u16_t)~lwip_ntohs(chksum);
+  sum += (u16_t)~old_value;
+  sum += new_value;
+  sum = (sum & 0xFFFF) + (sum >> 16);
+  sum = (sum & 0xFFFF) + (sum >> 16);
+  return lwip_htons((u16_t)~sum);
+}
+
+/* headers are in the first pbuf for everything tapif and the serial
+ * drivers deliver, a syn split across pbufs is left alone */
+static void
+pmtu_clamp_mss(struct pbuf *p, u16_t iphdr_len, u16_t mtu)
+{
+  if(p->len < iphdr_len + TCP_HLEN)
+  {
+    return;
+  }
+
+  struct tcp_hdr *tcph = (struct tcp_hdr *)((u8_t *)p->payload + iphdr_len);
+  if(!(TCPH_FLAGS(tcph) & TCP_SYN))
+  {
+    return;
+  }
+
+  u16_t hdr_len = TCPH_HDRLEN_BYTES(tcph);
+  if(hdr_len < TCP_HLEN || p->len < iphdr_len + hdr_len)
+  {
+    return;
+  }
+
+  u16_t max_mss = mtu - PMTU_TCPIP_HLEN;
+  u8_t *opts = (u8_t *)tcph;
+  u16_t i = TCP_HLEN;
+  while(i < hdr_len)
+  {
+    u8_t kind = opts[i];
+    if(kind == PMTU_TCP_OPT_EOL)
+    {
+      break;
+    }
+    if(kind == PMTU_TCP_OPT_NOP)
+    {
+      i++;
+      continue;
+    }
+    if(i + 1 >= hdr_len || opts[i + 1] < 2 || i + opts[i + 1] > hdr_len)
+    {
+      break;
+    }
+
+    if(kind == PMTU_TCP_OPT_MSS && opts[i + 1] == 4)
+    {
+      u16_t mss = (opts[i + 2] << 8) | opts[i + 3];
+      if(mss > max_mss)
+      {
+        u16_t old_word;
+        u16_t new_word;
+        memcpy(&old_word, &opts[i + 2], sizeof(old_word));
+        opts[i + 2] = max_mss >> 8;
+        opts[i + 3] = max_mss & 0xFF;
+        memcpy(&new_word, &opts[i + 2], sizeof(new_word));
+
+        // the tcp checksum starts at the tcp header, byte i + 2 decides
+        // which half of a checksum word the value lands in
+        tcph->chksum = pmtu_chksum_adjust(tcph->chksum, lwip_ntohs(old_word),
+                                          lwip_ntohs(new_word), i & 1);
+      }
+      return;
+    }
+    i += opts[i + 1];
+  }
+  /* a syn without the option means 536, which every link carries */
+}
+
+static int
+pmtu_icmp_allowed(void)
+{
+  u32_t second = sys_now() / 1000;
+  if(second != pmtu_icmp_second)
+  {
+    pmtu_icmp_second = second;
+    pmtu_icmp_count = 0;
+  }
+  return pmtu_icmp_count++ < PMTU_ICMP_PER_SECOND;
+}
+
+/* errors about icmp errors are not sent (rfc 1122 3.2.2) */
+static int
+pmtu_is_icmp_error(struct pbuf *p, u16_t iphdr_len)
+{
+  u8_t type;
+  if(pbuf_copy_partial(p, &type, 1, iphdr_len) != 1)
+  {
+    return 0;
+  }
+  return type == ICMP_DUR || type == ICMP_SQ || type == ICMP_RD ||
+         type == ICMP_TE || type == ICMP_PP;
+}
+
+static void
+pmtu_send_too_big(struct pbuf *p, struct netif *inp, u16_t iphdr_len, u16_t mtu)
+{
+  const struct ip_hdr *iph = (const struct ip_hdr *)p->payload;
+  u16_t quote = LWIP_MIN(p->tot_len, iphdr_len + PMTU_ICMP_QUOTE);
+
+  struct pbuf *q = pbuf_alloc(PBUF_IP, sizeof(struct icmp_echo_hdr) + quote, PBUF_RAM);
+  if(!q)
+  {
+    return;
+  }
+
+  /* type 3 code 4, the next-hop mtu in the low half of the unused word */
+  struct icmp_echo_hdr *icmph = (struct icmp_echo_hdr *)q->payload;
+  icmph->type = ICMP_DUR;
+  icmph->code = ICMP_DUR_FRAG;
+  icmph->chksum = 0;
+  icmph->id = 0;
+  icmph->seqno = lwip_htons(mtu);
+  pbuf_copy_partial(p, (u8_t *)q->payload + sizeof(*icmph), quote, 0);
+  icmph->chksum = inet_chksum(q->payload, q->len);
+
+  ip4_addr_t src;
+  ip4_addr_copy(src, iph->src);
+  ip4_output_if(q, netif_ip4_addr(inp), &src, ICMP_TTL, 0, IP_PROTO_ICMP, inp);
+  pbuf_free(q);
+}
+
+err_t
+pmtu_input(struct pbuf *p, struct netif *inp)
+{
+  if(p->len < IP_HLEN)
+  {
+    return ip_input(p, inp);
+  }
+
+  const struct ip_hdr *iph = (const struct ip_hdr *)p->payload;
+  u16_t iphdr_len = IPH_HL_BYTES(iph);
+  if(IPH_V(iph) != 4 || iphdr_len < IP_HLEN || p->len < iphdr_len ||
+     IPH_TTL(iph) <= 1)
+  {
+    // ip_input drops it or answers with time exceeded
+    return ip_input(p, inp);
+  }
+
+  ip4_addr_t dest;
+  ip4_addr_copy(dest, iph->dest);
+  if(ip4_addr_ismulticast(&dest) || ip4_addr_isbroadcast(&dest, inp))
+  {
+    return ip_input(p, inp);
+  }
+
+  struct netif *netif;
+  NETIF_FOREACH(netif)
+  {
+    if(ip4_addr_cmp(&dest, netif_ip4_addr(netif)))
+    {
+      return ip_input(p, inp);
+    }
+  }
+
+  struct netif *out = ip4_route(&dest);
+  if(!out || out == inp || !out->mtu)
+  {
+    return ip_input(p, inp);
+  }
+
+  u16_t offset = lwip_ntohs(IPH_OFFSET(iph));
+  u16_t tot_len = lwip_ntohs(IPH_LEN(iph));
+  if(tot_len > out->mtu)
+  {
+    if(!(offset & IP_DF))
+    {
+      // ip4_forward drops it, without IP_FRAG there is nothing better
+      return ip_input(p, inp);
+    }
+
+    if((offset & IP_OFFMASK) == 0 &&
+       !(IPH_PROTO(iph) == IP_PROTO_ICMP && pmtu_is_icmp_error(p, iphdr_len)) &&
+       pmtu_icmp_allowed())
+    {
+      pmtu_send_too_big(p, inp, iphdr_len, out->mtu);
+    }
+    pbuf_free(p);
+    return ERR_OK;
+  }
+
+  if(IPH_PROTO(iph) == IP_PROTO_TCP && (offset & IP_OFFMASK) == 0 &&
+     out->mtu > PMTU_TCPIP_HLEN)
+  {
+    pmtu_clamp_mss(p, iphdr_len, out->mtu);
+  }
+
+  return ip_input(p, inp);
+}
@@ -0,0 +1,256 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "gateway/reactor.h"
+
+#include "lwip/arch.h"
+#include "lwip/timeouts.h"
+#include "arch/sio_pc.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+/* epoll user data of the timerfd, sources use their index */
+#define REACTOR_TIMER_TAG (UINT32_MAX)
+
+static void
+reactor_arm_timer(struct reactor *reactor, uint32_t sleeptime_ms)
+{
+  struct itimerspec its;
+  memset(&its, 0, sizeof(its));
+
+  if(sleeptime_ms != SYS_TIMEOUTS_SLEEPTIME_INFINITE)
+  {
+    its.it_value.tv_sec = sleeptime_ms / 1000;
+    its.it_value.tv_nsec = (sleeptime_ms % 1000) * 1000000L;
+    if(sleeptime_ms == 0)
+    {
+      /* all zero would disarm the timer, expire as soon as possible instead */
+      its.it_value.tv_nsec = 1;
+    }
+  }
+
+  if(timerfd_settime(reactor->timer_fd, 0, &its, NULL) < 0)
+  {
+    perror("reactor: timerfd_settime");
+  }
+}
+
+int
+reactor_open(struct reactor *reactor)
+{
+  memset(reactor, 0, sizeof(*reactor));
+
+  reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if(reactor->epoll_fd < 0)
+  {
+    perror("reactor: epoll_create1");
+    return -1;
+  }
+
+  reactor->timer_fd = timerfd_create(CLOCK_MONOTONIC,
+                                     TFD_NONBLOCK | TFD_CLOEXEC);
+  if(reactor->timer_fd < 0)
+  {
+    perror("reactor: timerfd_create");
+    close(reactor->epoll_fd);
+    return -1;
+  }
+
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.u32 = REACTOR_TIMER_TAG;
+
+  if(epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->timer_fd, &ev) < 0)
+  {
+    perror("reactor: epoll_ctl timerfd");
+    close(reactor->timer_fd);
+    close(reactor->epoll_fd);
+    return -1;
+  }
+
+  return 0;
+}
+
+int
+reactor_add(struct reactor *reactor,
+            int fd,
+            reactor_poll_fn poll,
+            void *arg)
+{
+  if(reactor->num_sources >= REACTOR_MAX_SOURCES)
+  {
+    fprintf(stderr, "reactor: too many sources\n");
+    return -1;
+  }
+
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  /* level triggered: the poll functions may leave data in the fd
+   * (tapif_poll reads at most TAPIF_RX_BUDGET packets per call) */
+  ev.events = EPOLLIN;
+  ev.data.u32 = reactor->num_sources;
+
+  if(epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+  {
+    perror("reactor: epoll_ctl");
+    return -1;
+  }
+
+  struct reactor_source *source = &reactor->sources[reactor->num_sources++];
+  source->fd = fd;
+  source->poll = poll;
+  source->arg = arg;
+  source->sio_fd = -1;
+  source->events = ev.events;
+
+  return 0;
+}
+
+int
+reactor_add_sio(struct reactor *reactor,
+                int fd,
+                reactor_poll_fn poll,
+                void *arg)
+{
+  if(uring_enabled() && sio_set_rx_ready(fd, poll, arg) == 0)
+  {
+    return 0;
+  }
+
+  if(reactor_add(reactor, fd, poll, arg) < 0)
+  {
+    return -1;
+  }
+
+  reactor->sources[reactor->num_sources - 1].sio_fd = fd;
+  return 0;
+}
+
+/* POLLOUT while a device's tx queue waits for it, the poll and epoll
+ * event bits are the same on linux */
+static void
+reactor_arm_sources(struct reactor *reactor)
+{
+  for(uint32_t i = 0; i < reactor->num_sources; i++)
+  {
+    struct reactor_source *source = &reactor->sources[i];
+    if(source->sio_fd < 0)
+    {
+      continue;
+    }
+
+    uint32_t events = EPOLLIN | (uint16_t)sio_tx_events(source->sio_fd);
+    if(events == source->events)
+    {
+      continue;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.u32 = i;
+    if(epoll_ctl(reactor->epoll_fd, EPOLL_CTL_MOD, source->fd, &ev) < 0)
+    {
+      perror("reactor: epoll_ctl");
+      continue;
+    }
+    source->events = events;
+  }
+}
+
+static void
+reactor_dispatch(struct reactor *reactor, int timeout)
+{
+  struct epoll_event events[REACTOR_MAX_SOURCES + 1];
+
+  int n = epoll_wait(reactor->epoll_fd, events, LWIP_ARRAYSIZE(events), timeout);
+  if(n < 0)
+  {
+    if(errno != EINTR)
+    {
+      perror("reactor: epoll_wait");
+    }
+    return;
+  }
+
+  for(int i = 0; i < n; i++)
+  {
+    uint32_t tag = events[i].data.u32;
+
+    if(tag == REACTOR_TIMER_TAG)
+    {
+      uint64_t expirations;
+      if(read(reactor->timer_fd, &expirations, sizeof(expirations)) < 0 &&
+         errno != EAGAIN)
+      {
+        perror("reactor: timerfd read");
+      }
+    } else {
+      struct reactor_source *source = &reactor->sources[tag];
+      source->poll(source->arg);
+    }
+  }
+}
+
+static void
+reactor_epoll_ready(struct uring_op *op, int32_t res, uint32_t flags)
+{
+  struct reactor *reactor =
+    (struct reactor *)((uint8_t *)op - offsetof(struct reactor, epoll_op));
+
+  (void)flags;
+  reactor->epoll_armed = 0;
+  if(res < 0 && res != -EINTR)
+  {
+    fprintf(stderr, "reactor: poll epoll fd: %s\n", strerror(-res));
+    return;
+  }
+  reactor_dispatch(reactor, 0);
+}
+
+/* the timerfd stays disarmed, uring_run's wait carries the timeout */
+static void
+reactor_run_uring(struct reactor *reactor)
+{
+  reactor_arm_sources(reactor);
+
+  if(reactor->num_sources && !reactor->epoll_armed)
+  {
+    struct io_uring_sqe *sqe = uring_sqe(&reactor->epoll_op);
+    if(sqe)
+    {
+      reactor->epoll_op.complete = reactor_epoll_ready;
+      sqe->opcode = IORING_OP_POLL_ADD;
+      sqe->fd = reactor->epoll_fd;
+      sqe->poll32_events = EPOLLIN;
+      reactor->epoll_armed = 1;
+    }
+  }
+
+  uint32_t sleeptime = sys_timeouts_sleeptime();
+  uring_run(sleeptime == SYS_TIMEOUTS_SLEEPTIME_INFINITE ? UINT32_MAX : sleeptime);
+}
+
+void
+reactor_run_once(struct reactor *reactor)
+{
+  sys_check_timeouts();
+
+  if(uring_enabled())
+  {
+    reactor_run_uring(reactor);
+    return;
+  }
+
+  reactor_arm_timer(reactor, sys_timeouts_sleeptime());
+  reactor_arm_sources(reactor);
+  reactor_dispatch(reactor, -1);
+}
@@ -0,0 +1,551 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "gateway/sched.h"
+#include "link_counters.h"
+
+#include "lwip/opt.h"
+#include "lwip/def.h"
+#include "lwip/pbuf.h"
+#include "lwip/timeouts.h"
+#include "lwip/prot/ip4.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SCHED_MAX_NETIF (256)
+
+/* the shaper's bucket, what may go out back to back after an idle link */
+#define SCHED_BURST_PACKETS (2)
+
+/* slip ends, escapes are in SCHED_RATE_PERCENT */
+#define SCHED_FRAME_OVERHEAD (2)
+
+#define SCHED_PRIO (SCHED_FLOWS)
+
+struct sched_pkt
+{
+  struct sched_pkt *next;
+  uint64_t enqueue_ns;
+  ip4_addr_t dest;
+  u16_t len;
+  u8_t data[];
+};
+
+struct sched_queue
+{
+  struct sched_pkt *head;
+  struct sched_pkt *tail;
+  u32_t packets;
+  u32_t bytes;
+  s32_t deficit;
+  /* on the round robin list */
+  struct sched_queue *next_active;
+  u8_t active;
+
+  /* codel */
+  uint64_t first_above_ns;
+  uint64_t drop_next_ns;
+  u32_t count;
+  u32_t last_count;
+  u8_t dropping;
+};
+
+struct sched_link
+{
+  struct netif *netif;
+  netif_output_fn lower_output;
+  struct sched_config config;
+  struct link_counters *counters;
+  struct link_counters own_counters;
+
+  uint64_t target_ns;
+  uint64_t interval_ns;
+  u32_t quantum;
+
+  /* shaper credit in bytes, may go below 0 by one packet */
+  int64_t credit;
+  int64_t burst;
+  uint64_t refill_ns;
+  u8_t timer_armed;
+
+  u32_t packets;
+  /* queues[SCHED_PRIO] is the priority band and the fifo */
+  struct sched_queue queues[SCHED_FLOWS + 1];
+  struct sched_queue *active_head;
+  struct sched_queue *active_tail;
+};
+
+static struct sched_link *sched_links[SCHED_MAX_NETIF];
+
+static uint64_t
+sched_now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static u32_t
+sched_isqrt(uint64_t x)
+{
+  uint64_t r = 0;
+  uint64_t bit = 1ULL << 62;
+  while(bit > x)
+  {
+    bit >>= 2;
+  }
+  while(bit)
+  {
+    if(x >= r + bit)
+    {
+      x -= r + bit;
+      r = (r >> 1) + bit;
+    } else {
+      r >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (u32_t)r;
+}
+
+/* --- queues --------------------------------------------------------- */
+
+static void
+sched_queue_push(struct sched_queue *q, struct sched_pkt *pkt)
+{
+  pkt->next = NULL;
+  if(q->tail)
+  {
+    q->tail->next = pkt;
+  } else {
+    q->head = pkt;
+  }
+  q->tail = pkt;
+  q->packets++;
+  q->bytes += pkt->len;
+}
+
+static struct sched_pkt *
+sched_queue_pop(struct sched_queue *q)
+{
+  struct sched_pkt *pkt = q->head;
+  if(pkt)
+  {
+    q->head = pkt->next;
+    if(!q->head)
+    {
+      q->tail = NULL;
+    }
+    q->packets--;
+    q->bytes -= pkt->len;
+  }
+  return pkt;
+}
+
+/* back to the head, the lower output had no room for it */
+static void
+sched_queue_unpop(struct sched_queue *q, struct sched_pkt *pkt)
+{
+  pkt->next = q->head;
+  q->head = pkt;
+  if(!q->tail)
+  {
+    q->tail = pkt;
+  }
+  q->packets++;
+  q->bytes += pkt->len;
+}
+
+static void
+sched_active_push(struct sched_link *link, struct sched_queue *q)
+{
+  q->active = 1;
+  q->next_active = NULL;
+  if(link->active_tail)
+  {
+    link->active_tail->next_active = q;
+  } else {
+    link->active_head = q;
+  }
+  link->active_tail = q;
+}
+
+static void
+sched_activate(struct sched_link *link, struct sched_queue *q)
+{
+  if(!q->active)
+  {
+    q->deficit = link->quantum;
+    sched_active_push(link, q);
+  }
+}
+
+static struct sched_queue *
+sched_active_pop(struct sched_link *link)
+{
+  struct sched_queue *q = link->active_head;
+  if(q)
+  {
+    link->active_head = q->next_active;
+    if(!link->active_head)
+    {
+      link->active_tail = NULL;
+    }
+    q->active = 0;
+  }
+  return q;
+}
+
+static void
+sched_drop(struct sched_link *link, struct sched_pkt *pkt)
+{
+  link->packets--;
+  LINK_COUNTERS_INC(link->counters, tx_aqm_dropped);
+  free(pkt);
+}
+
+/* --- codel ---------------------------------------------------------- */
+
+static uint64_t
+sched_codel_control_law(const struct sched_link *link, uint64_t t, u32_t count)
+{
+  /* interval / sqrt(count), in 1/256 steps */
+  return t + (link->interval_ns << 8) / sched_isqrt((uint64_t)count << 16);
+}
+
+static int
+sched_codel_should_drop(struct sched_link *link, struct sched_queue *q,
+                        const struct sched_pkt *pkt, uint64_t now)
+{
+  if(!pkt)
+  {
+    q->first_above_ns = 0;
+    return 0;
+  }
+
+  /* a single packet in the queue is not a standing queue */
+  if(now - pkt->enqueue_ns < link->target_ns || q->bytes <= link->quantum)
+  {
+    q->first_above_ns = 0;
+    return 0;
+  }
+
+  if(!q->first_above_ns)
+  {
+    q->first_above_ns = now + link->interval_ns;
+    return 0;
+  }
+  return now >= q->first_above_ns;
+}
+
+/* rfc 8289 5.5, the head of q after the drops codel asks for */
+static struct sched_pkt *
+sched_codel_dequeue(struct sched_link *link, struct sched_queue *q, uint64_t now)
+{
+  struct sched_pkt *pkt = sched_queue_pop(q);
+  int drop = sched_codel_should_drop(link, q, pkt, now);
+
+  if(q->dropping)
+  {
+    if(!drop)
+    {
+      q->dropping = 0;
+    }
+    while(q->dropping && now >= q->drop_next_ns)
+    {
+      sched_drop(link, pkt);
+      q->count++;
+      pkt = sched_queue_pop(q);
+      if(!sched_codel_should_drop(link, q, pkt, now))
+      {
+        q->dropping = 0;
+      } else {
+        q->drop_next_ns = sched_codel_control_law(link, q->drop_next_ns, q->count);
+      }
+    }
+  } else if(drop) {
+    sched_drop(link, pkt);
+    pkt = sched_queue_pop(q);
+    q->dropping = 1;
+
+    /* back into dropping soon after leaving it: resume near the old rate */
+    u32_t delta = q->count - q->last_count;
+    if(delta > 1 && now - q->drop_next_ns < 16 * link->interval_ns)
+    {
+      q->count = delta;
+    } else {
+      q->count = 1;
+    }
+    q->last_count = q->count;
+    q->drop_next_ns = sched_codel_control_law(link, now, q->count);
+  }
+
+  return pkt;
+}
+
+/* --- enqueue -------------------------------------------------------- */
+
+static struct sched_queue *
+sched_classify(struct sched_link *link, const u8_t *pkt, u16_t len)
+{
+  const struct ip_hdr *iph = (const struct ip_hdr *)pkt;
+
+  if(link->config.fifo ||
+     len < IP_HLEN || IPH_V(iph) != 4)
+  {
+    return &link->queues[SCHED_PRIO];
+  }
+
+  if(len <= SCHED_SMALL_PACKET || IPH_PROTO(iph) == IP_PROTO_ICMP)
+  {
+    return &link->queues[SCHED_PRIO];
+  }
+
+  u32_t h;
+  memcpy(&h, &iph->src, sizeof(h));
+  h ^= IPH_PROTO(iph);
+  h *= 0x9E3779B1UL;
+
+  u32_t dest;
+  memcpy(&dest, &iph->dest, sizeof(dest));
+  h ^= dest;
+  h *= 0x9E3779B1UL;
+
+  u16_t hlen = IPH_HL_BYTES(iph);
+  if((IPH_PROTO(iph) == IP_PROTO_TCP || IPH_PROTO(iph) == IP_PROTO_UDP) &&
+     !(lwip_ntohs(IPH_OFFSET(iph)) & IP_OFFMASK) && len >= hlen + 4)
+  {
+    u32_t ports;
+    memcpy(&ports, pkt + hlen, sizeof(ports));
+    h ^= ports;
+    h *= 0x9E3779B1UL;
+  }
+
+  return &link->queues[(h >> 16) % SCHED_FLOWS];
+}
+
+/* fq_codel's overflow rule: the flow with the most bytes pays */
+static void
+sched_drop_longest(struct sched_link *link)
+{
+  struct sched_queue *longest = &link->queues[0];
+  for(u32_t i = 1; i < SCHED_FLOWS; i++)
+  {
+    if(link->queues[i].bytes > longest->bytes)
+    {
+      longest = &link->queues[i];
+    }
+  }
+
+  struct sched_pkt *pkt = sched_queue_pop(longest);
+  if(pkt)
+  {
+    sched_drop(link, pkt);
+  }
+}
+
+/* --- dequeue -------------------------------------------------------- */
+
+static struct sched_pkt *
+sched_dequeue(struct sched_link *link, uint64_t now, struct sched_queue **from)
+{
+  struct sched_queue *prio = &link->queues[SCHED_PRIO];
+  if(prio->head)
+  {
+    *from = prio;
+    return sched_queue_pop(prio);
+  }
+
+  struct sched_queue *q;
+  while((q = link->active_head) != NULL)
+  {
+    if(q->deficit <= 0)
+    {
+      /* used up its round, to the back with the next quantum */
+      sched_active_pop(link);
+      q->deficit += link->quantum;
+      sched_active_push(link, q);
+      continue;
+    }
+
+    struct sched_pkt *pkt = sched_codel_dequeue(link, q, now);
+    if(!pkt)
+    {
+      sched_active_pop(link);
+      continue;
+    }
+
+    q->deficit -= pkt->len;
+    *from = q;
+    return pkt;
+  }
+
+  return NULL;
+}
+
+static void sched_tick(void *arg);
+
+static void
+sched_refill(struct sched_link *link, uint64_t now)
+{
+  /* the bucket is full long before a second, and the product stays
+   * within 64 bits */
+  uint64_t elapsed = LWIP_MIN(now - link->refill_ns, 1000000000ULL);
+  link->refill_ns = now;
+  link->credit += (int64_t)(elapsed * link->config.rate / 1000000000ULL);
+  if(link->credit > link->burst)
+  {
+    link->credit = link->burst;
+  }
+}
+
+static void
+sched_run(struct sched_link *link)
+{
+  uint64_t now = sched_now_ns();
+  sched_refill(link, now);
+
+  while(link->credit > 0 && link->packets)
+  {
+    struct sched_queue *from;
+    struct sched_pkt *pkt = sched_dequeue(link, now, &from);
+    if(!pkt)
+    {
+      break;
+    }
+
+    struct pbuf *p = pbuf_alloc(PBUF_RAW, pkt->len, PBUF_REF);
+    if(!p)
+    {
+      sched_queue_unpop(from, pkt);
+      break;
+    }
+    p->payload = pkt->data;
+
+    err_t err = link->lower_output(link->netif, p, &pkt->dest);
+    pbuf_free(p);
+    if(err == ERR_MEM)
+    {
+      sched_queue_unpop(from, pkt);
+      break;
+    }
+
+    u32_t delay_us = (u32_t)((now - pkt->enqueue_ns) / 1000);
+    LINK_COUNTERS_SET(link->counters, tx_delay_us, delay_us);
+    if(delay_us > link->counters->tx_delay_max_us)
+    {
+      LINK_COUNTERS_SET(link->counters, tx_delay_max_us, delay_us);
+    }
+
+    link->credit -= pkt->len + SCHED_FRAME_OVERHEAD;
+    link->packets--;
+    free(pkt);
+  }
+
+  if(link->packets && !link->timer_armed)
+  {
+    /* until the credit is back, at least one tick */
+    u32_t wait_ms = 1;
+    if(link->credit < 0)
+    {
+      wait_ms = (u32_t)((-link->credit * 1000) / link->config.rate) + 1;
+    }
+    link->timer_armed = 1;
+    sys_timeout(wait_ms, sched_tick, link);
+  }
+}
+
+static void
+sched_tick(void *arg)
+{
+  struct sched_link *link = (struct sched_link *)arg;
+  link->timer_armed = 0;
+  sched_run(link);
+}
+
+static err_t
+sched_output(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+  struct sched_link *link = sched_links[netif->num];
+
+  struct sched_pkt *pkt = malloc(sizeof(*pkt) + p->tot_len);
+  if(!pkt)
+  {
+    LINK_COUNTERS_INC(link->counters, tx_aqm_dropped);
+    return ERR_MEM;
+  }
+  pkt->len = pbuf_copy_partial(p, pkt->data, p->tot_len, 0);
+  pkt->enqueue_ns = sched_now_ns();
+  ip4_addr_copy(pkt->dest, *ipaddr);
+
+  struct sched_queue *q = sched_classify(link, pkt->data, pkt->len);
+  u32_t limit = link->config.fifo ? SCHED_LIMIT : SCHED_PRIO_LIMIT;
+  if(q == &link->queues[SCHED_PRIO] && q->packets >= limit)
+  {
+    LINK_COUNTERS_INC(link->counters, tx_aqm_dropped);
+    free(pkt);
+    return ERR_OK;
+  }
+
+  sched_queue_push(q, pkt);
+  link->packets++;
+  if(q != &link->queues[SCHED_PRIO])
+  {
+    sched_activate(link, q);
+    if(link->packets > SCHED_LIMIT)
+    {
+      sched_drop_longest(link);
+    }
+  }
+
+  sched_run(link);
+  return ERR_OK;
+}
+
+u32_t
+sched_rate_of_baud(u32_t baud)
+{
+  return (u32_t)((uint64_t)baud / 10 * SCHED_RATE_PERCENT / 100);
+}
+
+err_t
+sched_attach(struct netif *netif, const struct sched_config *config)
+{
+  if(sched_links[netif->num] || config->rate == 0)
+  {
+    return ERR_ARG;
+  }
+
+  /* host only, like the drivers below */
+  struct sched_link *link = calloc(1, sizeof(*link));
+  if(!link)
+  {
+    return ERR_MEM;
+  }
+
+  link->netif = netif;
+  link->lower_output = netif->output;
+  link->config = *config;
+  link->counters = link_counters_of(netif);
+  if(!link->counters)
+  {
+    link->counters = &link->own_counters;
+  }
+
+  link->quantum = netif->mtu;
+  link->burst = (int64_t)SCHED_BURST_PACKETS * (netif->mtu + SCHED_FRAME_OVERHEAD);
+  link->credit = link->burst;
+  link->refill_ns = sched_now_ns();
+
+  /* 1.5 mtu on the wire, codel cannot ask for less than one packet */
+  uint64_t mtu_ns = (uint64_t)(netif->mtu + SCHED_FRAME_OVERHEAD) * 1000000000ULL / config->rate;
+  link->target_ns = LWIP_MAX((uint64_t)SCHED_CODEL_TARGET_US * 1000, mtu_ns * 3 / 2);
+  link->interval_ns = LWIP_MAX((uint64_t)SCHED_CODEL_INTERVAL_US * 1000, 2 * link->target_ns);
+
+  sched_links[netif->num] = link;
+  netif->output = sched_output;
+  return ERR_OK;
+}
@@ -0,0 +1,74 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "gateway/spsc_ring.h"
+
+#include <stdlib.h>
+
+int
+spsc_ring_init(struct spsc_ring *ring, uint32_t size)
+{
+  if(size == 0 || (size & (size - 1)))
+  {
+    return -1;
+  }
+
+  ring->slots = calloc(size, sizeof(void *));
+  if(!ring->slots)
+  {
+    return -1;
+  }
+
+  ring->mask = size - 1;
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  return 0;
+}
+
+void
+spsc_ring_destroy(struct spsc_ring *ring)
+{
+  free(ring->slots);
+  ring->slots = NULL;
+}
+
+int
+spsc_ring_push(struct spsc_ring *ring, void *item)
+{
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+  if(head - tail > ring->mask)
+  {
+    return -1;
+  }
+
+  ring->slots[head & ring->mask] = item;
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+  return 0;
+}
+
+void *
+spsc_ring_pop(struct spsc_ring *ring)
+{
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+  if(head == tail)
+  {
+    return NULL;
+  }
+
+  void *item = ring->slots[tail & ring->mask];
+  atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+  return item;
+}
+
+uint32_t
+spsc_ring_count(struct spsc_ring *ring)
+{
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  return head - tail;
+}
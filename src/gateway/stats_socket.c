@@ -0,0 +1,142 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#define _GNU_SOURCE
+
+#include "gateway/stats_socket.h"
+#include "link/link_stats.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* enough for a few hundred links, doubled when it is not */
+#define STATS_SOCKET_BUF_SIZE (64 * 1024)
+
+struct stats_socket
+{
+  int fd;
+  char *buf;
+  size_t size;
+};
+
+struct stats_socket *
+stats_socket_open(const char *path)
+{
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if(strlen(path) >= sizeof(addr.sun_path))
+  {
+    fprintf(stderr, "stats_socket: path too long: %s\n", path);
+    return NULL;
+  }
+  strcpy(addr.sun_path, path);
+
+  struct stats_socket *s = calloc(1, sizeof(struct stats_socket));
+  if(!s)
+  {
+    return NULL;
+  }
+  s->size = STATS_SOCKET_BUF_SIZE;
+  s->buf = malloc(s->size);
+  s->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if(!s->buf || s->fd < 0)
+  {
+    perror("stats_socket: socket");
+    goto fail;
+  }
+
+  unlink(path);
+  if(bind(s->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+     listen(s->fd, 8) < 0)
+  {
+    perror("stats_socket: bind");
+    goto fail;
+  }
+
+  return s;
+
+fail:
+  if(s->fd >= 0)
+  {
+    close(s->fd);
+  }
+  free(s->buf);
+  free(s);
+  return NULL;
+}
+
+int
+stats_socket_fd(const struct stats_socket *stats)
+{
+  return stats->fd;
+}
+
+/* the whole snapshot in s->buf, grown until it fits */
+static size_t
+stats_socket_format(struct stats_socket *s)
+{
+  while(1)
+  {
+    u32_t cursor = LINK_STATS_CURSOR_START;
+    size_t len = link_stats_format(s->buf, s->size, &cursor);
+    if(cursor == LINK_STATS_CURSOR_DONE)
+    {
+      return len;
+    }
+
+    char *buf = realloc(s->buf, 2 * s->size);
+    if(!buf)
+    {
+      return len;
+    }
+    s->buf = buf;
+    s->size *= 2;
+  }
+}
+
+void
+stats_socket_poll(void *stats)
+{
+  struct stats_socket *s = stats;
+  size_t len = 0;
+
+  while(1)
+  {
+    int client = accept4(s->fd, NULL, NULL, SOCK_CLOEXEC);
+    if(client < 0)
+    {
+      if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+      {
+        perror("stats_socket: accept");
+      }
+      return;
+    }
+
+    // one snapshot for everyone who connected at once
+    if(!len)
+    {
+      len = stats_socket_format(s);
+    }
+
+    // a client that does not read cannot stall the core: what does not
+    // fit into the socket buffer is dropped
+    size_t done = 0;
+    while(done < len)
+    {
+      ssize_t n = send(client, s->buf + done, len - done, MSG_DONTWAIT | MSG_NOSIGNAL);
+      if(n <= 0)
+      {
+        break;
+      }
+      done += n;
+    }
+    close(client);
+  }
+}
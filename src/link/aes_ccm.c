@@ -0,0 +1,405 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "link/aes_ccm.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AES_CCM_HAVE_NI 1
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#else
+#define AES_CCM_HAVE_NI 0
+#endif
+
+#define AES_CCM_L (2)
+
+static const u8_t aes_sbox[256] =
+{
+  0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+  0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+  0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+  0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+  0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+  0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+  0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+  0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+  0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+  0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+  0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+  0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+  0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+  0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+  0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+  0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+};
+
+static int aes_ccm_use_ni = -1;
+
+static void
+aes_expand(u8_t rk[176], const u8_t key[16])
+{
+  u8_t rcon = 0x01;
+
+  memcpy(rk, key, 16);
+  for(int i = 16; i < 176; i += 4)
+  {
+    u8_t t[4] = { rk[i - 4], rk[i - 3], rk[i - 2], rk[i - 1] };
+    if(i % 16 == 0)
+    {
+      u8_t first = t[0];
+      t[0] = aes_sbox[t[1]] ^ rcon;
+      t[1] = aes_sbox[t[2]];
+      t[2] = aes_sbox[t[3]];
+      t[3] = aes_sbox[first];
+      rcon = (rcon << 1) ^ ((rcon & 0x80) ? 0x1b : 0);
+    }
+    for(int j = 0; j < 4; j++)
+    {
+      rk[i + j] = rk[i + j - 16] ^ t[j];
+    }
+  }
+}
+
+static u8_t
+aes_xtime(u8_t x)
+{
+  return (x << 1) ^ ((x & 0x80) ? 0x1b : 0);
+}
+
+static void
+aes_encrypt_sw(const u8_t rk[176], const u8_t in[16], u8_t out[16])
+{
+  u8_t s[16];
+
+  for(int i = 0; i < 16; i++)
+  {
+    s[i] = in[i] ^ rk[i];
+  }
+
+  for(int round = 1; round <= 10; round++)
+  {
+    u8_t t[16];
+
+    /* sub bytes and shift rows, state is column major */
+    for(int c = 0; c < 4; c++)
+    {
+      for(int r = 0; r < 4; r++)
+      {
+        t[4 * c + r] = aes_sbox[s[4 * ((c + r) % 4) + r]];
+      }
+    }
+
+    if(round < 10)
+    {
+      for(int c = 0; c < 4; c++)
+      {
+        u8_t *col = &t[4 * c];
+        u8_t all = col[0] ^ col[1] ^ col[2] ^ col[3];
+        u8_t first = col[0];
+        col[0] ^= all ^ aes_xtime(col[0] ^ col[1]);
+        col[1] ^= all ^ aes_xtime(col[1] ^ col[2]);
+        col[2] ^= all ^ aes_xtime(col[2] ^ col[3]);
+        col[3] ^= all ^ aes_xtime(col[3] ^ first);
+      }
+    }
+
+    for(int i = 0; i < 16; i++)
+    {
+      s[i] = t[i] ^ rk[16 * round + i];
+    }
+  }
+
+  memcpy(out, s, 16);
+}
+
+static void
+ccm_block0(u8_t b[16], const u8_t nonce[AES_CCM_NONCE_LEN], u16_t aad_len, u16_t len, u8_t tag_len)
+{
+  b[0] = (aad_len ? 0x40 : 0) | (((tag_len - 2) / 2) << 3) | (AES_CCM_L - 1);
+  memcpy(&b[1], nonce, AES_CCM_NONCE_LEN);
+  b[14] = len >> 8;
+  b[15] = len;
+}
+
+static void
+ccm_ctr(u8_t a[16], const u8_t nonce[AES_CCM_NONCE_LEN], u16_t i)
+{
+  a[0] = AES_CCM_L - 1;
+  memcpy(&a[1], nonce, AES_CCM_NONCE_LEN);
+  a[14] = i >> 8;
+  a[15] = i;
+}
+
+/* B0 and the length prefixed aad, zero padded to whole blocks
+ * the aad of a link frame is a short header, 2 blocks are plenty */
+static int
+ccm_prefix(u8_t *blocks, const u8_t nonce[AES_CCM_NONCE_LEN],
+           const u8_t *aad, u16_t aad_len, u16_t len, u8_t tag_len)
+{
+  ccm_block0(blocks, nonce, aad_len, len, tag_len);
+  if(!aad_len)
+  {
+    return 1;
+  }
+
+  int n = 1 + (2 + aad_len + 15) / 16;
+  memset(&blocks[16], 0, 16 * (n - 1));
+  blocks[16] = aad_len >> 8;
+  blocks[17] = aad_len;
+  memcpy(&blocks[18], aad, aad_len);
+  return n;
+}
+
+#define CCM_MAX_AAD (30)
+
+static int
+ccm_sw(const u8_t *rk, const u8_t nonce[AES_CCM_NONCE_LEN],
+       const u8_t *aad, u16_t aad_len, u8_t *data, u16_t len,
+       u8_t tag_len, int decrypt)
+{
+  u8_t prefix[48];
+  u8_t x[16] = { 0 };
+  u8_t a[16];
+  u8_t s[16];
+
+  int n = ccm_prefix(prefix, nonce, aad, aad_len, len, tag_len);
+  for(int b = 0; b < n; b++)
+  {
+    for(int i = 0; i < 16; i++)
+    {
+      x[i] ^= prefix[16 * b + i];
+    }
+    aes_encrypt_sw(rk, x, x);
+  }
+
+  for(u16_t off = 0, ctr = 1; off < len; off += 16, ctr++)
+  {
+    u16_t chunk = (len - off < 16) ? len - off : 16;
+
+    ccm_ctr(a, nonce, ctr);
+    aes_encrypt_sw(rk, a, s);
+    for(u16_t i = 0; i < chunk; i++)
+    {
+      u8_t plain = decrypt ? data[off + i] ^ s[i] : data[off + i];
+      x[i] ^= plain;
+      data[off + i] ^= s[i];
+    }
+    aes_encrypt_sw(rk, x, x);
+  }
+
+  ccm_ctr(a, nonce, 0);
+  aes_encrypt_sw(rk, a, s);
+
+  u8_t diff = 0;
+  for(u8_t i = 0; i < tag_len; i++)
+  {
+    if(decrypt)
+    {
+      diff |= data[len + i] ^ x[i] ^ s[i];
+    } else {
+      data[len + i] = x[i] ^ s[i];
+    }
+  }
+  return diff ? -1 : 0;
+}
+
+#if AES_CCM_HAVE_NI
+
+#define AES_NI __attribute__((target("aes,sse2")))
+
+/* two independent blocks through the rounds side by side, cbc-mac is a
+ * chain but the counter stream is not, pairing them hides aesenc latency */
+static inline AES_NI void
+aes_ni_2(const __m128i *rk, __m128i *x, __m128i *y)
+{
+  __m128i a = _mm_xor_si128(*x, rk[0]);
+  __m128i b = _mm_xor_si128(*y, rk[0]);
+  for(int r = 1; r < 10; r++)
+  {
+    a = _mm_aesenc_si128(a, rk[r]);
+    b = _mm_aesenc_si128(b, rk[r]);
+  }
+  *x = _mm_aesenclast_si128(a, rk[10]);
+  *y = _mm_aesenclast_si128(b, rk[10]);
+}
+
+static inline AES_NI __m128i
+aes_ni_1(const __m128i *rk, __m128i x)
+{
+  x = _mm_xor_si128(x, rk[0]);
+  for(int r = 1; r < 10; r++)
+  {
+    x = _mm_aesenc_si128(x, rk[r]);
+  }
+  return _mm_aesenclast_si128(x, rk[10]);
+}
+
+static inline AES_NI __m128i
+ccm_ni_ctr(__m128i a0, u16_t i)
+{
+  /* the counter is the big endian last 16 bit word */
+  return _mm_insert_epi16(a0, (u16_t)((i >> 8) | (i << 8)), 7);
+}
+
+static AES_NI int
+ccm_ni(const u8_t *round_keys, const u8_t nonce[AES_CCM_NONCE_LEN],
+       const u8_t *aad, u16_t aad_len, u8_t *data, u16_t len,
+       u8_t tag_len, int decrypt)
+{
+  const __m128i *rk = (const __m128i *)round_keys;
+  u8_t prefix[48];
+  u8_t a[16];
+
+  int n = ccm_prefix(prefix, nonce, aad, aad_len, len, tag_len);
+  ccm_ctr(a, nonce, 0);
+
+  /* B0 and the tag's key stream block together */
+  __m128i x = _mm_loadu_si128((const __m128i *)prefix);
+  __m128i a0 = _mm_loadu_si128((const __m128i *)a);
+  __m128i s0 = a0;
+  aes_ni_2(rk, &x, &s0);
+  for(int b = 1; b < n; b++)
+  {
+    x = aes_ni_1(rk, _mm_xor_si128(x, _mm_loadu_si128((const __m128i *)&prefix[16 * b])));
+  }
+
+  u16_t full = len / 16;
+  u16_t rest = len % 16;
+  u8_t tail[16] = { 0 };
+  memcpy(tail, &data[16 * full], rest);
+
+  if(!decrypt)
+  {
+    for(u16_t i = 0; i < full; i++)
+    {
+      __m128i p = _mm_loadu_si128((const __m128i *)&data[16 * i]);
+      __m128i s = ccm_ni_ctr(a0, i + 1);
+      x = _mm_xor_si128(x, p);
+      aes_ni_2(rk, &x, &s);
+      _mm_storeu_si128((__m128i *)&data[16 * i], _mm_xor_si128(p, s));
+    }
+    if(rest)
+    {
+      __m128i p = _mm_loadu_si128((const __m128i *)tail);
+      __m128i s = ccm_ni_ctr(a0, full + 1);
+      x = _mm_xor_si128(x, p);
+      aes_ni_2(rk, &x, &s);
+      _mm_storeu_si128((__m128i *)tail, _mm_xor_si128(p, s));
+      memcpy(&data[16 * full], tail, rest);
+    }
+
+    _mm_storeu_si128((__m128i *)tail, _mm_xor_si128(x, s0));
+    memcpy(&data[len], tail, tag_len);
+    return 0;
+  }
+
+  /* the mac needs the plaintext, so block i's mac runs beside block
+   * i + 1's key stream */
+  __m128i s = aes_ni_1(rk, ccm_ni_ctr(a0, 1));
+  for(u16_t i = 0; i < full; i++)
+  {
+    __m128i p = _mm_xor_si128(_mm_loadu_si128((const __m128i *)&data[16 * i]), s);
+    _mm_storeu_si128((__m128i *)&data[16 * i], p);
+    x = _mm_xor_si128(x, p);
+    if(i + 1 < full || rest)
+    {
+      s = ccm_ni_ctr(a0, i + 2);
+      aes_ni_2(rk, &x, &s);
+    } else {
+      x = aes_ni_1(rk, x);
+    }
+  }
+  if(rest)
+  {
+    u8_t plain[16] = { 0 };
+    _mm_storeu_si128((__m128i *)plain, _mm_xor_si128(_mm_loadu_si128((const __m128i *)tail), s));
+    memset(&plain[rest], 0, 16 - rest);
+    memcpy(&data[16 * full], plain, rest);
+    x = aes_ni_1(rk, _mm_xor_si128(x, _mm_loadu_si128((const __m128i *)plain)));
+  }
+
+  u8_t mac[16];
+  _mm_storeu_si128((__m128i *)mac, _mm_xor_si128(x, s0));
+  u8_t diff = 0;
+  for(u8_t i = 0; i < tag_len; i++)
+  {
+    diff |= mac[i] ^ data[len + i];
+  }
+  return diff ? -1 : 0;
+}
+
+#endif
+
+static int
+ccm_run(const struct aes_ccm_key *key, const u8_t nonce[AES_CCM_NONCE_LEN],
+        const u8_t *aad, u16_t aad_len, u8_t *data, u16_t len,
+        u8_t tag_len, int decrypt)
+{
+  if(tag_len < 4 || tag_len > AES_CCM_MAX_TAG_LEN || (tag_len & 1) ||
+     aad_len > CCM_MAX_AAD)
+  {
+    return -1;
+  }
+
+#if AES_CCM_HAVE_NI
+  if(aes_ccm_use_ni > 0)
+  {
+    return ccm_ni(key->round_keys, nonce, aad, aad_len, data, len, tag_len, decrypt);
+  }
+#endif
+  return ccm_sw(key->round_keys, nonce, aad, aad_len, data, len, tag_len, decrypt);
+}
+
+enum aes_ccm_impl
+aes_ccm_select(enum aes_ccm_impl wanted)
+{
+#if AES_CCM_HAVE_NI
+  __builtin_cpu_init();
+
+  if(wanted >= AES_CCM_AESNI && __builtin_cpu_supports("aes") && __builtin_cpu_supports("sse2"))
+  {
+    aes_ccm_use_ni = 1;
+    return AES_CCM_AESNI;
+  }
+#else
+  (void)wanted;
+#endif
+  aes_ccm_use_ni = 0;
+  return AES_CCM_SOFTWARE;
+}
+
+int
+aes_ccm_init(struct aes_ccm_key *key, const u8_t raw[AES_CCM_KEY_LEN])
+{
+  if(aes_ccm_use_ni < 0)
+  {
+    aes_ccm_select(AES_CCM_AESNI);
+  }
+
+  aes_expand(key->round_keys, raw);
+  key->area = 0;
+  return 0;
+}
+
+int
+aes_ccm_seal(const struct aes_ccm_key *key,
+             const u8_t nonce[AES_CCM_NONCE_LEN],
+             const u8_t *aad, u16_t aad_len,
+             u8_t *data, u16_t len,
+             u8_t tag_len)
+{
+  return ccm_run(key, nonce, aad, aad_len, data, len, tag_len, 0);
+}
+
+int
+aes_ccm_open(const struct aes_ccm_key *key,
+             const u8_t nonce[AES_CCM_NONCE_LEN],
+             const u8_t *aad, u16_t aad_len,
+             u8_t *data, u16_t len,
+             u8_t tag_len)
+{
+  return ccm_run(key, nonce, aad, aad_len, data, len, tag_len, 1);
+}
@@ -0,0 +1,123 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "link/aes_ccm.h"
+
+#include "ti_bsp/aes.h"
+#include "ti_bsp/ccm.h"
+#include "ti_bsp/sys_ctrl.h"
+
+#include <string.h>
+
+#define AES_CCM_L (2)
+
+static u8_t aes_ccm_next_area = KEY_AREA_0;
+
+int
+aes_ccm_init(struct aes_ccm_key *key, const u8_t raw[AES_CCM_KEY_LEN])
+{
+  if(aes_ccm_next_area > KEY_AREA_7)
+  {
+    return -1;
+  }
+
+  if(aes_ccm_next_area == KEY_AREA_0)
+  {
+    SysCtrlPeripheralEnable(SYS_CTRL_PERIPH_AES);
+  }
+
+  // the key store is loaded through the engine's dma
+  uint32_t copy[AES_CCM_KEY_LEN / 4];
+  memcpy(copy, raw, sizeof(copy));
+  if(AESLoadKey((uint8_t *)copy, aes_ccm_next_area) != AES_SUCCESS)
+  {
+    return -1;
+  }
+
+  memset(key->round_keys, 0, sizeof(key->round_keys));
+  key->area = aes_ccm_next_area++;
+  return 0;
+}
+
+// the engine works while the core spins, a frame is done long before
+// the uart could have sent it
+int
+aes_ccm_seal(const struct aes_ccm_key *key,
+             const u8_t nonce[AES_CCM_NONCE_LEN],
+             const u8_t *aad, u16_t aad_len,
+             u8_t *data, u16_t len,
+             u8_t tag_len)
+{
+  u8_t n[AES_CCM_NONCE_LEN];
+  u8_t tag[AES_CCM_MAX_TAG_LEN];
+  memcpy(n, nonce, sizeof(n));
+
+  if(CCMAuthEncryptStart(true,
+                         tag_len,
+                         n,
+                         data,
+                         len,
+                         (uint8_t *)aad,
+                         aad_len,
+                         key->area,
+                         tag,
+                         AES_CCM_L,
+                         0) != AES_SUCCESS)
+  {
+    return -1;
+  }
+
+  while(!CCMAuthEncryptCheckResult())
+  {
+  }
+
+  if(CCMAuthEncryptGetResult(tag_len, len, tag) != AES_SUCCESS)
+  {
+    return -1;
+  }
+
+  memcpy(&data[len], tag, tag_len);
+  return 0;
+}
+
+int
+aes_ccm_open(const struct aes_ccm_key *key,
+             const u8_t nonce[AES_CCM_NONCE_LEN],
+             const u8_t *aad, u16_t aad_len,
+             u8_t *data, u16_t len,
+             u8_t tag_len)
+{
+  u8_t n[AES_CCM_NONCE_LEN];
+  u8_t tag[AES_CCM_MAX_TAG_LEN];
+  memcpy(n, nonce, sizeof(n));
+
+  if(CCMInvAuthDecryptStart(true,
+                            tag_len,
+                            n,
+                            data,
+                            len + tag_len,
+                            (uint8_t *)aad,
+                            aad_len,
+                            key->area,
+                            tag,
+                            AES_CCM_L,
+                            0) != AES_SUCCESS)
+  {
+    return -1;
+  }
+
+  while(!CCMInvAuthDecryptCheckResult())
+  {
+  }
+
+  // compares the tag behind the data with the computed one
+  return (CCMInvAuthDecryptGetResult(tag_len, data, len + tag_len, tag) == AES_SUCCESS) ? 0 : -1;
+}
+
+enum aes_ccm_impl
+aes_ccm_select(enum aes_ccm_impl wanted)
+{
+  (void)wanted;
+  return AES_CCM_CC2538;
+}
@@ -0,0 +1,575 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "link/hc.h"
+
+#include "lwip/opt.h"
+#include "lwip/def.h"
+#include "lwip/ip.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/pbuf.h"
+#include "lwip/timeouts.h"
+#include "lwip/prot/ip4.h"
+#include "lwip/prot/tcp.h"
+#include "lwip/prot/udp.h"
+
+#include <string.h>
+
+#define HC_TYPE_FULL       (0x70)
+#define HC_TYPE_COMPRESSED (0x80)
+#define HC_TYPE_CTRL       (0xF0)
+
+/* ip id is the previous one + 1, not carried */
+#define HC_FLAG_ID_NEXT (0x01)
+
+#define HC_CTRL_REQUEST (1)
+#define HC_CTRL_ACK     (2)
+
+/* type and cid in front of a full header packet */
+#define HC_FULL_HLEN (2)
+
+/* type, op, cids, mru */
+#define HC_CTRL_LEN (5)
+#define HC_CTRL_LEN_NO_MRU (3)
+
+/* smallest mtu ipv4 allows */
+#define HC_MIN_MTU (68)
+
+#define HC_NEGOTIATE_INTERVAL_MS (1000)
+#define HC_NEGOTIATE_TRIES (10)
+
+/* a lost full header costs at most this many packets */
+#define HC_REFRESH_INTERVAL (16)
+
+/* ip header + largest tcp header */
+#define HC_MAX_HDR (IP_HLEN + 60)
+
+/* netif client data slot of the link, after the link counters' */
+#define HC_CLIENT_DATA (LWIP_NETIF_CLIENT_DATA_INDEX_MAX + 1)
+#if LWIP_NUM_NETIF_CLIENT_DATA < 2
+#error "hc needs LWIP_NUM_NETIF_CLIENT_DATA >= 2, see lwipopts.h"
+#endif
+
+struct hc_context
+{
+  ip4_addr_p_t src;
+  ip4_addr_p_t dest;
+  u16_t sport;
+  u16_t dport;
+  u16_t id;
+  u8_t tos;
+  u8_t ttl;
+  u8_t proto;
+  u8_t df;
+  u8_t valid;
+  u8_t since_full;
+};
+
+struct hc_link
+{
+  struct netif *netif;
+  netif_output_fn lower_output;
+  u8_t enabled;
+  u8_t initiate;
+  u8_t tries;
+  u8_t cids;
+  u8_t next_victim;
+  u16_t mru;
+  struct hc_context tx[HC_MAX_CONTEXTS];
+  struct hc_context rx[HC_MAX_CONTEXTS];
+  struct hc_stats stats;
+};
+
+static struct hc_link hc_links[HC_MAX_LINKS];
+
+static netif_input_fn hc_upper_input = ip_input;
+
+/* NULL for a netif without compression */
+static struct hc_link *
+hc_link_of(const struct netif *netif)
+{
+  return (struct hc_link *)netif_get_client_data(netif, HC_CLIENT_DATA);
+}
+
+static struct hc_link *
+hc_link_free(void)
+{
+  for(int i = 0; i < HC_MAX_LINKS; i++)
+  {
+    if(!hc_links[i].netif)
+    {
+      return &hc_links[i];
+    }
+  }
+  return NULL;
+}
+
+/* length of the l4 header that is part of the context, 0 for protocols
+ * without one (icmp etc. only get the ip header compressed), -1 if the
+ * packet can not be compressed */
+static int
+hc_l4_len(const u8_t *pkt, u16_t len, u8_t proto)
+{
+  if(proto == IP_PROTO_UDP)
+  {
+    return (len >= IP_HLEN + UDP_HLEN) ? UDP_HLEN : -1;
+  }
+
+  if(proto == IP_PROTO_TCP)
+  {
+    if(len < IP_HLEN + TCP_HLEN)
+    {
+      return -1;
+    }
+    const struct tcp_hdr *tcph = (const struct tcp_hdr *)(pkt + IP_HLEN);
+    int hlen = TCPH_HDRLEN_BYTES(tcph);
+    return (hlen >= TCP_HLEN && len >= IP_HLEN + hlen) ? hlen : -1;
+  }
+
+  return 0;
+}
+
+static void
+hc_context_store(struct hc_context *ctx, const u8_t *pkt)
+{
+  const struct ip_hdr *iph = (const struct ip_hdr *)pkt;
+
+  memcpy(&ctx->src, &iph->src, sizeof(ctx->src));
+  memcpy(&ctx->dest, &iph->dest, sizeof(ctx->dest));
+  ctx->id = lwip_ntohs(IPH_ID(iph));
+  ctx->tos = IPH_TOS(iph);
+  ctx->ttl = IPH_TTL(iph);
+  ctx->proto = IPH_PROTO(iph);
+  ctx->df = (lwip_ntohs(IPH_OFFSET(iph)) & IP_DF) != 0;
+  ctx->sport = 0;
+  ctx->dport = 0;
+
+  if(ctx->proto == IP_PROTO_UDP || ctx->proto == IP_PROTO_TCP)
+  {
+    /* source and destination port are the first 4 bytes of both */
+    memcpy(&ctx->sport, pkt + IP_HLEN, 2);
+    memcpy(&ctx->dport, pkt + IP_HLEN + 2, 2);
+  }
+
+  ctx->valid = 1;
+}
+
+static int
+hc_context_matches(const struct hc_context *ctx, const u8_t *pkt)
+{
+  const struct ip_hdr *iph = (const struct ip_hdr *)pkt;
+
+  if(!ctx->valid ||
+     ctx->proto != IPH_PROTO(iph) ||
+     memcmp(&ctx->src, &iph->src, sizeof(ctx->src)) ||
+     memcmp(&ctx->dest, &iph->dest, sizeof(ctx->dest)))
+  {
+    return 0;
+  }
+
+  if(ctx->proto == IP_PROTO_UDP || ctx->proto == IP_PROTO_TCP)
+  {
+    return !memcmp(&ctx->sport, pkt + IP_HLEN, 2) &&
+           !memcmp(&ctx->dport, pkt + IP_HLEN + 2, 2);
+  }
+
+  return 1;
+}
+
+static u8_t
+hc_tx_cid(struct hc_link *link, const u8_t *pkt)
+{
+  for(u8_t cid = 0; cid < link->cids; cid++)
+  {
+    if(hc_context_matches(&link->tx[cid], pkt))
+    {
+      return cid;
+    }
+  }
+
+  u8_t cid = link->next_victim;
+  link->next_victim = (link->next_victim + 1) % link->cids;
+  link->tx[cid].valid = 0;
+  return cid;
+}
+
+static void
+hc_send_ctrl(struct hc_link *link, u8_t op)
+{
+  struct pbuf *p = pbuf_alloc(PBUF_LINK, HC_CTRL_LEN, PBUF_RAM);
+  if(!p)
+  {
+    return;
+  }
+
+  u8_t *data = (u8_t *)p->payload;
+  data[0] = HC_TYPE_CTRL;
+  data[1] = op;
+  data[2] = HC_MAX_CONTEXTS;
+  data[3] = link->mru >> 8;
+  data[4] = link->mru & 0xFF;
+
+  link->lower_output(link->netif, p, netif_ip4_addr(link->netif));
+  pbuf_free(p);
+}
+
+static void
+hc_negotiate_timeout(void *arg)
+{
+  struct hc_link *link = (struct hc_link *)arg;
+
+  if(link->enabled || link->tries++ >= HC_NEGOTIATE_TRIES)
+  {
+    return;
+  }
+
+  hc_send_ctrl(link, HC_CTRL_REQUEST);
+  sys_untimeout(hc_negotiate_timeout, link);
+  sys_timeout(HC_NEGOTIATE_INTERVAL_MS, hc_negotiate_timeout, link);
+}
+
+static err_t
+hc_output_full(struct hc_link *link, struct pbuf *p, const ip4_addr_t *ipaddr, u8_t cid)
+{
+  struct pbuf *h = pbuf_alloc(PBUF_LINK, HC_FULL_HLEN, PBUF_RAM);
+  if(!h)
+  {
+    return ERR_MEM;
+  }
+
+  u8_t *data = (u8_t *)h->payload;
+  data[0] = HC_TYPE_FULL;
+  data[1] = cid;
+
+  pbuf_chain(h, p);
+  err_t err = link->lower_output(link->netif, h, ipaddr);
+  pbuf_free(h);
+
+  link->stats.tx_full++;
+  return err;
+}
+
+static err_t
+hc_output(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+  struct hc_link *link = hc_link_of(netif);
+  u8_t *pkt = (u8_t *)p->payload;
+  const struct ip_hdr *iph = (const struct ip_hdr *)pkt;
+
+  int l4_len = -1;
+  if(link->enabled &&
+     p->len >= IP_HLEN &&
+     IPH_V(iph) == 4 &&
+     IPH_HL(iph) == 5 &&
+     !(lwip_ntohs(IPH_OFFSET(iph)) & (IP_MF | IP_OFFMASK)))
+  {
+    l4_len = hc_l4_len(pkt, p->len, IPH_PROTO(iph));
+  }
+
+  if(l4_len < 0)
+  {
+    link->stats.tx_plain++;
+    return link->lower_output(netif, p, ipaddr);
+  }
+
+  u8_t cid = hc_tx_cid(link, pkt);
+  struct hc_context *ctx = &link->tx[cid];
+  u16_t id = lwip_ntohs(IPH_ID(iph));
+
+  if(!ctx->valid ||
+     ctx->tos != IPH_TOS(iph) ||
+     ctx->ttl != IPH_TTL(iph) ||
+     ctx->df != ((lwip_ntohs(IPH_OFFSET(iph)) & IP_DF) != 0) ||
+     ctx->since_full >= HC_REFRESH_INTERVAL)
+  {
+    hc_context_store(ctx, pkt);
+    ctx->since_full = 0;
+    return hc_output_full(link, p, ipaddr, cid);
+  }
+
+  u8_t comp[4 + HC_MAX_HDR];
+  u16_t n = 0;
+
+  comp[n++] = HC_TYPE_COMPRESSED;
+  comp[n++] = cid;
+  if(id == (u16_t)(ctx->id + 1))
+  {
+    comp[0] |= HC_FLAG_ID_NEXT;
+  } else {
+    comp[n++] = id >> 8;
+    comp[n++] = id & 0xFF;
+  }
+
+  if(IPH_PROTO(iph) == IP_PROTO_UDP)
+  {
+    /* length is implied by the frame, the checksum stays end to end */
+    memcpy(&comp[n], pkt + IP_HLEN + 6, 2);
+    n += 2;
+  } else if(IPH_PROTO(iph) == IP_PROTO_TCP) {
+    /* everything after the ports: seq, ack, flags, window, checksum, options */
+    memcpy(&comp[n], pkt + IP_HLEN + 4, l4_len - 4);
+    n += l4_len - 4;
+  }
+
+  ctx->id = id;
+  ctx->since_full++;
+
+  /* replace the headers in place and put them back afterwards, all
+   * drivers below copy or encode the frame before returning */
+  u16_t consumed = IP_HLEN + l4_len;
+  u8_t saved[HC_MAX_HDR];
+  memcpy(saved, pkt, consumed);
+
+  pbuf_remove_header(p, consumed - n);
+  memcpy(p->payload, comp, n);
+
+  err_t err = link->lower_output(netif, p, ipaddr);
+
+  pbuf_header_force(p, (s16_t)(consumed - n));
+  memcpy(p->payload, saved, consumed);
+
+  link->stats.tx_compressed++;
+  return err;
+}
+
+static err_t
+hc_input_full(struct hc_link *link, struct pbuf *p, struct netif *inp)
+{
+  const u8_t *data = (const u8_t *)p->payload;
+  u8_t cid = data[1];
+
+  if(p->len < HC_FULL_HLEN + IP_HLEN ||
+     cid >= HC_MAX_CONTEXTS ||
+     hc_l4_len(data + HC_FULL_HLEN, p->len - HC_FULL_HLEN,
+               IPH_PROTO((const struct ip_hdr *)(data + HC_FULL_HLEN))) < 0)
+  {
+    link->stats.rx_errors++;
+    pbuf_free(p);
+    return ERR_OK;
+  }
+
+  hc_context_store(&link->rx[cid], data + HC_FULL_HLEN);
+  link->stats.rx_full++;
+
+  pbuf_remove_header(p, HC_FULL_HLEN);
+  return hc_upper_input(p, inp);
+}
+
+static err_t
+hc_input_compressed(struct hc_link *link, struct pbuf *p, struct netif *inp)
+{
+  const u8_t *data = (const u8_t *)p->payload;
+  u16_t n = 2;
+
+  if(p->len < 2 || data[1] >= HC_MAX_CONTEXTS || !link->rx[data[1]].valid)
+  {
+    link->stats.rx_unknown_cid++;
+    pbuf_free(p);
+    return ERR_OK;
+  }
+
+  struct hc_context *ctx = &link->rx[data[1]];
+
+  u16_t id = ctx->id + 1;
+  if(!(data[0] & HC_FLAG_ID_NEXT))
+  {
+    if(p->len < n + 2)
+    {
+      goto err;
+    }
+    id = (data[n] << 8) | data[n + 1];
+    n += 2;
+  }
+
+  u16_t l4_len = 0;
+  u16_t dyn_len = 0;
+  if(ctx->proto == IP_PROTO_UDP)
+  {
+    l4_len = UDP_HLEN;
+    dyn_len = 2;
+  } else if(ctx->proto == IP_PROTO_TCP) {
+    /* data offset is in the 9th byte after the ports */
+    if(p->len < n + 9)
+    {
+      goto err;
+    }
+    l4_len = (data[n + 8] >> 4) * 4;
+    if(l4_len < TCP_HLEN)
+    {
+      goto err;
+    }
+    dyn_len = l4_len - 4;
+  }
+
+  if(p->len < n + dyn_len)
+  {
+    goto err;
+  }
+
+  u16_t hdr_len = IP_HLEN + l4_len;
+  u16_t payload_len = p->tot_len - n - dyn_len;
+
+  struct pbuf *h = pbuf_alloc(PBUF_LINK, hdr_len, PBUF_RAM);
+  if(!h)
+  {
+    goto err;
+  }
+
+  u8_t *hdr = (u8_t *)h->payload;
+  struct ip_hdr *iph = (struct ip_hdr *)hdr;
+
+  IPH_VHL_SET(iph, 4, IP_HLEN / 4);
+  IPH_TOS_SET(iph, ctx->tos);
+  IPH_LEN_SET(iph, lwip_htons(hdr_len + payload_len));
+  IPH_ID_SET(iph, lwip_htons(id));
+  IPH_OFFSET_SET(iph, ctx->df ? PP_HTONS(IP_DF) : 0);
+  IPH_TTL_SET(iph, ctx->ttl);
+  IPH_PROTO_SET(iph, ctx->proto);
+  memcpy(&iph->src, &ctx->src, sizeof(iph->src));
+  memcpy(&iph->dest, &ctx->dest, sizeof(iph->dest));
+  IPH_CHKSUM_SET(iph, 0);
+  IPH_CHKSUM_SET(iph, inet_chksum(iph, IP_HLEN));
+
+  if(ctx->proto == IP_PROTO_UDP)
+  {
+    struct udp_hdr *udph = (struct udp_hdr *)(hdr + IP_HLEN);
+    udph->src = ctx->sport;
+    udph->dest = ctx->dport;
+    udph->len = lwip_htons(UDP_HLEN + payload_len);
+    memcpy(&udph->chksum, &data[n], 2);
+  } else if(ctx->proto == IP_PROTO_TCP) {
+    memcpy(hdr + IP_HLEN, &ctx->sport, 2);
+    memcpy(hdr + IP_HLEN + 2, &ctx->dport, 2);
+    memcpy(hdr + IP_HLEN + 4, &data[n], dyn_len);
+  }
+
+  ctx->id = id;
+  link->stats.rx_compressed++;
+
+  pbuf_remove_header(p, n + dyn_len);
+  if(p->tot_len)
+  {
+    pbuf_cat(h, p);
+  } else {
+    pbuf_free(p);
+  }
+
+  return hc_upper_input(h, inp);
+
+err:
+  link->stats.rx_errors++;
+  pbuf_free(p);
+  return ERR_OK;
+}
+
+static void
+hc_input_ctrl(struct hc_link *link, struct pbuf *p)
+{
+  const u8_t *data = (const u8_t *)p->payload;
+
+  if(p->len >= HC_CTRL_LEN_NO_MRU)
+  {
+    /* the peer (re)started with empty contexts, resend full headers */
+    memset(link->tx, 0, sizeof(link->tx));
+    link->next_victim = 0;
+    link->cids = LWIP_MIN(data[2], HC_MAX_CONTEXTS);
+    link->enabled = link->cids > 0;
+
+    if(p->len >= HC_CTRL_LEN)
+    {
+      u16_t peer_mru = (data[3] << 8) | data[4];
+      link->netif->mtu = LWIP_MAX(LWIP_MIN(link->mru, peer_mru), HC_MIN_MTU);
+    }
+
+    if(data[1] == HC_CTRL_REQUEST)
+    {
+      hc_send_ctrl(link, HC_CTRL_ACK);
+    }
+  }
+
+  pbuf_free(p);
+}
+
+err_t
+hc_input(struct pbuf *p, struct netif *inp)
+{
+  struct hc_link *link = hc_link_of(inp);
+  u8_t type = (p->len > 0) ? *(const u8_t *)p->payload : 0;
+
+  if(!link || (type & 0xF0) == 0x40)
+  {
+    if(link)
+    {
+      link->stats.rx_plain++;
+      if(link->initiate && link->enabled)
+      {
+        /* a compressing peer only sends plain headers after a restart */
+        link->enabled = 0;
+        link->tries = 0;
+        inp->mtu = LWIP_MIN(link->mru, HC_DEFAULT_MTU);
+        hc_negotiate_timeout(link);
+      }
+    }
+    return hc_upper_input(p, inp);
+  }
+
+  if(type == HC_TYPE_FULL)
+  {
+    return hc_input_full(link, p, inp);
+  }
+
+  if((type & 0xF0) == HC_TYPE_COMPRESSED)
+  {
+    return hc_input_compressed(link, p, inp);
+  }
+
+  if(type == HC_TYPE_CTRL)
+  {
+    hc_input_ctrl(link, p);
+    return ERR_OK;
+  }
+
+  link->stats.rx_errors++;
+  pbuf_free(p);
+  return ERR_OK;
+}
+
+err_t
+hc_attach(struct netif *netif, int initiate)
+{
+  struct hc_link *link = hc_link_free();
+  if(!link)
+  {
+    return ERR_MEM;
+  }
+
+  memset(link, 0, sizeof(*link));
+  link->netif = netif;
+  netif_set_client_data(netif, HC_CLIENT_DATA, link);
+  link->lower_output = netif->output;
+  link->initiate = initiate;
+  link->mru = LWIP_MAX(netif->mtu, HC_MIN_MTU + HC_FULL_HLEN) - HC_FULL_HLEN;
+  netif->output = hc_output;
+  netif->mtu = LWIP_MIN(link->mru, HC_DEFAULT_MTU);
+
+  if(initiate)
+  {
+    hc_negotiate_timeout(link);
+  }
+
+  return ERR_OK;
+}
+
+void
+hc_set_upper_input(netif_input_fn input)
+{
+  hc_upper_input = input;
+}
+
+const struct hc_stats *
+hc_stats_of(const struct netif *netif)
+{
+  struct hc_link *link = hc_link_of(netif);
+  return link ? &link->stats : NULL;
+}
@@ -0,0 +1,402 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "link/hdlcif.h"
+#include "link/fcs.h"
+#include "link_counters.h"
+#include "sio_framing.h"
+
+#include "lwip/opt.h"
+#include "lwip/mem.h"
+#include "lwip/pbuf.h"
+#include "lwip/sio.h"
+
+#include <string.h>
+
+#define HDLC_FLAG    (0x7E)
+#define HDLC_ESC     (0x7D)
+#define HDLC_ESC_XOR (0x20)
+
+#ifndef HDLCIF_MTU
+#define HDLCIF_MTU (1500)
+#endif
+
+/* bytes encoded before they are handed to sio_write, ports whose
+ * sio_write can refuse a frame set it to a whole escaped frame */
+#ifndef HDLCIF_TX_CHUNK
+#define HDLCIF_TX_CHUNK (64)
+#endif
+
+#define HDLCIF_HDR_LEN (2)
+#define HDLCIF_RX_SEGMENT (PBUF_POOL_BUFSIZE - PBUF_LINK_HLEN - PBUF_LINK_ENCAPSULATION_HLEN)
+
+#define IFNAME0 'h'
+#define IFNAME1 'd'
+
+struct hdlcif_priv
+{
+  sio_fd_t sd;
+  struct hdlcif_config config;
+  /* p is the whole chain of the frame being received, q the current pbuf */
+  struct pbuf *p;
+  struct pbuf *q;
+  u16_t i;
+  u16_t recved;
+  u8_t esc;
+  u8_t drop;
+  struct hdlcif_stats stats;
+  struct link_counters counters;
+};
+
+struct hdlcif_tx
+{
+  sio_fd_t sd;
+  u16_t len;
+  u16_t escapes;
+  u32_t bytes;
+  /* sio_write refused a chunk, the rest of the frame is not sent */
+  u8_t refused;
+  u8_t buf[HDLCIF_TX_CHUNK];
+};
+
+static void
+hdlcif_tx_flush(struct hdlcif_tx *tx)
+{
+  if(!tx->refused && sio_write(tx->sd, tx->buf, tx->len) == 0)
+  {
+    tx->refused = 1;
+  }
+  tx->bytes += tx->len;
+  tx->len = 0;
+}
+
+static u8_t
+hdlcif_fcs_len(const struct hdlcif_priv *priv)
+{
+  return priv->config.fcs32 ? 4 : 2;
+}
+
+static void
+hdlcif_tx_byte(struct hdlcif_tx *tx, u8_t c)
+{
+  if(tx->len + 2u > sizeof(tx->buf))
+  {
+    hdlcif_tx_flush(tx);
+  }
+
+  if(c == HDLC_FLAG || c == HDLC_ESC)
+  {
+    tx->escapes++;
+    tx->buf[tx->len++] = HDLC_ESC;
+    c ^= HDLC_ESC_XOR;
+  }
+  tx->buf[tx->len++] = c;
+}
+
+static void
+hdlcif_tx_bytes(struct hdlcif_tx *tx, const u8_t *data, u16_t len)
+{
+  while(len--)
+  {
+    hdlcif_tx_byte(tx, *data++);
+  }
+}
+
+static err_t
+hdlcif_output(struct netif *netif, struct pbuf *p)
+{
+  struct hdlcif_priv *priv = (struct hdlcif_priv *)netif->state;
+  struct hdlcif_tx tx;
+  u8_t hdr[HDLCIF_HDR_LEN] = { priv->config.address, HDLCIF_CONTROL_UI };
+  u8_t fcs[4];
+
+  /* layers above may add their own headers to an mtu sized packet */
+  if(p->tot_len > HDLCIF_MTU)
+  {
+    LINK_COUNTERS_INC(&priv->counters, tx_dropped);
+    return ERR_BUF;
+  }
+
+  tx.sd = priv->sd;
+  tx.len = 0;
+  tx.escapes = 0;
+  tx.bytes = 0;
+  tx.refused = 0;
+  tx.buf[tx.len++] = HDLC_FLAG;
+
+  hdlcif_tx_bytes(&tx, hdr, sizeof(hdr));
+
+  if(priv->config.fcs32)
+  {
+    u32_t f = fcs32_update(FCS32_INIT, hdr, sizeof(hdr));
+    for(struct pbuf *q = p; q != NULL; q = q->next)
+    {
+      hdlcif_tx_bytes(&tx, q->payload, q->len);
+      f = fcs32_update(f, q->payload, q->len);
+    }
+    f ^= FCS32_INIT;
+    fcs[0] = f;
+    fcs[1] = f >> 8;
+    fcs[2] = f >> 16;
+    fcs[3] = f >> 24;
+  } else {
+    u16_t f = fcs16_update(FCS16_INIT, hdr, sizeof(hdr));
+    for(struct pbuf *q = p; q != NULL; q = q->next)
+    {
+      hdlcif_tx_bytes(&tx, q->payload, q->len);
+      f = fcs16_update(f, q->payload, q->len);
+    }
+    f ^= FCS16_INIT;
+    fcs[0] = f;
+    fcs[1] = f >> 8;
+  }
+
+  hdlcif_tx_bytes(&tx, fcs, hdlcif_fcs_len(priv));
+
+  if(tx.len == sizeof(tx.buf))
+  {
+    hdlcif_tx_flush(&tx);
+  }
+  tx.buf[tx.len++] = HDLC_FLAG;
+  hdlcif_tx_flush(&tx);
+
+  if(tx.refused)
+  {
+    LINK_COUNTERS_INC(&priv->counters, tx_busy);
+    return ERR_MEM;
+  }
+
+  LINK_COUNTERS_ADD(&priv->counters, tx_bytes, tx.bytes);
+  LINK_COUNTERS_INC(&priv->counters, tx_frames);
+  LINK_COUNTERS_ADD(&priv->counters, tx_escapes, tx.escapes);
+  return ERR_OK;
+}
+
+static err_t
+hdlcif_output_v4(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+  LWIP_UNUSED_ARG(ipaddr);
+  return hdlcif_output(netif, p);
+}
+
+static void
+hdlcif_rx_reset(struct hdlcif_priv *priv)
+{
+  if(priv->p)
+  {
+    pbuf_free(priv->p);
+  }
+  priv->p = NULL;
+  priv->q = NULL;
+  priv->i = 0;
+  priv->recved = 0;
+  priv->esc = 0;
+  priv->drop = 0;
+}
+
+static int
+hdlcif_fcs_ok(const struct hdlcif_priv *priv)
+{
+  if(priv->config.fcs32)
+  {
+    u32_t f = FCS32_INIT;
+    for(const struct pbuf *q = priv->p; q != NULL; q = q->next)
+    {
+      f = fcs32_update(f, q->payload, q->len);
+    }
+    return f == FCS32_GOOD;
+  }
+
+  u16_t f = FCS16_INIT;
+  for(const struct pbuf *q = priv->p; q != NULL; q = q->next)
+  {
+    f = fcs16_update(f, q->payload, q->len);
+  }
+  return f == FCS16_GOOD;
+}
+
+static void
+hdlcif_rx_frame(struct hdlcif_priv *priv, struct netif *netif)
+{
+  if(priv->recved < HDLCIF_HDR_LEN + hdlcif_fcs_len(priv) + 1)
+  {
+    priv->stats.rx_runt++;
+    LINK_COUNTERS_INC(&priv->counters, rx_errors);
+    hdlcif_rx_reset(priv);
+    return;
+  }
+
+  pbuf_realloc(priv->p, priv->recved);
+
+  if(!hdlcif_fcs_ok(priv))
+  {
+    priv->stats.rx_bad_fcs++;
+    LINK_COUNTERS_INC(&priv->counters, rx_errors);
+    hdlcif_rx_reset(priv);
+    return;
+  }
+
+  u8_t address = pbuf_get_at(priv->p, 0);
+  if(!priv->config.primary &&
+     address != priv->config.address &&
+     address != HDLCIF_ADDRESS_ALL)
+  {
+    priv->stats.rx_other_address++;
+    hdlcif_rx_reset(priv);
+    return;
+  }
+
+  /* only unnumbered information frames carry packets, RFC 1662 3.1 */
+  if(pbuf_get_at(priv->p, 1) != HDLCIF_CONTROL_UI)
+  {
+    priv->stats.rx_bad_control++;
+    LINK_COUNTERS_INC(&priv->counters, rx_errors);
+    hdlcif_rx_reset(priv);
+    return;
+  }
+
+  struct pbuf *p = priv->p;
+  priv->p = NULL;
+  hdlcif_rx_reset(priv);
+
+  pbuf_realloc(p, p->tot_len - hdlcif_fcs_len(priv));
+  pbuf_remove_header(p, HDLCIF_HDR_LEN);
+
+  LINK_COUNTERS_INC(&priv->counters, rx_frames);
+  if(netif->input(p, netif) != ERR_OK)
+  {
+    pbuf_free(p);
+  }
+}
+
+static void
+hdlcif_rx_byte(struct hdlcif_priv *priv, struct netif *netif, u8_t c)
+{
+  if(c == HDLC_FLAG)
+  {
+    if(priv->esc)
+    {
+      /* ESC FLAG aborts the frame */
+      priv->stats.rx_aborted++;
+      LINK_COUNTERS_INC(&priv->counters, rx_errors);
+      hdlcif_rx_reset(priv);
+    } else if(priv->drop) {
+      hdlcif_rx_reset(priv);
+    } else if(priv->recved) {
+      hdlcif_rx_frame(priv, netif);
+    }
+    return;
+  }
+
+  if(priv->drop)
+  {
+    return;
+  }
+
+  if(c == HDLC_ESC)
+  {
+    priv->esc = 1;
+    LINK_COUNTERS_INC(&priv->counters, rx_escapes);
+    return;
+  }
+
+  if(priv->esc)
+  {
+    c ^= HDLC_ESC_XOR;
+    priv->esc = 0;
+  }
+
+  /* the link's frame size, layers above may leave ip a smaller mtu */
+  if(priv->recved >= HDLCIF_MTU + HDLCIF_HDR_LEN + hdlcif_fcs_len(priv))
+  {
+    LINK_COUNTERS_INC(&priv->counters, rx_oversize);
+    priv->drop = 1;
+    return;
+  }
+
+  if(!priv->q || priv->i == priv->q->len)
+  {
+    struct pbuf *q = priv->p ? pbuf_alloc(PBUF_RAW, PBUF_POOL_BUFSIZE, PBUF_POOL) :
+                               pbuf_alloc(PBUF_LINK, HDLCIF_RX_SEGMENT, PBUF_POOL);
+    if(!q)
+    {
+      LINK_COUNTERS_INC(&priv->counters, rx_dropped);
+      priv->drop = 1;
+      return;
+    }
+
+    if(priv->p)
+    {
+      pbuf_cat(priv->p, q);
+    } else {
+      priv->p = q;
+    }
+    priv->q = q;
+    priv->i = 0;
+  }
+
+  ((u8_t *)priv->q->payload)[priv->i++] = c;
+  priv->recved++;
+}
+
+void
+hdlcif_poll(struct netif *netif)
+{
+  u8_t buf[64];
+  u32_t n;
+
+  LWIP_ASSERT("netif != NULL", (netif != NULL));
+  LWIP_ASSERT("netif->state != NULL", (netif->state != NULL));
+
+  struct hdlcif_priv *priv = (struct hdlcif_priv *)netif->state;
+
+  while((n = sio_tryread(priv->sd, buf, sizeof(buf))) > 0)
+  {
+    LINK_COUNTERS_ADD(&priv->counters, rx_bytes, n);
+    for(u32_t i = 0; i < n; i++)
+    {
+      hdlcif_rx_byte(priv, netif, buf[i]);
+    }
+  }
+}
+
+err_t
+hdlcif_init(struct netif *netif)
+{
+  const struct hdlcif_config *config = (const struct hdlcif_config *)netif->state;
+
+  LWIP_ASSERT("hdlcif_init: config", config != NULL);
+
+  struct hdlcif_priv *priv = (struct hdlcif_priv *)mem_malloc(sizeof(struct hdlcif_priv));
+  if(!priv)
+  {
+    return ERR_MEM;
+  }
+  memset(priv, 0, sizeof(*priv));
+  priv->config = *config;
+
+  netif->name[0] = IFNAME0;
+  netif->name[1] = IFNAME1;
+  netif->output = hdlcif_output_v4;
+  netif->mtu = HDLCIF_MTU;
+  netif->flags = 0;
+
+  sio_set_framing(config->devnum, SIO_FRAMING_HDLC);
+  priv->sd = sio_open(config->devnum);
+  if(priv->sd <= 0)
+  {
+    mem_free(priv);
+    return ERR_IF;
+  }
+
+  netif->state = priv;
+  link_counters_attach(netif, &priv->counters);
+  return ERR_OK;
+}
+
+const struct hdlcif_stats *
+hdlcif_stats(const struct netif *netif)
+{
+  return &((const struct hdlcif_priv *)netif->state)->stats;
+}
@@ -0,0 +1,308 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "link/link_stats.h"
+#include "link_counters.h"
+
+#include "lwip/memp.h"
+#include "lwip/netif.h"
+#include "lwip/stats.h"
+
+/* sio devnums are a u8_t */
+#define LINK_STATS_SIO_DEVS (256)
+
+/* entries named without a number behind */
+#define LINK_STATS_NO_NUM (0xFFFFFFFFUL)
+
+struct link_stats_out
+{
+  char *buf;
+  size_t size;
+  /* runs past size once a line does not fit, the line is cut then and
+   * link_stats_format takes pos back to where it began */
+  size_t pos;
+};
+
+struct link_stats_field
+{
+  const char *name;
+  u16_t offset;
+};
+
+#define LINK_STATS_FIELD(type, field) { #field, offsetof(type, field) }
+
+static const struct link_stats_field link_counter_fields[] =
+{
+  LINK_STATS_FIELD(struct link_counters, rx_bytes),
+  LINK_STATS_FIELD(struct link_counters, rx_frames),
+  LINK_STATS_FIELD(struct link_counters, rx_escapes),
+  LINK_STATS_FIELD(struct link_counters, rx_dropped),
+  LINK_STATS_FIELD(struct link_counters, rx_oversize),
+  LINK_STATS_FIELD(struct link_counters, rx_errors),
+  LINK_STATS_FIELD(struct link_counters, rx_overruns),
+  LINK_STATS_FIELD(struct link_counters, tx_bytes),
+  LINK_STATS_FIELD(struct link_counters, tx_frames),
+  LINK_STATS_FIELD(struct link_counters, tx_escapes),
+  LINK_STATS_FIELD(struct link_counters, tx_dropped),
+  LINK_STATS_FIELD(struct link_counters, tx_busy),
+  LINK_STATS_FIELD(struct link_counters, tx_queue),
+  LINK_STATS_FIELD(struct link_counters, tx_queue_max),
+  LINK_STATS_FIELD(struct link_counters, tx_aqm_dropped),
+  LINK_STATS_FIELD(struct link_counters, tx_delay_us),
+  LINK_STATS_FIELD(struct link_counters, tx_delay_max_us),
+};
+
+#if LWIP_STATS
+static const struct link_stats_field link_proto_fields[] =
+{
+  LINK_STATS_FIELD(struct stats_proto, xmit),
+  LINK_STATS_FIELD(struct stats_proto, recv),
+  LINK_STATS_FIELD(struct stats_proto, fw),
+  LINK_STATS_FIELD(struct stats_proto, drop),
+  LINK_STATS_FIELD(struct stats_proto, chkerr),
+  LINK_STATS_FIELD(struct stats_proto, lenerr),
+  LINK_STATS_FIELD(struct stats_proto, memerr),
+  LINK_STATS_FIELD(struct stats_proto, rterr),
+  LINK_STATS_FIELD(struct stats_proto, proterr),
+  LINK_STATS_FIELD(struct stats_proto, opterr),
+  LINK_STATS_FIELD(struct stats_proto, err),
+};
+
+struct link_stats_proto
+{
+  const char *name;
+  const struct stats_proto *stats;
+};
+
+static const struct link_stats_proto link_protos[] =
+{
+#if LINK_STATS
+  { "link", &lwip_stats.link },
+#endif
+#if IP_STATS
+  { "ip", &lwip_stats.ip },
+#endif
+#if ICMP_STATS
+  { "icmp", &lwip_stats.icmp },
+#endif
+#if UDP_STATS
+  { "udp", &lwip_stats.udp },
+#endif
+#if TCP_STATS
+  { "tcp", &lwip_stats.tcp },
+#endif
+};
+
+#define LINK_STATS_NUM_PROTOS (sizeof(link_protos) / sizeof(link_protos[0]))
+#else
+#define LINK_STATS_NUM_PROTOS (0)
+#endif
+
+#if LWIP_STATS && MEMP_STATS
+struct link_stats_pool
+{
+  const char *name;
+  memp_t type;
+};
+
+static const struct link_stats_pool link_pools[] =
+{
+#define LWIP_MEMPOOL(name, num, size, desc) { #name, MEMP_##name },
+#include "lwip/priv/memp_std.h"
+};
+
+#define LINK_STATS_NUM_POOLS (sizeof(link_pools) / sizeof(link_pools[0]))
+#else
+#define LINK_STATS_NUM_POOLS (0)
+#endif
+
+static void
+link_stats_put(struct link_stats_out *out, const char *s)
+{
+  while(*s)
+  {
+    if(out->pos < out->size)
+    {
+      out->buf[out->pos] = *s;
+    }
+    out->pos++;
+    s++;
+  }
+}
+
+static void
+link_stats_put_u32(struct link_stats_out *out, u32_t v)
+{
+  char digits[11];
+  int i = sizeof(digits) - 1;
+
+  digits[i] = '\0';
+  do
+  {
+    digits[--i] = '0' + v % 10;
+    v /= 10;
+  } while(v);
+
+  link_stats_put(out, &digits[i]);
+}
+
+static void
+link_stats_begin(struct link_stats_out *out, const char *name, u32_t num, const char *kind)
+{
+  link_stats_put(out, "{\"name\":\"");
+  link_stats_put(out, name);
+  if(num != LINK_STATS_NO_NUM)
+  {
+    link_stats_put_u32(out, num);
+  }
+  link_stats_put(out, "\",\"kind\":\"");
+  link_stats_put(out, kind);
+  link_stats_put(out, "\"");
+}
+
+static void
+link_stats_field(struct link_stats_out *out, const char *name, u32_t v)
+{
+  link_stats_put(out, ",\"");
+  link_stats_put(out, name);
+  link_stats_put(out, "\":");
+  link_stats_put_u32(out, v);
+}
+
+static void
+link_stats_end(struct link_stats_out *out)
+{
+  link_stats_put(out, "}\n");
+}
+
+static void
+link_stats_counters(struct link_stats_out *out, const char *name, u32_t num,
+                    const char *kind, const struct link_counters *counters)
+{
+  struct link_counters c;
+  link_counters_snapshot(&c, counters);
+
+  link_stats_begin(out, name, num, kind);
+  for(size_t i = 0; i < sizeof(link_counter_fields) / sizeof(link_counter_fields[0]); i++)
+  {
+    const struct link_stats_field *f = &link_counter_fields[i];
+    link_stats_field(out, f->name, *(const uint32_t *)((const u8_t *)&c + f->offset));
+  }
+  link_stats_end(out);
+}
+
+#if LWIP_STATS
+static void
+link_stats_proto(struct link_stats_out *out, const struct link_stats_proto *proto)
+{
+  link_stats_begin(out, proto->name, LINK_STATS_NO_NUM, "lwip");
+  for(size_t i = 0; i < sizeof(link_proto_fields) / sizeof(link_proto_fields[0]); i++)
+  {
+    const struct link_stats_field *f = &link_proto_fields[i];
+    link_stats_field(out, f->name, *(const STAT_COUNTER *)((const u8_t *)proto->stats + f->offset));
+  }
+  link_stats_end(out);
+}
+#endif
+
+#if LWIP_STATS && (MEM_STATS || MEMP_STATS)
+static void
+link_stats_mem(struct link_stats_out *out, const char *name, const struct stats_mem *stats)
+{
+  link_stats_begin(out, name, LINK_STATS_NO_NUM, "lwip");
+  link_stats_field(out, "avail", stats->avail);
+  link_stats_field(out, "used", stats->used);
+  link_stats_field(out, "max", stats->max);
+  link_stats_field(out, "err", stats->err);
+  link_stats_end(out);
+}
+#endif
+
+/* 0 if there is no entry i; netifs, then sio devices, then lwip's
+ * protocols, heap and pools */
+static int
+link_stats_entry(struct link_stats_out *out, u32_t i)
+{
+  struct netif *netif;
+  NETIF_FOREACH(netif)
+  {
+    const struct link_counters *counters = link_counters_of(netif);
+    if(counters && i-- == 0)
+    {
+      char name[3] = { netif->name[0], netif->name[1], '\0' };
+      link_stats_counters(out, name, netif->num, "netif", counters);
+      return 1;
+    }
+  }
+
+  for(u32_t devnum = 0; devnum < LINK_STATS_SIO_DEVS; devnum++)
+  {
+    const struct link_counters *counters = sio_link_counters(devnum);
+    if(counters && i-- == 0)
+    {
+      link_stats_counters(out, "sio", devnum, "sio", counters);
+      return 1;
+    }
+  }
+
+  if(i < LINK_STATS_NUM_PROTOS)
+  {
+#if LWIP_STATS
+    link_stats_proto(out, &link_protos[i]);
+#endif
+    return 1;
+  }
+  i -= LINK_STATS_NUM_PROTOS;
+
+#if LWIP_STATS && MEM_STATS
+  if(i-- == 0)
+  {
+    link_stats_mem(out, "mem", &lwip_stats.mem);
+    return 1;
+  }
+#endif
+
+  if(i < LINK_STATS_NUM_POOLS)
+  {
+#if LWIP_STATS && MEMP_STATS
+    link_stats_mem(out, link_pools[i].name, lwip_stats.memp[link_pools[i].type]);
+#endif
+    return 1;
+  }
+
+  return 0;
+}
+
+size_t
+link_stats_format(char *buf, size_t size, u32_t *cursor)
+{
+  struct link_stats_out out = { buf, size, 0 };
+
+  while(*cursor != LINK_STATS_CURSOR_DONE)
+  {
+    size_t line = out.pos;
+    if(!link_stats_entry(&out, *cursor))
+    {
+      *cursor = LINK_STATS_CURSOR_DONE;
+      break;
+    }
+
+    if(out.pos > out.size)
+    {
+      /* the cut line is not sent, whatever link_stats_put left of it */
+      out.pos = line;
+      if(line)
+      {
+        /* the next call starts with it */
+        break;
+      }
+      /* larger than the whole buffer, it would never fit: skip it */
+    }
+    (*cursor)++;
+  }
+
+  /* callers send exactly this much of buf */
+  LWIP_ASSERT("link_stats_format: whole lines within size", out.pos <= size);
+  return LWIP_MIN(out.pos, size);
+}
@@ -0,0 +1,385 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "link/lsec.h"
+
+#include "lwip/pbuf.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef LWIP_RAND
+#error "lsec needs LWIP_RAND() from the port for its epochs and challenges"
+#endif
+
+#define LSEC_TYPE_DATA (0x58)
+#define LSEC_TYPE_CTRL (0x59)
+
+#define LSEC_CTRL_CHALLENGE (1)
+#define LSEC_CTRL_RESPONSE (2)
+
+#define LSEC_CHALLENGE_LEN (8)
+#define LSEC_CTRL_LEN (1 + LSEC_CHALLENGE_LEN)
+
+#define LSEC_REPLAY_WINDOW (64)
+
+/* netif client data slot of the link, after hc's */
+#define LSEC_CLIENT_DATA (LWIP_NETIF_CLIENT_DATA_INDEX_MAX + 2)
+#if LWIP_NUM_NETIF_CLIENT_DATA < 3
+#error "lsec needs LWIP_NUM_NETIF_CLIENT_DATA >= 3, see lwipopts.h"
+#endif
+
+struct lsec_link
+{
+  struct netif *netif;
+  netif_output_fn lower_output;
+  netif_input_fn upper_input;
+  struct aes_ccm_key key;
+  u8_t initiator;
+
+  u32_t tx_epoch;
+  u32_t tx_pn;
+
+  u8_t rx_valid;
+  u32_t rx_epoch;
+  u32_t rx_pn;
+  uint64_t rx_window;
+
+  u8_t challenge_valid;
+  u8_t challenge[LSEC_CHALLENGE_LEN];
+
+  struct lsec_stats stats;
+};
+
+static struct lsec_link lsec_links[LSEC_MAX_LINKS];
+
+/* NULL for a netif without lsec */
+static struct lsec_link *
+lsec_link_of(const struct netif *netif)
+{
+  return (struct lsec_link *)netif_get_client_data(netif, LSEC_CLIENT_DATA);
+}
+
+static struct lsec_link *
+lsec_link_free(void)
+{
+  for(int i = 0; i < LSEC_MAX_LINKS; i++)
+  {
+    if(!lsec_links[i].netif)
+    {
+      return &lsec_links[i];
+    }
+  }
+  return NULL;
+}
+
+static void
+lsec_put32(u8_t *p, u32_t v)
+{
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static u32_t
+lsec_get32(const u8_t *p)
+{
+  return ((u32_t)p[0] << 24) | ((u32_t)p[1] << 16) | ((u32_t)p[2] << 8) | p[3];
+}
+
+static void
+lsec_nonce(u8_t nonce[AES_CCM_NONCE_LEN], u8_t from_initiator, const u8_t *hdr)
+{
+  memset(nonce, 0, AES_CCM_NONCE_LEN);
+  nonce[0] = from_initiator;
+  /* epoch and pn straight from the header */
+  memcpy(&nonce[1], &hdr[1], 8);
+}
+
+static void
+lsec_new_epoch(struct lsec_link *link)
+{
+  link->tx_epoch = LWIP_RAND();
+  link->tx_pn = 0;
+}
+
+/* seals p into a new frame of the given type */
+static err_t
+lsec_send(struct lsec_link *link, u8_t type, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+  u16_t len = p->tot_len;
+  struct pbuf *q = pbuf_alloc(PBUF_LINK, LSEC_OVERHEAD + len, PBUF_RAM);
+  if(!q)
+  {
+    return ERR_MEM;
+  }
+
+  if(++link->tx_pn == 0)
+  {
+    /* 2^32 frames, never reuse a pn within an epoch */
+    lsec_new_epoch(link);
+    link->tx_pn = 1;
+  }
+
+  u8_t *hdr = (u8_t *)q->payload;
+  hdr[0] = type;
+  lsec_put32(&hdr[1], link->tx_epoch);
+  lsec_put32(&hdr[5], link->tx_pn);
+  pbuf_copy_partial(p, &hdr[LSEC_HDR_LEN], len, 0);
+
+  u8_t nonce[AES_CCM_NONCE_LEN];
+  lsec_nonce(nonce, link->initiator, hdr);
+  if(aes_ccm_seal(&link->key, nonce, hdr, LSEC_HDR_LEN, &hdr[LSEC_HDR_LEN], len, LSEC_TAG_LEN) < 0)
+  {
+    pbuf_free(q);
+    return ERR_VAL;
+  }
+
+  err_t err = link->lower_output(link->netif, q, ipaddr);
+  pbuf_free(q);
+
+  link->stats.tx_frames++;
+  return err;
+}
+
+static void
+lsec_send_ctrl(struct lsec_link *link, u8_t op, const u8_t *challenge)
+{
+  struct pbuf *p = pbuf_alloc(PBUF_RAW, LSEC_CTRL_LEN, PBUF_RAM);
+  if(!p)
+  {
+    return;
+  }
+
+  u8_t *ctrl = (u8_t *)p->payload;
+  ctrl[0] = op;
+  memcpy(&ctrl[1], challenge, LSEC_CHALLENGE_LEN);
+
+  lsec_send(link, LSEC_TYPE_CTRL, p, netif_ip4_addr(link->netif));
+  pbuf_free(p);
+}
+
+/* the same challenge goes out until it is answered, a new one per frame
+ * would never be answered in time on a busy link; it is encrypted, so
+ * nobody but the peer learns it */
+static void
+lsec_challenge(struct lsec_link *link)
+{
+  if(!link->challenge_valid)
+  {
+    for(int i = 0; i < LSEC_CHALLENGE_LEN; i += 4)
+    {
+      lsec_put32(&link->challenge[i], LWIP_RAND());
+    }
+    link->challenge_valid = 1;
+  }
+  link->stats.challenges++;
+
+  lsec_send_ctrl(link, LSEC_CTRL_CHALLENGE, link->challenge);
+}
+
+/* 0 if pn is new to the epoch, the window slides forward with it */
+static int
+lsec_replay_check(struct lsec_link *link, u32_t pn)
+{
+  if(pn > link->rx_pn)
+  {
+    u32_t shift = pn - link->rx_pn;
+    link->rx_window = (shift >= LSEC_REPLAY_WINDOW) ? 1 : (link->rx_window << shift) | 1;
+    link->rx_pn = pn;
+    return 0;
+  }
+
+  u32_t age = link->rx_pn - pn;
+  if(age >= LSEC_REPLAY_WINDOW || (link->rx_window & ((uint64_t)1 << age)))
+  {
+    return -1;
+  }
+  link->rx_window |= (uint64_t)1 << age;
+  return 0;
+}
+
+static void
+lsec_input_ctrl(struct lsec_link *link, u32_t epoch, u32_t pn, const u8_t *ctrl, u16_t len)
+{
+  if(len != LSEC_CTRL_LEN)
+  {
+    link->stats.rx_malformed++;
+    return;
+  }
+
+  switch(ctrl[0])
+  {
+    case LSEC_CTRL_CHALLENGE:
+      /* answering a replayed challenge tells nobody anything */
+      lsec_send_ctrl(link, LSEC_CTRL_RESPONSE, &ctrl[1]);
+      /* a peer that asks most likely just booted, check it right away
+       * instead of dropping its first data frame */
+      if(!link->rx_valid || epoch != link->rx_epoch)
+      {
+        lsec_challenge(link);
+      }
+      break;
+    case LSEC_CTRL_RESPONSE:
+      if(!link->challenge_valid ||
+         memcmp(&ctrl[1], link->challenge, LSEC_CHALLENGE_LEN) != 0)
+      {
+        link->stats.rx_replayed++;
+        break;
+      }
+      link->challenge_valid = 0;
+      if(!link->rx_valid || epoch != link->rx_epoch)
+      {
+        /* the window of a known epoch already took pn; of a new one,
+         * nothing sent before the response counts any more */
+        link->rx_valid = 1;
+        link->rx_epoch = epoch;
+        link->rx_pn = pn;
+        link->rx_window = ~(uint64_t)0;
+      }
+      break;
+    default:
+      link->stats.rx_malformed++;
+      break;
+  }
+}
+
+static err_t
+lsec_input(struct pbuf *p, struct netif *inp)
+{
+  struct lsec_link *link = lsec_link_of(inp);
+
+  if(p->tot_len < LSEC_OVERHEAD)
+  {
+    link->stats.rx_malformed++;
+    pbuf_free(p);
+    return ERR_OK;
+  }
+
+  if(p->next)
+  {
+    /* ccm works on one buffer */
+    struct pbuf *flat = pbuf_clone(PBUF_RAW, PBUF_RAM, p);
+    pbuf_free(p);
+    if(!flat)
+    {
+      return ERR_OK;
+    }
+    p = flat;
+  }
+
+  u8_t *hdr = (u8_t *)p->payload;
+  u16_t len = p->tot_len - LSEC_OVERHEAD;
+  u8_t type = hdr[0];
+  if(type != LSEC_TYPE_DATA && type != LSEC_TYPE_CTRL)
+  {
+    link->stats.rx_malformed++;
+    pbuf_free(p);
+    return ERR_OK;
+  }
+
+  u8_t nonce[AES_CCM_NONCE_LEN];
+  lsec_nonce(nonce, !link->initiator, hdr);
+  if(aes_ccm_open(&link->key, nonce, hdr, LSEC_HDR_LEN, &hdr[LSEC_HDR_LEN], len, LSEC_TAG_LEN) < 0)
+  {
+    link->stats.rx_auth_failed++;
+    pbuf_free(p);
+    return ERR_OK;
+  }
+
+  u32_t epoch = lsec_get32(&hdr[1]);
+  u32_t pn = lsec_get32(&hdr[5]);
+
+  if(type == LSEC_TYPE_CTRL)
+  {
+    /* within the epoch ctrl frames share the window with data; before,
+     * only a response to the challenge outstanding right now counts */
+    if(link->rx_valid && epoch == link->rx_epoch && lsec_replay_check(link, pn) < 0)
+    {
+      link->stats.rx_replayed++;
+      pbuf_free(p);
+      return ERR_OK;
+    }
+    lsec_input_ctrl(link, epoch, pn, &hdr[LSEC_HDR_LEN], len);
+    pbuf_free(p);
+    return ERR_OK;
+  }
+
+  if(!link->rx_valid || epoch != link->rx_epoch)
+  {
+    /* authentic but maybe old, the peer has to prove it is live */
+    link->stats.rx_unknown_epoch++;
+    lsec_challenge(link);
+    pbuf_free(p);
+    return ERR_OK;
+  }
+
+  if(lsec_replay_check(link, pn) < 0)
+  {
+    link->stats.rx_replayed++;
+    pbuf_free(p);
+    return ERR_OK;
+  }
+
+  pbuf_remove_header(p, LSEC_HDR_LEN);
+  pbuf_realloc(p, len);
+  link->stats.rx_frames++;
+  return link->upper_input(p, inp);
+}
+
+static err_t
+lsec_output(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+  return lsec_send(lsec_link_of(netif), LSEC_TYPE_DATA, p, ipaddr);
+}
+
+err_t
+lsec_attach(struct netif *netif, const struct lsec_config *config)
+{
+  struct lsec_link *link = lsec_link_free();
+  if(!link)
+  {
+    return ERR_MEM;
+  }
+
+  memset(link, 0, sizeof(*link));
+  if(aes_ccm_init(&link->key, config->key) < 0)
+  {
+    return ERR_VAL;
+  }
+
+  link->netif = netif;
+  netif_set_client_data(netif, LSEC_CLIENT_DATA, link);
+  link->initiator = config->initiator ? 1 : 0;
+  link->lower_output = netif->output;
+  link->upper_input = netif->input;
+  lsec_new_epoch(link);
+
+  netif->output = lsec_output;
+  netif->input = lsec_input;
+  netif->mtu -= LSEC_OVERHEAD;
+
+  return ERR_OK;
+}
+
+err_t
+lsec_handshake(struct netif *netif)
+{
+  struct lsec_link *link = lsec_link_of(netif);
+  if(!link)
+  {
+    return ERR_ARG;
+  }
+
+  lsec_challenge(link);
+  return ERR_OK;
+}
+
+const struct lsec_stats *
+lsec_stats_of(const struct netif *netif)
+{
+  struct lsec_link *link = lsec_link_of(netif);
+  return link ? &link->stats : NULL;
+}
@@ -0,0 +1,254 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "link/slip_codec.h"
+
+#include <string.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#define SLIP_CODEC_X86 1
+#include <immintrin.h>
+#else
+#define SLIP_CODEC_X86 0
+#endif
+
+static size_t
+find_special_scalar(const uint8_t *data, size_t len)
+{
+  for(size_t i = 0; i < len; i++)
+  {
+    if(data[i] == SLIP_END || data[i] == SLIP_ESC)
+    {
+      return i;
+    }
+  }
+  return len;
+}
+
+#if SLIP_CODEC_X86
+__attribute__((target("sse2")))
+static size_t
+find_special_sse2(const uint8_t *data, size_t len)
+{
+  const __m128i end = _mm_set1_epi8((char)SLIP_END);
+  const __m128i esc = _mm_set1_epi8((char)SLIP_ESC);
+  size_t i = 0;
+
+  for(; i + 16 <= len; i += 16)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+    uint32_t mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, end),
+                                                   _mm_cmpeq_epi8(v, esc)));
+    if(mask)
+    {
+      return i + __builtin_ctz(mask);
+    }
+  }
+
+  return i + find_special_scalar(data + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t
+find_special_avx2(const uint8_t *data, size_t len)
+{
+  const __m256i end = _mm256_set1_epi8((char)SLIP_END);
+  const __m256i esc = _mm256_set1_epi8((char)SLIP_ESC);
+  size_t i = 0;
+
+  for(; i + 32 <= len; i += 32)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+    uint32_t mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, end),
+                                                         _mm256_cmpeq_epi8(v, esc)));
+    if(mask)
+    {
+      return i + __builtin_ctz(mask);
+    }
+  }
+
+  return i + find_special_sse2(data + i, len - i);
+}
+#endif
+
+typedef size_t (*find_special_fn)(const uint8_t *data, size_t len);
+
+static find_special_fn find_special = NULL;
+
+enum slip_codec_impl
+slip_codec_select(enum slip_codec_impl wanted)
+{
+#if SLIP_CODEC_X86
+  __builtin_cpu_init();
+
+  if(wanted >= SLIP_CODEC_AVX2 && __builtin_cpu_supports("avx2"))
+  {
+    find_special = find_special_avx2;
+    return SLIP_CODEC_AVX2;
+  }
+  if(wanted >= SLIP_CODEC_SSE2 && __builtin_cpu_supports("sse2"))
+  {
+    find_special = find_special_sse2;
+    return SLIP_CODEC_SSE2;
+  }
+#else
+  (void)wanted;
+#endif
+  find_special = find_special_scalar;
+  return SLIP_CODEC_SCALAR;
+}
+
+size_t
+slip_find_special(const uint8_t *data, size_t len)
+{
+  if(!find_special)
+  {
+    slip_codec_select(SLIP_CODEC_AVX2);
+  }
+  return find_special(data, len);
+}
+
+size_t
+slip_escape(uint8_t *dst, const uint8_t *src, size_t len)
+{
+  uint8_t *out = dst;
+
+  while(len)
+  {
+    size_t run = slip_find_special(src, len);
+    memcpy(out, src, run);
+    out += run;
+    src += run;
+    len -= run;
+
+    /* escape the whole run of special bytes without another search */
+    while(len && (*src == SLIP_END || *src == SLIP_ESC))
+    {
+      *out++ = SLIP_ESC;
+      *out++ = (*src == SLIP_END) ? SLIP_ESC_END : SLIP_ESC_ESC;
+      src++;
+      len--;
+    }
+  }
+
+  return out - dst;
+}
+
+void
+slip_decoder_reset(struct slip_decoder *dec, uint8_t *out, size_t out_len)
+{
+  dec->out = out;
+  dec->out_len = out_len;
+  dec->frame_len = 0;
+  dec->esc = 0;
+  dec->drop = 0;
+}
+
+void
+slip_decoder_window(struct slip_decoder *dec, uint8_t *out, size_t out_len)
+{
+  dec->out = out;
+  dec->out_len = out_len;
+}
+
+void
+slip_decoder_discard(struct slip_decoder *dec, uint8_t *out, size_t out_len)
+{
+  slip_decoder_reset(dec, out, out_len);
+  dec->drop = 1;
+}
+
+slip_decode_result
+slip_decode(struct slip_decoder *dec,
+            const uint8_t **in,
+            size_t *in_len)
+{
+  /* work on locals, dec->out may alias everything for the compiler */
+  const uint8_t *src = *in;
+  size_t len = *in_len;
+  uint8_t *out = dec->out;
+  size_t out_len = dec->out_len;
+  size_t frame_len = dec->frame_len;
+  uint8_t esc = dec->esc;
+  slip_decode_result result = SLIP_DECODE_NEED_INPUT;
+
+  while(len)
+  {
+    if(dec->drop)
+    {
+      const uint8_t *end = memchr(src, SLIP_END, len);
+      if(!end)
+      {
+        src += len;
+        len = 0;
+        break;
+      }
+      len -= end + 1 - src;
+      src = end + 1;
+      dec->drop = 0;
+      esc = 0;
+      frame_len = 0;
+      continue;
+    }
+
+    if(out_len == 0 && (esc || *src != SLIP_END))
+    {
+      result = SLIP_DECODE_NEED_OUTPUT;
+      break;
+    }
+
+    uint8_t c = *src;
+
+    if(esc)
+    {
+      src++;
+      len--;
+      esc = 0;
+      if(c == SLIP_ESC_END)
+      {
+        c = SLIP_END;
+      } else if(c == SLIP_ESC_ESC) {
+        c = SLIP_ESC;
+      }
+      *out++ = c;
+      out_len--;
+      frame_len++;
+      continue;
+    }
+
+    if(c != SLIP_END && c != SLIP_ESC)
+    {
+      size_t run = slip_find_special(src, len < out_len ? len : out_len);
+      memcpy(out, src, run);
+      out += run;
+      out_len -= run;
+      frame_len += run;
+      src += run;
+      len -= run;
+      /* input exhausted or window full */
+      continue;
+    }
+
+    src++;
+    len--;
+
+    if(c == SLIP_ESC)
+    {
+      esc = 1;
+      dec->escapes++;
+    } else if(frame_len > 0) {
+      result = SLIP_DECODE_FRAME;
+      break;
+    }
+    /* END without data: frame start or line noise */
+  }
+
+  dec->out = out;
+  dec->out_len = out_len;
+  dec->frame_len = frame_len;
+  dec->esc = esc;
+  *in = src;
+  *in_len = len;
+  return result;
+}
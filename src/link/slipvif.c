@@ -0,0 +1,183 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "link/slipvif.h"
+#include "link/slip_codec.h"
+#include "link_counters.h"
+
+#include "lwip/opt.h"
+#include "lwip/pbuf.h"
+#include "lwip/sio.h"
+#include "lwip/ip.h"
+
+#include <stdlib.h>
+
+#define SLIPVIF_MTU (1500)
+#define SLIPVIF_RX_CHUNK (2048)
+
+#define IFNAME0 's'
+#define IFNAME1 'v'
+
+struct slipvif_priv
+{
+  sio_fd_t sd;
+  /* p is the whole chain of the frame being received, q the current pbuf */
+  struct pbuf *p;
+  struct pbuf *q;
+  struct slip_decoder dec;
+  struct link_counters counters;
+  uint8_t rx_buf[SLIPVIF_RX_CHUNK];
+  uint8_t tx_buf[SLIP_ENCODED_MAX(SLIPVIF_MTU)];
+};
+
+static err_t
+slipvif_output(struct netif *netif, struct pbuf *p)
+{
+  struct slipvif_priv *priv = (struct slipvif_priv *)netif->state;
+
+  if(p->tot_len > SLIPVIF_MTU)
+  {
+    LINK_COUNTERS_INC(&priv->counters, tx_dropped);
+    return ERR_BUF;
+  }
+
+  uint8_t *out = priv->tx_buf;
+  *out++ = SLIP_END;
+
+  for(struct pbuf *q = p; q != NULL; q = q->next)
+  {
+    out += slip_escape(out, q->payload, q->len);
+  }
+
+  *out++ = SLIP_END;
+
+  size_t len = out - priv->tx_buf;
+  if(!sio_write(priv->sd, priv->tx_buf, len))
+  {
+    /* tx queue full, the frame was not taken */
+    LINK_COUNTERS_INC(&priv->counters, tx_busy);
+    return ERR_MEM;
+  }
+
+  LINK_COUNTERS_ADD(&priv->counters, tx_bytes, len);
+  LINK_COUNTERS_INC(&priv->counters, tx_frames);
+  LINK_COUNTERS_ADD(&priv->counters, tx_escapes, len - 2 - p->tot_len);
+  return ERR_OK;
+}
+
+static err_t
+slipvif_output_v4(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+  LWIP_UNUSED_ARG(ipaddr);
+  return slipvif_output(netif, p);
+}
+
+err_t
+slipvif_init(struct netif *netif)
+{
+  u8_t sio_num = LWIP_PTR_NUMERIC_CAST(u8_t, netif->state);
+
+  /* host only driver, the buffers would not fit into the lwip heap */
+  struct slipvif_priv *priv = calloc(1, sizeof(struct slipvif_priv));
+  if(!priv)
+  {
+    return ERR_MEM;
+  }
+
+  netif->name[0] = IFNAME0;
+  netif->name[1] = IFNAME1;
+  netif->output = slipvif_output_v4;
+  netif->mtu = SLIPVIF_MTU;
+  netif->flags = 0;
+
+  priv->sd = sio_open(sio_num);
+  if(priv->sd <= 0)
+  {
+    free(priv);
+    return ERR_IF;
+  }
+
+  netif->state = priv;
+  link_counters_attach(netif, &priv->counters);
+  return ERR_OK;
+}
+
+static void
+slipvif_next_window(struct slipvif_priv *priv)
+{
+  if(!priv->p)
+  {
+    /* the link's frame size, layers above may leave ip a smaller mtu */
+    priv->p = pbuf_alloc(PBUF_LINK, SLIPVIF_MTU, PBUF_POOL);
+    priv->q = priv->p;
+    if(!priv->p)
+    {
+      LINK_COUNTERS_INC(&priv->counters, rx_dropped);
+      slip_decoder_discard(&priv->dec, NULL, 0);
+      return;
+    }
+    slip_decoder_reset(&priv->dec, priv->q->payload, priv->q->len);
+  } else if(priv->q->next) {
+    priv->q = priv->q->next;
+    slip_decoder_window(&priv->dec, priv->q->payload, priv->q->len);
+  } else {
+    /* frame longer than the mtu */
+    LINK_COUNTERS_INC(&priv->counters, rx_oversize);
+    priv->q = priv->p;
+    slip_decoder_discard(&priv->dec, priv->q->payload, priv->q->len);
+  }
+}
+
+static void
+slipvif_input(struct slipvif_priv *priv, struct netif *netif,
+              const uint8_t *data, size_t len)
+{
+  while(len)
+  {
+    switch(slip_decode(&priv->dec, &data, &len))
+    {
+      case SLIP_DECODE_NEED_INPUT:
+        break;
+      case SLIP_DECODE_NEED_OUTPUT:
+        slipvif_next_window(priv);
+        break;
+      case SLIP_DECODE_FRAME:
+      {
+        struct pbuf *p = priv->p;
+        priv->p = NULL;
+        priv->q = NULL;
+        pbuf_realloc(p, priv->dec.frame_len);
+        LINK_COUNTERS_INC(&priv->counters, rx_frames);
+        if(netif->input(p, netif) != ERR_OK)
+        {
+          pbuf_free(p);
+        }
+        slipvif_next_window(priv);
+        break;
+      }
+    }
+  }
+}
+
+void
+slipvif_poll(struct netif *netif)
+{
+  LWIP_ASSERT("netif != NULL", (netif != NULL));
+  LWIP_ASSERT("netif->state != NULL", (netif->state != NULL));
+
+  struct slipvif_priv *priv = (struct slipvif_priv *)netif->state;
+
+  if(!priv->p && !priv->dec.drop)
+  {
+    slipvif_next_window(priv);
+  }
+
+  uint32_t n;
+  while((n = sio_tryread(priv->sd, priv->rx_buf, sizeof(priv->rx_buf))) > 0)
+  {
+    LINK_COUNTERS_ADD(&priv->counters, rx_bytes, n);
+    slipvif_input(priv, netif, priv->rx_buf, n);
+  }
+  LINK_COUNTERS_SET(&priv->counters, rx_escapes, priv->dec.escapes);
+}
@@ -4,17 +4,28 @@
 
 #include "server/udp.h"
 #include "server/tcp.h"
+#include "server/stats.h"
+#include "server/blast.h"
 
 #include "lwip/init.h"
 #include "lwip/ip.h"
 #include "lwip/timeouts.h"
 #include "lwip/sio.h"
 #include "netif/slipif.h"
+#include "link/hc.h"
+#include "link/hdlcif.h"
+#if defined(LINK_SEC) && LINK_SEC
+#include "link/lsec.h"
+#endif
 
 #include <unistd.h>
 
+/* largest frame the mote takes from the link: one may hold at most half
+ * the pbuf pool, the rest is left to what the stack has in flight */
+#define MOTE_LINK_MRU LWIP_MIN(1500, (PBUF_POOL_SIZE / 2) * PBUF_POOL_BUFSIZE)
+
 int
-main(int argc, char **argv)
+main(void)
 {
 // goal: HDLC in Normal response mode (because RS485 is shared by secondaries)
 // a) primary requests -> one of n secondary replies
@@ -26,6 +37,21 @@ main(int argc, char **argv)
   ip4_addr_t netmask_slip1;
   ip4_addr_t gw_slip1;
   struct netif slipif1;
+#if defined(LINK_HDLC) && LINK_HDLC
+  // secondary, answers on its own address only
+  static struct hdlcif_config hdlc1 = {
+    .devnum = 0,
+    .address = 0x02,
+    .fcs32 = 0,
+    .primary = 0,
+  };
+  hdlc1.devnum = num_slip1;
+  void *state_slip1 = &hdlc1;
+  netif_init_fn init_slip1 = hdlcif_init;
+#else
+  void *state_slip1 = (void *)num_slip1;
+  netif_init_fn init_slip1 = slipif_init;
+#endif
 
   lwip_init();
 
@@ -49,9 +75,9 @@ main(int argc, char **argv)
                                 &ipaddr_slip1,
                                 &netmask_slip1,
                                 &gw_slip1,
-                                (void *)num_slip1,
-                                slipif_init,
-                                ip_input);
+                                state_slip1,
+                                init_slip1,
+                                hc_input);
   LWIP_ASSERT("netif_add failed",
               ret == &slipif1);
 
@@ -60,9 +86,28 @@ main(int argc, char **argv)
   netif_set_up(&slipif1);
   netif_set_link_up(&slipif1);
 
+  // the gateway agrees on the mtu during the header compression handshake
+  slipif1.mtu = LWIP_MIN(slipif1.mtu, MOTE_LINK_MRU);
+
+#if defined(LINK_SEC) && LINK_SEC
+  // encrypts below header compression, the gateway is the initiator
+  static const struct lsec_config sec1 = {
+    .key = { LINK_SEC_KEY_BYTES },
+    .initiator = 0,
+  };
+  err_t sec_err = lsec_attach(&slipif1, &sec1);
+  LWIP_ASSERT("lsec_attach failed",
+              sec_err == ERR_OK);
+#endif
+
+  // header compression, the gateway offers it
+  hc_attach(&slipif1, 0);
+
 
   #if defined(LWIP_UDP) && LWIP_UDP
     udp_server_setup();
+    stats_server_setup();
+    blast_server_setup();
   #endif
 
 
@@ -75,7 +120,11 @@ main(int argc, char **argv)
   while (1)
   {
     sys_check_timeouts(); // required for tcp
+#if defined(LINK_HDLC) && LINK_HDLC
+    hdlcif_poll(&slipif1);
+#else
     slipif_poll(&slipif1);
+#endif
   }
 
 }
@@ -8,47 +8,116 @@
 #include "lwip/sio.h"
 #include "netif/slipif.h"
 #include "lwip_tap/tapif.h"
+#include "arch/sio_pc.h"
+#include "arch/uring_pc.h"
 
+#include "gateway/reactor.h"
+#include "gateway/iothread.h"
+#include "gateway/link_config.h"
+#include "gateway/stats_socket.h"
+#include "gateway/capture.h"
+#include "gateway/pmtu.h"
+#include "gateway/fastpath.h"
+#include "gateway/sched.h"
+#include "link/slipvif.h"
+#include "link/hdlcif.h"
+#include "link/hc.h"
+#include "link/lsec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
-int
-main(int argc, char **argv)
+static struct netif tapif1;
+static struct netif slipifs[GATEWAY_MAX_LINKS];
+
+static struct link_config links[GATEWAY_MAX_LINKS];
+static struct hdlcif_config hdlc_configs[GATEWAY_MAX_LINKS];
+static uint32_t num_links = 0;
+
+static void
+usage(const char *name)
 {
-  struct netif tapif1;
-  struct netif slipif2;
+  fprintf(stderr,
+          "usage: %s [-l path,ip/prefix[,baud[,framing[,key]]][,mtu=n]]... [-f file] [-t] [-w workers] [-c cpu] [-p prio] [-s path] [-P file] [-q|-Q] [-F] [-u]\n"
+          "  -l link  serial link with its own netif and subnet,\n"
+          "           default /dev/ttyUSB0,10.1.0.1/16; subnets outside\n"
+          "           10.0.0.0/15 need a route to the tun interface;\n"
+          "           framing is slip (default), hdlc or hdlc32;\n"
+          "           a key of 32 hex digits encrypts the link;\n"
+          "           mtu caps the frames taken from the link (default\n"
+          "           1500), the mote agrees on the mtu at link up\n"
+          "  -f file  more links, one -l spec per line\n"
+          "  -t       threaded mode: links are sharded across io workers,\n"
+          "           slip links only\n"
+          "  -w n     number of io workers for the serial links (default 1)\n"
+          "  -c cpu   pin serial io worker i to cpu + i\n"
+          "  -p prio  run the serial io workers with SCHED_FIFO prio\n"
+          "  -s path  serve the link counters on a unix socket at path\n"
+          "  -P file  capture the plain ip traffic of tun and all links\n"
+          "           to a pcapng file, drops packets the disk cannot take\n"
+          "  -q       shape each link to its baud with priority for small\n"
+          "           packets, fair queueing and codel\n"
+          "  -Q       shape each link to its baud with a plain fifo\n"
+          "  -F       no cut-through fast path, lwip forwards everything\n"
+          "  -u       move tun and serial reads and writes onto an io_uring,\n"
+          "           one syscall per loop; not with -t, falls back to\n"
+          "           epoll on kernels without it\n",
+          name);
+}
 
-  lwip_init();
+static void
+poll_tapif(void *arg)
+{
+  tapif_poll(arg);
+}
 
-  struct netif *ret;
-
-  {
-    ip4_addr_t ipaddr_tap1;
-    ip4_addr_t netmask_tap1;
-    ip4_addr_t gw_tap1;
-    IP4_ADDR(&ipaddr_tap1,
-             10,
-             0,
-             0,
-             1);
-    IP4_ADDR(&netmask_tap1,
-             255,
-             254,
-             0,
-             0);
-    IP4_ADDR(&gw_tap1,
-             0,
-             0,
-             0,
-             0);
-
-    ret = netif_add(&tapif1,
-                    &ipaddr_tap1,
-                    &netmask_tap1,
-                    &gw_tap1,
-                    NULL,
-                    tapif_init,
-                    ip_input);
-  }
+static void
+poll_slipif(void *arg)
+{
+#if 1 // vectorized host driver, same wire format as slipif
+  slipvif_poll(arg);
+#else
+  slipif_poll(arg);
+#endif
+}
+
+static void
+poll_hdlcif(void *arg)
+{
+  hdlcif_poll(arg);
+}
+
+static void
+add_tapif(void)
+{
+  ip4_addr_t ipaddr_tap1;
+  ip4_addr_t netmask_tap1;
+  ip4_addr_t gw_tap1;
+  IP4_ADDR(&ipaddr_tap1,
+           10,
+           0,
+           0,
+           1);
+  IP4_ADDR(&netmask_tap1,
+           255,
+           254,
+           0,
+           0);
+  IP4_ADDR(&gw_tap1,
+           0,
+           0,
+           0,
+           0);
+
+  struct netif *ret = netif_add(&tapif1,
+                                &ipaddr_tap1,
+                                &netmask_tap1,
+                                &gw_tap1,
+                                NULL,
+                                tapif_init,
+                                ip_input);
 
   LWIP_ASSERT("netif_add failed",
               ret == &tapif1);
@@ -57,51 +126,342 @@ main(int argc, char **argv)
 
   netif_set_up(&tapif1);
   netif_set_link_up(&tapif1);
+}
 
-#if 1
-  {
-    ptrdiff_t num_slip2 = 0; // USB0
-    ip4_addr_t ipaddr_slip2;
-    ip4_addr_t netmask_slip2;
-    ip4_addr_t gw_slip2;
-    IP4_ADDR(&ipaddr_slip2,
-             10,
-             1,
-             0,
-             1);
-    IP4_ADDR(&netmask_slip2,
-             255,
-             255,
-             0,
-             0);
-    IP4_ADDR(&gw_slip2,
-             0,
-             0,
-             0,
-             0);
-
-    ret = netif_add(&slipif2,
-                    &ipaddr_slip2,
-                    &netmask_slip2,
-                    &gw_slip2,
-                    (void *)num_slip2,
-                    slipif_init,
-                    ip_input);
-  }
+static void
+add_slipif(uint32_t num)
+{
+  ptrdiff_t devnum = num;
+  ip4_addr_t gw;
+  IP4_ADDR(&gw,
+           0,
+           0,
+           0,
+           0);
 
-  LWIP_ASSERT("netif_add failed",
-              ret == &slipif2);
+  if(sio_set_path(devnum, links[num].path, links[num].baud) < 0)
+  {
+    exit(1);
+  }
 
-  netif_set_up(&slipif2);
-  netif_set_link_up(&slipif2);
+  void *state = (void *)devnum;
+#if 1 // vectorized host driver, same wire format as slipif
+  netif_init_fn init = slipvif_init;
+#else
+  netif_init_fn init = slipif_init;
 #endif
 
+  if(links[num].framing != LINK_FRAMING_SLIP)
+  {
+    // the gateway is the primary, the mote answers on address 2
+    hdlc_configs[num].devnum = devnum;
+    hdlc_configs[num].address = 0x02;
+    hdlc_configs[num].fcs32 = links[num].framing == LINK_FRAMING_HDLC32;
+    hdlc_configs[num].primary = 1;
+    state = &hdlc_configs[num];
+    init = hdlcif_init;
+  }
+
+  struct netif *ret = netif_add(&slipifs[num],
+                                &links[num].ipaddr,
+                                &links[num].netmask,
+                                &gw,
+                                state,
+                                init,
+                                hc_input);
+
+  if(ret != &slipifs[num])
+  {
+    fprintf(stderr, "cannot open link %s\n", links[num].path);
+    exit(1);
+  }
+
+  netif_set_up(&slipifs[num]);
+  netif_set_link_up(&slipifs[num]);
+}
+
+int
+main(int argc, char **argv)
+{
+  int threaded = 0;
+  const char *stats_path = NULL;
+  const char *capture_path = NULL;
+  int shaping = 0;
+  int fifo = 0;
+  int fastpath = 1;
+  int use_uring = 0;
+  uint32_t num_workers = 1;
+  struct iothread_config tun_config = { .cpu = -1, .fifo_priority = 0 };
+  struct iothread_config serial_config = { .cpu = -1, .fifo_priority = 0 };
+
+  int opt;
+  while((opt = getopt(argc, argv, "l:f:tw:c:p:s:P:qQFu")) != -1)
+  {
+    switch(opt)
+    {
+      case 'l':
+        if(num_links == GATEWAY_MAX_LINKS ||
+           link_config_parse(&links[num_links], optarg) < 0)
+        {
+          fprintf(stderr, "bad link %s\n", optarg);
+          return 1;
+        }
+        num_links++;
+        break;
+      case 'f':
+        if(link_config_load(links, &num_links, GATEWAY_MAX_LINKS, optarg) < 0)
+        {
+          return 1;
+        }
+        break;
+      case 't':
+        threaded = 1;
+        break;
+      case 'w':
+        num_workers = atoi(optarg);
+        break;
+      case 'c':
+        serial_config.cpu = atoi(optarg);
+        break;
+      case 'p':
+        serial_config.fifo_priority = atoi(optarg);
+        break;
+      case 's':
+        stats_path = optarg;
+        break;
+      case 'P':
+        capture_path = optarg;
+        break;
+      case 'q':
+        shaping = 1;
+        fifo = 0;
+        break;
+      case 'Q':
+        shaping = 1;
+        fifo = 1;
+        break;
+      case 'F':
+        fastpath = 0;
+        break;
+      case 'u':
+        use_uring = 1;
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if(num_links == 0)
+  {
+    link_config_parse(&links[num_links++], "/dev/ttyUSB0,10.1.0.1/16");
+  }
+
+  if(num_workers < 1 || num_workers > num_links)
+  {
+    num_workers = num_links;
+  }
+
+  lwip_init();
+
+  // the io workers own their fds, the ring is for the core thread only
+  if(use_uring && threaded)
+  {
+    fprintf(stderr, "-u is ignored with -t\n");
+  } else if(use_uring && uring_init() < 0) {
+    fprintf(stderr, "no io_uring, staying on epoll\n");
+  }
+
+  add_tapif();
+
+  for(uint32_t i = 0; i < num_links; i++)
+  {
+    add_slipif(i);
+  }
+
+  struct reactor reactor;
+  if(reactor_open(&reactor) < 0)
+  {
+    exit(1);
+  }
+
+  if(threaded)
+  {
+    struct iothread_worker *tun = iothread_worker_create(&tun_config);
+    if(!iothread_attach(tun,
+                        &tapif1,
+                        ((struct tapif *)tapif1.state)->fd,
+                        IOTHREAD_TUN))
+    {
+      exit(1);
+    }
+
+    struct iothread_worker *workers[GATEWAY_MAX_LINKS];
+    for(uint32_t w = 0; w < num_workers; w++)
+    {
+      struct iothread_config config = serial_config;
+      if(config.cpu >= 0)
+      {
+        config.cpu += w;
+      }
+      workers[w] = iothread_worker_create(&config);
+    }
+
+    for(uint32_t i = 0; i < num_links; i++)
+    {
+      if(links[i].framing != LINK_FRAMING_SLIP)
+      {
+        fprintf(stderr, "threaded mode supports slip links only: %s\n", links[i].path);
+        exit(1);
+      }
+      if(!iothread_attach(workers[i % num_workers],
+                          &slipifs[i],
+                          sio_fd_of(i),
+                          IOTHREAD_SERIAL))
+      {
+        exit(1);
+      }
+    }
+
+    iothread_worker_start(tun);
+    if(reactor_add(&reactor,
+                   iothread_worker_core_fd(tun),
+                   iothread_worker_poll,
+                   tun) < 0)
+    {
+      exit(1);
+    }
+
+    for(uint32_t w = 0; w < num_workers; w++)
+    {
+      iothread_worker_start(workers[w]);
+      if(reactor_add(&reactor,
+                     iothread_worker_core_fd(workers[w]),
+                     iothread_worker_poll,
+                     workers[w]) < 0)
+      {
+        exit(1);
+      }
+    }
+  } else {
+    if(((struct tapif *)tapif1.state)->uring == NULL &&
+       reactor_add(&reactor,
+                   ((struct tapif *)tapif1.state)->fd,
+                   poll_tapif,
+                   &tapif1) < 0)
+    {
+      exit(1);
+    }
+
+    for(uint32_t i = 0; i < num_links; i++)
+    {
+      if(reactor_add_sio(&reactor,
+                         sio_fd_of(i),
+                         (links[i].framing == LINK_FRAMING_SLIP) ? poll_slipif : poll_hdlcif,
+                         &slipifs[i]) < 0)
+      {
+        exit(1);
+      }
+    }
+  }
+
+  // encryption and header compression sit on top of whatever output path
+  // the link uses, compression above so it still sees plain headers
+  for(uint32_t i = 0; i < num_links; i++)
+  {
+    // what is left of the frame after encryption and compression is the
+    // mru offered to the mote
+    slipifs[i].mtu = LWIP_MIN(slipifs[i].mtu, links[i].mtu);
+    if(links[i].has_key)
+    {
+      struct lsec_config sec;
+      memcpy(sec.key, links[i].key, sizeof(sec.key));
+      sec.initiator = 1;
+      if(lsec_attach(&slipifs[i], &sec) != ERR_OK)
+      {
+        fprintf(stderr, "cannot secure link %s\n", links[i].path);
+        exit(1);
+      }
+    }
+    hc_attach(&slipifs[i], 1);
+    if(links[i].has_key)
+    {
+      lsec_handshake(&slipifs[i]);
+    }
+  }
+
+  // the queue forms in the scheduler instead of the tty, above
+  // compression so it still sees plain headers
+  if(shaping)
+  {
+    for(uint32_t i = 0; i < num_links; i++)
+    {
+      struct sched_config sched = {
+        .rate = sched_rate_of_baud(links[i].baud),
+        .fifo = fifo,
+      };
+      if(sched_attach(&slipifs[i], &sched) != ERR_OK)
+      {
+        fprintf(stderr, "cannot shape link %s\n", links[i].path);
+        exit(1);
+      }
+    }
+  }
+
+  // transit packets either cut through or are checked against the egress
+  // mtu right before ip
+  if(fastpath)
+  {
+    fastpath_init();
+  }
+  netif_input_fn upper_input = fastpath ? fastpath_input : pmtu_input;
+  tapif1.input = upper_input;
+  hc_set_upper_input(upper_input);
+
+  // outermost on output, between compression and ip on input
+  if(capture_path)
+  {
+    if(capture_open(capture_path) < 0)
+    {
+      exit(1);
+    }
+    if(capture_attach(&tapif1) != ERR_OK)
+    {
+      fprintf(stderr, "cannot capture tun\n");
+      exit(1);
+    }
+    tapif1.input = capture_input;
+    for(uint32_t i = 0; i < num_links; i++)
+    {
+      if(capture_attach(&slipifs[i]) != ERR_OK)
+      {
+        fprintf(stderr, "cannot capture link %s\n", links[i].path);
+        exit(1);
+      }
+    }
+    hc_set_upper_input(capture_input);
+    capture_set_upper_input(upper_input);
+  }
+
+  if(stats_path)
+  {
+    struct stats_socket *stats = stats_socket_open(stats_path);
+    if(!stats)
+    {
+      exit(1);
+    }
+    if(reactor_add(&reactor,
+                   stats_socket_fd(stats),
+                   stats_socket_poll,
+                   stats) < 0)
+    {
+      exit(1);
+    }
+  }
+
   while (1)
   {
-    //sys_check_timeouts();
-    tapif_poll(&tapif1);
-    slipif_poll(&slipif2);
-    usleep(100);
+    reactor_run_once(&reactor);
   }
 
 }
@@ -0,0 +1,245 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+/* LWIP_PROFILE builds: mem_malloc and pbuf_alloc are linked with --wrap,
+ * every call from outside mem.c/pbuf.c lands here and is counted into a
+ * size histogram; at exit the histograms, lwip's own high water marks and
+ * an lwipopts overlay sized from them are written to $LWIP_PROFILE_OVERLAY
+ * (stderr if unset), feed it back with -DLWIP_OPTS_OVERLAY=<file>
+ *
+ * host ports only, the firmware is profiled on cc2538_sim */
+
+#include "lwip/opt.h"
+#include "lwip/mem.h"
+#include "lwip/memp.h"
+#include "lwip/pbuf.h"
+#include "lwip/stats.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#if !LWIP_STATS || !MEM_STATS || !MEMP_STATS
+#error "LWIP_PROFILE needs MEM_STATS and MEMP_STATS"
+#endif
+
+/* what the overlay adds on top of the high water mark */
+#define MEM_PROFILE_HEADROOM_PERCENT (25)
+
+/* <= 16, <= 32, ... <= 16384, larger */
+#define MEM_PROFILE_BUCKETS (12)
+#define MEM_PROFILE_FIRST_BUCKET (16)
+
+#define MEM_PROFILE_HEAP_ALIGN (64)
+
+struct mem_profile_hist
+{
+  const char *name;
+  u32_t calls;
+  u32_t failures;
+  u32_t max;
+  u32_t buckets[MEM_PROFILE_BUCKETS];
+};
+
+enum mem_profile_src
+{
+  MEM_PROFILE_HEAP,
+  MEM_PROFILE_PBUF_RAM,
+  MEM_PROFILE_PBUF_POOL,
+  MEM_PROFILE_PBUF_REF,
+  MEM_PROFILE_SRCS,
+};
+
+static struct mem_profile_hist mem_profile[MEM_PROFILE_SRCS] =
+{
+  [MEM_PROFILE_HEAP] = { .name = "mem_malloc" },
+  [MEM_PROFILE_PBUF_RAM] = { .name = "pbuf_alloc PBUF_RAM" },
+  [MEM_PROFILE_PBUF_POOL] = { .name = "pbuf_alloc PBUF_POOL" },
+  [MEM_PROFILE_PBUF_REF] = { .name = "pbuf_alloc PBUF_REF/ROM" },
+};
+
+struct mem_profile_pool
+{
+  const char *name;
+  memp_t type;
+};
+
+static const struct mem_profile_pool mem_profile_pools[] =
+{
+#define LWIP_MEMPOOL(name, num, size, desc) { #name, MEMP_##name },
+#include "lwip/priv/memp_std.h"
+};
+
+void *__real_mem_malloc(mem_size_t size);
+struct pbuf *__real_pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type);
+
+static void
+mem_profile_count(struct mem_profile_hist *hist, u32_t size, int ok)
+{
+  u32_t bucket = 0;
+  u32_t limit = MEM_PROFILE_FIRST_BUCKET;
+  while(size > limit && bucket < MEM_PROFILE_BUCKETS - 1)
+  {
+    limit <<= 1;
+    bucket++;
+  }
+
+  hist->calls++;
+  hist->buckets[bucket]++;
+  if(size > hist->max)
+  {
+    hist->max = size;
+  }
+  if(!ok)
+  {
+    hist->failures++;
+  }
+}
+
+void *
+__wrap_mem_malloc(mem_size_t size)
+{
+  void *mem = __real_mem_malloc(size);
+  mem_profile_count(&mem_profile[MEM_PROFILE_HEAP], size, mem != NULL);
+  return mem;
+}
+
+struct pbuf *
+__wrap_pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
+{
+  struct pbuf *p = __real_pbuf_alloc(layer, length, type);
+
+  enum mem_profile_src src = MEM_PROFILE_PBUF_REF;
+  if(type == PBUF_RAM)
+  {
+    src = MEM_PROFILE_PBUF_RAM;
+  } else if(type == PBUF_POOL) {
+    src = MEM_PROFILE_PBUF_POOL;
+  }
+  mem_profile_count(&mem_profile[src], length, p != NULL);
+
+  return p;
+}
+
+static u32_t
+mem_profile_size(u32_t high_water, u32_t configured, u32_t failures)
+{
+  if(failures)
+  {
+    // the high water mark is the limit, there is no telling how far
+    // the workload would have gone
+    return 2 * configured;
+  }
+
+  u32_t size = high_water + (high_water * MEM_PROFILE_HEADROOM_PERCENT + 99) / 100;
+  return (size > high_water) ? size : high_water + 1;
+}
+
+static void
+mem_profile_hist_print(FILE *out, const struct mem_profile_hist *hist)
+{
+  fprintf(out, "/* %s: %u calls, %u failed, largest %u\n *  ",
+          hist->name, hist->calls, hist->failures, hist->max);
+
+  u32_t limit = MEM_PROFILE_FIRST_BUCKET;
+  for(u32_t i = 0; i < MEM_PROFILE_BUCKETS; i++)
+  {
+    if(i < MEM_PROFILE_BUCKETS - 1)
+    {
+      fprintf(out, " <=%u:%u", limit, hist->buckets[i]);
+    } else {
+      fprintf(out, " >%u:%u", limit >> 1, hist->buckets[i]);
+    }
+    limit <<= 1;
+  }
+  fprintf(out, "\n */\n");
+}
+
+static void
+mem_profile_report(void)
+{
+  const char *path = getenv("LWIP_PROFILE_OVERLAY");
+  FILE *out = path ? fopen(path, "w") : stderr;
+  if(!out)
+  {
+    perror(path);
+    return;
+  }
+
+  fprintf(out,
+          "/* lwipopts overlay measured by LWIP_PROFILE, pid %d\n"
+          " * high water + %u%%, doubled where allocations failed */\n\n",
+          (int)getpid(), MEM_PROFILE_HEADROOM_PERCENT);
+
+  for(u32_t i = 0; i < MEM_PROFILE_SRCS; i++)
+  {
+    mem_profile_hist_print(out, &mem_profile[i]);
+  }
+  fprintf(out, "\n");
+
+  // a single request larger than the heap fails without lwip counting it
+  const struct stats_mem *heap = &lwip_stats.mem;
+  u32_t heap_failures = LWIP_MAX(heap->err, mem_profile[MEM_PROFILE_HEAP].failures);
+  u32_t mem_size = mem_profile_size(heap->max, heap->avail, heap_failures);
+  mem_size = (mem_size + MEM_PROFILE_HEAP_ALIGN - 1) & ~(MEM_PROFILE_HEAP_ALIGN - 1);
+  fprintf(out,
+          "#undef MEM_SIZE\n"
+          "#define MEM_SIZE (%u) // high water %u of %u, %u failed\n",
+          mem_size, (u32_t)heap->max, (u32_t)heap->avail, heap_failures);
+
+  for(size_t i = 0; i < sizeof(mem_profile_pools) / sizeof(mem_profile_pools[0]); i++)
+  {
+    const struct mem_profile_pool *pool = &mem_profile_pools[i];
+    const struct stats_mem *stats = lwip_stats.memp[pool->type];
+    u32_t num = memp_pools[pool->type]->num;
+
+    char option[48];
+    if(pool->type == MEMP_PBUF_POOL)
+    {
+      snprintf(option, sizeof(option), "PBUF_POOL_SIZE");
+    } else {
+      snprintf(option, sizeof(option), "MEMP_NUM_%s", pool->name);
+    }
+
+    fprintf(out,
+            "#undef %s\n"
+            "#define %s (%u) // high water %u of %u, %u failed\n",
+            option, option,
+            mem_profile_size(stats->max, num, stats->err),
+            (u32_t)stats->max, num, (u32_t)stats->err);
+  }
+
+  if(out != stderr)
+  {
+    fclose(out);
+  }
+}
+
+/* the ports never return from main, a signal has to end them through
+ * exit to get the report out */
+static void
+mem_profile_stop(int sig)
+{
+  (void)sig;
+  exit(0);
+}
+
+/* a signal the shell already ignores stays ignored */
+static void
+mem_profile_catch(int sig)
+{
+  if(signal(sig, mem_profile_stop) == SIG_IGN)
+  {
+    signal(sig, SIG_IGN);
+  }
+}
+
+__attribute__((constructor)) static void
+mem_profile_start(void)
+{
+  atexit(mem_profile_report);
+  mem_profile_catch(SIGINT);
+  mem_profile_catch(SIGTERM);
+}
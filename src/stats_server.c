@@ -0,0 +1,74 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "server/stats.h"
+
+#if defined(LWIP_UDP) && LWIP_UDP
+#include "link/link_stats.h"
+#include "lwip/udp.h"
+
+/* one datagram, holds any single line and fits every link mtu without
+ * taking the mote's heap */
+#define STATS_SERVER_CHUNK (512)
+
+static char stats_chunk[STATS_SERVER_CHUNK];
+
+static struct udp_pcb * server_instance()
+{
+  static struct udp_pcb * instance = NULL;
+  if(!instance)
+  {
+    instance = udp_new();
+  }
+  return instance;
+}
+
+static void
+stats_recv_callback(void *arg, struct udp_pcb *pcb, struct pbuf *p,
+                    const ip_addr_t *addr, u16_t port)
+{
+  LWIP_UNUSED_ARG(arg);
+
+  if(p)
+  {
+    pbuf_free(p);
+  }
+
+  u32_t cursor = LINK_STATS_CURSOR_START;
+  while(cursor != LINK_STATS_CURSOR_DONE)
+  {
+    size_t len = link_stats_format(stats_chunk, sizeof(stats_chunk), &cursor);
+    if(!len)
+    {
+      break;
+    }
+
+    // the link copies the datagram out before udp_sendto returns
+    struct pbuf *q = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_REF);
+    if(!q)
+    {
+      break;
+    }
+    q->payload = stats_chunk;
+    udp_sendto(pcb, q, addr, port);
+    pbuf_free(q);
+  }
+}
+
+void stats_server_setup(void)
+{
+  struct udp_pcb * server = server_instance();
+  udp_bind(server, &netif_default->ip_addr, USECASE_STATS_PORT);
+  udp_recv(server, stats_recv_callback, NULL);
+}
+
+#else
+
+// null impl, the tcp build has no udp
+
+void stats_server_setup(void)
+{
+
+}
+#endif
@@ -5,90 +5,281 @@
 #include "server/tcp.h"
 
 #if defined(LWIP_TCP) && LWIP_TCP
+#include "lwip/memp.h"
 #include "lwip/tcp.h"
 
-#include <string.h>
+/* one session per pcb lwip can hold */
+#define TCP_SERVER_MAX_SESSIONS (MEMP_NUM_TCP_PCB)
 
-static struct tcp_pcb * server_instance(struct tcp_pcb * replaced)
+/* source payload, written by reference, never copied */
+#define TCP_SERVER_PATTERN_SIZE (TCP_MSS)
+
+/* in units of the coarse tcp timer (500 ms), retries what ran out of
+ * send queue or could not close */
+#define TCP_SERVER_POLL_INTERVAL (2)
+
+enum tcp_session_mode
+{
+  TCP_SESSION_ECHO,
+  TCP_SESSION_SINK,
+  TCP_SESSION_SOURCE,
+};
+
+struct tcp_session
+{
+  struct tcp_pcb *pcb;
+  enum tcp_session_mode mode;
+  u8_t closing; // peer closed, or our close ran out of memory
+  /* echo: received and not yet acked by the peer, the first written
+   * bytes of it are queued in tcp by reference */
+  struct pbuf *queue;
+  u16_t written;
+};
+
+LWIP_MEMPOOL_DECLARE(TCP_SESSION, TCP_SERVER_MAX_SESSIONS, sizeof(struct tcp_session), "TCP_SESSION");
+
+static u8_t tcp_server_pattern[TCP_SERVER_PATTERN_SIZE];
+
+static void
+tcp_session_free(struct tcp_session *s)
 {
-  static struct tcp_pcb * instance = NULL;
-  if(!instance)
+  if(s->queue)
   {
-    instance = tcp_new();
-  } else if(replaced) {
-    /* The tcp_listen() function returns a new connection identifier, and the one passed as an argument to the function will be deallocated. */
-    instance = replaced;
+    pbuf_free(s->queue);
   }
-  return instance;
+  LWIP_MEMPOOL_FREE(TCP_SESSION, s);
 }
 
-struct tcp_session_data
+/* tcp still points into the echo queue until the peer acked it, so the
+ * session stays until then */
+static void
+tcp_session_close(struct tcp_session *s)
 {
-  uint32_t a;
-};
+  struct tcp_pcb *pcb = s->pcb;
 
-static uint8_t * reply = NULL;
+  s->closing = 1;
+  if(s->queue)
+  {
+    return;
+  }
+
+  tcp_recv(pcb, NULL);
+  tcp_sent(pcb, NULL);
+  if(tcp_close(pcb) == ERR_OK)
+  {
+    tcp_arg(pcb, NULL);
+    tcp_err(pcb, NULL);
+    tcp_poll(pcb, NULL, 0);
+    tcp_session_free(s);
+  }
+  // else out of memory, tcp_session_poll tries again
+}
 
-err_t tcp_sent_callback(void *arg, struct tcp_pcb *tpcb,
-                              u16_t len)
+/* queues the unwritten part of the echo queue by reference, as much as
+ * the send buffer takes */
+static void
+tcp_session_echo(struct tcp_session *s)
 {
-  mem_free(reply);
-  reply = NULL;
-  return ERR_OK;
+  u16_t skip = s->written;
+
+  for(struct pbuf *q = s->queue; q; q = q->next)
+  {
+    if(skip >= q->len)
+    {
+      skip -= q->len;
+      continue;
+    }
+
+    u16_t rest = q->len - skip;
+    u16_t len = LWIP_MIN(rest, tcp_sndbuf(s->pcb));
+    if(!len)
+    {
+      break;
+    }
+
+    u8_t flags = (q->next || len < rest) ? TCP_WRITE_FLAG_MORE : 0;
+    if(tcp_write(s->pcb, (const u8_t *)q->payload + skip, len, flags) != ERR_OK)
+    {
+      break;
+    }
+    s->written += len;
+    skip = 0;
+
+    if(len < rest)
+    {
+      break;
+    }
+  }
+
+  tcp_output(s->pcb);
 }
 
-err_t tcp_receive_callback(void *arg, struct tcp_pcb *tpcb,
-                             struct pbuf *p, err_t err)
+static void
+tcp_session_source(struct tcp_session *s)
 {
-  static uint8_t msg[] = "dave is not here man";
+  while(1)
+  {
+    u16_t len = LWIP_MIN(sizeof(tcp_server_pattern), tcp_sndbuf(s->pcb));
+    if(!len ||
+       tcp_write(s->pcb, tcp_server_pattern, len, TCP_WRITE_FLAG_MORE) != ERR_OK)
+    {
+      break;
+    }
+  }
+
+  tcp_output(s->pcb);
+}
 
-  if (p)
+static err_t
+tcp_session_sent(void *arg, struct tcp_pcb *pcb, u16_t len)
+{
+  struct tcp_session *s = arg;
+  LWIP_UNUSED_ARG(pcb);
+
+  if(s->mode == TCP_SESSION_ECHO)
   {
-    pbuf_free(p);
-    tcp_recved(tpcb, p->tot_len);
+    /* the peer has the echo, the bytes can go and the window opens by as
+     * much; a client that does not read stalls its own uplink */
+    s->queue = pbuf_free_header(s->queue, len);
+    s->written -= len;
+    tcp_recved(s->pcb, len);
+    if(s->closing && !s->queue)
+    {
+      tcp_session_close(s);
+      return ERR_OK;
+    }
+    tcp_session_echo(s);
+  } else if(s->mode == TCP_SESSION_SOURCE) {
+    tcp_session_source(s);
+  }
 
-    if(!reply)
+  return ERR_OK;
+}
+
+static err_t
+tcp_session_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  struct tcp_session *s = arg;
+
+  if(!p || err != ERR_OK)
+  {
+    /* p = NULL indicated connection closed */
+    if(p)
     {
-      reply = mem_malloc(sizeof(msg));
-      memcpy(reply, msg, sizeof(msg));
-      tcp_write(tpcb, reply, sizeof(msg), 0);
+      pbuf_free(p);
     }
+    tcp_session_close(s);
+    return ERR_OK;
+  }
 
+  if(s->mode == TCP_SESSION_ECHO)
+  {
+    if(s->queue)
+    {
+      pbuf_cat(s->queue, p);
+    } else {
+      s->queue = p;
+    }
+    tcp_session_echo(s);
   } else {
-    /* p = NULL indicated connection closed */
-    mem_free(arg);
-    tcp_close(tpcb);
+    tcp_recved(pcb, p->tot_len);
+    pbuf_free(p);
   }
 
+  return ERR_OK;
+}
 
-  if (err != ERR_OK) {
-    /* connection closed by remote */
-    tcp_close(tpcb);
+static err_t
+tcp_session_poll(void *arg, struct tcp_pcb *pcb)
+{
+  struct tcp_session *s = arg;
+  LWIP_UNUSED_ARG(pcb);
+
+  if(s->closing && !s->queue)
+  {
+    tcp_session_close(s);
+  } else if(s->mode == TCP_SESSION_ECHO) {
+    tcp_session_echo(s);
+  } else if(s->mode == TCP_SESSION_SOURCE) {
+    tcp_session_source(s);
   }
+
   return ERR_OK;
 }
 
+static void
+tcp_session_err(void *arg, err_t err)
+{
+  LWIP_UNUSED_ARG(err);
+
+  /* the pcb is already gone */
+  tcp_session_free(arg);
+}
+
 static err_t
 tcp_accept_callback(void *arg, struct tcp_pcb *pcb, err_t err)
 {
+  if(err != ERR_OK || !pcb)
+  {
+    return ERR_VAL;
+  }
+
+  struct tcp_session *s = LWIP_MEMPOOL_ALLOC(TCP_SESSION);
+  if(!s)
+  {
+    tcp_abort(pcb);
+    return ERR_ABRT;
+  }
+
+  s->pcb = pcb;
+  s->mode = (enum tcp_session_mode)(uintptr_t)arg;
+  s->closing = 0;
+  s->queue = NULL;
+  s->written = 0;
+
+  tcp_arg(pcb, s);
+  tcp_recv(pcb, tcp_session_recv);
+  tcp_sent(pcb, tcp_session_sent);
+  tcp_err(pcb, tcp_session_err);
+  tcp_poll(pcb, tcp_session_poll, TCP_SERVER_POLL_INTERVAL);
 
-  struct tcp_session_data * ctx = (struct tcp_session_data*) mem_malloc(sizeof(struct tcp_session_data));
-  tcp_arg(pcb, ctx);
-  tcp_recv(pcb, tcp_receive_callback);
-  tcp_sent(pcb, tcp_sent_callback);
+  if(s->mode == TCP_SESSION_SOURCE)
+  {
+    tcp_session_source(s);
+  }
 
   return ERR_OK;
 }
 
-void tcp_server_setup(void)
+static void
+tcp_server_listen(u16_t port, enum tcp_session_mode mode)
 {
-  struct tcp_pcb * server = server_instance(NULL);
-  tcp_bind(server, &netif_default->ip_addr, USECASE_SERVER_PORT);
-  struct tcp_pcb * listen_server = tcp_listen(server);
-  server_instance(listen_server);
+  struct tcp_pcb *server = tcp_new();
+  if(!server || tcp_bind(server, &netif_default->ip_addr, port) != ERR_OK)
+  {
+    return;
+  }
+
+  /* The tcp_listen() function returns a new connection identifier, and the one passed as an argument to the function will be deallocated. */
+  struct tcp_pcb *listen_server = tcp_listen(server);
+  tcp_arg(listen_server, (void *)(uintptr_t)mode);
   tcp_accept(listen_server, tcp_accept_callback);
 }
 
+void tcp_server_setup(void)
+{
+  LWIP_MEMPOOL_INIT(TCP_SESSION);
+
+  for(u16_t i = 0; i < sizeof(tcp_server_pattern); i++)
+  {
+    tcp_server_pattern[i] = 'a' + i % 26;
+  }
+
+  tcp_server_listen(USECASE_SERVER_PORT, TCP_SESSION_ECHO);
+  tcp_server_listen(USECASE_TCP_SINK_PORT, TCP_SESSION_SINK);
+  tcp_server_listen(USECASE_TCP_SOURCE_PORT, TCP_SESSION_SOURCE);
+}
+
 #else
 
 // null impl
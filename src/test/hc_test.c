@@ -0,0 +1,379 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+/* two netifs with header compression, their outputs queue frames for the
+ * other one's hc_input: udp, tcp and icmp flows must come out of the
+ * peer byte for byte, in both directions, also when there are more flows
+ * than contexts, after a full header frame was lost and after one side
+ * restarted with empty contexts */
+
+#include "link/hc.h"
+
+#include "lwip/init.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/prot/ip4.h"
+#include "lwip/prot/tcp.h"
+#include "lwip/prot/udp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_MAX_FRAMES (16)
+#define TEST_MAX_FRAME (1600)
+#define TEST_PACKETS (40)
+
+/* hc.c sends a full header again after this many compressed ones */
+#define TEST_REFRESH_INTERVAL (16)
+
+/* the 20 byte tcp header plus 12 bytes of timestamp option */
+#define TEST_TCP_HLEN (32)
+
+struct wire
+{
+  u8_t frame[TEST_MAX_FRAMES][TEST_MAX_FRAME];
+  u16_t len[TEST_MAX_FRAMES];
+  int count;
+  int drop;
+  struct netif *peer;
+};
+
+struct flow
+{
+  u8_t proto;
+  u16_t sport;
+  u16_t dport;
+  u16_t id;
+  u32_t seq;
+};
+
+static struct netif mote;
+static struct netif gateway;
+static struct wire to_gateway;
+static struct wire to_mote;
+
+static u8_t delivered_pkt[TEST_MAX_FRAME];
+static u16_t delivered_len;
+static struct netif *delivered_netif;
+static int delivered;
+
+static int failures;
+
+static void
+check(int ok, const char *what)
+{
+  if(!ok)
+  {
+    fprintf(stderr, "FAIL: %s\n", what);
+    failures++;
+  }
+}
+
+static err_t
+wire_output(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+  struct wire *wire = (struct wire *)netif->state;
+  LWIP_UNUSED_ARG(ipaddr);
+
+  if(wire->drop)
+  {
+    wire->drop--;
+    return ERR_OK;
+  }
+  if(wire->count == TEST_MAX_FRAMES || p->tot_len > TEST_MAX_FRAME)
+  {
+    return ERR_MEM;
+  }
+  wire->len[wire->count] = pbuf_copy_partial(p, wire->frame[wire->count], p->tot_len, 0);
+  wire->count++;
+  return ERR_OK;
+}
+
+/* hc's upper input, keeps the last packet to compare */
+static err_t
+record_input(struct pbuf *p, struct netif *inp)
+{
+  delivered_len = pbuf_copy_partial(p, delivered_pkt, sizeof(delivered_pkt), 0);
+  delivered_netif = inp;
+  delivered++;
+  pbuf_free(p);
+  return ERR_OK;
+}
+
+/* deliver both directions until the negotiation has nothing more to say */
+static void
+pump(void)
+{
+  struct wire *wires[] = { &to_gateway, &to_mote };
+
+  for(int busy = 1; busy;)
+  {
+    busy = 0;
+    for(int w = 0; w < 2; w++)
+    {
+      struct wire *wire = wires[w];
+      int count = wire->count;
+      static u8_t frame[TEST_MAX_FRAMES][TEST_MAX_FRAME];
+      u16_t len[TEST_MAX_FRAMES];
+
+      memcpy(frame, wire->frame, sizeof(frame));
+      memcpy(len, wire->len, sizeof(len));
+      wire->count = 0;
+
+      for(int i = 0; i < count; i++)
+      {
+        struct pbuf *p = pbuf_alloc(PBUF_RAW, len[i], PBUF_RAM);
+        if(!p)
+        {
+          fprintf(stderr, "out of pbufs\n");
+          exit(1);
+        }
+        pbuf_take(p, frame[i], len[i]);
+        hc_input(p, wire->peer);
+        busy = 1;
+      }
+    }
+  }
+}
+
+static u16_t
+make_packet(u8_t *pkt, const struct netif *from, const struct netif *to, struct flow *flow, u16_t payload_len)
+{
+  struct ip_hdr *iph = (struct ip_hdr *)pkt;
+  u16_t l4_len = (flow->proto == IP_PROTO_UDP) ? UDP_HLEN :
+                 (flow->proto == IP_PROTO_TCP) ? TEST_TCP_HLEN : 8;
+  u16_t len = IP_HLEN + l4_len + payload_len;
+
+  memset(pkt, 0, len);
+  IPH_VHL_SET(iph, 4, IP_HLEN / 4);
+  IPH_LEN_SET(iph, lwip_htons(len));
+  IPH_ID_SET(iph, lwip_htons(flow->id));
+  IPH_OFFSET_SET(iph, PP_HTONS(IP_DF));
+  IPH_TTL_SET(iph, 64);
+  IPH_PROTO_SET(iph, flow->proto);
+  memcpy(&iph->src, netif_ip4_addr(from), sizeof(iph->src));
+  memcpy(&iph->dest, netif_ip4_addr(to), sizeof(iph->dest));
+  IPH_CHKSUM_SET(iph, inet_chksum(iph, IP_HLEN));
+
+  u8_t *l4 = pkt + IP_HLEN;
+  if(flow->proto == IP_PROTO_UDP)
+  {
+    struct udp_hdr *udph = (struct udp_hdr *)l4;
+    udph->src = lwip_htons(flow->sport);
+    udph->dest = lwip_htons(flow->dport);
+    udph->len = lwip_htons(UDP_HLEN + payload_len);
+    udph->chksum = lwip_htons(flow->id ^ 0x5A5A);
+  } else if(flow->proto == IP_PROTO_TCP) {
+    struct tcp_hdr *tcph = (struct tcp_hdr *)l4;
+    tcph->src = lwip_htons(flow->sport);
+    tcph->dest = lwip_htons(flow->dport);
+    tcph->seqno = lwip_htonl(flow->seq);
+    tcph->ackno = lwip_htonl(~flow->seq);
+    TCPH_HDRLEN_FLAGS_SET(tcph, TEST_TCP_HLEN / 4, TCP_ACK | TCP_PSH);
+    tcph->wnd = PP_HTONS(2048);
+    tcph->chksum = lwip_htons(flow->id);
+    /* nop, nop, timestamp */
+    l4[TCP_HLEN] = 1;
+    l4[TCP_HLEN + 1] = 1;
+    l4[TCP_HLEN + 2] = 8;
+    l4[TCP_HLEN + 3] = 10;
+    memcpy(&l4[TCP_HLEN + 4], &flow->seq, 4);
+    flow->seq += payload_len;
+  } else {
+    /* echo request, the identifier stands in for the ports */
+    l4[0] = 8;
+    l4[4] = flow->sport >> 8;
+    l4[5] = flow->sport & 0xFF;
+    l4[6] = flow->id >> 8;
+    l4[7] = flow->id & 0xFF;
+  }
+
+  for(u16_t i = 0; i < payload_len; i++)
+  {
+    pkt[IP_HLEN + l4_len + i] = (u8_t)(flow->id + i);
+  }
+
+  /* mostly the next id, now and then a jump that has to be sent */
+  flow->id += (flow->id % 7 == 3) ? 5 : 1;
+  return len;
+}
+
+/* 1 if the packet came out of the peer unchanged, 0 if it did not come
+ * out at all, a changed packet is a failure */
+static int
+send_packet(struct netif *from, struct netif *to, struct flow *flow, u16_t payload_len)
+{
+  u8_t pkt[TEST_MAX_FRAME];
+  u16_t len = make_packet(pkt, from, to, flow, payload_len);
+  struct pbuf *p = pbuf_alloc(PBUF_IP, len, PBUF_RAM);
+  if(!p)
+  {
+    fprintf(stderr, "out of pbufs\n");
+    exit(1);
+  }
+  pbuf_take(p, pkt, len);
+
+  delivered = 0;
+  from->output(from, p, netif_ip4_addr(to));
+  check(p->tot_len == len && memcmp(p->payload, pkt, len) == 0, "headers not restored after output");
+  pbuf_free(p);
+  pump();
+
+  if(!delivered)
+  {
+    return 0;
+  }
+  check(delivered == 1, "packet delivered more than once");
+  check(delivered_netif == to, "packet delivered to the wrong netif");
+  check(delivered_len == len && memcmp(delivered_pkt, pkt, len) == 0, "packet changed on the way");
+  return 1;
+}
+
+static void
+test_flows(void)
+{
+  struct flow flows[] = {
+    { IP_PROTO_UDP, 5683, 61616, 100, 0 },
+    { IP_PROTO_TCP, 49152, 80, 2000, 1000 },
+    { IP_PROTO_ICMP, 0x1234, 0, 65530, 0 },
+  };
+  struct flow back[] = {
+    { IP_PROTO_UDP, 61616, 5683, 7, 0 },
+    { IP_PROTO_TCP, 80, 49152, 300, 77 },
+    { IP_PROTO_ICMP, 0x4321, 0, 1, 0 },
+  };
+
+  for(int i = 0; i < TEST_PACKETS; i++)
+  {
+    for(int f = 0; f < 3; f++)
+    {
+      check(send_packet(&mote, &gateway, &flows[f], (u16_t)(i * 13 % 200)), "mote to gateway lost");
+      check(send_packet(&gateway, &mote, &back[f], (u16_t)(i * 29 % 300)), "gateway to mote lost");
+    }
+  }
+
+  const struct hc_stats *m = hc_stats_of(&mote);
+  const struct hc_stats *g = hc_stats_of(&gateway);
+  check(m->tx_compressed > m->tx_full && g->tx_compressed > g->tx_full, "flows not compressed");
+  check(m->tx_compressed == g->rx_compressed && m->tx_full == g->rx_full, "mote tx and gateway rx disagree");
+  check(g->tx_compressed == m->rx_compressed && g->tx_full == m->rx_full, "gateway tx and mote rx disagree");
+}
+
+/* the next flow gets a context id the gateway has not seen yet */
+static void
+test_lost_full(void)
+{
+  struct flow flow = { IP_PROTO_UDP, 5684, 61617, 40000, 0 };
+  u32_t unknown = hc_stats_of(&gateway)->rx_unknown_cid;
+  int lost = 0;
+
+  to_gateway.drop = 1;
+  while(!send_packet(&mote, &gateway, &flow, 32))
+  {
+    if(++lost > TEST_REFRESH_INTERVAL + 1)
+    {
+      check(0, "flow not recovered after a lost full header");
+      return;
+    }
+  }
+
+  check(lost == TEST_REFRESH_INTERVAL + 1, "lost more or fewer packets than until the refresh");
+  check(hc_stats_of(&gateway)->rx_unknown_cid == unknown + lost - 1, "compressed packets without context not counted");
+
+  for(int i = 0; i < TEST_PACKETS; i++)
+  {
+    check(send_packet(&mote, &gateway, &flow, 32), "flow lost after the refresh");
+  }
+}
+
+/* more flows than contexts, every packet evicts one */
+static void
+test_eviction(void)
+{
+  struct flow flows[HC_MAX_CONTEXTS + 4];
+  u32_t full = hc_stats_of(&mote)->tx_full;
+
+  for(int f = 0; f < HC_MAX_CONTEXTS + 4; f++)
+  {
+    flows[f] = (struct flow){ IP_PROTO_UDP, 10000 + f, 20000, 0, 0 };
+  }
+
+  for(int i = 0; i < 5; i++)
+  {
+    for(int f = 0; f < HC_MAX_CONTEXTS + 4; f++)
+    {
+      check(send_packet(&mote, &gateway, &flows[f], 16), "evicted flow lost");
+    }
+  }
+
+  check(hc_stats_of(&mote)->tx_full - full == 5 * (HC_MAX_CONTEXTS + 4), "evicting flow sent compressed");
+}
+
+/* the mote comes back with empty contexts and compression off, its first
+ * plain packet makes the gateway negotiate again */
+static void
+test_restart(void)
+{
+  struct flow flow = { IP_PROTO_UDP, 5683, 61616, 9, 0 };
+  struct flow back = { IP_PROTO_TCP, 80, 49152, 500, 5 };
+
+  mote.output = wire_output;
+  mote.mtu = 1500;
+  check(hc_attach(&mote, 0) == ERR_OK, "restarted mote not attached");
+
+  /* compressed for contexts the mote lost, or a refresh */
+  for(int i = 0; i < 3; i++)
+  {
+    send_packet(&gateway, &mote, &back, 100);
+  }
+
+  u32_t plain = hc_stats_of(&gateway)->rx_plain;
+  check(send_packet(&mote, &gateway, &flow, 100), "plain packet after restart lost");
+  check(hc_stats_of(&gateway)->rx_plain == plain + 1, "packet after restart not plain");
+
+  for(int i = 0; i < TEST_PACKETS; i++)
+  {
+    check(send_packet(&gateway, &mote, &back, 100), "gateway to mote lost after restart");
+    check(send_packet(&mote, &gateway, &flow, 100), "mote to gateway lost after restart");
+  }
+  check(hc_stats_of(&mote)->tx_compressed > 0 && hc_stats_of(&gateway)->tx_compressed > 0,
+        "no compression after restart");
+}
+
+static void
+link_init(struct netif *netif, struct wire *wire, struct netif *peer, u8_t host)
+{
+  netif->output = wire_output;
+  netif->state = wire;
+  netif->mtu = 1500;
+  IP4_ADDR(ip_2_ip4(&netif->ip_addr), 10, 0, 0, host);
+  wire->peer = peer;
+}
+
+int
+main(void)
+{
+  lwip_init();
+  hc_set_upper_input(record_input);
+
+  link_init(&mote, &to_gateway, &gateway, 2);
+  link_init(&gateway, &to_mote, &mote, 1);
+
+  /* the mote answers, the gateway offers */
+  check(hc_attach(&mote, 0) == ERR_OK && hc_attach(&gateway, 1) == ERR_OK, "attach");
+  pump();
+  check(mote.mtu == 1498 && gateway.mtu == 1498, "mtu not negotiated");
+
+  test_flows();
+  test_lost_full();
+  test_eviction();
+  test_restart();
+
+  if(failures)
+  {
+    return 1;
+  }
+  printf("hc_test: ok\n");
+  return 0;
+}
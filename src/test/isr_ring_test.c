@@ -0,0 +1,144 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+/* the uart rx ring on the host: bytes must come out in order while head
+ * and tail run over UINT32_MAX, a full ring must refuse and count every
+ * byte it drops without touching what it holds, and one pop must copy a
+ * span that wraps around the end of the buffer */
+
+#include "isr_ring.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_RING_SIZE (8)
+
+static int failures;
+
+static void
+check(int ok, const char *what)
+{
+  if(!ok)
+  {
+    fprintf(stderr, "FAIL: %s\n", what);
+    failures++;
+  }
+}
+
+/* both indices a few bytes short of UINT32_MAX, as after a long uptime */
+static void
+ring_at(struct isr_ring *ring, uint8_t *buf, uint32_t index)
+{
+  isr_ring_init(ring, buf, TEST_RING_SIZE);
+  atomic_store(&ring->head, index);
+  atomic_store(&ring->tail, index);
+}
+
+static void
+test_index_wrap(void)
+{
+  struct isr_ring ring;
+  uint8_t buf[TEST_RING_SIZE];
+  uint8_t c;
+
+  ring_at(&ring, buf, UINT32_MAX - 2);
+  for(int i = 0; i < 3 * TEST_RING_SIZE; i++)
+  {
+    check(isr_ring_push(&ring, (uint8_t)i) == 0, "push refused across the index wrap");
+    check(isr_ring_count(&ring) == 1, "count across the index wrap");
+    check(isr_ring_pop(&ring, &c, 1) == 1 && c == (uint8_t)i, "byte lost across the index wrap");
+    check(isr_ring_count(&ring) == 0, "ring not empty across the index wrap");
+  }
+
+  /* a full ring whose head has wrapped and whose tail has not */
+  ring_at(&ring, buf, UINT32_MAX - 2);
+  for(int i = 0; i < TEST_RING_SIZE; i++)
+  {
+    check(isr_ring_push(&ring, (uint8_t)i) == 0, "push refused before the ring is full");
+  }
+  check(atomic_load(&ring.head) < atomic_load(&ring.tail), "head did not wrap");
+  check(isr_ring_count(&ring) == TEST_RING_SIZE, "full count across the index wrap");
+  check(isr_ring_push(&ring, 0xff) == -1, "full ring took a byte across the index wrap");
+}
+
+static void
+test_full(void)
+{
+  struct isr_ring ring;
+  uint8_t buf[TEST_RING_SIZE];
+  uint8_t data[TEST_RING_SIZE];
+
+  isr_ring_init(&ring, buf, sizeof(buf));
+  for(int i = 0; i < TEST_RING_SIZE; i++)
+  {
+    check(isr_ring_push(&ring, (uint8_t)i) == 0, "push refused before the ring is full");
+  }
+  for(int i = 0; i < 5; i++)
+  {
+    check(isr_ring_push(&ring, 0xff) == -1, "full ring took a byte");
+  }
+  check(ring.dropped == 5, "dropped bytes not counted");
+  check(isr_ring_count(&ring) == TEST_RING_SIZE, "full ring count");
+
+  check(isr_ring_pop(&ring, data, sizeof(data)) == TEST_RING_SIZE, "full ring pop");
+  for(int i = 0; i < TEST_RING_SIZE; i++)
+  {
+    check(data[i] == (uint8_t)i, "full ring overwritten by a dropped byte");
+  }
+
+  /* room again, the count stays */
+  check(isr_ring_push(&ring, 0) == 0, "push refused after the pop");
+  check(ring.dropped == 5, "dropped count changed by a push");
+}
+
+static void
+test_bulk_wrap(void)
+{
+  struct isr_ring ring;
+  uint8_t buf[TEST_RING_SIZE];
+  uint8_t data[TEST_RING_SIZE];
+
+  /* for every start position, fill the ring and pop it in two spans */
+  for(int start = 0; start < TEST_RING_SIZE; start++)
+  {
+    for(int split = 0; split <= TEST_RING_SIZE; split++)
+    {
+      ring_at(&ring, buf, UINT32_MAX - TEST_RING_SIZE + start);
+      for(int i = 0; i < TEST_RING_SIZE; i++)
+      {
+        isr_ring_push(&ring, (uint8_t)(i + 1));
+      }
+
+      memset(data, 0, sizeof(data));
+      check(isr_ring_pop(&ring, data, split) == (uint32_t)split, "first span length");
+      check(isr_ring_pop(&ring, data + split, sizeof(data)) == (uint32_t)(TEST_RING_SIZE - split),
+            "second span length");
+      check(isr_ring_pop(&ring, data, sizeof(data)) == 0, "pop from an empty ring");
+      for(int i = 0; i < TEST_RING_SIZE; i++)
+      {
+        if(data[i] != (uint8_t)(i + 1))
+        {
+          fprintf(stderr, "FAIL: start %d split %d: byte %d is %u\n", start, split, i, data[i]);
+          failures++;
+          break;
+        }
+      }
+    }
+  }
+}
+
+int
+main(void)
+{
+  test_index_wrap();
+  test_full();
+  test_bulk_wrap();
+
+  if(failures)
+  {
+    return 1;
+  }
+  printf("isr_ring_test: ok\n");
+  return 0;
+}
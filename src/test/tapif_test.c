@@ -0,0 +1,266 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+/* tapif's low_level_output against a SOCK_SEQPACKET socketpair instead
+ * of a tun fd, no root needed: chains of 3 to TAPIF_MAX_IOV + 1 segments
+ * must arrive as one record with their bytes in order, the longest one
+ * must be refused with ERR_BUF and send nothing; with every rx slot held
+ * by lwip, tapif_poll must still read the tun fd empty
+ *
+ * -b compares writev of a 3 segment 1500 byte chain with the copy into a
+ * stack buffer it replaced */
+
+#include "tapif.c"
+
+#include "lwip/init.h"
+
+#include <time.h>
+#include <sys/socket.h>
+
+#define TEST_MAX_SEGMENTS (TAPIF_MAX_IOV + 1)
+#define TEST_BENCH_PACKETS (200000)
+
+/* packets beyond the rx slots, they go to pool pbufs */
+#define TEST_RX_EXTRA (4)
+
+static int failures;
+
+static struct pbuf *held[TAPIF_RX_SLOTS + TEST_RX_EXTRA];
+static int held_count;
+
+static void
+check(int ok, const char *what, int segments)
+{
+  if(!ok)
+  {
+    fprintf(stderr, "FAIL: %s, %d segments\n", what, segments);
+    failures++;
+  }
+}
+
+/* segment i is 1 + (i * 37) % 97 bytes, the payload counts up */
+static struct pbuf *
+make_chain(int segments, u8_t *expected, u16_t *len)
+{
+  struct pbuf *head = NULL;
+  *len = 0;
+
+  for(int i = 0; i < segments; i++)
+  {
+    u16_t seg_len = 1 + (i * 37) % 97;
+    struct pbuf *q = pbuf_alloc(PBUF_RAW, seg_len, PBUF_RAM);
+    if(!q)
+    {
+      fprintf(stderr, "out of pbufs\n");
+      exit(1);
+    }
+    for(u16_t k = 0; k < seg_len; k++)
+    {
+      expected[*len] = (u8_t)(*len * 7 + segments);
+      ((u8_t *)q->payload)[k] = expected[*len];
+      (*len)++;
+    }
+    if(head)
+    {
+      pbuf_cat(head, q);
+    } else {
+      head = q;
+    }
+  }
+  return head;
+}
+
+static void
+test_chains(struct netif *netif, int peer)
+{
+  struct tapif *tapif = (struct tapif *)netif->state;
+  u8_t expected[TEST_MAX_SEGMENTS * 97];
+  u8_t got[sizeof(expected) + 1];
+
+  for(int segments = 3; segments <= TEST_MAX_SEGMENTS; segments++)
+  {
+    u16_t len;
+    struct pbuf *p = make_chain(segments, expected, &len);
+    u32_t dropped = tapif->counters.tx_dropped;
+
+    err_t err = netif->linkoutput(netif, p);
+    ssize_t n = recv(peer, got, sizeof(got), MSG_DONTWAIT);
+
+    if(segments <= TAPIF_MAX_IOV)
+    {
+      check(err == ERR_OK, "chain refused", segments);
+      check(n == len, "record length", segments);
+      check(n == len && memcmp(got, expected, len) == 0, "record bytes", segments);
+    } else {
+      check(err == ERR_BUF, "overlong chain not refused with ERR_BUF", segments);
+      check(n < 0 && errno == EAGAIN, "overlong chain written", segments);
+      check(tapif->counters.tx_dropped == dropped + 1, "tx_dropped not counted", segments);
+    }
+    pbuf_free(p);
+  }
+}
+
+/* lwip keeps every packet, as a queue in front of a slow link would */
+static err_t
+hold_input(struct pbuf *p, struct netif *inp)
+{
+  LWIP_UNUSED_ARG(inp);
+
+  if(held_count == LWIP_ARRAYSIZE(held))
+  {
+    return ERR_MEM;
+  }
+  held[held_count++] = p;
+  return ERR_OK;
+}
+
+static void
+test_rx_held(struct netif *netif, int peer)
+{
+  struct tapif *tapif = (struct tapif *)netif->state;
+  int packets = LWIP_ARRAYSIZE(held);
+  u8_t buf[100];
+
+  for(int i = 0; i < packets; i++)
+  {
+    buf[0] = (u8_t)i;
+    if(send(peer, buf, sizeof(buf), 0) != sizeof(buf))
+    {
+      perror("send");
+      exit(1);
+    }
+  }
+
+  /* one budget per call, a spinning poll would leave packets behind */
+  for(int i = 0; i < packets; i++)
+  {
+    tapif_poll(netif);
+  }
+
+  if(held_count != packets || recv(tapif->fd, buf, sizeof(buf), MSG_DONTWAIT | MSG_PEEK) >= 0)
+  {
+    fprintf(stderr, "FAIL: %d of %d packets read with every rx slot held\n", held_count, packets);
+    failures++;
+  }
+  for(int i = 0; i < held_count; i++)
+  {
+    if(held[i]->tot_len != sizeof(buf) || ((u8_t *)held[i]->payload)[0] != (u8_t)i)
+    {
+      fprintf(stderr, "FAIL: held packet %d damaged or out of order\n", i);
+      failures++;
+    }
+    pbuf_free(held[i]);
+  }
+  if(tapif->rx_free_count != TAPIF_RX_SLOTS)
+  {
+    fprintf(stderr, "FAIL: %d of %d rx slots back\n", tapif->rx_free_count, TAPIF_RX_SLOTS);
+    failures++;
+  }
+}
+
+static uint64_t
+now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* what low_level_output did before it gathered the chain */
+static err_t
+copy_output(struct netif *netif, struct pbuf *p)
+{
+  struct tapif *tapif = (struct tapif *)netif->state;
+  char buf[1514];
+
+  pbuf_copy_partial(p, buf, p->tot_len, 0);
+  if(write(tapif->fd, buf, p->tot_len) == -1)
+  {
+    return ERR_IF;
+  }
+  return ERR_OK;
+}
+
+static void
+bench(struct netif *netif, int peer, const char *name, netif_linkoutput_fn output)
+{
+  struct pbuf *p = pbuf_alloc(PBUF_RAW, 500, PBUF_RAM);
+  u8_t buf[1514];
+
+  for(int i = 0; p && i < 2; i++)
+  {
+    struct pbuf *q = pbuf_alloc(PBUF_RAW, 500, PBUF_RAM);
+    if(!q)
+    {
+      pbuf_free(p);
+      p = NULL;
+      break;
+    }
+    pbuf_cat(p, q);
+  }
+  if(!p)
+  {
+    fprintf(stderr, "out of pbufs\n");
+    exit(1);
+  }
+
+  uint64_t start = now_ns();
+  for(int i = 0; i < TEST_BENCH_PACKETS; i++)
+  {
+    if(output(netif, p) != ERR_OK || recv(peer, buf, sizeof(buf), 0) != 1500)
+    {
+      fprintf(stderr, "%s: write failed\n", name);
+      exit(1);
+    }
+  }
+  double ns = (double)(now_ns() - start) / TEST_BENCH_PACKETS;
+
+  printf("%-7s %u segments: %.0f ns/packet, %.0f MB/s\n",
+         name, pbuf_clen(p), ns, 1500 / ns * 1000.0);
+  pbuf_free(p);
+}
+
+int
+main(int argc, char **argv)
+{
+  static struct tapif tapif;
+  static struct netif netif;
+  int sv[2];
+
+  lwip_init();
+
+  if(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0)
+  {
+    perror("socketpair");
+    return 1;
+  }
+
+  tapif.fd = sv[0];
+  netif.state = &tapif;
+  netif.linkoutput = low_level_output;
+  netif.input = hold_input;
+  netif.mtu = 1500;
+  fcntl(sv[0], F_SETFL, O_NONBLOCK);
+  if(tapif_rx_init(&tapif) != ERR_OK)
+  {
+    fprintf(stderr, "tapif_rx_init failed\n");
+    return 1;
+  }
+
+  test_chains(&netif, sv[1]);
+  test_rx_held(&netif, sv[1]);
+
+  if(argc > 1 && strcmp(argv[1], "-b") == 0)
+  {
+    bench(&netif, sv[1], "copy", copy_output);
+    bench(&netif, sv[1], "writev", low_level_output);
+  }
+
+  if(failures)
+  {
+    return 1;
+  }
+  printf("tapif_test: ok\n");
+  return 0;
+}
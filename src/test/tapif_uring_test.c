@@ -0,0 +1,242 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+/* tapif's io_uring reads against a fake ring whose submission queue
+ * holds as many entries as the test allows: a multishot read or a slot
+ * read that found the queue full must go out with the next uring_run,
+ * on kernels without multishot reads every slot must have exactly one
+ * read in flight once the queue has room again */
+
+#include "tapif.c"
+
+#include "lwip/init.h"
+
+#define TEST_PACKET_LEN (100)
+
+static int failures;
+
+/* sqes uring_sqe hands out before the queue counts as full, the one sqe
+ * is reused as nothing reads it back */
+static int sq_room;
+
+/* what is in flight */
+static struct uring_op *inflight[TAPIF_RX_SLOTS + 1];
+static int inflight_count;
+
+static struct uring_retry *retries;
+static struct io_uring_sqe sqe;
+
+static struct pbuf *held[TAPIF_RX_SLOTS];
+static int held_count;
+
+static void
+check(int ok, const char *what)
+{
+  if(!ok)
+  {
+    fprintf(stderr, "FAIL: %s\n", what);
+    failures++;
+  }
+}
+
+/* the fake ring, linked instead of uring.c */
+int
+uring_init(void)
+{
+  return 0;
+}
+
+int
+uring_enabled(void)
+{
+  return 1;
+}
+
+struct io_uring_sqe *
+uring_sqe(struct uring_op *op)
+{
+  if(sq_room == 0)
+  {
+    return NULL;
+  }
+  for(int i = 0; i < inflight_count; i++)
+  {
+    check(inflight[i] != op, "second request of an op in flight");
+  }
+  sq_room--;
+  inflight[inflight_count++] = op;
+  memset(&sqe, 0, sizeof(sqe));
+  sqe.user_data = (uintptr_t)op;
+  return &sqe;
+}
+
+void
+uring_retry_later(struct uring_retry *retry)
+{
+  if(retry->queued)
+  {
+    return;
+  }
+  retry->queued = 1;
+  retry->next = retries;
+  retries = retry;
+}
+
+void
+uring_run(uint32_t timeout_ms)
+{
+  struct uring_retry *list = retries;
+
+  LWIP_UNUSED_ARG(timeout_ms);
+  retries = NULL;
+  while(list)
+  {
+    struct uring_retry *retry = list;
+    list = list->next;
+    retry->queued = 0;
+    retry->retry(retry);
+  }
+}
+
+int
+uring_bufs_init(struct uring_bufs *bufs, uint16_t entries)
+{
+  bufs->entries = entries;
+  return 0;
+}
+
+void
+uring_bufs_put(struct uring_bufs *bufs, void *addr, uint32_t len, uint16_t bid)
+{
+  LWIP_UNUSED_ARG(addr);
+  LWIP_UNUSED_ARG(len);
+  LWIP_UNUSED_ARG(bid);
+  bufs->tail++;
+}
+
+int
+uring_fixed_buffer(void *buf, size_t len)
+{
+  LWIP_UNUSED_ARG(buf);
+  LWIP_UNUSED_ARG(len);
+  return -1;
+}
+
+static void
+run(int room)
+{
+  sq_room = room;
+  uring_run(0);
+}
+
+static void
+complete(int i, int32_t res, uint32_t flags)
+{
+  struct uring_op *op = inflight[i];
+  inflight[i] = inflight[--inflight_count];
+  op->complete(op, res, flags);
+}
+
+static err_t
+hold_input(struct pbuf *p, struct netif *inp)
+{
+  LWIP_UNUSED_ARG(inp);
+
+  if(held_count == LWIP_ARRAYSIZE(held))
+  {
+    return ERR_MEM;
+  }
+  held[held_count++] = p;
+  return ERR_OK;
+}
+
+static int
+slot_reads(struct tapif *tapif)
+{
+  int reads = 0;
+
+  for(int i = 0; i < inflight_count; i++)
+  {
+    for(int k = 0; k < TAPIF_RX_SLOTS; k++)
+    {
+      reads += inflight[i] == &tapif->rx_slots[k].read_op;
+    }
+  }
+  return reads;
+}
+
+int
+main(void)
+{
+  static struct tapif tapif;
+  static struct netif netif;
+  struct tapif_uring *u;
+
+  lwip_init();
+
+  tapif.fd = -1;
+  netif.state = &tapif;
+  netif.input = hold_input;
+  netif.mtu = 1500;
+  if(tapif_rx_init(&tapif) != ERR_OK)
+  {
+    fprintf(stderr, "tapif_rx_init failed\n");
+    return 1;
+  }
+
+  /* the multishot read finds the queue full */
+  sq_room = 0;
+  if(tapif_uring_open(&netif, &tapif) != ERR_OK)
+  {
+    fprintf(stderr, "tapif_uring_open failed\n");
+    return 1;
+  }
+  u = tapif.uring;
+  check(!u->rx_armed && inflight_count == 0, "multishot read armed without room");
+  run(1);
+  check(u->rx_armed && inflight_count == 1 && inflight[0] == &u->rx_op,
+        "multishot read not armed with the next uring_run");
+
+  /* a kernel before 6.7: one read per slot, 8 fit */
+  sq_room = 8;
+  complete(0, -EINVAL, 0);
+  check(inflight_count == 8, "slot reads beyond the queue room");
+  check(u->rx_pending != NULL, "slot reads not kept for the retry");
+
+  /* room comes back a bit at a time */
+  run(5);
+  check(slot_reads(&tapif) == 13, "slot reads not retried as room came back");
+  run(TAPIF_RX_SLOTS);
+  check(slot_reads(&tapif) == TAPIF_RX_SLOTS, "slot reads lost on a full queue");
+  check(u->rx_pending == NULL, "slot reads still pending");
+
+  /* every read completes while the queue is full, lwip holds the packets
+   * and hands them back, still without room */
+  sq_room = 0;
+  while(inflight_count)
+  {
+    complete(0, TEST_PACKET_LEN, 0);
+  }
+  check(held_count == TAPIF_RX_SLOTS, "packets not delivered");
+  for(int i = 0; i < held_count; i++)
+  {
+    check(held[i]->tot_len == TEST_PACKET_LEN, "packet length");
+    pbuf_free(held[i]);
+  }
+  held_count = 0;
+  check(inflight_count == 0, "slot read with a full queue");
+
+  run(3);
+  check(slot_reads(&tapif) == 3, "slot reads not retried after a partial run");
+  run(TAPIF_RX_SLOTS);
+  check(slot_reads(&tapif) == TAPIF_RX_SLOTS, "slots lost after lwip gave them back");
+  check(retries == NULL, "retry still queued with every read in flight");
+
+  if(failures)
+  {
+    return 1;
+  }
+  printf("tapif_uring_test: ok\n");
+  return 0;
+}
@@ -21,6 +21,7 @@ static void
 udp_recv_callback(void *arg, struct udp_pcb *pcb, struct pbuf *p,
                   const ip_addr_t *addr, u16_t port)
 {
+  LWIP_UNUSED_ARG(arg);
 
   udp_sendto(pcb, p, addr, port);
 
@@ -0,0 +1,19 @@
+# SPDX-FileCopyrightText: 2022 Marian Sauer
+#
+# SPDX-License-Identifier: BSD-2-Clause
+
+# firmware built for the host against a model of the cc2538 uart,
+# for perf/valgrind and ci without boards
+
+set(CMAKE_C_COMPILER "gcc")
+set(CMAKE_CXX_COMPILER "g++")
+
+
+set(GCC_SIM_COMMON_FLAGS "-ffunction-sections -fdata-sections -fno-omit-frame-pointer")
+
+set(CMAKE_CXX_FLAGS_INIT "${GCC_SIM_COMMON_FLAGS}")
+set(CMAKE_C_FLAGS_INIT "${GCC_SIM_COMMON_FLAGS}")
+
+
+# project specific variable
+set(PORT_CC2538_SIM 1)
@@ -0,0 +1,18 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef PORT_ARCH_cc_H
+#define PORT_ARCH_cc_H
+
+#define LWIP_TIMEVAL_PRIVATE 0
+
+typedef unsigned int sys_prot_t;
+
+unsigned int sys_random(void);
+#define LWIP_RAND() sys_random()
+
+#define sio_fd_t uint32_t
+#define __sio_fd_t_defined
+
+#endif
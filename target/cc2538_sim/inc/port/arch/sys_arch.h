@@ -0,0 +1,10 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef PORT_ARCH_sys_arch_H
+#define PORT_ARCH_sys_arch_H
+
+#define SYS_ARCH_UNPROTECT(lev)
+
+#endif
@@ -0,0 +1,31 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef PORT_SIM_nvic_model_H
+#define PORT_SIM_nvic_model_H
+
+#include <stdint.h>
+
+/* peripheral interrupts on the host: a periodic timer signal samples the
+ * modelled interrupt lines and runs the vector of each enabled, asserted
+ * one; if the signal lands inside a peripheral model the vector runs when
+ * the model is left instead
+ *
+ * a tick that comes late means the host did not run us, the models are
+ * paused for the gap instead of letting bytes pile up in the fifos */
+
+/* the handler startup_gcc.c has in its vector table */
+void nvic_model_vector(uint32_t interrupt, void (*handler)(void));
+
+/* sample the lines every period_ns, 0 on success */
+int nvic_model_start(uint64_t period_ns);
+
+/* ticks that came more than a period late */
+uint64_t nvic_model_stalls(void);
+
+/* brackets every access of a peripheral model */
+void nvic_model_enter(void);
+void nvic_model_leave(void);
+
+#endif
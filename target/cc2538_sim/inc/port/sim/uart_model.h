@@ -0,0 +1,36 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef PORT_SIM_uart_model_H
+#define PORT_SIM_uart_model_H
+
+#include <stdint.h>
+
+/* cc2538 uart as the firmware sees it through driverlib: 16 byte
+ * fifos, DR/FR/RSR side effects, bytes paced at the baud rate set with
+ * UARTConfigSetExpClk; the wire is an fd, usually a pty master */
+
+#define UART_MODEL_FIFO_DEPTH (16)
+
+struct uart_model_stats
+{
+  uint64_t rx_bytes;
+  uint64_t tx_bytes;
+  uint64_t rx_overruns; // byte arrived with the rx fifo full
+  uint64_t tx_stall_polls; // UARTCharPut spins on a full tx fifo
+};
+
+/* base is UART0_BASE or UART1_BASE, 0 on success */
+int uart_model_attach(uint32_t base, int wire_fd);
+
+const struct uart_model_stats *uart_model_stats(uint32_t base);
+
+/* brings the wire up to date, true while MIS is non zero */
+int uart_model_irq(uint32_t base);
+
+/* the host did not run us for ns, neither did the firmware, so the
+ * wire did not move either */
+void uart_model_pause(uint64_t ns);
+
+#endif
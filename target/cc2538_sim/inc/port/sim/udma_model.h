@@ -0,0 +1,18 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef PORT_SIM_udma_model_H
+#define PORT_SIM_udma_model_H
+
+#include <stdint.h>
+
+/* the uDMA as far as peripheral channels in basic mode go: the
+ * peripheral model pulls bytes when it would raise a dma request,
+ * the transfer is found by its destination register */
+
+/* copies up to len bytes of the enabled transfer into dst_reg, true in
+ * *done once the transfer finished and the channel disabled itself */
+uint32_t udma_model_pull(uint32_t dst_reg, uint8_t *data, uint32_t len, int *done);
+
+#endif
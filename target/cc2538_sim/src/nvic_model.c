@@ -0,0 +1,212 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+/* driverlib's interrupt api on top of nvic_model, one level of priority,
+ * an isr is never interrupted by another one */
+
+#include "sim/nvic_model.h"
+#include "sim/uart_model.h"
+
+#include "ti_bsp/interrupt.h"
+#include "ti_bsp/hw/hw_ints.h"
+#include "ti_bsp/hw/hw_memmap.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define NVIC_MODEL_NUM (64)
+
+static void (*vectors[NVIC_MODEL_NUM])(void);
+static volatile sig_atomic_t enabled[NVIC_MODEL_NUM];
+static volatile sig_atomic_t masked;
+
+static volatile sig_atomic_t busy;
+static volatile sig_atomic_t in_isr;
+static volatile sig_atomic_t pending;
+
+static uint64_t period;
+static uint64_t last_tick_ns;
+static uint64_t pause_ns;
+static uint64_t stalls;
+
+static uint64_t
+nvic_model_now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int
+nvic_model_line(uint32_t interrupt)
+{
+  switch(interrupt)
+  {
+    case INT_UART0:
+      return uart_model_irq(UART0_BASE);
+    case INT_UART1:
+      return uart_model_irq(UART1_BASE);
+    default:
+      return 0;
+  }
+}
+
+static void
+nvic_model_dispatch(void)
+{
+  pending = 0;
+  if(pause_ns)
+  {
+    uart_model_pause(pause_ns);
+    pause_ns = 0;
+  }
+
+  if(masked)
+  {
+    return;
+  }
+
+  in_isr = 1;
+  for(uint32_t i = 0; i < NVIC_MODEL_NUM; i++)
+  {
+    if(enabled[i] && vectors[i] && nvic_model_line(i))
+    {
+      vectors[i]();
+    }
+  }
+  in_isr = 0;
+}
+
+static void
+nvic_model_tick(int sig)
+{
+  (void)sig;
+
+  uint64_t now = nvic_model_now_ns();
+  if(last_tick_ns && now - last_tick_ns > 2 * period)
+  {
+    pause_ns += now - last_tick_ns - period;
+    stalls++;
+  }
+  last_tick_ns = now;
+
+  if(busy || in_isr)
+  {
+    pending = 1;
+    return;
+  }
+  nvic_model_dispatch();
+}
+
+void
+nvic_model_vector(uint32_t interrupt, void (*handler)(void))
+{
+  if(interrupt < NVIC_MODEL_NUM)
+  {
+    vectors[interrupt] = handler;
+  }
+}
+
+int
+nvic_model_start(uint64_t period_ns)
+{
+  period = period_ns;
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = nvic_model_tick;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  if(sigaction(SIGALRM, &sa, NULL) < 0)
+  {
+    perror("nvic_model: sigaction");
+    return -1;
+  }
+
+  timer_t timer;
+  struct sigevent sev;
+  memset(&sev, 0, sizeof(sev));
+  sev.sigev_notify = SIGEV_SIGNAL;
+  sev.sigev_signo = SIGALRM;
+  if(timer_create(CLOCK_MONOTONIC, &sev, &timer) < 0)
+  {
+    perror("nvic_model: timer_create");
+    return -1;
+  }
+
+  struct itimerspec its;
+  its.it_interval.tv_sec = period_ns / 1000000000ULL;
+  its.it_interval.tv_nsec = period_ns % 1000000000ULL;
+  its.it_value = its.it_interval;
+  if(timer_settime(timer, 0, &its, NULL) < 0)
+  {
+    perror("nvic_model: timer_settime");
+    return -1;
+  }
+  return 0;
+}
+
+uint64_t
+nvic_model_stalls(void)
+{
+  return stalls;
+}
+
+void
+nvic_model_enter(void)
+{
+  busy++;
+}
+
+void
+nvic_model_leave(void)
+{
+  busy--;
+  if(!busy && pending && !in_isr)
+  {
+    nvic_model_dispatch();
+  }
+}
+
+/* driverlib */
+
+bool
+IntMasterEnable(void)
+{
+  bool was_masked = masked;
+  masked = 0;
+  if(pending && !busy && !in_isr)
+  {
+    nvic_model_dispatch();
+  }
+  return was_masked;
+}
+
+bool
+IntMasterDisable(void)
+{
+  bool was_masked = masked;
+  masked = 1;
+  return was_masked;
+}
+
+void
+IntEnable(uint32_t ui32Interrupt)
+{
+  if(ui32Interrupt < NVIC_MODEL_NUM)
+  {
+    enabled[ui32Interrupt] = 1;
+  }
+}
+
+void
+IntDisable(uint32_t ui32Interrupt)
+{
+  if(ui32Interrupt < NVIC_MODEL_NUM)
+  {
+    enabled[ui32Interrupt] = 0;
+  }
+}
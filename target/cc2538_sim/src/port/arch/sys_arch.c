@@ -0,0 +1,31 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <time.h>
+#include <stdint.h>
+#include <sys/random.h>
+
+/* the host clock instead of the board's systick, lwip timers run the
+ * same either way */
+uint32_t
+sys_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC,
+                &ts);
+  return (uint32_t) (ts.tv_sec * 1000L + ts.tv_nsec / 1000000L);
+}
+
+/* link security epochs and challenges, must differ across restarts */
+unsigned int
+sys_random(void)
+{
+  unsigned int r;
+
+  while(getrandom(&r, sizeof(r), 0) != sizeof(r))
+  {
+  }
+  return r;
+}
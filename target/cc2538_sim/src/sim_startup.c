@@ -0,0 +1,112 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+/* stands in for ResetISR in startup_gcc.c: wires uart0 to a pty and
+ * runs uart0_startup before the firmware's main
+ *
+ * the pty slave is linked to $CC2538_SIM_UART0 (default
+ * /tmp/cc2538_sim_uart0), the gateway uses it like the board's ttyUSB */
+
+#include "sim/uart_model.h"
+#include "sim/nvic_model.h"
+
+#include "ti_bsp/hw/hw_ints.h"
+#include "ti_bsp/hw/hw_memmap.h"
+
+#include <fcntl.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define SIM_DEFAULT_UART0 "/tmp/cc2538_sim_uart0"
+// a third of the time the 16 byte rx fifo takes to fill at 1 Mbaud
+#define SIM_NVIC_PERIOD_NS (50000)
+
+extern void uart0_startup(void);
+extern void uart0_isr(void);
+extern uint32_t uart0_rx_dropped(void);
+
+static void
+sim_report(void)
+{
+  const struct uart_model_stats *stats = uart_model_stats(UART0_BASE);
+
+  fprintf(stderr,
+          "uart0: rx %llu bytes, %llu overruns, tx %llu bytes, %llu UARTCharPut spins\n",
+          (unsigned long long)stats->rx_bytes,
+          (unsigned long long)stats->rx_overruns,
+          (unsigned long long)stats->tx_bytes,
+          (unsigned long long)stats->tx_stall_polls);
+  fprintf(stderr,
+          "uart0: %u bytes dropped by the isr\n",
+          uart0_rx_dropped());
+  fprintf(stderr,
+          "host stalled the simulation %llu times\n",
+          (unsigned long long)nvic_model_stalls());
+}
+
+/* the firmware never returns from main, exit on a signal so gprof/gcov
+ * data and the uart stats still get written */
+static void
+sim_stop(int sig)
+{
+  (void)sig;
+  exit(0);
+}
+
+__attribute__((constructor)) void
+cc2538_sim_reset(void)
+{
+  const char *path = getenv("CC2538_SIM_UART0");
+  if(!path)
+  {
+    path = SIM_DEFAULT_UART0;
+  }
+
+  struct termios raw;
+  memset(&raw, 0, sizeof(raw));
+  cfmakeraw(&raw);
+
+  int master;
+  int slave;
+  char name[64];
+  if(openpty(&master, &slave, name, &raw, NULL) < 0)
+  {
+    perror("cc2538_sim: openpty");
+    exit(1);
+  }
+
+  /* the slave stays open so the master does not read EIO while no
+   * gateway is attached */
+  unlink(path);
+  if(symlink(name, path) < 0)
+  {
+    perror(path);
+    exit(1);
+  }
+
+  int flags = fcntl(master, F_GETFL);
+  fcntl(master, F_SETFL, flags | O_NONBLOCK);
+
+  uart_model_attach(UART0_BASE, master);
+
+  atexit(sim_report);
+  signal(SIGINT, sim_stop);
+  signal(SIGTERM, sim_stop);
+
+  fprintf(stderr, "cc2538_sim: uart0 on %s\n", path);
+
+  nvic_model_vector(INT_UART0, uart0_isr);
+
+  uart0_startup();
+
+  if(nvic_model_start(SIM_NVIC_PERIOD_NS) < 0)
+  {
+    exit(1);
+  }
+}
@@ -0,0 +1,62 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+/* the rest of the soc uart0_startup touches, clocks and pin muxing
+ * have nothing to model on the host */
+
+#include "ti_bsp/sys_ctrl.h"
+#include "ti_bsp/gpio.h"
+#include "ti_bsp/ioc.h"
+
+#define SIM_SYS_CLOCK (32000000)
+
+uint32_t
+SysCtrlClockGet(void)
+{
+  return SIM_SYS_CLOCK;
+}
+
+void
+SysCtrlIOClockSet(uint32_t ui32IODiv)
+{
+  (void)ui32IODiv;
+}
+
+void
+SysCtrlPeripheralEnable(uint32_t ui32Peripheral)
+{
+  (void)ui32Peripheral;
+}
+
+void
+IOCPinConfigPeriphOutput(uint32_t ui32Port, uint8_t ui8Pins,
+                         uint32_t ui32OutputSignal)
+{
+  (void)ui32Port;
+  (void)ui8Pins;
+  (void)ui32OutputSignal;
+}
+
+void
+IOCPinConfigPeriphInput(uint32_t ui32Port, uint8_t ui8Pin,
+                        uint32_t ui32PinSelectReg)
+{
+  (void)ui32Port;
+  (void)ui8Pin;
+  (void)ui32PinSelectReg;
+}
+
+void
+GPIOPinTypeUARTInput(uint32_t ui32Port, uint8_t ui8Pins)
+{
+  (void)ui32Port;
+  (void)ui8Pins;
+}
+
+void
+GPIOPinTypeUARTOutput(uint32_t ui32Port, uint8_t ui8Pins)
+{
+  (void)ui32Port;
+  (void)ui8Pins;
+}
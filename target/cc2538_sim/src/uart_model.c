@@ -0,0 +1,630 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+/* driverlib's uart api on top of a register model, each function does
+ * what third_party/ti/src/uart.c does with HWREG, but through
+ * uart_reg_read/uart_reg_write so DR, FR and RSR get their side effects
+ *
+ * time is the host's monotonic clock: a byte leaves the tx fifo and
+ * enters the rx fifo once per byte time (8N1, 10 bits), so polling too
+ * slowly overruns the rx fifo just like on the board
+ *
+ * RIS follows the board for what the firmware uses: RX while the rx fifo
+ * is at or above its IFLS level, RT once a non empty rx fifo saw no byte
+ * for 32 bit times, OE latched until ICR; with TXDMAE set the tx fifo is
+ * fed from the uDMA model and the end of the transfer raises the uart
+ * interrupt as on the board */
+
+#include "sim/uart_model.h"
+#include "sim/nvic_model.h"
+#include "sim/udma_model.h"
+
+#include "ti_bsp/uart.h"
+#include "ti_bsp/hw/hw_memmap.h"
+#include "ti_bsp/hw/hw_uart.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define UART_MODEL_NUM (2)
+#define UART_MODEL_REGS (UART_O_CC / 4 + 1)
+#define UART_MODEL_WIRE_BUF (4096)
+
+struct uart_model
+{
+  uint32_t base;
+  int wire_fd;
+  uint32_t regs[UART_MODEL_REGS];
+
+  uint8_t rx_fifo[UART_MODEL_FIFO_DEPTH];
+  uint8_t rx_head;
+  uint8_t rx_count;
+  uint8_t tx_fifo[UART_MODEL_FIFO_DEPTH];
+  uint8_t tx_head;
+  uint8_t tx_count;
+  /* the dma channel feeding the tx fifo finished, raises the uart
+   * interrupt once */
+  int dma_done;
+
+  uint64_t byte_ns;
+  uint64_t rx_arrival_ns;
+  uint64_t rx_last_ns;
+  uint64_t tx_last_ns;
+  uint64_t wire_poll_ns;
+
+  /* bytes read from the wire that did not arrive at the uart yet */
+  uint8_t wire_rx[UART_MODEL_WIRE_BUF];
+  uint32_t wire_rx_pos;
+  uint32_t wire_rx_len;
+
+  struct uart_model_stats stats;
+};
+
+static struct uart_model models[UART_MODEL_NUM] =
+{
+  { .wire_fd = -1 },
+  { .wire_fd = -1 },
+};
+
+static struct uart_model *
+uart_model_of(uint32_t base)
+{
+  switch(base)
+  {
+    case UART0_BASE:
+      return &models[0];
+    case UART1_BASE:
+      return &models[1];
+    default:
+      fprintf(stderr, "uart_model: no uart at 0x%08x\n", base);
+      return &models[0];
+  }
+}
+
+static uint64_t
+uart_model_now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint32_t
+uart_model_depth(const struct uart_model *m)
+{
+  return (m->regs[UART_O_LCRH / 4] & UART_LCRH_FEN) ? UART_MODEL_FIFO_DEPTH : 1;
+}
+
+static void
+uart_model_rx_byte(struct uart_model *m, uint8_t c)
+{
+  if(m->rx_count == uart_model_depth(m))
+  {
+    m->regs[UART_O_RSR / 4] |= UART_RSR_OE;
+    m->regs[UART_O_RIS / 4] |= UART_RIS_OERIS;
+    m->stats.rx_overruns++;
+    return;
+  }
+
+  m->rx_fifo[(m->rx_head + m->rx_count) % UART_MODEL_FIFO_DEPTH] = c;
+  m->rx_count++;
+  m->stats.rx_bytes++;
+}
+
+static void
+uart_model_tx_push(struct uart_model *m, uint8_t c)
+{
+  m->tx_fifo[(m->tx_head + m->tx_count) % UART_MODEL_FIFO_DEPTH] = c;
+  m->tx_count++;
+}
+
+/* the dma request stays up while the tx fifo has room */
+static void
+uart_model_tx_dma(struct uart_model *m)
+{
+  if(!(m->regs[UART_O_DMACTL / 4] & UART_DMACTL_TXDMAE))
+  {
+    return;
+  }
+
+  uint8_t buf[UART_MODEL_FIFO_DEPTH];
+  int done;
+  uint32_t n = udma_model_pull(m->base + UART_O_DR, buf,
+                               uart_model_depth(m) - m->tx_count, &done);
+  for(uint32_t i = 0; i < n; i++)
+  {
+    uart_model_tx_push(m, buf[i]);
+  }
+  m->dma_done |= done;
+}
+
+static void
+uart_model_wire_write(struct uart_model *m, const uint8_t *data, uint32_t len)
+{
+  if(len && write(m->wire_fd, data, len) < 0)
+  {
+    perror("uart_model: wire");
+  }
+}
+
+/* let the wire catch up with the clock */
+static void
+uart_model_advance(struct uart_model *m)
+{
+  if(m->wire_fd < 0 || !m->byte_ns ||
+     !(m->regs[UART_O_CTL / 4] & UART_CTL_UARTEN))
+  {
+    return;
+  }
+
+  uint64_t now = uart_model_now_ns();
+
+  if(!m->tx_count)
+  {
+    /* the fifo ran dry, whatever the dma hands over now starts now */
+    uart_model_tx_dma(m);
+    m->tx_last_ns = now;
+  }
+
+  /* the dma refills the fifo as it drains, keeping the wire busy */
+  uint8_t out[256];
+  uint32_t out_len = 0;
+  while(m->tx_count)
+  {
+    uint64_t n = (now - m->tx_last_ns) / m->byte_ns;
+    if(n > m->tx_count)
+    {
+      n = m->tx_count;
+    }
+    if(n > sizeof(out) - out_len)
+    {
+      n = sizeof(out) - out_len;
+    }
+    if(!n)
+    {
+      break;
+    }
+
+    for(uint64_t i = 0; i < n; i++)
+    {
+      out[out_len++] = m->tx_fifo[m->tx_head];
+      m->tx_head = (m->tx_head + 1) % UART_MODEL_FIFO_DEPTH;
+    }
+    m->tx_count -= n;
+    m->tx_last_ns += n * m->byte_ns;
+    m->stats.tx_bytes += n;
+
+    if(out_len == sizeof(out))
+    {
+      uart_model_wire_write(m, out, out_len);
+      out_len = 0;
+    }
+    uart_model_tx_dma(m);
+  }
+  uart_model_wire_write(m, out, out_len);
+
+  if(m->wire_rx_pos == m->wire_rx_len)
+  {
+    /* at most one look at the wire per byte time, the firmware polls FR
+     * far more often than bytes can arrive */
+    if(now - m->wire_poll_ns < m->byte_ns)
+    {
+      return;
+    }
+    m->wire_poll_ns = now;
+
+    ssize_t n = read(m->wire_fd, m->wire_rx, sizeof(m->wire_rx));
+    if(n <= 0)
+    {
+      return;
+    }
+    m->wire_rx_pos = 0;
+    m->wire_rx_len = n;
+
+    /* an idle line does not bank byte times */
+    if(now - m->rx_last_ns > m->byte_ns)
+    {
+      m->rx_last_ns = now;
+    }
+  }
+
+  uint64_t n = (now - m->rx_last_ns) / m->byte_ns;
+  if(n > m->wire_rx_len - m->wire_rx_pos)
+  {
+    n = m->wire_rx_len - m->wire_rx_pos;
+  }
+  for(uint64_t i = 0; i < n; i++)
+  {
+    uart_model_rx_byte(m, m->wire_rx[m->wire_rx_pos++]);
+  }
+  m->rx_last_ns += n * m->byte_ns;
+  if(n)
+  {
+    m->rx_arrival_ns = m->rx_last_ns;
+  }
+}
+
+static uint32_t
+uart_model_ris(struct uart_model *m)
+{
+  static const uint8_t rx_levels[] = { 2, 4, 8, 12, 14 };
+  uint32_t sel = (m->regs[UART_O_IFLS / 4] & UART_IFLS_RXIFLSEL_M) >> UART_IFLS_RXIFLSEL_S;
+  uint32_t level = (uart_model_depth(m) == 1) ? 1 : rx_levels[sel < 5 ? sel : 4];
+  uint32_t ris = m->regs[UART_O_RIS / 4] & UART_RIS_OERIS;
+
+  if(m->rx_count >= level)
+  {
+    ris |= UART_RIS_RXRIS;
+  }
+  if(m->rx_count &&
+     uart_model_now_ns() - m->rx_arrival_ns >= 32 * m->byte_ns / 10)
+  {
+    ris |= UART_RIS_RTRIS;
+  }
+  return ris;
+}
+
+static uint32_t
+uart_reg_read_locked(uint32_t base, uint32_t offset)
+{
+  struct uart_model *m = uart_model_of(base);
+
+  switch(offset)
+  {
+    case UART_O_DR:
+    {
+      uart_model_advance(m);
+      if(!m->rx_count)
+      {
+        return 0;
+      }
+      uint8_t c = m->rx_fifo[m->rx_head];
+      m->rx_head = (m->rx_head + 1) % UART_MODEL_FIFO_DEPTH;
+      m->rx_count--;
+      return c;
+    }
+    case UART_O_FR:
+    {
+      uart_model_advance(m);
+      uint32_t depth = uart_model_depth(m);
+      uint32_t fr = 0;
+      fr |= (m->rx_count == 0) ? UART_FR_RXFE : 0;
+      fr |= (m->rx_count == depth) ? UART_FR_RXFF : 0;
+      fr |= (m->tx_count == 0) ? UART_FR_TXFE : 0;
+      fr |= (m->tx_count == depth) ? UART_FR_TXFF : 0;
+      fr |= (m->tx_count != 0) ? UART_FR_BUSY : 0;
+      return fr;
+    }
+    case UART_O_RIS:
+      uart_model_advance(m);
+      return uart_model_ris(m);
+    case UART_O_MIS:
+      uart_model_advance(m);
+      return uart_model_ris(m) & m->regs[UART_O_IM / 4];
+    default:
+      return (offset / 4 < UART_MODEL_REGS) ? m->regs[offset / 4] : 0;
+  }
+}
+
+static void
+uart_reg_write_locked(uint32_t base, uint32_t offset, uint32_t value)
+{
+  struct uart_model *m = uart_model_of(base);
+
+  switch(offset)
+  {
+    case UART_O_DR:
+      uart_model_advance(m);
+      if(m->tx_count == uart_model_depth(m))
+      {
+        /* the board drops it as well */
+        return;
+      }
+      if(!m->tx_count)
+      {
+        m->tx_last_ns = uart_model_now_ns();
+      }
+      uart_model_tx_push(m, value);
+      break;
+    case UART_O_ECR:
+      /* any write clears the errors */
+      m->regs[UART_O_RSR / 4] = 0;
+      break;
+    case UART_O_ICR:
+      /* RX and RT follow the fifo, only OE is latched */
+      m->regs[UART_O_RIS / 4] &= ~(value & UART_RIS_OERIS);
+      break;
+    case UART_O_FR:
+    case UART_O_RIS:
+    case UART_O_MIS:
+      break;
+    default:
+      if(offset / 4 < UART_MODEL_REGS)
+      {
+        m->regs[offset / 4] = value;
+      }
+      break;
+  }
+}
+
+/* the nvic model must not run the isr while the main loop is half way
+ * through a register access, like the bus finishing before an exception */
+static uint32_t
+uart_reg_read(uint32_t base, uint32_t offset)
+{
+  nvic_model_enter();
+  uint32_t value = uart_reg_read_locked(base, offset);
+  nvic_model_leave();
+  return value;
+}
+
+static void
+uart_reg_write(uint32_t base, uint32_t offset, uint32_t value)
+{
+  nvic_model_enter();
+  uart_reg_write_locked(base, offset, value);
+  nvic_model_leave();
+}
+
+#define UART_REG_SET(base, offset, bits) \
+  uart_reg_write((base), (offset), uart_reg_read((base), (offset)) | (bits))
+#define UART_REG_CLEAR(base, offset, bits) \
+  uart_reg_write((base), (offset), uart_reg_read((base), (offset)) & ~(bits))
+
+static void
+uart_model_update_baud(uint32_t base, uint32_t clk)
+{
+  struct uart_model *m = uart_model_of(base);
+  uint32_t div = 64 * m->regs[UART_O_IBRD / 4] + m->regs[UART_O_FBRD / 4];
+  uint64_t baud = div ? (uint64_t)clk * 4 / div : 0;
+
+  if(m->regs[UART_O_CTL / 4] & UART_CTL_HSE)
+  {
+    baud *= 2;
+  }
+  m->byte_ns = baud ? 10ULL * 1000000000ULL / baud : 0;
+}
+
+int
+uart_model_attach(uint32_t base, int wire_fd)
+{
+  struct uart_model *m = uart_model_of(base);
+
+  memset(m, 0, sizeof(*m));
+  m->base = base;
+  m->wire_fd = wire_fd;
+  return 0;
+}
+
+const struct uart_model_stats *
+uart_model_stats(uint32_t base)
+{
+  return &uart_model_of(base)->stats;
+}
+
+void
+uart_model_pause(uint64_t ns)
+{
+  for(uint32_t i = 0; i < UART_MODEL_NUM; i++)
+  {
+    models[i].rx_arrival_ns += ns;
+    models[i].rx_last_ns += ns;
+    models[i].tx_last_ns += ns;
+  }
+}
+
+int
+uart_model_irq(uint32_t base)
+{
+  struct uart_model *m = uart_model_of(base);
+  int irq = uart_reg_read(base, UART_O_MIS) != 0;
+
+  irq |= m->dma_done;
+  m->dma_done = 0;
+  return irq;
+}
+
+/* driverlib */
+
+void
+UARTConfigSetExpClk(uint32_t ui32Base, uint32_t ui32UARTClk,
+                    uint32_t ui32Baud, uint32_t ui32Config)
+{
+  UARTDisable(ui32Base);
+
+  if((ui32Baud * 16) > ui32UARTClk)
+  {
+    UART_REG_SET(ui32Base, UART_O_CTL, UART_CTL_HSE);
+    ui32Baud /= 2;
+  } else {
+    UART_REG_CLEAR(ui32Base, UART_O_CTL, UART_CTL_HSE);
+  }
+
+  uint32_t ui32Div = (((ui32UARTClk * 8) / ui32Baud) + 1) / 2;
+
+  uart_reg_write(ui32Base, UART_O_IBRD, ui32Div / 64);
+  uart_reg_write(ui32Base, UART_O_FBRD, ui32Div % 64);
+  uart_reg_write(ui32Base, UART_O_LCRH, ui32Config);
+
+  uart_model_update_baud(ui32Base, ui32UARTClk);
+}
+
+void
+UARTConfigGetExpClk(uint32_t ui32Base, uint32_t ui32UARTClk,
+                    uint32_t *pui32Baud, uint32_t *pui32Config)
+{
+  uint32_t ui32Int = uart_reg_read(ui32Base, UART_O_IBRD);
+  uint32_t ui32Frac = uart_reg_read(ui32Base, UART_O_FBRD);
+  *pui32Baud = (ui32UARTClk * 4) / ((64 * ui32Int) + ui32Frac);
+
+  if(uart_reg_read(ui32Base, UART_O_CTL) & UART_CTL_HSE)
+  {
+    *pui32Baud *= 2;
+  }
+
+  *pui32Config = (uart_reg_read(ui32Base, UART_O_LCRH) &
+                  (UART_LCRH_SPS | UART_LCRH_WLEN_M | UART_LCRH_STP2 |
+                   UART_LCRH_EPS | UART_LCRH_PEN));
+}
+
+void
+UARTEnable(uint32_t ui32Base)
+{
+  UART_REG_SET(ui32Base, UART_O_LCRH, UART_LCRH_FEN);
+  UART_REG_SET(ui32Base, UART_O_CTL, UART_CTL_UARTEN | UART_CTL_TXE | UART_CTL_RXE);
+}
+
+void
+UARTDisable(uint32_t ui32Base)
+{
+  while(uart_reg_read(ui32Base, UART_O_FR) & UART_FR_BUSY)
+  {
+  }
+
+  UART_REG_CLEAR(ui32Base, UART_O_LCRH, UART_LCRH_FEN);
+  UART_REG_CLEAR(ui32Base, UART_O_CTL, UART_CTL_UARTEN | UART_CTL_TXE | UART_CTL_RXE);
+}
+
+void
+UARTFIFOEnable(uint32_t ui32Base)
+{
+  UART_REG_SET(ui32Base, UART_O_LCRH, UART_LCRH_FEN);
+}
+
+void
+UARTFIFODisable(uint32_t ui32Base)
+{
+  UART_REG_CLEAR(ui32Base, UART_O_LCRH, UART_LCRH_FEN);
+}
+
+bool
+UARTCharsAvail(uint32_t ui32Base)
+{
+  return (uart_reg_read(ui32Base, UART_O_FR) & UART_FR_RXFE) ? false : true;
+}
+
+bool
+UARTSpaceAvail(uint32_t ui32Base)
+{
+  return (uart_reg_read(ui32Base, UART_O_FR) & UART_FR_TXFF) ? false : true;
+}
+
+int32_t
+UARTCharGetNonBlocking(uint32_t ui32Base)
+{
+  if(!(uart_reg_read(ui32Base, UART_O_FR) & UART_FR_RXFE))
+  {
+    return uart_reg_read(ui32Base, UART_O_DR);
+  } else {
+    return -1;
+  }
+}
+
+int32_t
+UARTCharGet(uint32_t ui32Base)
+{
+  while(uart_reg_read(ui32Base, UART_O_FR) & UART_FR_RXFE)
+  {
+  }
+
+  return uart_reg_read(ui32Base, UART_O_DR);
+}
+
+bool
+UARTCharPutNonBlocking(uint32_t ui32Base, uint8_t ui8Data)
+{
+  if(!(uart_reg_read(ui32Base, UART_O_FR) & UART_FR_TXFF))
+  {
+    uart_reg_write(ui32Base, UART_O_DR, ui8Data);
+    return true;
+  } else {
+    return false;
+  }
+}
+
+void
+UARTCharPut(uint32_t ui32Base, uint8_t ui8Data)
+{
+  while(uart_reg_read(ui32Base, UART_O_FR) & UART_FR_TXFF)
+  {
+    uart_model_of(ui32Base)->stats.tx_stall_polls++;
+  }
+
+  uart_reg_write(ui32Base, UART_O_DR, ui8Data);
+}
+
+bool
+UARTBusy(uint32_t ui32Base)
+{
+  return (uart_reg_read(ui32Base, UART_O_FR) & UART_FR_BUSY) ? true : false;
+}
+
+void
+UARTIntEnable(uint32_t ui32Base, uint32_t ui32IntFlags)
+{
+  UART_REG_SET(ui32Base, UART_O_IM, ui32IntFlags);
+}
+
+void
+UARTIntDisable(uint32_t ui32Base, uint32_t ui32IntFlags)
+{
+  UART_REG_CLEAR(ui32Base, UART_O_IM, ui32IntFlags);
+}
+
+uint32_t
+UARTRxErrorGet(uint32_t ui32Base)
+{
+  return uart_reg_read(ui32Base, UART_O_RSR) & 0x0000000F;
+}
+
+void
+UARTFIFOLevelSet(uint32_t ui32Base, uint32_t ui32TxLevel,
+                 uint32_t ui32RxLevel)
+{
+  uart_reg_write(ui32Base, UART_O_IFLS, ui32TxLevel | ui32RxLevel);
+}
+
+uint32_t
+UARTIntStatus(uint32_t ui32Base, bool bMasked)
+{
+  return uart_reg_read(ui32Base, bMasked ? UART_O_MIS : UART_O_RIS);
+}
+
+void
+UARTIntClear(uint32_t ui32Base, uint32_t ui32IntFlags)
+{
+  uart_reg_write(ui32Base, UART_O_ICR, ui32IntFlags);
+}
+
+void
+UARTDMAEnable(uint32_t ui32Base, uint32_t ui32DMAFlags)
+{
+  UART_REG_SET(ui32Base, UART_O_DMACTL, ui32DMAFlags);
+}
+
+void
+UARTDMADisable(uint32_t ui32Base, uint32_t ui32DMAFlags)
+{
+  UART_REG_CLEAR(ui32Base, UART_O_DMACTL, ui32DMAFlags);
+}
+
+void
+UARTRxErrorClear(uint32_t ui32Base)
+{
+  uart_reg_write(ui32Base, UART_O_ECR, 0);
+}
+
+void
+UARTClockSourceSet(uint32_t ui32Base, uint32_t ui32Source)
+{
+  uart_reg_write(ui32Base, UART_O_CC, ui32Source);
+}
+
+uint32_t
+UARTClockSourceGet(uint32_t ui32Base)
+{
+  return uart_reg_read(ui32Base, UART_O_CC);
+}
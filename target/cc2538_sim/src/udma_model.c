@@ -0,0 +1,173 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+/* driverlib's udma api for the calls the firmware makes, the control
+ * table handed to uDMAControlBaseSet is not used, the channel state
+ * lives here */
+
+#include "sim/udma_model.h"
+#include "sim/nvic_model.h"
+
+#include "ti_bsp/udma.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define UDMA_MODEL_CHANNELS (32)
+
+struct udma_model_channel
+{
+  uint32_t control;
+  uint32_t mode;
+  const uint8_t *src;
+  uint32_t dst;
+  uint32_t left;
+  int enabled;
+};
+
+static struct udma_model_channel channels[UDMA_MODEL_CHANNELS];
+static void *control_table;
+
+uint32_t
+udma_model_pull(uint32_t dst_reg, uint8_t *data, uint32_t len, int *done)
+{
+  *done = 0;
+
+  for(uint32_t i = 0; i < UDMA_MODEL_CHANNELS; i++)
+  {
+    struct udma_model_channel *ch = &channels[i];
+    if(!ch->enabled || ch->dst != dst_reg)
+    {
+      continue;
+    }
+
+    uint32_t n = (len < ch->left) ? len : ch->left;
+    if((ch->control & UDMA_SRC_INC_NONE) == UDMA_SRC_INC_NONE)
+    {
+      memset(data, ch->src[0], n);
+    } else {
+      memcpy(data, ch->src, n);
+      ch->src += n;
+    }
+    ch->left -= n;
+
+    if(!ch->left)
+    {
+      ch->enabled = 0;
+      ch->mode = UDMA_MODE_STOP;
+      *done = 1;
+    }
+    return n;
+  }
+  return 0;
+}
+
+/* driverlib */
+
+void
+uDMAEnable(void)
+{
+}
+
+void
+uDMADisable(void)
+{
+}
+
+void
+uDMAControlBaseSet(void *pControlTable)
+{
+  control_table = pControlTable;
+}
+
+void *
+uDMAControlBaseGet(void)
+{
+  return control_table;
+}
+
+void
+uDMAChannelAssign(uint32_t ui32Mapping)
+{
+  (void)ui32Mapping;
+}
+
+void
+uDMAChannelAttributeEnable(uint32_t ui32ChannelNum, uint32_t ui32Attr)
+{
+  (void)ui32ChannelNum;
+  (void)ui32Attr;
+}
+
+void
+uDMAChannelAttributeDisable(uint32_t ui32ChannelNum, uint32_t ui32Attr)
+{
+  (void)ui32ChannelNum;
+  (void)ui32Attr;
+}
+
+void
+uDMAChannelControlSet(uint32_t ui32ChannelStructIndex, uint32_t ui32Control)
+{
+  nvic_model_enter();
+  channels[ui32ChannelStructIndex & 0x1f].control = ui32Control;
+  nvic_model_leave();
+}
+
+void
+uDMAChannelTransferSet(uint32_t ui32ChannelStructIndex, uint32_t ui32Mode,
+                       void *pvSrcAddr, void *pvDstAddr,
+                       uint32_t ui32TransferSize)
+{
+  nvic_model_enter();
+  struct udma_model_channel *ch = &channels[ui32ChannelStructIndex & 0x1f];
+  ch->mode = ui32Mode;
+  ch->src = pvSrcAddr;
+  ch->dst = (uint32_t)(uintptr_t)pvDstAddr;
+  ch->left = ui32TransferSize;
+  nvic_model_leave();
+}
+
+void
+uDMAChannelEnable(uint32_t ui32ChannelNum)
+{
+  nvic_model_enter();
+  channels[ui32ChannelNum & 0x1f].enabled = 1;
+  nvic_model_leave();
+}
+
+void
+uDMAChannelDisable(uint32_t ui32ChannelNum)
+{
+  nvic_model_enter();
+  channels[ui32ChannelNum & 0x1f].enabled = 0;
+  nvic_model_leave();
+}
+
+bool
+uDMAChannelIsEnabled(uint32_t ui32ChannelNum)
+{
+  nvic_model_enter();
+  bool enabled = channels[ui32ChannelNum & 0x1f].enabled;
+  nvic_model_leave();
+  return enabled;
+}
+
+uint32_t
+uDMAChannelModeGet(uint32_t ui32ChannelStructIndex)
+{
+  nvic_model_enter();
+  uint32_t mode = channels[ui32ChannelStructIndex & 0x1f].mode;
+  nvic_model_leave();
+  return mode;
+}
+
+uint32_t
+uDMAChannelSizeGet(uint32_t ui32ChannelStructIndex)
+{
+  nvic_model_enter();
+  uint32_t left = channels[ui32ChannelStructIndex & 0x1f].left;
+  nvic_model_leave();
+  return left;
+}
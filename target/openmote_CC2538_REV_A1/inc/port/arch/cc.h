@@ -9,6 +9,9 @@
 
 typedef unsigned int sys_prot_t;
 
+unsigned int sys_random(void);
+#define LWIP_RAND() sys_random()
+
 #define sio_fd_t uint32_t
 #define __sio_fd_t_defined
 
@@ -13,6 +13,7 @@ int usleep(useconds_t a)
 {
   volatile uint32_t cycle_burn = (1<<10) * a;
   while(cycle_burn--);
+  return 0;
 }
 
 void
@@ -2,11 +2,63 @@
 //
 // SPDX-License-Identifier: BSD-2-Clause
 
+#include "ti_bsp/hw/hw_rfcore_sfr.h"
+#include "ti_bsp/hw/hw_rfcore_xreg.h"
+#include "ti_bsp/hw/hw_types.h"
+#include "ti_bsp/sys_ctrl.h"
+#include "ti_bsp/systick.h"
+
 #include <time.h>
 #include <stdint.h>
 
+#define RFST_ISRXON (0xE3)
+#define RFST_ISRFOFF (0xEF)
+
+#define SYS_TICK_HZ (1000)
+
+static volatile uint32_t sys_ticks;
+static int sys_tick_started;
+
+void
+sys_tick_isr(void)
+{
+  sys_ticks++;
+}
+
+/* 1 ms systick, started by the first call (lwip_init), so tcp
+ * retransmits and the lwip timers run on the board as well */
 uint32_t
 sys_now(void)
 {
-  return 0;
+  if(!sys_tick_started)
+  {
+    sys_tick_started = 1;
+    SysTickPeriodSet(SysCtrlClockGet() / SYS_TICK_HZ);
+    SysTickIntEnable();
+    SysTickEnable();
+  }
+  return sys_ticks;
+}
+
+/* link security epochs and challenges, must differ across resets, so
+ * the bits come from the noise of the radio's I channel rather than
+ * the soc adc lfsr, which starts from the same state after every reset */
+unsigned int
+sys_random(void)
+{
+  unsigned int r = 0;
+
+  SysCtrlPeripheralEnable(SYS_CTRL_PERIPH_RFC);
+  HWREG(RFCORE_SFR_RFST) = RFST_ISRXON;
+  while(!(HWREG(RFCORE_XREG_RSSISTAT) & RFCORE_XREG_RSSISTAT_RSSI_VALID))
+  {
+  }
+
+  for(int i = 0; i < 32; i++)
+  {
+    r = (r << 1) | (HWREG(RFCORE_XREG_RFRND) & RFCORE_XREG_RFRND_IRND);
+  }
+
+  HWREG(RFCORE_SFR_RFST) = RFST_ISRFOFF;
+  return r;
 }
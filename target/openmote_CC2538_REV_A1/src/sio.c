@@ -3,24 +3,99 @@
 // SPDX-License-Identifier: BSD-2-Clause
 
 #include "arch/cc.h"
+#include "link_counters.h"
+#include "sio_framing.h"
 #include "ti_bsp/uart.h"
 #include <stdint.h>
 
 
 extern uint32_t uart0_instance(void);
+extern uint32_t uart0_read(uint8_t *data, uint32_t len);
+extern void uart0_write(const uint8_t *data, uint32_t len);
+extern void uart0_tx_commit(void);
+extern uint32_t uart0_rx_dropped(void);
+extern uint32_t uart0_tx_queued(void);
+
+#define SIO_SLIP_END (0xC0)
+#define SIO_HDLC_FLAG (0x7E)
+
+// bytes since the last commit, saturating: a delimiter after more than one
+// closes a frame, an opening one arrives in an empty buffer
+static uint8_t sio_tx_pending;
+// SLIP END or HDLC flag, the other one is payload
+static uint8_t sio_tx_end = SIO_SLIP_END;
+
+// main loop only, the isr's overruns are picked up when they are read
+static struct link_counters uart0_counters;
+static uint8_t uart0_opened;
+
+static void
+sio_tx_frame(const uint8_t *data, uint32_t len)
+{
+  uart0_write(data, len);
+  // no lwip here for LWIP_MIN, the sum is 32 bit and can not wrap
+  sio_tx_pending = (sio_tx_pending + len < 2) ? sio_tx_pending + len : 2;
+  LINK_COUNTERS_ADD(&uart0_counters, tx_bytes, len);
+
+  if(data[len - 1] == sio_tx_end && sio_tx_pending > 1)
+  {
+    uart0_tx_commit();
+    sio_tx_pending = 0;
+    LINK_COUNTERS_INC(&uart0_counters, tx_frames);
+    LINK_COUNTERS_QUEUE(&uart0_counters, uart0_tx_queued());
+  }
+}
 
 void
 sio_send(uint8_t c, sio_fd_t fd)
 {
+  if(fd == uart0_instance())
+  {
+    sio_tx_frame(&c, 1);
+    return;
+  }
+
   UARTCharPut(fd, c);
 }
 
+uint32_t
+sio_write(sio_fd_t fd, const uint8_t *data, uint32_t len)
+{
+  if(!len)
+  {
+    return 0;
+  }
+
+  if(fd == uart0_instance())
+  {
+    sio_tx_frame(data, len);
+    return len;
+  }
+
+  for(uint32_t i = 0; i < len; i++)
+  {
+    UARTCharPut(fd, data[i]);
+  }
+  return len;
+}
+
+void
+sio_set_framing(uint8_t devnum, enum sio_framing framing)
+{
+  // only uart0 collects frames, the others go out byte by byte
+  if(devnum == 3)
+  {
+    sio_tx_end = (framing == SIO_FRAMING_HDLC) ? SIO_HDLC_FLAG : SIO_SLIP_END;
+  }
+}
+
 sio_fd_t
 sio_open(uint8_t devnum)
 {
   switch(devnum)
   {
     case 3:
+      uart0_opened = 1;
       return uart0_instance();
     default:
       return 0;
@@ -30,6 +105,14 @@ sio_open(uint8_t devnum)
 uint32_t
 sio_tryread(sio_fd_t fd, uint8_t *data, uint32_t len)
 {
+  // uart0 is drained by its isr, hand out everything it collected
+  if(fd == uart0_instance())
+  {
+    uint32_t n = uart0_read(data, len);
+    LINK_COUNTERS_ADD(&uart0_counters, rx_bytes, n);
+    return n;
+  }
+
   int32_t c = UARTCharGetNonBlocking(fd);
 
   if(c < 0)
@@ -42,3 +125,15 @@ sio_tryread(sio_fd_t fd, uint8_t *data, uint32_t len)
     return 1;
   }
 }
+
+const struct link_counters *
+sio_link_counters(uint8_t devnum)
+{
+  if(devnum != 3 || !uart0_opened)
+  {
+    return NULL;
+  }
+
+  LINK_COUNTERS_SET(&uart0_counters, rx_overruns, uart0_rx_dropped());
+  return &uart0_counters;
+}
@@ -23,6 +23,8 @@ void ResetISR(void);
 void NmiSR(void);
 void FaultISR(void);
 void IntDefaultHandler(void);
+void uart0_isr(void);
+void sys_tick_isr(void);
 
 
 //*****************************************************************************
@@ -67,13 +69,13 @@ void (* const gVectors[])(void) =
   IntDefaultHandler,                      // 12 Debug monitor handler
   0,                                      // 13 Reserved
   IntDefaultHandler,                      // 14 The PendSV handler
-  IntDefaultHandler,                      // 15 The SysTick handler
+  sys_tick_isr,                           // 15 The SysTick handler
   IntDefaultHandler,                      // 16 GPIO Port A
   IntDefaultHandler,                      // 17 GPIO Port B
   IntDefaultHandler,                      // 18 GPIO Port C
   IntDefaultHandler,                      // 19 GPIO Port D
   0,                                      // 20 none
-  IntDefaultHandler,                      // 21 UART0 Rx and Tx
+  uart0_isr,                              // 21 UART0 Rx and Tx
   IntDefaultHandler,                      // 22 UART1 Rx and Tx
   IntDefaultHandler,                      // 23 SSI0 Rx and Tx
   IntDefaultHandler,                      // 24 I2C Master and Slave
@@ -6,19 +6,177 @@
 #include "ti_bsp/uart.h"
 #include "ti_bsp/gpio.h"
 #include "ti_bsp/ioc.h"
+#include "ti_bsp/interrupt.h"
+#include "ti_bsp/udma.h"
 #include "ti_bsp/hw/hw_memmap.h"
 #include "ti_bsp/hw/hw_ioc.h"
+#include "ti_bsp/hw/hw_ints.h"
+#include "ti_bsp/hw/hw_uart.h"
+#include "isr_ring.h"
+
+#include <string.h>
 
 #define UART0_PIN_UART_RXD            GPIO_PIN_0
 #define UART0_PIN_UART_TXD            GPIO_PIN_1
 #define UART0_GPIO_BASE               GPIO_A_BASE
 
+#ifndef LINK_BAUD
+#define LINK_BAUD                     1000000
+#endif
+
+// ~10 ms at 1 Mbaud, lwIP may take that long for a packet
+#define UART0_RX_RING_SIZE            1024
+
+// one basic uDMA transfer moves at most 1024 items
+#define UART0_TX_BUF_SIZE             1024
+#define UART0_TX_DMA_CHANNEL          UDMA_CH9_UART0TX
+
+static uint8_t uart0_rx_buf[UART0_RX_RING_SIZE];
+static struct isr_ring uart0_rx;
+static volatile uint32_t uart0_rx_overruns;
+
+// double buffered tx: the main loop fills one buffer while the uDMA
+// feeds the other to the fifo, a committed buffer is owned by the isr
+// until its transfer is done and its length is back to 0
+static uint8_t uart0_tx_buf[2][UART0_TX_BUF_SIZE];
+static volatile uint32_t uart0_tx_len[2];
+static volatile int8_t uart0_tx_active = -1;
+static uint8_t uart0_tx_fill_idx;
+static uint32_t uart0_tx_fill;
+
+// primary control structures only, channels 0..31
+static uint8_t uart0_dma_table[512] __attribute__((aligned(1024)));
+
 uint32_t
 uart0_instance(void)
 {
   return UART0_BASE;
 }
 
+static void
+uart0_tx_start(uint8_t idx)
+{
+  uart0_tx_active = idx;
+  uDMAChannelTransferSet(UART0_TX_DMA_CHANNEL | UDMA_PRI_SELECT,
+                         UDMA_MODE_BASIC,
+                         uart0_tx_buf[idx],
+                         (void *)(uintptr_t)(uart0_instance() + UART_O_DR),
+                         uart0_tx_len[idx]);
+  uDMAChannelEnable(UART0_TX_DMA_CHANNEL);
+}
+
+// the uDMA disables the channel when its transfer is done and raises the
+// uart's interrupt, start the buffer that was committed in the meantime
+static void
+uart0_tx_done(void)
+{
+  if(uart0_tx_active < 0 ||
+     uDMAChannelIsEnabled(UART0_TX_DMA_CHANNEL))
+  {
+    return;
+  }
+
+  uart0_tx_len[uart0_tx_active] = 0;
+  uint8_t next = uart0_tx_active ^ 1;
+  if(uart0_tx_len[next])
+  {
+    uart0_tx_start(next);
+  } else {
+    uart0_tx_active = -1;
+  }
+}
+
+// vector 21, fires at half a fifo, on rx timeout for the tail of a frame
+// and when the tx uDMA transfer is done
+void
+uart0_isr(void)
+{
+  uint32_t status = UARTIntStatus(uart0_instance(), true);
+  UARTIntClear(uart0_instance(), status);
+
+  if(status & UART_INT_OE)
+  {
+    uart0_rx_overruns++;
+    UARTRxErrorClear(uart0_instance());
+  }
+
+  int32_t c;
+  while((c = UARTCharGetNonBlocking(uart0_instance())) >= 0)
+  {
+    isr_ring_push(&uart0_rx, c);
+  }
+
+  uart0_tx_done();
+}
+
+uint32_t
+uart0_read(uint8_t *data, uint32_t len)
+{
+  return isr_ring_pop(&uart0_rx, data, len);
+}
+
+// hands the buffer being filled to the uDMA, only blocks while the other
+// buffer is still waiting for or in its transfer
+void
+uart0_tx_commit(void)
+{
+  if(!uart0_tx_fill)
+  {
+    return;
+  }
+
+  uint8_t idx = uart0_tx_fill_idx;
+  while(uart0_tx_len[idx ^ 1])
+  {
+  }
+
+  IntDisable(INT_UART0);
+  uart0_tx_len[idx] = uart0_tx_fill;
+  if(uart0_tx_active < 0)
+  {
+    uart0_tx_start(idx);
+  }
+  IntEnable(INT_UART0);
+
+  uart0_tx_fill_idx = idx ^ 1;
+  uart0_tx_fill = 0;
+}
+
+void
+uart0_write(const uint8_t *data, uint32_t len)
+{
+  while(len)
+  {
+    uint32_t n = UART0_TX_BUF_SIZE - uart0_tx_fill;
+    if(n > len)
+    {
+      n = len;
+    }
+    memcpy(&uart0_tx_buf[uart0_tx_fill_idx][uart0_tx_fill], data, n);
+    uart0_tx_fill += n;
+    data += n;
+    len -= n;
+
+    if(uart0_tx_fill == UART0_TX_BUF_SIZE)
+    {
+      uart0_tx_commit();
+    }
+  }
+}
+
+uint32_t
+uart0_rx_dropped(void)
+{
+  return uart0_rx.dropped + uart0_rx_overruns;
+}
+
+// bytes committed or being filled that the uDMA has not finished yet
+uint32_t
+uart0_tx_queued(void)
+{
+  return uart0_tx_len[0] + uart0_tx_len[1] + uart0_tx_fill;
+}
+
 void
 uart0_startup(void)
 {
@@ -48,15 +206,39 @@ uart0_startup(void)
 
   UARTConfigSetExpClk(uart0_instance(),
                       SysCtrlClockGet(),
-                      1000000,
+                      LINK_BAUD,
                       (UART_CONFIG_WLEN_8 | UART_CONFIG_STOP_ONE |
                       UART_CONFIG_PAR_NONE));
 
+  isr_ring_init(&uart0_rx, uart0_rx_buf, sizeof(uart0_rx_buf));
+
+  UARTFIFOLevelSet(uart0_instance(),
+                   UART_FIFO_TX4_8,
+                   UART_FIFO_RX4_8);
+  UARTIntEnable(uart0_instance(),
+                UART_INT_RX | UART_INT_RT | UART_INT_OE);
+
+  // the uDMA has no clock gate of its own
+  uDMAEnable();
+  uDMAControlBaseSet(uart0_dma_table);
+  uDMAChannelAssign(UART0_TX_DMA_CHANNEL);
+  uDMAChannelAttributeDisable(UART0_TX_DMA_CHANNEL,
+                              UDMA_ATTR_ALL);
+  uDMAChannelControlSet(UART0_TX_DMA_CHANNEL | UDMA_PRI_SELECT,
+                        UDMA_SIZE_8 | UDMA_SRC_INC_8 | UDMA_DST_INC_NONE |
+                        UDMA_ARB_4);
+  UARTDMAEnable(uart0_instance(),
+                UART_DMA_TX);
+
+  IntEnable(INT_UART0);
+
   UARTEnable(uart0_instance());
 }
 
 int _write(int file, char *ptr, int len)
 {
+  (void)file;
+  (void)ptr;
   for(int i = 0; i < len; i++)
   {
     //UARTCharPut(uart0_instance(), *(ptr + i));
@@ -9,7 +9,17 @@
 
 typedef unsigned int sys_prot_t;
 
+unsigned int sys_random(void);
+#define LWIP_RAND() sys_random()
+
 #define sio_fd_t int
 #define __sio_fd_t_defined
 
+/* the largest frame sio_write takes whole: a fully escaped 1500 byte
+ * SLIP frame, or an HDLC frame with FCS-32 */
+#define SIO_FRAME_MAX (2 * (1500 + 6) + 2)
+
+/* sio_write queues or refuses whole frames, hdlcif hands it one at once */
+#define HDLCIF_TX_CHUNK (SIO_FRAME_MAX)
+
 #endif
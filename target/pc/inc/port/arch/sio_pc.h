@@ -0,0 +1,56 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef PORT_ARCH_sio_pc_H
+#define PORT_ARCH_sio_pc_H
+
+#include "arch/cc.h"
+#include <stdint.h>
+
+/* fd opened by sio_open(devnum), -1 if devnum was never opened
+ * slipif keeps its sio_fd_t private, the gateway needs it for epoll */
+sio_fd_t sio_fd_of(uint8_t devnum);
+
+/* sio_open(devnum) opens path at baud instead of /dev/ttyUSB<devnum>
+ * at 1000000, works for ttys and ptys
+ * "pty:path" creates a pty instead and links its slave to path, the
+ * other end of the link (e.g. a mote build) opens that like a tty */
+int sio_set_path(uint8_t devnum, const char *path, uint32_t baud);
+
+/* sio_open(devnum) uses an already open fd, e.g. one side of openpty(),
+ * termios is left as the caller set it up */
+int sio_set_fd(uint8_t devnum, int fd);
+
+enum sio_pair_kind
+{
+  SIO_PAIR_PTY,
+  SIO_PAIR_SOCKET, // UNIX stream socketpair
+  SIO_PAIR_RING,   // lock-free byte rings in shared memory
+};
+
+/* connects devnum a and b back to back, the pair is usable from two
+ * threads or, set up before fork, from two processes */
+int sio_pair(uint8_t a, uint8_t b, enum sio_pair_kind kind);
+
+/* sio_write never waits either: it takes one whole frame, sends what
+ * the device takes and queues the rest, up to a few frames per device;
+ * 0 when the queue is full and nothing was taken, drivers answer ERR_MEM
+ * queued frames move on whenever the driver polls (sio_tryread) */
+
+/* event to poll sio_fd_of(devnum) for, besides POLLIN, until the queue
+ * can make progress: POLLOUT, or 0 while nothing is queued
+ * a ring wakes its writer with POLLIN */
+short sio_tx_events(sio_fd_t fd);
+
+/* on the io_uring (uring_init before sio_open) a device is not polled:
+ * ready(arg) runs whenever received bytes wait for sio_tryread, and queued
+ * frames are written as the ring completes; -1 for devices the ring does
+ * not take (sockets, rings), those stay on the epoll path */
+int sio_set_rx_ready(sio_fd_t fd, void (*ready)(void *arg), void *arg);
+
+/* bytes taken, 0 when the device is full (poll the fd for POLLOUT), -1
+ * on error; passes the tx queue by, for devices that send nothing else */
+int32_t sio_write_nonblock(sio_fd_t fd, const uint8_t *data, uint32_t len);
+
+#endif
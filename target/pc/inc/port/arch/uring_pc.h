@@ -0,0 +1,95 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef PORT_ARCH_uring_pc_H
+#define PORT_ARCH_uring_pc_H
+
+#include <linux/io_uring.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* optional io_uring backend for the host's devices: one ring per process,
+ * owned by the lwip core thread; tapif and sio move their reads and writes
+ * onto it once uring_init succeeded, the reactor then sleeps in
+ * io_uring_enter instead of epoll_wait
+ *
+ * requests are prepared with uring_sqe and all go to the kernel with the
+ * next uring_run, together with the wait for completions: one syscall per
+ * loop iteration however many packets moved
+ *
+ * no liburing, the raw syscalls are enough for what we use */
+
+/* submission queue entries, the completion queue is twice that */
+#define URING_ENTRIES (256)
+
+/* slots for registered buffers (IORING_OP_READ_FIXED, _WRITE_FIXED) */
+#define URING_FIXED_BUFFERS (512)
+
+/* newer than the uapi headers we build against, kernel 6.7; older kernels
+ * fail it with -EINVAL and callers go back to one read per buffer */
+#define URING_OP_READ_MULTISHOT (IORING_OP_SENDMSG_ZC + 1)
+
+struct uring_op;
+
+/* flags are the cqe's: IORING_CQE_F_MORE, IORING_CQE_F_BUFFER and the
+ * buffer id above IORING_CQE_BUFFER_SHIFT */
+typedef void (*uring_complete_fn)(struct uring_op *op, int32_t res, uint32_t flags);
+
+/* embedded in whatever owns a request, the cqe's user_data points at it */
+struct uring_op
+{
+  uring_complete_fn complete;
+};
+
+/* an owner whose uring_sqe came back NULL, see uring_retry_later */
+struct uring_retry
+{
+  void (*retry)(struct uring_retry *retry);
+  struct uring_retry *next;
+  uint8_t queued;
+};
+
+/* provided buffers: the kernel picks one per read from the group */
+struct uring_bufs
+{
+  struct io_uring_buf_ring *ring;
+  uint16_t entries;
+  uint16_t tail;
+  uint16_t bgid;
+};
+
+/* 0 when the ring is up, -1 with a message when the kernel lacks what we
+ * need (io_uring itself, or the 5.11 wait timeout), the callers keep
+ * their epoll and poll paths then */
+int uring_init(void);
+
+int uring_enabled(void);
+
+/* zeroed sqe whose completion goes to op, NULL only when the queue is
+ * full even after handing what it holds to the kernel */
+struct io_uring_sqe *uring_sqe(struct uring_op *op);
+
+/* retry->retry runs from the next uring_run, before it submits; a
+ * request that found the queue full would otherwise wait for a
+ * completion that may never come; queuing it twice runs it once */
+void uring_retry_later(struct uring_retry *retry);
+
+/* runs the retries, submits what was prepared, waits up to timeout_ms
+ * for a completion (UINT32_MAX: no limit, 0 while a retry is still
+ * queued) and runs all completions */
+void uring_run(uint32_t timeout_ms);
+
+/* a group of entries (a power of two) buffers, empty until
+ * uring_bufs_put; 0 on success */
+int uring_bufs_init(struct uring_bufs *bufs, uint16_t entries);
+
+/* hands buffer bid back to the kernel */
+void uring_bufs_put(struct uring_bufs *bufs, void *addr, uint32_t len, uint16_t bid);
+
+/* registers buf, the index goes into sqe->buf_index of fixed reads and
+ * writes within it; -1 when the kernel has no sparse tables (5.13) or
+ * the slots are used up, plain reads and writes work the same */
+int uring_fixed_buffer(void *buf, size_t len);
+
+#endif
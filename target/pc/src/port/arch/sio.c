@@ -3,82 +3,421 @@
 // SPDX-License-Identifier: BSD-2-Clause
 
 #include "arch/cc.h"
+#include "arch/sio_pc.h"
+#include "arch/uring_pc.h"
+#include "sio_backend.h"
 #include <stdint.h>
 
 #include <unistd.h>
 #include <stdio.h>
-#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pty.h>
+#include <sys/socket.h>
 
 #include <termios.h>
 
-void
-sio_send(uint8_t c, sio_fd_t fd)
+#define SIO_MAX_DEVNUM (256)
+
+/* fds above this are not backed by a device, written unbuffered */
+#define SIO_MAX_FD (1024)
+
+#define SIO_SLIP_END (0xC0)
+#define SIO_HDLC_FLAG (0x7E)
+
+/* sio_send collects slipif's bytes here until the frame is complete */
+struct sio_tx
+{
+  uint32_t len;
+  uint8_t buf[SIO_TX_BUF_SIZE];
+};
+
+static struct sio_dev devs[SIO_MAX_DEVNUM];
+
+static struct sio_dev *dev_of_fd[SIO_MAX_FD];
+static struct sio_tx *tx_of_fd[SIO_MAX_FD];
+
+static struct sio_dev *
+sio_dev_of(sio_fd_t fd)
 {
-  int ret = write(fd,
-                  &c,
-                  sizeof(c));
+  return (fd >= 0 && fd < SIO_MAX_FD) ? dev_of_fd[fd] : NULL;
+}
+
+static struct sio_tx *
+sio_tx_of(sio_fd_t fd)
+{
+  return (fd >= 0 && fd < SIO_MAX_FD) ? tx_of_fd[fd] : NULL;
+}
+
+/* bytes taken, a device error drops the rest as if they were sent */
+static uint32_t
+sio_dev_write(struct sio_dev *dev, const uint8_t *data, uint32_t len)
+{
+  int32_t ret = dev->backend->write(dev, data, len);
 
   if(ret < 0)
   {
     perror("sio_send");
+    LINK_COUNTERS_INC_SHARED(&dev->counters, tx_dropped);
+    return len;
   }
-#if 0
-  if (ret)
+
+  LINK_COUNTERS_ADD_SHARED(&dev->counters, tx_bytes, ret);
+  return ret;
+}
+
+/* writes queued frames until the device is full */
+static void
+sio_txq_drain(struct sio_dev *dev)
+{
+  struct sio_txq *txq = dev->txq;
+
+  while(txq->count)
   {
-    printf("-> %u 0x%02x\n",
-           (uint32_t) time(NULL),
-           c);
+    struct sio_frame *f = &txq->frames[txq->head];
+    uint32_t n = sio_dev_write(dev, f->buf + f->sent, f->len - f->sent);
+    if(!n)
+    {
+      break;
+    }
+
+    f->sent += n;
+    if(f->sent == f->len)
+    {
+      txq->head = (txq->head + 1) % SIO_TXQ_FRAMES;
+      txq->count--;
+    }
   }
-#endif
+
+  LINK_COUNTERS_SET_SHARED(&dev->counters, tx_queue, txq->count);
 }
 
-sio_fd_t
-sio_open(uint8_t devnum)
+/* a whole frame: written, queued, or refused with 0 when the queue is
+ * full; only a queue that was empty lets a frame go straight out */
+static uint32_t
+sio_txq_frame(struct sio_dev *dev, const uint8_t *data, uint32_t len)
 {
-  char dev_name[] = "/dev/ttyUSB255";
-  snprintf(dev_name, sizeof(dev_name), "/dev/ttyUSB%u", devnum);
-  int fd = open(dev_name,
-                O_NONBLOCK | O_RDWR);
+  struct sio_txq *txq = dev->txq;
 
+  if(!dev->uring)
+  {
+    sio_txq_drain(dev);
+  }
+  if(txq->count == SIO_TXQ_FRAMES)
   {
-    struct termios tty;
+    LINK_COUNTERS_INC_SHARED(&dev->counters, tx_busy);
+    return 0;
+  }
 
-    if (tcgetattr(fd, &tty) < 0) {
-      perror("Error from tcgetattr: ");
-      return -1;
+  /* on the io_uring every frame is queued and written with the next
+   * uring_run, together with everything else the loop iteration sent */
+  uint32_t done = (txq->count || dev->uring) ? 0 : sio_dev_write(dev, data, len);
+  if(done < len)
+  {
+    if(len - done > SIO_TX_BUF_SIZE)
+    {
+      /* no driver frames that much, do not have it retried forever */
+      fprintf(stderr, "sio_write: %u byte frame does not fit the tx queue\n", len);
+      LINK_COUNTERS_INC_SHARED(&dev->counters, tx_dropped);
+      return len;
     }
 
-    cfmakeraw(&tty);
+    struct sio_frame *f = &txq->frames[(txq->head + txq->count) % SIO_TXQ_FRAMES];
+    memcpy(f->buf, data + done, len - done);
+    f->len = len - done;
+    f->sent = 0;
+    txq->count++;
 
-    cfsetospeed(&tty, B1000000);
-    cfsetispeed(&tty, B1000000);
+    LINK_COUNTERS_SET_SHARED(&dev->counters, tx_queue, txq->count);
+    if(txq->count > dev->counters.tx_queue_max)
+    {
+      LINK_COUNTERS_SET_SHARED(&dev->counters, tx_queue_max, txq->count);
+    }
+  }
 
+  LINK_COUNTERS_INC_SHARED(&dev->counters, tx_frames);
+  if(dev->uring)
+  {
+    sio_uring_kick(dev);
+  }
+  return len;
+}
 
+void
+sio_send(uint8_t c, sio_fd_t fd)
+{
+  struct sio_dev *dev = sio_dev_of(fd);
+  struct sio_tx *tx = sio_tx_of(fd);
 
-    if (tcsetattr(fd, TCSANOW, &tty) != 0) {
-      perror("Error from tcsetattr: ");
-      return -1;
+  if(!dev || !tx)
+  {
+    if(write(fd, &c, sizeof(c)) < 0)
+    {
+      perror("sio_send");
     }
+    return;
+  }
+
+  tx->buf[tx->len++] = c;
 
-    tcflush(fd, TCIOFLUSH);
+  /* slipif sends END before and after each frame, only the closing one
+   * (buffer holds more than the END) completes a frame; slipif cannot
+   * be told to retry, a frame the queue refuses is dropped whole */
+  uint8_t end = (dev->framing == SIO_FRAMING_HDLC) ? SIO_HDLC_FLAG : SIO_SLIP_END;
+  if((c == end && tx->len > 1) || tx->len == sizeof(tx->buf))
+  {
+    if(!sio_txq_frame(dev, tx->buf, tx->len))
+    {
+      LINK_COUNTERS_INC_SHARED(&dev->counters, tx_dropped);
+    }
+    tx->len = 0;
   }
+}
 
+/* bulk path for drivers that frame a whole packet themselves, one call
+ * per frame */
+uint32_t
+sio_write(sio_fd_t fd, const uint8_t *data, uint32_t len)
+{
+  struct sio_dev *dev = sio_dev_of(fd);
 
-  return (fd > 0) ? fd : 0;
+  if(!dev)
+  {
+    ssize_t ret = write(fd, data, len);
+    return (ret > 0) ? ret : 0;
+  }
+
+  return sio_txq_frame(dev, data, len);
+}
+
+int32_t
+sio_write_nonblock(sio_fd_t fd, const uint8_t *data, uint32_t len)
+{
+  struct sio_dev *dev = sio_dev_of(fd);
+
+  if(!dev)
+  {
+    ssize_t ret = write(fd, data, len);
+    return (ret >= 0) ? ret : -1;
+  }
+
+  int32_t ret = dev->backend->write(dev, data, len);
+  if(ret > 0)
+  {
+    LINK_COUNTERS_ADD_SHARED(&dev->counters, tx_bytes, ret);
+  }
+  return ret;
+}
+
+short
+sio_tx_events(sio_fd_t fd)
+{
+  struct sio_dev *dev = sio_dev_of(fd);
+
+  return (dev && !dev->uring && dev->txq->count) ? dev->backend->tx_event : 0;
+}
+
+int
+sio_set_rx_ready(sio_fd_t fd, void (*ready)(void *arg), void *arg)
+{
+  struct sio_dev *dev = sio_dev_of(fd);
+
+  return (dev && dev->uring) ? sio_uring_set_rx_ready(dev, ready, arg) : -1;
 }
 
 uint32_t
 sio_tryread(sio_fd_t fd, uint8_t *data, uint32_t len)
 {
-  int ret = read(fd,
-                 data,
-                 len);
-#if 0
-  return (ret > 0) ? printf("<- %u 0x%02x\n",
-                            (uint32_t) time(NULL),
-                            *data), ret :
-                     0;
-#else
-  return (ret > 0) ? ret : 0;
-#endif
+  struct sio_dev *dev = sio_dev_of(fd);
+
+  if(!dev)
+  {
+    ssize_t ret = read(fd, data, len);
+    return (ret > 0) ? ret : 0;
+  }
+
+  if(dev->uring)
+  {
+    uint32_t n = sio_uring_read(dev, data, len);
+    LINK_COUNTERS_ADD_SHARED(&dev->counters, rx_bytes, n);
+    return n;
+  }
+
+  /* every driver polls, that is where queued frames move on */
+  if(dev->txq->count)
+  {
+    sio_txq_drain(dev);
+  }
+
+  uint32_t n = dev->backend->read(dev, data, len);
+  LINK_COUNTERS_ADD_SHARED(&dev->counters, rx_bytes, n);
+  return n;
+}
+
+void
+sio_set_framing(uint8_t devnum, enum sio_framing framing)
+{
+  devs[devnum].framing = framing;
+}
+
+sio_fd_t
+sio_open(uint8_t devnum)
+{
+  struct sio_dev *dev = &devs[devnum];
+
+  if(!dev->backend)
+  {
+    char dev_name[] = "/dev/ttyUSB255";
+    snprintf(dev_name, sizeof(dev_name), "/dev/ttyUSB%u", devnum);
+
+    dev->backend = &sio_backend_tty;
+    dev->path = strdup(dev_name);
+    dev->speed = B1000000;
+  }
+
+  int fd = dev->backend->open(dev);
+  if(fd <= 0 || fd >= SIO_MAX_FD)
+  {
+    fprintf(stderr, "sio_open: %s device %u failed\n", dev->backend->name, devnum);
+    return 0;
+  }
+
+  if(!dev->txq)
+  {
+    dev->txq = calloc(1, sizeof(struct sio_txq));
+    if(!dev->txq)
+    {
+      perror("sio_open");
+      return 0;
+    }
+  }
+
+  dev->fd = fd;
+  dev->opened = 1;
+  dev_of_fd[fd] = dev;
+
+  if(uring_enabled() && dev->backend->uring && !dev->uring)
+  {
+    /* the epoll path stays if the ring cannot take the device */
+    sio_uring_open(dev);
+  }
+
+  if(!tx_of_fd[fd])
+  {
+    tx_of_fd[fd] = calloc(1, sizeof(struct sio_tx));
+  }
+
+  return fd;
+}
+
+static speed_t
+sio_speed_of_baud(uint32_t baud)
+{
+  switch(baud)
+  {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 500000: return B500000;
+    case 921600: return B921600;
+    case 1000000: return B1000000;
+    case 1500000: return B1500000;
+    case 2000000: return B2000000;
+    case 3000000: return B3000000;
+    default: return B0;
+  }
+}
+
+int
+sio_set_path(uint8_t devnum, const char *path, uint32_t baud)
+{
+  struct sio_dev *dev = &devs[devnum];
+  speed_t speed = sio_speed_of_baud(baud);
+  if(speed == B0)
+  {
+    fprintf(stderr, "sio_set_path: unsupported baud rate %u\n", baud);
+    return -1;
+  }
+
+  dev->backend = &sio_backend_tty;
+  if(strncmp(path, "pty:", 4) == 0)
+  {
+    dev->backend = &sio_backend_pty;
+    path += 4;
+  }
+
+  free(dev->path);
+  dev->path = strdup(path);
+  dev->speed = speed;
+  return dev->path ? 0 : -1;
+}
+
+int
+sio_set_fd(uint8_t devnum, int fd)
+{
+  if(fd <= 0)
+  {
+    return -1;
+  }
+
+  devs[devnum].backend = &sio_backend_fd;
+  devs[devnum].fd = fd;
+  return 0;
+}
+
+int
+sio_pair(uint8_t a, uint8_t b, enum sio_pair_kind kind)
+{
+  int fds[2];
+
+  switch(kind)
+  {
+    case SIO_PAIR_PTY:
+    {
+      struct termios raw;
+      memset(&raw, 0, sizeof(raw));
+      cfmakeraw(&raw);
+      if(openpty(&fds[0], &fds[1], NULL, &raw, NULL) < 0)
+      {
+        perror("sio_pair: openpty");
+        return -1;
+      }
+      devs[a].backend = &sio_backend_fd;
+      devs[b].backend = &sio_backend_fd;
+      break;
+    }
+    case SIO_PAIR_SOCKET:
+      if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+      {
+        perror("sio_pair: socketpair");
+        return -1;
+      }
+      devs[a].backend = &sio_backend_socket;
+      devs[b].backend = &sio_backend_socket;
+      break;
+    case SIO_PAIR_RING:
+      return sio_ring_pair(&devs[a], &devs[b]);
+    default:
+      return -1;
+  }
+
+  devs[a].fd = fds[0];
+  devs[b].fd = fds[1];
+  return 0;
+}
+
+sio_fd_t
+sio_fd_of(uint8_t devnum)
+{
+  return devs[devnum].opened ? devs[devnum].fd : -1;
+}
+
+const struct link_counters *
+sio_link_counters(uint8_t devnum)
+{
+  return devs[devnum].opened ? &devs[devnum].counters : NULL;
 }
@@ -0,0 +1,108 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef PORT_ARCH_sio_backend_H
+#define PORT_ARCH_sio_backend_H
+
+#include "arch/cc.h"
+#include "link_counters.h"
+#include "sio_framing.h"
+#include <poll.h>
+#include <stdint.h>
+#include <termios.h>
+
+/* one whole frame, see arch/cc.h */
+#define SIO_TX_BUF_SIZE (SIO_FRAME_MAX)
+
+/* frames a device holds while it cannot take them */
+#define SIO_TXQ_FRAMES (8)
+
+struct sio_dev;
+struct sio_ring;
+struct sio_uring;
+
+/* whatever the device did not take of a frame, sent is where the next
+ * write picks up */
+struct sio_frame
+{
+  uint32_t len;
+  uint32_t sent;
+  uint8_t buf[SIO_TX_BUF_SIZE];
+};
+
+/* frames leave in order, only the head can be partly written; a frame
+ * is queued whole or refused, so a full device never tears one apart */
+struct sio_txq
+{
+  uint32_t head;
+  uint32_t count;
+  struct sio_frame frames[SIO_TXQ_FRAMES];
+};
+
+/* every backend hands out an fd that polls readable when bytes are
+ * pending, the byte path itself is up to the backend */
+struct sio_backend
+{
+  const char *name;
+  /* fd for sio_open, -1 on failure */
+  int (*open)(struct sio_dev *dev);
+  /* bytes read, 0 when nothing is pending */
+  uint32_t (*read)(struct sio_dev *dev, uint8_t *data, uint32_t len);
+  /* bytes taken without blocking, 0 when full, -1 on error */
+  int32_t (*write)(struct sio_dev *dev, const uint8_t *data, uint32_t len);
+  /* poll event on fd once a write that returned 0 can make progress */
+  short tx_event;
+  /* reads and writes are plain syscalls on fd, io_uring can take them */
+  uint8_t uring;
+};
+
+struct sio_dev
+{
+  const struct sio_backend *backend;
+  uint8_t opened;
+  int fd;
+
+  /* picks the byte that closes a frame in sio_send */
+  enum sio_framing framing;
+
+  /* tty and pty */
+  char *path;
+  speed_t speed;
+
+  /* ring: bytes from and to the peer, fd is our eventfd */
+  struct sio_ring *rx;
+  struct sio_ring *tx;
+  int peer_fd;
+
+  /* frames waiting for the device */
+  struct sio_txq *txq;
+
+  /* reads and writes on the io_uring, NULL on the epoll path */
+  struct sio_uring *uring;
+
+  /* bytes on the wire; written from whichever thread runs the device */
+  struct link_counters counters;
+};
+
+extern const struct sio_backend sio_backend_tty;
+extern const struct sio_backend sio_backend_pty;
+extern const struct sio_backend sio_backend_fd;
+extern const struct sio_backend sio_backend_socket;
+extern const struct sio_backend sio_backend_ring;
+
+/* links a and b through a pair of rings in shared memory, survives fork */
+int sio_ring_pair(struct sio_dev *a, struct sio_dev *b);
+
+/* moves dev onto the io_uring, 0 on success */
+int sio_uring_open(struct sio_dev *dev);
+
+/* bytes the ring read for dev, like backend->read */
+uint32_t sio_uring_read(struct sio_dev *dev, uint8_t *data, uint32_t len);
+
+/* writes the head of dev->txq unless a write is in flight */
+void sio_uring_kick(struct sio_dev *dev);
+
+int sio_uring_set_rx_ready(struct sio_dev *dev, void (*ready)(void *arg), void *arg);
+
+#endif
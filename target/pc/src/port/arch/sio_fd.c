@@ -0,0 +1,183 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+/* backends on top of a plain fd: ttys, ptys, UNIX sockets */
+
+#include "sio_backend.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pty.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+static int
+sio_fd_nonblock(int fd)
+{
+  int flags = fcntl(fd, F_GETFL);
+  return (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) ? -1 : 0;
+}
+
+static uint32_t
+sio_fd_read(struct sio_dev *dev, uint8_t *data, uint32_t len)
+{
+  ssize_t ret = read(dev->fd,
+                     data,
+                     len);
+
+  return (ret > 0) ? ret : 0;
+}
+
+static int32_t
+sio_fd_write(struct sio_dev *dev, const uint8_t *data, uint32_t len)
+{
+  ssize_t ret = write(dev->fd,
+                      data,
+                      len);
+
+  if(ret < 0)
+  {
+    return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+  }
+  return ret;
+}
+
+static int
+sio_tty_open(struct sio_dev *dev)
+{
+  int fd = open(dev->path,
+                O_NONBLOCK | O_RDWR | O_NOCTTY);
+  if(fd < 0)
+  {
+    perror(dev->path);
+    return -1;
+  }
+
+  struct termios tty;
+
+  if (tcgetattr(fd, &tty) < 0) {
+    perror("Error from tcgetattr: ");
+    close(fd);
+    return -1;
+  }
+
+  cfmakeraw(&tty);
+
+  cfsetospeed(&tty, dev->speed);
+  cfsetispeed(&tty, dev->speed);
+
+  if (tcsetattr(fd, TCSANOW, &tty) != 0) {
+    perror("Error from tcsetattr: ");
+    close(fd);
+    return -1;
+  }
+
+  tcflush(fd, TCIOFLUSH);
+
+  return fd;
+}
+
+const struct sio_backend sio_backend_tty =
+{
+  .name = "tty",
+  .open = sio_tty_open,
+  .read = sio_fd_read,
+  .write = sio_fd_write,
+  .tx_event = POLLOUT,
+  .uring = 1,
+};
+
+/* we keep the master, the slave shows up as a symlink at path for
+ * whatever plays the other end (a mote build, socat, minicom) */
+static int
+sio_pty_open(struct sio_dev *dev)
+{
+  struct termios raw;
+  memset(&raw, 0, sizeof(raw));
+  cfmakeraw(&raw);
+
+  int master;
+  int slave;
+  char name[64];
+  if(openpty(&master, &slave, name, &raw, NULL) < 0)
+  {
+    perror("openpty");
+    return -1;
+  }
+
+  unlink(dev->path);
+  if(symlink(name, dev->path) < 0)
+  {
+    perror(dev->path);
+    close(master);
+    close(slave);
+    return -1;
+  }
+
+  /* holding the slave open keeps the master from reading EIO until the
+   * other end shows up */
+  if(sio_fd_nonblock(master) < 0)
+  {
+    close(master);
+    close(slave);
+    return -1;
+  }
+
+  return master;
+}
+
+const struct sio_backend sio_backend_pty =
+{
+  .name = "pty",
+  .open = sio_pty_open,
+  .read = sio_fd_read,
+  .write = sio_fd_write,
+  .tx_event = POLLOUT,
+  .uring = 1,
+};
+
+/* fd set up by the caller or by sio_pair, termios is left alone */
+static int
+sio_adopted_open(struct sio_dev *dev)
+{
+  return (sio_fd_nonblock(dev->fd) < 0) ? -1 : dev->fd;
+}
+
+const struct sio_backend sio_backend_fd =
+{
+  .name = "fd",
+  .open = sio_adopted_open,
+  .read = sio_fd_read,
+  .write = sio_fd_write,
+  .tx_event = POLLOUT,
+  .uring = 1,
+};
+
+/* a peer that went away must not kill us with SIGPIPE, which keeps
+ * sockets on send() and off the io_uring */
+static int32_t
+sio_socket_write(struct sio_dev *dev, const uint8_t *data, uint32_t len)
+{
+  ssize_t ret = send(dev->fd,
+                     data,
+                     len,
+                     MSG_DONTWAIT | MSG_NOSIGNAL);
+
+  if(ret < 0)
+  {
+    return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+  }
+  return ret;
+}
+
+const struct sio_backend sio_backend_socket =
+{
+  .name = "socket",
+  .open = sio_adopted_open,
+  .read = sio_fd_read,
+  .write = sio_socket_write,
+  .tx_event = POLLOUT,
+};
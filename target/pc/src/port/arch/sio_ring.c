@@ -0,0 +1,189 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+/* in-memory link: a lock-free byte ring per direction, an eventfd per
+ * end so the reader can still sleep in epoll; a writer that found the
+ * ring full is woken through the same eventfd once the reader took bytes
+ * the rings live in shared memory, a pair set up before fork connects
+ * two processes as well as two threads */
+
+#include "sio_backend.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+
+#define SIO_RING_SIZE (64 * 1024)
+#define SIO_RING_MASK (SIO_RING_SIZE - 1)
+
+/* head is written by the producer, tail by the consumer, full is set
+ * by the producer and cleared by the consumer */
+struct sio_ring
+{
+  _Alignas(64) _Atomic uint32_t head;
+  _Alignas(64) _Atomic uint32_t tail;
+  _Atomic uint32_t full;
+  _Alignas(64) uint8_t data[SIO_RING_SIZE];
+};
+
+static uint32_t
+sio_ring_push(struct sio_ring *ring, const uint8_t *data, uint32_t len)
+{
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  uint32_t space = SIO_RING_SIZE - (head - tail);
+
+  if(len > space)
+  {
+    len = space;
+  }
+
+  uint32_t at = head & SIO_RING_MASK;
+  uint32_t first = (len < SIO_RING_SIZE - at) ? len : SIO_RING_SIZE - at;
+  memcpy(&ring->data[at], data, first);
+  memcpy(&ring->data[0], data + first, len - first);
+
+  atomic_store_explicit(&ring->head, head + len, memory_order_release);
+  return len;
+}
+
+static uint32_t
+sio_ring_pop(struct sio_ring *ring, uint8_t *data, uint32_t len)
+{
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  uint32_t used = head - tail;
+
+  if(len > used)
+  {
+    len = used;
+  }
+
+  uint32_t at = tail & SIO_RING_MASK;
+  uint32_t first = (len < SIO_RING_SIZE - at) ? len : SIO_RING_SIZE - at;
+  memcpy(data, &ring->data[at], first);
+  memcpy(data + first, &ring->data[0], len - first);
+
+  atomic_store_explicit(&ring->tail, tail + len, memory_order_release);
+  return len;
+}
+
+static int
+sio_ring_open(struct sio_dev *dev)
+{
+  return (dev->rx && dev->tx) ? dev->fd : -1;
+}
+
+static uint32_t
+sio_ring_read(struct sio_dev *dev, uint8_t *data, uint32_t len)
+{
+  uint32_t n = sio_ring_pop(dev->rx, data, len);
+
+  if(n && atomic_exchange_explicit(&dev->rx->full, 0, memory_order_seq_cst))
+  {
+    eventfd_write(dev->peer_fd, 1);
+  }
+
+  if(n < len)
+  {
+    /* drained: clear the wakeup, then look again so bytes that came in
+     * between are not left without one */
+    eventfd_t value;
+    eventfd_read(dev->fd, &value);
+    n += sio_ring_pop(dev->rx, data + n, len - n);
+  }
+
+  return n;
+}
+
+static int32_t
+sio_ring_write(struct sio_dev *dev, const uint8_t *data, uint32_t len)
+{
+  uint32_t n = sio_ring_push(dev->tx, data, len);
+
+  if(n)
+  {
+    eventfd_write(dev->peer_fd, 1);
+  }
+
+  if(n < len)
+  {
+    /* ask the reader for a wakeup, then look again in case it emptied
+     * the ring before it could see the flag */
+    atomic_store_explicit(&dev->tx->full, 1, memory_order_seq_cst);
+    uint32_t head = atomic_load_explicit(&dev->tx->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&dev->tx->tail, memory_order_seq_cst);
+    if(head - tail < SIO_RING_SIZE)
+    {
+      eventfd_write(dev->fd, 1);
+    }
+  }
+  return n;
+}
+
+const struct sio_backend sio_backend_ring =
+{
+  .name = "ring",
+  .open = sio_ring_open,
+  .read = sio_ring_read,
+  .write = sio_ring_write,
+  .tx_event = POLLIN,
+};
+
+int
+sio_ring_pair(struct sio_dev *a, struct sio_dev *b)
+{
+  struct sio_ring *rings = mmap(NULL,
+                                2 * sizeof(struct sio_ring),
+                                PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_ANONYMOUS,
+                                -1,
+                                0);
+  if(rings == MAP_FAILED)
+  {
+    perror("sio_ring_pair: mmap");
+    return -1;
+  }
+
+  int fd_a = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  int fd_b = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if(fd_a < 0 || fd_b < 0)
+  {
+    perror("sio_ring_pair: eventfd");
+    if(fd_a >= 0)
+    {
+      close(fd_a);
+    }
+    if(fd_b >= 0)
+    {
+      close(fd_b);
+    }
+    munmap(rings, 2 * sizeof(struct sio_ring));
+    return -1;
+  }
+
+  atomic_init(&rings[0].head, 0);
+  atomic_init(&rings[0].tail, 0);
+  atomic_init(&rings[0].full, 0);
+  atomic_init(&rings[1].head, 0);
+  atomic_init(&rings[1].tail, 0);
+  atomic_init(&rings[1].full, 0);
+
+  a->backend = &sio_backend_ring;
+  a->fd = fd_a;
+  a->peer_fd = fd_b;
+  a->tx = &rings[0];
+  a->rx = &rings[1];
+
+  b->backend = &sio_backend_ring;
+  b->fd = fd_b;
+  b->peer_fd = fd_a;
+  b->tx = &rings[1];
+  b->rx = &rings[0];
+
+  return 0;
+}
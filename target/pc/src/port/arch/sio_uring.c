@@ -0,0 +1,289 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+/* fd backends on the io_uring: one multishot read per device fills
+ * provided buffers that sio_tryread copies out and hands back, frames of
+ * the tx queue are written from its registered memory, one write in
+ * flight per device */
+
+#include "arch/uring_pc.h"
+#include "sio_backend.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* power of two */
+#define SIO_URING_RX_BUFS (8)
+#define SIO_URING_RX_BUF_SIZE (2048)
+
+struct sio_uring_rx
+{
+  uint16_t bid;
+  uint16_t len;
+  uint16_t off;
+};
+
+struct sio_uring
+{
+  struct sio_dev *dev;
+  struct uring_op rx_op;
+  struct uring_op tx_op;
+  struct uring_bufs bufs;
+  /* cleared when the kernel predates multishot reads */
+  uint8_t multishot;
+  uint8_t rx_armed;
+  /* the device failed, reads are not armed again */
+  uint8_t rx_dead;
+  uint8_t tx_busy;
+  /* tx_op is a poll for the fd, not a write */
+  uint8_t tx_poll;
+  /* registered buffer index of dev->txq, -1 for plain writes */
+  int fixed;
+  /* a read or write found the submission queue full */
+  struct uring_retry retry;
+  /* buffers the kernel filled, in order, not yet read through sio */
+  uint16_t rx_head;
+  uint16_t rx_count;
+  struct sio_uring_rx rx[SIO_URING_RX_BUFS];
+  void (*ready)(void *arg);
+  void *ready_arg;
+  uint8_t buf[SIO_URING_RX_BUFS][SIO_URING_RX_BUF_SIZE];
+};
+
+#define SIO_URING_OF(op, member) \
+  ((struct sio_uring *)((uint8_t *)(op) - offsetof(struct sio_uring, member)))
+
+static void
+sio_uring_arm_rx(struct sio_uring *u)
+{
+  struct io_uring_sqe *sqe = uring_sqe(&u->rx_op);
+  if(!sqe)
+  {
+    uring_retry_later(&u->retry);
+    return;
+  }
+
+  /* a plain read takes one buffer and is armed again on completion */
+  sqe->opcode = u->multishot ? URING_OP_READ_MULTISHOT : IORING_OP_READ;
+  sqe->fd = u->dev->fd;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = u->bufs.bgid;
+  sqe->len = u->multishot ? 0 : SIO_URING_RX_BUF_SIZE;
+  sqe->off = -1;
+  u->rx_armed = 1;
+}
+
+static void
+sio_uring_rx_done(struct uring_op *op, int32_t res, uint32_t flags)
+{
+  struct sio_uring *u = SIO_URING_OF(op, rx_op);
+
+  if(!(flags & IORING_CQE_F_MORE))
+  {
+    u->rx_armed = 0;
+  }
+
+  if(res > 0 && (flags & IORING_CQE_F_BUFFER))
+  {
+    struct sio_uring_rx *rx = &u->rx[(u->rx_head + u->rx_count) % SIO_URING_RX_BUFS];
+    rx->bid = flags >> IORING_CQE_BUFFER_SHIFT;
+    rx->len = res;
+    rx->off = 0;
+    u->rx_count++;
+  } else if(res == -EINVAL && u->multishot) {
+    u->multishot = 0;
+  } else if(res == -ENOBUFS) {
+    /* everything waits for sio_tryread, which arms the read again */
+    return;
+  } else if(res <= 0 && res != -EAGAIN && res != -EINTR) {
+    fprintf(stderr, "sio: %s fd %d read: %s\n",
+            u->dev->backend->name, u->dev->fd, res ? strerror(-res) : "end of file");
+    u->rx_dead = 1;
+  }
+
+  if(!u->rx_armed && !u->rx_dead)
+  {
+    sio_uring_arm_rx(u);
+  }
+
+  if(u->rx_count && u->ready)
+  {
+    u->ready(u->ready_arg);
+  }
+}
+
+uint32_t
+sio_uring_read(struct sio_dev *dev, uint8_t *data, uint32_t len)
+{
+  struct sio_uring *u = dev->uring;
+  uint32_t n = 0;
+
+  while(n < len && u->rx_count)
+  {
+    struct sio_uring_rx *rx = &u->rx[u->rx_head];
+    uint32_t chunk = rx->len - rx->off;
+    if(chunk > len - n)
+    {
+      chunk = len - n;
+    }
+
+    memcpy(data + n, &u->buf[rx->bid][rx->off], chunk);
+    rx->off += chunk;
+    n += chunk;
+
+    if(rx->off == rx->len)
+    {
+      uring_bufs_put(&u->bufs, u->buf[rx->bid], SIO_URING_RX_BUF_SIZE, rx->bid);
+      u->rx_head = (u->rx_head + 1) % SIO_URING_RX_BUFS;
+      u->rx_count--;
+    }
+  }
+
+  if(!u->rx_armed && !u->rx_dead)
+  {
+    sio_uring_arm_rx(u);
+  }
+  return n;
+}
+
+static void
+sio_uring_tx_done(struct uring_op *op, int32_t res, uint32_t flags)
+{
+  struct sio_uring *u = SIO_URING_OF(op, tx_op);
+  struct sio_dev *dev = u->dev;
+  struct sio_txq *txq = dev->txq;
+  struct sio_frame *f = &txq->frames[txq->head];
+
+  (void)flags;
+  u->tx_busy = 0;
+
+  if(u->tx_poll)
+  {
+    u->tx_poll = 0;
+    sio_uring_kick(dev);
+    return;
+  }
+
+  if(res > 0)
+  {
+    f->sent += res;
+    LINK_COUNTERS_ADD_SHARED(&dev->counters, tx_bytes, res);
+  } else if(res == -EAGAIN) {
+    /* kernels that do not wait for the fd themselves: poll for it, the
+     * poll's completion comes back here with POLLOUT and writes again */
+    struct io_uring_sqe *sqe = uring_sqe(&u->tx_op);
+    if(sqe)
+    {
+      sqe->opcode = IORING_OP_POLL_ADD;
+      sqe->fd = dev->fd;
+      sqe->poll32_events = dev->backend->tx_event;
+      u->tx_busy = 1;
+      u->tx_poll = 1;
+    } else {
+      uring_retry_later(&u->retry);
+    }
+    return;
+  } else if(res < 0 && res != -EINTR) {
+    fprintf(stderr, "sio: %s fd %d write: %s\n",
+            dev->backend->name, dev->fd, strerror(-res));
+    LINK_COUNTERS_INC_SHARED(&dev->counters, tx_dropped);
+    f->sent = f->len;
+  }
+
+  if(f->sent == f->len)
+  {
+    txq->head = (txq->head + 1) % SIO_TXQ_FRAMES;
+    txq->count--;
+    LINK_COUNTERS_SET_SHARED(&dev->counters, tx_queue, txq->count);
+  }
+
+  sio_uring_kick(dev);
+}
+
+void
+sio_uring_kick(struct sio_dev *dev)
+{
+  struct sio_uring *u = dev->uring;
+  struct sio_txq *txq = dev->txq;
+
+  if(u->tx_busy || !txq->count)
+  {
+    return;
+  }
+
+  struct io_uring_sqe *sqe = uring_sqe(&u->tx_op);
+  if(!sqe)
+  {
+    uring_retry_later(&u->retry);
+    return;
+  }
+
+  struct sio_frame *f = &txq->frames[txq->head];
+  sqe->opcode = IORING_OP_WRITE;
+  if(u->fixed >= 0)
+  {
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->buf_index = u->fixed;
+  }
+  sqe->fd = dev->fd;
+  sqe->addr = (uintptr_t)(f->buf + f->sent);
+  sqe->len = f->len - f->sent;
+  sqe->off = -1;
+  u->tx_busy = 1;
+}
+
+static void
+sio_uring_retry(struct uring_retry *retry)
+{
+  struct sio_uring *u = SIO_URING_OF(retry, retry);
+
+  if(!u->rx_armed && !u->rx_dead)
+  {
+    sio_uring_arm_rx(u);
+  }
+  sio_uring_kick(u->dev);
+}
+
+int
+sio_uring_set_rx_ready(struct sio_dev *dev, void (*ready)(void *arg), void *arg)
+{
+  dev->uring->ready = ready;
+  dev->uring->ready_arg = arg;
+  return 0;
+}
+
+int
+sio_uring_open(struct sio_dev *dev)
+{
+  struct sio_uring *u = calloc(1, sizeof(struct sio_uring));
+  if(!u)
+  {
+    return -1;
+  }
+
+  if(uring_bufs_init(&u->bufs, SIO_URING_RX_BUFS) < 0)
+  {
+    free(u);
+    return -1;
+  }
+
+  for(uint16_t i = 0; i < SIO_URING_RX_BUFS; i++)
+  {
+    uring_bufs_put(&u->bufs, u->buf[i], SIO_URING_RX_BUF_SIZE, i);
+  }
+
+  u->dev = dev;
+  u->rx_op.complete = sio_uring_rx_done;
+  u->tx_op.complete = sio_uring_tx_done;
+  u->retry.retry = sio_uring_retry;
+  u->multishot = 1;
+  u->fixed = uring_fixed_buffer(dev->txq, sizeof(*dev->txq));
+
+  dev->uring = u;
+  sio_uring_arm_rx(u);
+  return 0;
+}
@@ -4,6 +4,7 @@
 
 #include <time.h>
 #include <stdint.h>
+#include <sys/random.h>
 
 static void
 get_monotonic_time(struct timespec *ts)
@@ -20,3 +21,15 @@ sys_now(void)
   get_monotonic_time(&ts);
   return (uint32_t) (ts.tv_sec * 1000L + ts.tv_nsec / 1000000L);
 }
+
+/* link security epochs and challenges, must differ across restarts */
+unsigned int
+sys_random(void)
+{
+  unsigned int r;
+
+  while(getrandom(&r, sizeof(r), 0) != sizeof(r))
+  {
+  }
+  return r;
+}
@@ -0,0 +1,347 @@
+// SPDX-FileCopyrightText: 2022 Marian Sauer
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "arch/uring_pc.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+struct uring
+{
+  int fd;
+  /* submission queue, tail is ours, head the kernel's */
+  uint32_t *sq_head;
+  uint32_t *sq_tail;
+  uint32_t sq_mask;
+  uint32_t sq_entries;
+  struct io_uring_sqe *sqes;
+  /* prepared and not yet handed to the kernel */
+  uint32_t to_submit;
+  /* completion queue, head is ours */
+  uint32_t *cq_head;
+  uint32_t *cq_tail;
+  uint32_t cq_mask;
+  struct io_uring_cqe *cqes;
+  uint16_t next_bgid;
+  uint32_t fixed_buffers;
+  /* owners waiting for room in the submission queue */
+  struct uring_retry *retry;
+};
+
+static struct uring uring = { .fd = -1 };
+
+static int
+uring_enter(uint32_t to_submit, uint32_t min_complete, uint32_t flags, void *arg, size_t argsz)
+{
+  return syscall(__NR_io_uring_enter, uring.fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int
+uring_register(uint32_t opcode, void *arg, uint32_t nr)
+{
+  return syscall(__NR_io_uring_register, uring.fd, opcode, arg, nr);
+}
+
+static int
+uring_setup(struct io_uring_params *params)
+{
+  /* completions are only reaped from the core thread, in uring_run, so
+   * the kernel may defer its work until then instead of interrupting us */
+  memset(params, 0, sizeof(*params));
+  params->flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+
+  int fd = syscall(__NR_io_uring_setup, URING_ENTRIES, params);
+  if(fd < 0 && errno == EINVAL)
+  {
+    /* before 6.1 */
+    memset(params, 0, sizeof(*params));
+    fd = syscall(__NR_io_uring_setup, URING_ENTRIES, params);
+  }
+  return fd;
+}
+
+static void
+uring_fixed_init(void)
+{
+  struct io_uring_rsrc_register reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.nr = URING_FIXED_BUFFERS;
+  reg.flags = IORING_RSRC_REGISTER_SPARSE;
+
+  if(uring_register(IORING_REGISTER_BUFFERS2, &reg, sizeof(reg)) < 0)
+  {
+    uring.fixed_buffers = URING_FIXED_BUFFERS;
+  }
+}
+
+int
+uring_init(void)
+{
+  struct io_uring_params params;
+
+  int fd = uring_setup(&params);
+  if(fd < 0)
+  {
+    perror("io_uring_setup");
+    return -1;
+  }
+
+  uint32_t needed = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+  if((params.features & needed) != needed)
+  {
+    fprintf(stderr, "io_uring: kernel too old, need 5.11\n");
+    close(fd);
+    return -1;
+  }
+
+  size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+  size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  size_t ring_size = (sq_size > cq_size) ? sq_size : cq_size;
+
+  uint8_t *ring = mmap(NULL,
+                       ring_size,
+                       PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE,
+                       fd,
+                       IORING_OFF_SQ_RING);
+  struct io_uring_sqe *sqes = mmap(NULL,
+                                   params.sq_entries * sizeof(struct io_uring_sqe),
+                                   PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_POPULATE,
+                                   fd,
+                                   IORING_OFF_SQES);
+  if(ring == MAP_FAILED || sqes == MAP_FAILED)
+  {
+    perror("io_uring: mmap");
+    close(fd);
+    return -1;
+  }
+
+  uring.fd = fd;
+  uring.sq_head = (uint32_t *)(ring + params.sq_off.head);
+  uring.sq_tail = (uint32_t *)(ring + params.sq_off.tail);
+  uring.sq_mask = *(uint32_t *)(ring + params.sq_off.ring_mask);
+  uring.sq_entries = params.sq_entries;
+  uring.sqes = sqes;
+  uring.cq_head = (uint32_t *)(ring + params.cq_off.head);
+  uring.cq_tail = (uint32_t *)(ring + params.cq_off.tail);
+  uring.cq_mask = *(uint32_t *)(ring + params.cq_off.ring_mask);
+  uring.cqes = (struct io_uring_cqe *)(ring + params.cq_off.cqes);
+
+  /* sqe i always sits at slot i */
+  uint32_t *array = (uint32_t *)(ring + params.sq_off.array);
+  for(uint32_t i = 0; i < params.sq_entries; i++)
+  {
+    array[i] = i;
+  }
+
+  uring_fixed_init();
+  return 0;
+}
+
+int
+uring_enabled(void)
+{
+  return uring.fd >= 0;
+}
+
+static void
+uring_submit(void)
+{
+  while(uring.to_submit)
+  {
+    int ret = uring_enter(uring.to_submit, 0, 0, NULL, 0);
+    if(ret < 0)
+    {
+      if(errno != EINTR && errno != EAGAIN && errno != EBUSY)
+      {
+        perror("io_uring_enter");
+      }
+      return;
+    }
+    uring.to_submit -= ret;
+  }
+}
+
+struct io_uring_sqe *
+uring_sqe(struct uring_op *op)
+{
+  uint32_t tail = *uring.sq_tail;
+
+  if(tail - __atomic_load_n(uring.sq_head, __ATOMIC_ACQUIRE) == uring.sq_entries)
+  {
+    uring_submit();
+    if(tail - __atomic_load_n(uring.sq_head, __ATOMIC_ACQUIRE) == uring.sq_entries)
+    {
+      return NULL;
+    }
+  }
+
+  struct io_uring_sqe *sqe = &uring.sqes[tail & uring.sq_mask];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->user_data = (uintptr_t)op;
+
+  __atomic_store_n(uring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+  uring.to_submit++;
+  return sqe;
+}
+
+void
+uring_retry_later(struct uring_retry *retry)
+{
+  if(retry->queued)
+  {
+    return;
+  }
+  retry->queued = 1;
+  retry->next = uring.retry;
+  uring.retry = retry;
+}
+
+static void
+uring_run_retries(void)
+{
+  struct uring_retry *list = uring.retry;
+  uring.retry = NULL;
+
+  while(list)
+  {
+    struct uring_retry *retry = list;
+    list = list->next;
+    retry->queued = 0;
+    retry->retry(retry);
+  }
+}
+
+void
+uring_run(uint32_t timeout_ms)
+{
+  uring_run_retries();
+  if(uring.retry)
+  {
+    /* still no room, come back as soon as the kernel took some */
+    timeout_ms = 0;
+  }
+
+  uint32_t head = *uring.cq_head;
+  int ready = head != __atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE);
+
+  if(uring.to_submit || !ready)
+  {
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    uint32_t flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+
+    if(timeout_ms != UINT32_MAX)
+    {
+      ts.tv_sec = timeout_ms / 1000;
+      ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+      arg.ts = (uintptr_t)&ts;
+    }
+
+    int ret = uring_enter(uring.to_submit, ready ? 0 : 1, flags, &arg, sizeof(arg));
+    if(ret >= 0)
+    {
+      uring.to_submit -= ret;
+    } else if(errno != ETIME && errno != EINTR && errno != EBUSY) {
+      perror("io_uring_enter");
+    }
+  }
+
+  /* completions may prepare new requests, those go out with the next run */
+  while(head != __atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE))
+  {
+    struct io_uring_cqe cqe = uring.cqes[head & uring.cq_mask];
+    __atomic_store_n(uring.cq_head, ++head, __ATOMIC_RELEASE);
+
+    struct uring_op *op = (struct uring_op *)(uintptr_t)cqe.user_data;
+    if(op)
+    {
+      op->complete(op, cqe.res, cqe.flags);
+    }
+  }
+}
+
+int
+uring_bufs_init(struct uring_bufs *bufs, uint16_t entries)
+{
+  size_t size = entries * sizeof(struct io_uring_buf);
+
+  /* the kernel wants the ring page aligned */
+  void *ring = mmap(NULL,
+                    size,
+                    PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS,
+                    -1,
+                    0);
+  if(ring == MAP_FAILED)
+  {
+    perror("io_uring: mmap buffer ring");
+    return -1;
+  }
+
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (uintptr_t)ring;
+  reg.ring_entries = entries;
+  reg.bgid = uring.next_bgid;
+
+  if(uring_register(IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+  {
+    perror("io_uring: register buffer ring");
+    munmap(ring, size);
+    return -1;
+  }
+
+  bufs->ring = ring;
+  bufs->entries = entries;
+  bufs->tail = 0;
+  bufs->bgid = uring.next_bgid++;
+  return 0;
+}
+
+void
+uring_bufs_put(struct uring_bufs *bufs, void *addr, uint32_t len, uint16_t bid)
+{
+  struct io_uring_buf *buf = &bufs->ring->bufs[bufs->tail & (bufs->entries - 1)];
+  buf->addr = (uintptr_t)addr;
+  buf->len = len;
+  buf->bid = bid;
+
+  __atomic_store_n(&bufs->ring->tail, ++bufs->tail, __ATOMIC_RELEASE);
+}
+
+int
+uring_fixed_buffer(void *buf, size_t len)
+{
+  if(uring.fixed_buffers == URING_FIXED_BUFFERS)
+  {
+    return -1;
+  }
+
+  struct iovec iov =
+  {
+    .iov_base = buf,
+    .iov_len = len,
+  };
+  struct io_uring_rsrc_update2 update;
+  memset(&update, 0, sizeof(update));
+  update.offset = uring.fixed_buffers;
+  update.data = (uintptr_t)&iov;
+  update.nr = 1;
+
+  if(uring_register(IORING_REGISTER_BUFFERS_UPDATE, &update, sizeof(update)) < 0)
+  {
+    perror("io_uring: register buffer");
+    return -1;
+  }
+
+  return uring.fixed_buffers++;
+}
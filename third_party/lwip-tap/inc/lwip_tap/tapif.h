@@ -9,6 +9,10 @@
 #define __TAPIF_H__
 
 #include "lwip/netif.h"
+#include "link_counters.h"
+
+struct tapif_rx_slot;
+struct tapif_uring;
 
 struct tapif {
   /* Add whatever per-interface state that is needed here. */
@@ -17,7 +21,14 @@ struct tapif {
   ip_addr_t ip_addr;
   ip_addr_t netmask;
   ip_addr_t gw;
-  struct pbuf * p;
+  /* preallocated receive buffers, recycled by their custom pbuf free */
+  struct tapif_rx_slot *rx_slots;
+  struct tapif_rx_slot **rx_free;
+  u16_t rx_free_count;
+  /* set when uring_init ran before tapif_init: reads and writes go
+   * through the io_uring and tapif_poll has nothing to do */
+  struct tapif_uring *uring;
+  struct link_counters counters;
 };
 
 err_t tapif_init(struct netif *netif);
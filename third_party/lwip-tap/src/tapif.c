@@ -18,6 +18,7 @@
 #include <net/route.h>
 #include <errno.h>
 #include <assert.h>
+#include <stddef.h>
 
 
 #include "lwip/debug.h"
@@ -29,6 +30,8 @@
 #include "lwip/pbuf.h"
 #include "lwip/sys.h"
 
+#include "arch/uring_pc.h"
+
 
 #if defined(LWIP_DEBUG) && defined(LWIP_TCPDUMP)
 #include "netif/tcpdump.h"
@@ -43,6 +46,71 @@
 #define IFNAME0 't'
 #define IFNAME1 'p'
 
+/* pbuf segments per packet, a 1500 byte pool chain needs 3 */
+#ifndef TAPIF_MAX_IOV
+#define TAPIF_MAX_IOV 16
+#endif
+
+/* packets read per tapif_poll() call */
+#ifndef TAPIF_RX_BUDGET
+#define TAPIF_RX_BUDGET 16
+#endif
+
+/* receive buffers in flight through lwip at once */
+#ifndef TAPIF_RX_SLOTS
+#define TAPIF_RX_SLOTS 32
+#endif
+
+#ifndef TAPIF_RX_MTU
+#define TAPIF_RX_MTU 1500
+#endif
+
+#define TAPIF_RX_BUF_SIZE (LWIP_MEM_ALIGN_SIZE(PBUF_IP) + TAPIF_RX_MTU)
+
+/* writes in flight on the io_uring, each holds its pbuf until done */
+#ifndef TAPIF_URING_TX_OPS
+#define TAPIF_URING_TX_OPS 64
+#endif
+
+struct tapif_rx_slot {
+  struct pbuf_custom pc;
+  struct tapif *tapif;
+  /* io_uring without multishot reads: a fixed read per free slot */
+  struct uring_op read_op;
+  /* its read found the submission queue full */
+  struct tapif_rx_slot *next;
+  u8_t buf[TAPIF_RX_BUF_SIZE];
+};
+
+struct tapif_uring_tx {
+  struct uring_op op;
+  struct tapif *tapif;
+  struct pbuf *p;
+  struct tapif_uring_tx *next;
+  struct iovec iov[TAPIF_MAX_IOV];
+};
+
+/* the tun fd on the io_uring: the rx slots are provided to one multishot
+ * read and come back as custom pbufs without a copy, on kernels before
+ * 6.7 each free slot has a read of its own into the registered slots;
+ * writes gather the pbuf chain like writev and keep it until done */
+struct tapif_uring {
+  struct netif *netif;
+  struct uring_op rx_op;
+  struct uring_bufs bufs;
+  u8_t multishot;
+  u8_t rx_armed;
+  u8_t rx_dead;
+  /* reads that found the submission queue full, uring_run retries them */
+  struct uring_retry retry;
+  struct tapif_rx_slot *rx_pending;
+  u8_t rx_arm_pending;
+  /* registered buffer index of the rx slots, -1 for plain reads */
+  int fixed;
+  struct tapif_uring_tx tx[TAPIF_URING_TX_OPS];
+  struct tapif_uring_tx *tx_free;
+};
+
 #ifndef TAPIF_DEBUG
 #define TAPIF_DEBUG LWIP_DBG_OFF
 #endif
@@ -68,7 +136,7 @@ low_level_probe(struct netif *netif,const char *name)
   }
 
   memset(&ifr, 0, sizeof(ifr));
-  strncpy(ifr.ifr_name, name, len);
+  memcpy(ifr.ifr_name, name, len);
 
 
   if (ioctl(s, SIOCGIFMTU, &ifr) == -1) {
@@ -133,7 +201,8 @@ low_level_init(struct netif *netif,const char *name)
   memset(&ifr, 0, sizeof(ifr));
   if (name != NULL)
   {
-    strncpy(ifr.ifr_name,name,strlen(name));
+    /* ifr was zeroed, the last byte stays the terminator */
+    strncpy(ifr.ifr_name, name, sizeof(ifr.ifr_name) - 1);
   }
 
   ifr.ifr_flags = IFF_TUN|IFF_NO_PI;
@@ -154,6 +223,313 @@ low_level_init(struct netif *netif,const char *name)
     exit(1);
 }
 /*-----------------------------------------------------------------------------------*/
+static void tapif_uring_slot_back(struct tapif *tapif, struct tapif_rx_slot *slot);
+
+static void
+tapif_rx_slot_free(struct pbuf *p)
+{
+  struct tapif_rx_slot *slot = (struct tapif_rx_slot *)p;
+  struct tapif *tapif = slot->tapif;
+
+  if (tapif->uring) {
+    tapif_uring_slot_back(tapif, slot);
+    return;
+  }
+  tapif->rx_free[tapif->rx_free_count++] = slot;
+}
+
+static err_t
+tapif_rx_init(struct tapif *tapif)
+{
+  int i;
+
+  tapif->rx_slots = (struct tapif_rx_slot *)calloc(TAPIF_RX_SLOTS, sizeof(struct tapif_rx_slot));
+  tapif->rx_free = (struct tapif_rx_slot **)calloc(TAPIF_RX_SLOTS, sizeof(struct tapif_rx_slot *));
+  if (!tapif->rx_slots || !tapif->rx_free) {
+    free(tapif->rx_slots);
+    free(tapif->rx_free);
+    return ERR_MEM;
+  }
+
+  for (i = 0; i < TAPIF_RX_SLOTS; i++) {
+    tapif->rx_slots[i].tapif = tapif;
+    tapif->rx_slots[i].pc.custom_free_function = tapif_rx_slot_free;
+    tapif->rx_free[i] = &tapif->rx_slots[i];
+  }
+  tapif->rx_free_count = TAPIF_RX_SLOTS;
+
+  return ERR_OK;
+}
+/*-----------------------------------------------------------------------------------*/
+static void
+tapif_rx_deliver(struct tapif *tapif, struct tapif_rx_slot *slot, int len)
+{
+  struct netif *netif = tapif->uring->netif;
+  struct pbuf *p = pbuf_alloced_custom(PBUF_IP, len, PBUF_REF, &slot->pc,
+                                       slot->buf, sizeof(slot->buf));
+
+  LINK_COUNTERS_ADD(&tapif->counters, rx_bytes, len);
+  LINK_COUNTERS_INC(&tapif->counters, rx_frames);
+  if (netif->input(p, netif) != ERR_OK) {
+    LINK_COUNTERS_INC(&tapif->counters, rx_dropped);
+    pbuf_free(p);
+  }
+}
+
+static void
+tapif_uring_arm_rx(struct tapif *tapif)
+{
+  struct tapif_uring *u = tapif->uring;
+  struct io_uring_sqe *sqe = uring_sqe(&u->rx_op);
+
+  if (!sqe) {
+    u->rx_arm_pending = 1;
+    uring_retry_later(&u->retry);
+    return;
+  }
+  sqe->opcode = URING_OP_READ_MULTISHOT;
+  sqe->fd = tapif->fd;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = u->bufs.bgid;
+  sqe->off = -1;
+  u->rx_armed = 1;
+}
+
+static void
+tapif_uring_read_slot(struct tapif *tapif, struct tapif_rx_slot *slot)
+{
+  struct tapif_uring *u = tapif->uring;
+  struct io_uring_sqe *sqe = uring_sqe(&slot->read_op);
+
+  if (!sqe) {
+    slot->next = u->rx_pending;
+    u->rx_pending = slot;
+    uring_retry_later(&u->retry);
+    return;
+  }
+  sqe->opcode = IORING_OP_READ;
+  if (u->fixed >= 0) {
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->buf_index = u->fixed;
+  }
+  sqe->fd = tapif->fd;
+  sqe->addr = (uintptr_t)(slot->buf + LWIP_MEM_ALIGN_SIZE(PBUF_IP));
+  sqe->len = TAPIF_RX_MTU;
+  sqe->off = -1;
+}
+
+static void
+tapif_uring_slot_back(struct tapif *tapif, struct tapif_rx_slot *slot)
+{
+  struct tapif_uring *u = tapif->uring;
+
+  if (u->rx_dead) {
+    return;
+  }
+  if (!u->multishot) {
+    tapif_uring_read_slot(tapif, slot);
+    return;
+  }
+  uring_bufs_put(&u->bufs, slot->buf + LWIP_MEM_ALIGN_SIZE(PBUF_IP), TAPIF_RX_MTU,
+                 slot - tapif->rx_slots);
+  if (!u->rx_armed) {
+    tapif_uring_arm_rx(tapif);
+  }
+}
+
+static void
+tapif_uring_retry(struct uring_retry *retry)
+{
+  struct tapif_uring *u = (struct tapif_uring *)
+    ((u8_t *)retry - offsetof(struct tapif_uring, retry));
+  struct tapif *tapif = u->netif->state;
+  struct tapif_rx_slot *pending = u->rx_pending;
+
+  u->rx_pending = NULL;
+  while (pending && !u->rx_dead) {
+    struct tapif_rx_slot *slot = pending;
+    pending = slot->next;
+    tapif_uring_read_slot(tapif, slot);
+  }
+  if (u->rx_arm_pending && !u->rx_armed && !u->rx_dead) {
+    u->rx_arm_pending = 0;
+    tapif_uring_arm_rx(tapif);
+  }
+}
+
+static int
+tapif_uring_rx_error(struct tapif *tapif, int32_t res)
+{
+  if (res == -EAGAIN || res == -EINTR) {
+    return 0;
+  }
+  fprintf(stderr, "tapif: read: %s\n", res ? strerror(-res) : "end of file");
+  tapif->uring->rx_dead = 1;
+  return -1;
+}
+
+static void
+tapif_uring_read_done(struct uring_op *op, int32_t res, uint32_t flags)
+{
+  struct tapif_rx_slot *slot = (struct tapif_rx_slot *)
+    ((u8_t *)op - offsetof(struct tapif_rx_slot, read_op));
+  struct tapif *tapif = slot->tapif;
+
+  LWIP_UNUSED_ARG(flags);
+  if (res > 0) {
+    tapif_rx_deliver(tapif, slot, res);
+  } else if (tapif_uring_rx_error(tapif, res) == 0) {
+    tapif_uring_read_slot(tapif, slot);
+  }
+}
+
+static void
+tapif_uring_rx_done(struct uring_op *op, int32_t res, uint32_t flags)
+{
+  struct tapif_uring *u = (struct tapif_uring *)
+    ((u8_t *)op - offsetof(struct tapif_uring, rx_op));
+  struct tapif *tapif = u->netif->state;
+  int i;
+
+  if (!(flags & IORING_CQE_F_MORE)) {
+    u->rx_armed = 0;
+  }
+
+  if (res > 0 && (flags & IORING_CQE_F_BUFFER)) {
+    tapif_rx_deliver(tapif, &tapif->rx_slots[flags >> IORING_CQE_BUFFER_SHIFT], res);
+  } else if (res == -EINVAL && u->multishot) {
+    /* before 6.7, nothing was taken from the buffer ring yet */
+    u->multishot = 0;
+    for (i = 0; i < TAPIF_RX_SLOTS; i++) {
+      tapif_uring_read_slot(tapif, &tapif->rx_slots[i]);
+    }
+    return;
+  } else if (res == -ENOBUFS) {
+    /* every slot is in lwip, the first one back arms the read again */
+    return;
+  } else if (tapif_uring_rx_error(tapif, res) < 0) {
+    return;
+  }
+
+  if (!u->rx_armed) {
+    tapif_uring_arm_rx(tapif);
+  }
+}
+
+static void
+tapif_uring_tx_done(struct uring_op *op, int32_t res, uint32_t flags)
+{
+  struct tapif_uring_tx *tx = (struct tapif_uring_tx *)op;
+  struct tapif *tapif = tx->tapif;
+
+  LWIP_UNUSED_ARG(flags);
+  if (res < 0) {
+    fprintf(stderr, "tapif: writev: %s\n", strerror(-res));
+    LINK_COUNTERS_INC(&tapif->counters, tx_dropped);
+  } else {
+    LINK_COUNTERS_ADD(&tapif->counters, tx_bytes, res);
+    LINK_COUNTERS_INC(&tapif->counters, tx_frames);
+  }
+
+  pbuf_free(tx->p);
+  tx->p = NULL;
+  tx->next = tapif->uring->tx_free;
+  tapif->uring->tx_free = tx;
+}
+
+static err_t
+tapif_uring_open(struct netif *netif, struct tapif *tapif)
+{
+  struct tapif_uring *u;
+  int i;
+
+  u = (struct tapif_uring *)calloc(1, sizeof(struct tapif_uring));
+  if (!u) {
+    return ERR_MEM;
+  }
+  if (uring_bufs_init(&u->bufs, TAPIF_RX_SLOTS) < 0) {
+    free(u);
+    return ERR_IF;
+  }
+
+  u->netif = netif;
+  u->rx_op.complete = tapif_uring_rx_done;
+  u->retry.retry = tapif_uring_retry;
+  u->multishot = 1;
+  u->fixed = uring_fixed_buffer(tapif->rx_slots, TAPIF_RX_SLOTS * sizeof(struct tapif_rx_slot));
+  for (i = 0; i < TAPIF_URING_TX_OPS; i++) {
+    u->tx[i].op.complete = tapif_uring_tx_done;
+    u->tx[i].tapif = tapif;
+    u->tx[i].next = u->tx_free;
+    u->tx_free = &u->tx[i];
+  }
+
+  /* the slots belong to the ring now, not to tapif_poll */
+  tapif->uring = u;
+  tapif->rx_free_count = 0;
+  for (i = 0; i < TAPIF_RX_SLOTS; i++) {
+    tapif->rx_slots[i].read_op.complete = tapif_uring_read_done;
+    tapif_uring_slot_back(tapif, &tapif->rx_slots[i]);
+  }
+  return ERR_OK;
+}
+/*-----------------------------------------------------------------------------------*/
+/* every pbuf of the chain is its own iovec, the packet is gathered
+ * without a copy in user space; -1 if the chain is too long */
+static int
+tapif_iov(struct pbuf *p, struct iovec *iov)
+{
+  struct pbuf *q;
+  int iovcnt = 0;
+
+  for(q = p; q != NULL; q = q->next) {
+    if (iovcnt == TAPIF_MAX_IOV) {
+      LWIP_DEBUGF(TAPIF_DEBUG, ("tapif: pbuf chain too long\n"));
+      return -1;
+    }
+    iov[iovcnt].iov_base = q->payload;
+    iov[iovcnt].iov_len = q->len;
+    iovcnt++;
+  }
+  return iovcnt;
+}
+
+/* the write goes to the kernel with the next uring_run, batched with
+ * everything else of the loop iteration */
+static err_t
+tapif_uring_output(struct tapif *tapif, struct pbuf *p)
+{
+  struct tapif_uring *u = tapif->uring;
+  struct tapif_uring_tx *tx = u->tx_free;
+  struct io_uring_sqe *sqe;
+  int iovcnt;
+
+  if (!tx) {
+    LINK_COUNTERS_INC(&tapif->counters, tx_busy);
+    return ERR_MEM;
+  }
+  iovcnt = tapif_iov(p, tx->iov);
+  if (iovcnt < 0) {
+    LINK_COUNTERS_INC(&tapif->counters, tx_dropped);
+    return ERR_BUF;
+  }
+  sqe = uring_sqe(&tx->op);
+  if (!sqe) {
+    LINK_COUNTERS_INC(&tapif->counters, tx_busy);
+    return ERR_MEM;
+  }
+
+  u->tx_free = tx->next;
+  pbuf_ref(p);
+  tx->p = p;
+  sqe->opcode = IORING_OP_WRITEV;
+  sqe->fd = tapif->fd;
+  sqe->addr = (uintptr_t)tx->iov;
+  sqe->len = iovcnt;
+  sqe->off = -1;
+  return ERR_OK;
+}
+/*-----------------------------------------------------------------------------------*/
 /*
  * low_level_output():
  *
@@ -166,29 +542,30 @@ low_level_init(struct netif *netif,const char *name)
 static err_t
 low_level_output(struct netif *netif, struct pbuf *p)
 {
-  struct pbuf *q;
-  char buf[1514];
-  char *bufptr;
+  struct iovec iov[TAPIF_MAX_IOV];
+  int iovcnt;
   struct tapif *tapif;
 
   tapif = (struct tapif *)netif->state;
-  /* initiate transfer(); */
-
-  bufptr = &buf[0];
+  if (tapif->uring) {
+    return tapif_uring_output(tapif, p);
+  }
 
-  for(q = p; q != NULL; q = q->next) {
-    /* Send the data from the pbuf to the interface, one pbuf at a
-       time. The size of the data in each pbuf is kept in the ->len
-       variable. */
-    /* send data from(q->payload, q->len); */
-    memcpy(bufptr, q->payload, q->len);
-    bufptr += q->len;
+  /* initiate transfer(); */
+  iovcnt = tapif_iov(p, iov);
+  if (iovcnt < 0) {
+    LINK_COUNTERS_INC(&tapif->counters, tx_dropped);
+    return ERR_BUF;
   }
 
   /* signal that packet should be sent(); */
-  if(write(tapif->fd, buf, p->tot_len) == -1) {
-    perror("tapif: write");
+  if(writev(tapif->fd, iov, iovcnt) == -1) {
+    perror("tapif: writev");
+    LINK_COUNTERS_INC(&tapif->counters, tx_dropped);
+    return ERR_IF;
   }
+  LINK_COUNTERS_ADD(&tapif->counters, tx_bytes, p->tot_len);
+  LINK_COUNTERS_INC(&tapif->counters, tx_frames);
   return ERR_OK;
 }
 
@@ -241,41 +618,88 @@ tapif_init(struct netif *netif)
 
   low_level_init(netif,name);
 
-  return ERR_OK;
+  memset(&tapif->counters, 0, sizeof(tapif->counters));
+  link_counters_attach(netif, &tapif->counters);
+
+  tapif->uring = NULL;
+  err = tapif_rx_init(tapif);
+  if (err == ERR_OK && uring_enabled() && tapif_uring_open(netif, tapif) != ERR_OK) {
+    fprintf(stderr, "tapif: io_uring unavailable, tapif_poll reads\n");
+  }
+  return err;
+}
+
+/* a recycled slot, or a pool chain while lwip holds all of them */
+static struct pbuf *
+tapif_rx_pbuf(struct tapif *tapif, u16_t len)
+{
+  struct tapif_rx_slot *slot;
+  struct pbuf *p;
+
+  if (tapif->rx_free_count == 0) {
+    p = pbuf_alloc(PBUF_IP, len, PBUF_POOL);
+    if (p != NULL && pbuf_clen(p) > TAPIF_MAX_IOV) {
+      pbuf_free(p);
+      p = NULL;
+    }
+    return p;
+  }
+
+  slot = tapif->rx_free[--tapif->rx_free_count];
+  return pbuf_alloced_custom(PBUF_IP, len, PBUF_REF, &slot->pc,
+                             slot->buf, sizeof(slot->buf));
 }
 
 void
 tapif_poll(struct netif *netif)
 {
-  u8_t c;
   struct tapif *priv;
+  int budget;
 
   LWIP_ASSERT("netif != NULL", (netif != NULL));
   LWIP_ASSERT("netif->state != NULL", (netif->state != NULL));
 
   priv = (struct tapif *)netif->state;
-
-  if (priv->p == NULL)
-  {
-    priv->p = pbuf_alloc(PBUF_IP, netif->mtu, PBUF_POOL);
+  if (priv->uring) {
+    /* reads complete on the io_uring */
+    return;
   }
 
-  int ret = read(priv->fd, priv->p->payload, netif->mtu);
-  if(ret < 0)
-  {
-    switch(errno)
-    {
-      case EAGAIN:
-        break;
-      default:
-        assert(0);
-        break;
+  for (budget = TAPIF_RX_BUDGET; budget > 0; budget--) {
+    u16_t len = LWIP_MIN(netif->mtu, TAPIF_RX_MTU);
+    struct pbuf *p = tapif_rx_pbuf(priv, len);
+    int ret;
+
+    if (p == NULL) {
+      /* nothing to read into, drop the packet: the fd is level triggered
+         and would wake the loop again right away */
+      u8_t scratch[TAPIF_RX_MTU];
+      ret = read(priv->fd, scratch, len);
+      if (ret > 0) {
+        LINK_COUNTERS_INC(&priv->counters, rx_dropped);
+        continue;
+      }
+    } else {
+      struct iovec iov[TAPIF_MAX_IOV];
+      ret = readv(priv->fd, iov, tapif_iov(p, iov));
+      if (ret > 0) {
+        pbuf_realloc(p, ret);
+        LINK_COUNTERS_ADD(&priv->counters, rx_bytes, ret);
+        LINK_COUNTERS_INC(&priv->counters, rx_frames);
+        if (netif->input(p, netif) != ERR_OK) {
+          LINK_COUNTERS_INC(&priv->counters, rx_dropped);
+          pbuf_free(p);
+        }
+        continue;
+      }
+      /* hands the slot back */
+      pbuf_free(p);
     }
-  } else {
-    if (netif->input(priv->p, netif) != ERR_OK) {
-      pbuf_free(priv->p);
+
+    if (ret < 0 && errno != EAGAIN) {
+      assert(0);
     }
-    priv->p = NULL;
+    break;
   }
 }
 /*-----------------------------------------------------------------------------------*/